@@ -296,6 +296,57 @@ fi
 if [[ -n "${SKFS_SYNC_DIR_UPDATES}" ]] ; then 
 	syncDirUpdates="${SKFS_SYNC_DIR_UPDATES}"
 fi
+if [[ -n "${SKFS_REWRITE_BUFFER_KB}" ]] ; then 
+	rewriteBufferKB="${SKFS_REWRITE_BUFFER_KB}"
+fi
+if [[ -n "${SKFS_WRITE_BUFFER_POOL_MB}" ]] ; then 
+	writeBufferPoolMB="${SKFS_WRITE_BUFFER_POOL_MB}"
+fi
+if [[ -n "${SKFS_WRITE_BEHIND_JOURNAL_DIR}" ]] ; then 
+	writeBehindJournalDir="${SKFS_WRITE_BEHIND_JOURNAL_DIR}"
+fi
+if [[ -n "${SKFS_WRITE_BEHIND_MB}" ]] ; then 
+	writeBehindMB="${SKFS_WRITE_BEHIND_MB}"
+fi
+if [[ -n "${SKFS_DEDUP}" ]] ; then 
+	dedup="${SKFS_DEDUP}"
+fi
+if [[ -n "${SKFS_STATFS_REFRESH_SECS}" ]] ; then 
+	statfsRefreshSecs="${SKFS_STATFS_REFRESH_SECS}"
+fi
+if [[ -n "${SKFS_NEGATIVE_CACHE_MILLIS}" ]] ; then 
+	negativeCacheMillis="${SKFS_NEGATIVE_CACHE_MILLIS}"
+fi
+if [[ -n "${SKFS_NEGATIVE_CACHE_TIMEOUTS}" ]] ; then 
+	negativeCacheTimeouts="${SKFS_NEGATIVE_CACHE_TIMEOUTS}"
+fi
+if [[ -n "${SKFS_DIR_DATA_FRESHNESS_MILLIS}" ]] ; then 
+	dirDataFreshnessMillis="${SKFS_DIR_DATA_FRESHNESS_MILLIS}"
+fi
+if [[ -n "${SKFS_HEDGE_PERCENTILE}" ]] ; then 
+	hedgePercentile="${SKFS_HEDGE_PERCENTILE}"
+fi
+if [[ -n "${SKFS_METRICS_SOCKET}" ]] ; then 
+	metricsSocket="${SKFS_METRICS_SOCKET}"
+fi
+if [[ -n "${SKFS_TRACE_FILE}" ]] ; then 
+	traceFile="${SKFS_TRACE_FILE}"
+fi
+if [[ -n "${SKFS_TRACE_SAMPLE_RATE}" ]] ; then 
+	traceSampleRate="${SKFS_TRACE_SAMPLE_RATE}"
+fi
+if [[ -n "${SKFS_ZERO_COPY_READS}" ]] ; then 
+	zeroCopyReads="${SKFS_ZERO_COPY_READS}"
+fi
+if [[ -n "${SKFS_PEER_BLOCK_CACHE}" ]] ; then 
+	peerBlockCache="${SKFS_PEER_BLOCK_CACHE}"
+fi
+if [[ -n "${SKFS_PEER_CACHE_PORT}" ]] ; then 
+	peerCachePort="${SKFS_PEER_CACHE_PORT}"
+fi
+if [[ -n "${SKFS_F2P_EXPECTED_ENTRIES}" ]] ; then 
+	f2pExpectedEntries="${SKFS_F2P_EXPECTED_ENTRIES}"
+fi
 
 f_printSection "TEARING DOWN OLD SKFS"
 f_printSubSection "Unmounting FUSE"
@@ -481,6 +532,57 @@ fi
 if [[ -n "${syncDirUpdates}" ]] ; then
     syncDirUpdatesOption="--syncDirUpdates=${syncDirUpdates}"
 fi
+if [[ -n "${rewriteBufferKB}" ]] ; then
+    rewriteBufferKBOption="--rewriteBufferKB=${rewriteBufferKB}"
+fi
+if [[ -n "${writeBufferPoolMB}" ]] ; then
+    writeBufferPoolMBOption="--writeBufferPoolMB=${writeBufferPoolMB}"
+fi
+if [[ -n "${writeBehindJournalDir}" ]] ; then
+    writeBehindOption="--writeBehindJournalDir=${writeBehindJournalDir}"
+    if [[ -n "${writeBehindMB}" ]] ; then
+        writeBehindOption="${writeBehindOption} --writeBehindMB=${writeBehindMB}"
+    fi
+fi
+if [[ -n "${dedup}" ]] ; then
+    dedupOption="--dedup=${dedup}"
+fi
+if [[ -n "${statfsRefreshSecs}" ]] ; then
+    statfsRefreshSecsOption="--statfsRefreshSecs=${statfsRefreshSecs}"
+fi
+if [[ -n "${negativeCacheMillis}" ]] ; then
+    negativeCacheOption="--negativeCacheMillis=${negativeCacheMillis}"
+fi
+if [[ -n "${negativeCacheTimeouts}" ]] ; then
+    negativeCacheOption="${negativeCacheOption} --negativeCacheTimeouts=${negativeCacheTimeouts}"
+fi
+if [[ -n "${dirDataFreshnessMillis}" ]] ; then
+    negativeCacheOption="${negativeCacheOption} --dirDataFreshnessMillis=${dirDataFreshnessMillis}"
+fi
+if [[ -n "${hedgePercentile}" ]] ; then
+    hedgePercentileOption="--hedgePercentile=${hedgePercentile}"
+fi
+if [[ -n "${metricsSocket}" ]] ; then
+    metricsSocketOption="--metricsSocket=${metricsSocket}"
+fi
+if [[ -n "${traceFile}" ]] ; then
+    traceOption="--traceFile=${traceFile}"
+fi
+if [[ -n "${traceSampleRate}" ]] ; then
+    traceOption="${traceOption} --traceSampleRate=${traceSampleRate}"
+fi
+if [[ -n "${zeroCopyReads}" ]] ; then
+    zeroCopyReadsOption="--zeroCopyReads=${zeroCopyReads}"
+fi
+if [[ -n "${peerBlockCache}" ]] ; then
+    peerCacheOption="--peerBlockCache=${peerBlockCache}"
+fi
+if [[ -n "${peerCachePort}" ]] ; then
+    peerCacheOption="${peerCacheOption} --peerCachePort=${peerCachePort}"
+fi
+if [[ -n "${f2pExpectedEntries}" ]] ; then
+    f2pOption="--f2pExpectedEntries=${f2pExpectedEntries}"
+fi
 
 echo "entryTimeoutOption:    $entryTimeoutOption"
 echo "attrTimeoutOption:     $attrTimeoutOption"
@@ -517,7 +619,7 @@ rm -v $tmpFile
 echo "writing to tmpFile: $tmpFile"
 echo "export PATH=${SK_JAVA_HOME}/bin:${PATH}:${fuseBin}:" >> $tmpFile
 # note -d option is currently in skfs.c
-export start_fuse="nohup $FS_EXEC --mount=${SKFS_MOUNT} --verbose=${verbosity} --host=localhost --gcname=${GCName} --zkLoc=${zkEnsemble} --compression=${Compression} --nfsMapping=${nfsMapping} --permanentSuffixes=${permanentSuffixes} --noErrorCachePaths=${noErrorCachePaths} --noLinkCachePaths=${noLinkCachePaths} --snapshotOnlyPaths=${snapshotOnlyPaths} --taskOutputPaths=${taskOutputPaths} --compressedPaths=${compressedPaths} --noFBWPaths=${noFBWPaths} ${fbwQOption} --fsNativeOnlyFile=${nativeFSOnlyFile} --transientCacheSizeKB=${transientCacheSizeKB} --logLevel=${logLevel} ${useBigWrites} ${entryTimeoutOption} ${attrTimeoutOption} ${negativeTimeoutOption} ${dhtOpMinTimeoutMSOption} ${dhtOpMaxTimeoutMSOption} ${nativeFileModeOption} ${brRemoteAddressFileOption}  ${brPortOption} ${reconciliationSleepOption} ${odwMinWriteIntervalMillisOption} ${syncDirUpdatesOption} ${skfsJvmOpt} > ${SKFS_LOG_DIR}/fuse.log.$$ 2>&1"
+export start_fuse="nohup $FS_EXEC --mount=${SKFS_MOUNT} --verbose=${verbosity} --host=localhost --gcname=${GCName} --zkLoc=${zkEnsemble} --compression=${Compression} --nfsMapping=${nfsMapping} --permanentSuffixes=${permanentSuffixes} --noErrorCachePaths=${noErrorCachePaths} --noLinkCachePaths=${noLinkCachePaths} --snapshotOnlyPaths=${snapshotOnlyPaths} --taskOutputPaths=${taskOutputPaths} --compressedPaths=${compressedPaths} --noFBWPaths=${noFBWPaths} ${fbwQOption} --fsNativeOnlyFile=${nativeFSOnlyFile} --transientCacheSizeKB=${transientCacheSizeKB} --logLevel=${logLevel} ${useBigWrites} ${entryTimeoutOption} ${attrTimeoutOption} ${negativeTimeoutOption} ${dhtOpMinTimeoutMSOption} ${dhtOpMaxTimeoutMSOption} ${nativeFileModeOption} ${brRemoteAddressFileOption}  ${brPortOption} ${reconciliationSleepOption} ${odwMinWriteIntervalMillisOption} ${syncDirUpdatesOption} ${rewriteBufferKBOption} ${writeBufferPoolMBOption} ${writeBehindOption} ${dedupOption} ${statfsRefreshSecsOption} ${negativeCacheOption} ${hedgePercentileOption} ${metricsSocketOption} ${traceOption} ${zeroCopyReadsOption} ${peerCacheOption} ${f2pOption} ${skfsJvmOpt} > ${SKFS_LOG_DIR}/fuse.log.$$ 2>&1"
 #echo "export LD_LIBRARY_PATH=${LD_LIBRARY_PATH}" >> $tmpFile  
 #echo "export MALLOC_ARENA_MAX=4" >> $tmpFile
 #echo "export CLASSPATH=${CLASSPATH}" >> $tmpFile
@@ -0,0 +1,155 @@
+#!/bin/ksh
+
+# Starts several skfsd daemons on this host, each with its own mount and a
+# peer block cache listening on 127.0.0.1:<port>, then checks that a file
+# written through one mount reads back identically through the others and
+# that blocks were served by peers (non-zero pbc fetchHits).
+# The daemons need the same environment as check_skfs.sh (LD_LIBRARY_PATH,
+# CLASSPATH, a running SK instance for GCName).
+
+function f_stopDaemons {
+	typeset i=0
+	while [[ $i -lt $numDaemons ]]; do
+		${fuseBin}fusermount -u ${testDir}/mnt.$i > /dev/null 2>&1
+		((i++))
+	done
+	if [[ -n "${daemonPids}" ]]; then
+		kill ${daemonPids} > /dev/null 2>&1
+		sleep 1
+		kill -9 ${daemonPids} > /dev/null 2>&1
+	fi
+}
+
+function f_fail {
+	echo "$1"
+	f_stopDaemons
+	echo
+	echo "RESULT: FAIL"
+	exit -1
+}
+
+# sum of the last reported pbc fetchHits over all daemon logs
+function f_getFetchHits {
+	typeset total=0
+	typeset i=0
+	typeset hits
+	while [[ $i -lt $numDaemons ]]; do
+		hits=`grep "pbc fetchHits" ${testDir}/fuse.log.$i | tail -1 | sed 's/.*fetchHits \([0-9]*\).*/\1/'`
+		if [[ -n "$hits" ]]; then
+			((total += hits))
+		fi
+		((i++))
+	done
+	echo $total
+}
+
+usage()
+{
+  echo "usage      : $0 -e <skfsd> -z <zkEnsemble> -g <GCName> [ -n <numDaemons> -p <basePort> -d <testDir> -m <fileMB> -f <fuseBin> ]"
+  echo "    skfsd           : path to the skfsd executable"
+  echo "    zkEnsemble      : ZooKeeper ensemble definition"
+  echo "    GCName          : GridConfig Name"
+  echo "    numDaemons      : number of daemons to start, default: 3"
+  echo "    basePort        : peerCachePort of the first daemon, default: 33778"
+  echo "    testDir         : directory for mounts, logs and the peer file, default: /tmp/skfs_pbc_test.<pid>"
+  echo "    fileMB          : size of the test file, default: 16"
+  echo "    fuseBin         : directory containing fusermount, default: \$PATH"
+  exit 1
+}
+
+numDaemons=3
+basePort=33778
+testDir="/tmp/skfs_pbc_test.$$"
+fileMB=16
+fuseBin=""
+# skfsd's stats thread reports every 20 seconds
+statsWaitSecs=25
+
+while getopts "e:z:g:n:p:d:m:f:" opt; do
+    case $opt in
+    e) FS_EXEC="$OPTARG" ;;
+    z) zkEnsemble="$OPTARG" ;;
+	g) GCName="$OPTARG" ;;
+	n) numDaemons="$OPTARG" ;;
+	p) basePort="$OPTARG" ;;
+	d) testDir="$OPTARG" ;;
+	m) fileMB="$OPTARG" ;;
+	f) fuseBin="$OPTARG/" ;;
+    *) usage
+    esac
+done
+shift $(($OPTIND - 1))
+
+if [[ -z "${FS_EXEC}" || -z "${zkEnsemble}" || -z "${GCName}" || $numDaemons -lt 2 ]] ; then
+	usage
+fi
+
+mkdir -p ${testDir} || f_fail "Unable to create ${testDir}"
+peerFile=${testDir}/peers
+rm -f ${peerFile}
+i=0
+while [[ $i -lt $numDaemons ]]; do
+	echo "127.0.0.1:$(($basePort + $i))" >> ${peerFile}
+	((i++))
+done
+echo "peer file ${peerFile}:"
+cat ${peerFile}
+
+daemonPids=""
+i=0
+while [[ $i -lt $numDaemons ]]; do
+	mkdir -p ${testDir}/mnt.$i
+	nohup ${FS_EXEC} --mount=${testDir}/mnt.$i --host=localhost --gcname=${GCName} --zkLoc=${zkEnsemble} --brRemoteAddressFile=${peerFile} --peerBlockCache=TRUE --peerCachePort=$(($basePort + $i)) > ${testDir}/fuse.log.$i 2>&1 &
+	daemonPids="${daemonPids} $!"
+	((i++))
+done
+echo "skfsd pids:${daemonPids}"
+
+# wait for all mounts
+i=0
+while [[ $i -lt $numDaemons ]]; do
+	tries=0
+	while [[ ! -d ${testDir}/mnt.$i/skfs ]]; do
+		((tries++))
+		if [[ $tries -gt 60 ]]; then
+			f_fail "Timed out waiting for ${testDir}/mnt.$i"
+		fi
+		sleep 1
+	done
+	((i++))
+done
+
+testFile=skfs/pbc_test.$$
+dd if=/dev/urandom of=${testDir}/mnt.0/${testFile} bs=1M count=${fileMB} > /dev/null 2>&1 || f_fail "Unable to write ${testFile}"
+expected=`md5sum < ${testDir}/mnt.0/${testFile}`
+
+# Each daemon owns a share of the blocks. The first pass through every mount
+# leaves each owner with its share cached; the second pass must be served
+# by peers for the blocks a daemon doesn't own.
+for pass in 1 2; do
+	i=1
+	while [[ $i -lt $numDaemons ]]; do
+		actual=`md5sum < ${testDir}/mnt.$i/${testFile}`
+		if [[ "$actual" != "$expected" ]] ; then
+			f_fail "Checksum mismatch in pass $pass through mnt.$i"
+		fi
+		((i++))
+	done
+done
+
+echo "Waiting ${statsWaitSecs}s for stats"
+sleep ${statsWaitSecs}
+i=0
+while [[ $i -lt $numDaemons ]]; do
+	echo "mnt.$i: `grep "pbc fetchHits" ${testDir}/fuse.log.$i | tail -1`"
+	((i++))
+done
+fetchHits=`f_getFetchHits`
+rm -f ${testDir}/mnt.0/${testFile}
+if [[ $fetchHits -eq 0 ]] ; then
+	f_fail "No blocks were fetched from peers"
+fi
+
+f_stopDaemons
+echo
+echo "RESULT: PASS"
@@ -42,7 +42,7 @@ function f_checkParams {
 
 function f_compileAndLink {	
 	echo "compile source files"
-	typeset cFilenames="hashtable.c hashtable_utility.c hashtable_itr.c Util.c ArrayBlockingQueue.c QueueProcessor.c Cache.c FileBlockCache.c AttrCache.c AttrReader.c DirEntryIndex.c FileBlockID.c FileID.c FileIDToPathMap.c ActiveOp.c ActiveOpRef.c AttrReadRequest.c FileBlockReadRequest.c FileBlockReader.c PartialBlockReader.c PartialBlockReadRequest.c NSKeySplit.c AttrWriter.c AttrWriteRequest.c FileBlockWriter.c FileBlockWriteRequest.c SRFSDHT.c ResponseTimeStats.c ReaderStats.c PathGroup.c G2TaskOutputReader.c G2OutputDir.c PathListEntry.c FileAttr.c WritableFile.c WritableFileBlock.c WritableFileTable.c ArrayBlockList.c DirEntry.c DirData.c DirDataReader.c DirDataReadRequest.c OpenDir.c OpenDirCache.c OpenDirTable.c OpenDirUpdate.c OpenDirWriter.c OpenDirWriteRequest.c ReconciliationSet.c FileStatus.c WritableFileReference.c NativeFile.c NativeFileReference.c NativeFileTable.c skfs.c SKFSOpenFile.c BlockReader.c"
+	typeset cFilenames="hashtable.c hashtable_utility.c hashtable_itr.c Util.c ArrayBlockingQueue.c QueueProcessor.c Cache.c FileBlockCache.c AttrCache.c AttrReader.c DirEntryIndex.c FileBlockID.c FileID.c FileIDToPathMap.c ActiveOp.c ActiveOpRef.c AttrReadRequest.c FileBlockReadRequest.c FileBlockReader.c PartialBlockReader.c PartialBlockReadRequest.c NSKeySplit.c AttrWriter.c AttrWriteRequest.c FileBlockWriter.c FileBlockWriteRequest.c SRFSDHT.c ResponseTimeStats.c ReaderStats.c PathGroup.c G2TaskOutputReader.c G2OutputDir.c PathListEntry.c FileAttr.c WritableFile.c WritableFileBlock.c WritableFileTable.c ArrayBlockList.c DirEntry.c DirData.c DirDataReader.c DirDataReadRequest.c OpenDir.c OpenDirCache.c OpenDirTable.c OpenDirUpdate.c OpenDirWriter.c OpenDirWriteRequest.c ReconciliationSet.c FileStatus.c WritableFileReference.c NativeFile.c NativeFileReference.c NativeFileTable.c skfs.c SKFSOpenFile.c BlockReader.c WriteBehind.c BlockDedup.c LatencyHistogram.c MetricsServer.c BinaryLog.c Trace.c BlockBuffer.c PeerBlockCache.c"
 	typeset fileCount=0;
 	typeset resolvedAbsFilenames;
 	for filename in $cFilenames ; do
@@ -56,6 +56,7 @@ function f_compileAndLink {
 	SKFS_EXEC=$SKFS_INSTALL_ARCH_DIR/$SKFS_EXEC_NAME
 	f_link "$SKFS_EXEC" "$SKFS_BUILD_ARCH_DIR/$ALL_DOT_O_FILES" "$cc" "$cc_opts -W -Wall -Wno-unused" "$lib_opts"
 	
+	f_buildBenchmarks
 	f_runBuildChecks
 	#echo "compile UnitTest"
 	#SKFS_OBJ="$SKFS_BUILD_ARCH_DIR/UnitTest.o"
@@ -72,12 +73,30 @@ function f_compileAndLink {
 	#$cc -DUNIT_TESTS $cc_opts -W -Wall -Wno-unused -o $SKFS_EXEC $SKFS_BUILD_ARCH_DIR/$ALL_DOT_O_FILES $lib_opts 
 }
 
+# Benchmarks link against the skfs objects, minus skfs.o (which has skfsd's main)
+function f_buildBenchmarks {
+	typeset benchObjDir=$SKFS_BUILD_ARCH_DIR/bench
+	f_cleanOrMakeDirectory "$benchObjDir"
+	
+	f_printSubSection "Benchmarks"
+	typeset benchNames="F2PBenchmark"
+	for benchName in $benchNames ; do
+		f_compileAssemble "$SKFS_SRC_DIR/bench/$benchName.c" "$benchObjDir/$benchName.o" "$cc" "$cc_opts -W -Wall -Wno-unused -Wno-strict-aliasing" "$inc_opts -I${SKFS_SRC_DIR}"
+	done
+	
+	typeset skfsObjs=$(ls $SKFS_BUILD_ARCH_DIR/$ALL_DOT_O_FILES | grep -v "/skfs.o$")
+	SKFS_F2P_BENCH_EXEC=$SKFS_INSTALL_ARCH_DIR/$SKFS_F2P_BENCH_EXEC_NAME
+	f_link "$SKFS_F2P_BENCH_EXEC" "$benchObjDir/F2PBenchmark.o $skfsObjs" "$cc" "$cc_opts -W -Wall -Wno-unused" "$lib_opts"
+}
+
 function f_runBuildChecks {
 	f_printSection "SUMMARY of Silverking FS Build"
 
-	f_testEquals "$SKFS_BUILD_ARCH_DIR" "$ALL_DOT_O_FILES" "57" 
+	f_testEquals "$SKFS_BUILD_ARCH_DIR" "$ALL_DOT_O_FILES" "65" 
 	echo "Checking INSTALL /$SKFS_EXEC_NAME"
 	f_testExists "$SKFS_EXEC"
+	echo "Checking INSTALL /$SKFS_F2P_BENCH_EXEC_NAME"
+	f_testExists "$SKFS_F2P_BENCH_EXEC"
 }
 
 function f_printVariables {
@@ -0,0 +1,71 @@
+package com.ms.silverking.cloud.dht.client;
+
+import java.util.ArrayList;
+import java.util.List;
+import java.util.concurrent.BlockingQueue;
+import java.util.concurrent.LinkedBlockingQueue;
+import java.util.concurrent.TimeUnit;
+
+/**
+ * Collects the completions of many asynchronous operations so that a single thread
+ * can wait for any of them to complete. Each operation is identified by a caller-supplied tag.
+ * Primarily intended for native clients that cannot implement AsyncOperationListener.
+ */
+public class AsyncOperationCompletionQueue {
+	private final BlockingQueue<Long>	completions;
+
+	private static final long[]	noCompletions = new long[0];
+
+	public AsyncOperationCompletionQueue() {
+		completions = new LinkedBlockingQueue<>();
+	}
+
+	/**
+	 * Add an operation to this queue. Its tag will be returned by take() once
+	 * the operation has completed (succeeded or failed).
+	 * @param asyncOperation the operation to add
+	 * @param tag caller-supplied identifier of the operation
+	 */
+	public void add(AsyncOperation asyncOperation, long tag) {
+		asyncOperation.addListener(new CompletionListener(tag));
+	}
+
+	/**
+	 * Wait for at least one operation to complete.
+	 * @param maxCompletions maximum number of completions to return
+	 * @param timeoutMillis maximum time to wait
+	 * @return tags of the completed operations; empty if the timeout expired
+	 * @throws InterruptedException
+	 */
+	public long[] take(int maxCompletions, long timeoutMillis) throws InterruptedException {
+		Long		first;
+		List<Long>	taken;
+		long[]		tags;
+
+		first = completions.poll(timeoutMillis, TimeUnit.MILLISECONDS);
+		if (first == null) {
+			return noCompletions;
+		}
+		taken = new ArrayList<>();
+		taken.add(first);
+		completions.drainTo(taken, maxCompletions - 1);
+		tags = new long[taken.size()];
+		for (int i = 0; i < tags.length; i++) {
+			tags[i] = taken.get(i);
+		}
+		return tags;
+	}
+
+	private class CompletionListener implements AsyncOperationListener {
+		private final long	tag;
+
+		CompletionListener(long tag) {
+			this.tag = tag;
+		}
+
+		@Override
+		public void asyncOperationUpdated(AsyncOperation asyncOperation) {
+			completions.add(tag);
+		}
+	}
+}
@@ -47,4 +47,23 @@
 	 * @throws RetrievalException
 	 */
 	public Map<K, ? extends StoredValue<V>> getLatestStoredValues() throws RetrievalException;
+	/**
+	 * Returns the MetaData of the given keys packed into a single array of
+	 * fixed-size native byte order records (see AsyncRetrievalOperationImpl.packedMetaDataRecordSize).
+	 * Allows native clients to obtain the MetaData of many keys in a single call
+	 * rather than making one call per key and field. Keys without a successfully
+	 * retrieved value are marked as not found.
+	 * @param keys keys to query
+	 * @return packed MetaData records in the same order as keys
+	 */
+	public byte[] getPackedMetaData(Object[] keys);
+	/**
+	 * Returns the values of the given keys packed into a single array for native clients.
+	 * The array begins with one native byte order int per key holding the length of
+	 * that key's value (-1 if no value was successfully retrieved), followed by the 
+	 * concatenated values in key order. Only byte[] values are supported.
+	 * @param keys keys to query
+	 * @return packed values in the same order as keys
+	 */
+	public byte[] getPackedValues(Object[] keys);
 }
@@ -64,6 +64,31 @@ public Set<Object> getFailedKeys() {
         return failedKeys;
     }
     
+    /**
+     * Bulk form of getOperationState(Object) and getFailureCause(Object). Returns the
+     * OperationState and FailureCause of all given keys in a single call so that
+     * native clients do not need to cross the JNI boundary once per key.
+     * For keys[i], element 2*i holds the OperationState ordinal and element 2*i+1 holds
+     * the FailureCause ordinal. Either is -1 if no information is available.
+     * @param keys the keys to query
+     * @return packed OperationState and FailureCause ordinals
+     */
+    public byte[] getOperationStatesAndFailureCauses(Object[] keys) {
+        byte[]  packed;
+        
+        packed = new byte[keys.length * 2];
+        for (int i = 0; i < keys.length; i++) {
+            OperationState  state;
+            FailureCause    cause;
+            
+            state = operationState.get(keys[i]);
+            cause = failureCause.get(keys[i]);
+            packed[2 * i] = state != null ? (byte)state.ordinal() : -1;
+            packed[2 * i + 1] = cause != null ? (byte)cause.ordinal() : -1;
+        }
+        return packed;
+    }
+    
     public String getDetailedFailureMessage() {
         StringBuilder   sb;
         
@@ -48,4 +48,23 @@ protected RetrievalException(Throwable cause,
 	public StoredValue getStoredValue(Object key) {
 		return partialResults.get(key);
 	}
+	
+	/**
+	 * Bulk accessor for partial results. Returns the value of the partial result
+	 * for each given key, or null for keys without a partial result.
+	 * @param keys the keys to query
+	 * @return values of the partial results in the same order as keys
+	 */
+	public Object[] getPartialValues(Object[] keys) {
+		Object[]	values;
+		
+		values = new Object[keys.length];
+		for (int i = 0; i < keys.length; i++) {
+			StoredValue	storedValue;
+			
+			storedValue = partialResults.get(keys[i]);
+			values[i] = storedValue != null ? storedValue.getValue() : null;
+		}
+		return values;
+	}
 }
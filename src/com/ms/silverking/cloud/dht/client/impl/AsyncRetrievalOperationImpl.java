@@ -2,6 +2,7 @@
 
 import java.lang.ref.WeakReference;
 import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
 import java.util.ArrayList;
 import java.util.HashMap;
 import java.util.Iterator;
@@ -38,6 +39,7 @@
 import com.ms.silverking.cloud.dht.net.ProtoRetrievalMessageGroup;
 import com.ms.silverking.collection.ConcurrentSingleMap;
 import com.ms.silverking.log.Log;
+import com.ms.silverking.numeric.NumConversion;
 import com.ms.silverking.text.StringUtil;
 
 public class AsyncRetrievalOperationImpl<K,V> extends AsyncKVOperationImpl<K,V> 
@@ -58,6 +60,23 @@
     private static final int    opConcurrencyLevel = 4;
     private static final int    capacityFactor = 2;
     
+    /*
+     * Packed MetaData record layout (native byte order). Must be kept in sync with
+     * SKMetaDataBatch in the native client.
+     *  found               byte
+     *  checksumType        byte
+     *  checksumLength      byte
+     *  reserved            byte
+     *  storedLength        int
+     *  uncompressedLength  int
+     *  reserved            int
+     *  version             long
+     *  creationTime        long (nanos)
+     *  checksum            byte[packedMetaDataMaxChecksumLength]
+     */
+    public static final int    packedMetaDataMaxChecksumLength = 24;
+    public static final int    packedMetaDataRecordSize = 32 + packedMetaDataMaxChecksumLength;
+    
     private static final int    waitForConstantTime_ms = 60 * 1000;
     private static final boolean    testReceiveCorruption = false;
     private static final double     receiveCorruptionProbability = 0.3;
@@ -342,6 +361,77 @@ public StoredValue<V> getStoredValue(K key) throws RetrievalException {
         return storedValueMap;
     }
     
+    @Override
+    public byte[] getPackedMetaData(Object[] keys) {
+        ByteBuffer  packed;
+        
+        packed = ByteBuffer.allocate(keys.length * packedMetaDataRecordSize).order(ByteOrder.nativeOrder());
+        for (int i = 0; i < keys.length; i++) {
+            RetrievalResultBase<V>  result;
+            int                     recordStart;
+            
+            recordStart = i * packedMetaDataRecordSize;
+            result = results.get(keys[i]);
+            if (result != null && result.getOpResult() == OpResult.SUCCEEDED) {
+                MetaData    metaData;
+                byte[]      checksum;
+                int         checksumLength;
+                
+                metaData = result.getMetaData();
+                checksum = metaData.getChecksum();
+                checksumLength = checksum != null ? Math.min(checksum.length, packedMetaDataMaxChecksumLength) : 0;
+                packed.put(recordStart, (byte)1);
+                packed.put(recordStart + 1, (byte)metaData.getChecksumType().ordinal());
+                packed.put(recordStart + 2, (byte)checksumLength);
+                packed.putInt(recordStart + 4, metaData.getStoredLength());
+                packed.putInt(recordStart + 8, metaData.getUncompressedLength());
+                packed.putLong(recordStart + 16, metaData.getVersion());
+                packed.putLong(recordStart + 24, metaData.getCreationTime().inNanos());
+                for (int j = 0; j < checksumLength; j++) {
+                    packed.put(recordStart + 32 + j, checksum[j]);
+                }
+            } // else leave the record zeroed (not found)
+        }
+        return packed.array();
+    }
+    
+    @Override
+    public byte[] getPackedValues(Object[] keys) {
+        ByteBuffer  packed;
+        byte[][]    values;
+        long        totalLength;
+        
+        values = new byte[keys.length][];
+        totalLength = (long)keys.length * NumConversion.BYTES_PER_INT;
+        for (int i = 0; i < keys.length; i++) {
+            RetrievalResultBase<V>  result;
+            
+            result = results.get(keys[i]);
+            if (result != null && result.getOpResult() == OpResult.SUCCEEDED) {
+                Object  value;
+                
+                value = result.getValue();
+                if (value instanceof byte[]) {
+                    values[i] = (byte[])value;
+                    totalLength += values[i].length;
+                }
+            }
+        }
+        if (totalLength > Integer.MAX_VALUE) {
+            throw new RuntimeException("Packed values too large: "+ totalLength);
+        }
+        packed = ByteBuffer.allocate((int)totalLength).order(ByteOrder.nativeOrder());
+        for (int i = 0; i < keys.length; i++) {
+            packed.putInt(values[i] != null ? values[i].length : -1);
+        }
+        for (int i = 0; i < keys.length; i++) {
+            if (values[i] != null) {
+                packed.put(values[i]);
+            }
+        }
+        return packed.array();
+    }
+    
     @Override
     public void resultReceived(DHTKey dhtKey, MessageGroupRetrievalResponseEntry entry) {
         RawRetrievalResult  rawResult;
@@ -31,7 +31,7 @@ namespace SKManagedClient {
 	};
 	
 	public enum struct SKChecksumType_M {
-		NONE = 0, MD5, SHA_1, MURMUR3_32, MURMUR3_128
+		NONE = 0, MD5, SHA_1, MURMUR3_32, MURMUR3_128, SYSTEM
 	};
 	
 	public enum struct SKKeyDigestType_M {
@@ -53,34 +53,7 @@ using std::exception;
 using std::cout;
 using std::endl;
 
-vector<string> * getJvmArgsFromEnv(){
-	const char * str = NULL;
-    vector<string> * result = new vector<string>();
-    char delim1 = ',';
-    str = getenv("SK_JVM_ARGS");
-
-    if (str) {
-        do
-        {
-            const char *begin = str;
-
-            while(*str != delim1 && *str ) //&& *(str+1) != '-'
-                str++;
-
-            if( str - begin > 1 ) {
-                result->push_back(string(begin, str));
-            }
-        } while (0 != *str++);
-    } 
-    if(result->size() == 0) {
-        result->push_back("-Xmx4G");
-        result->push_back("-Xms32M");
-        result->push_back("-Xcheck:jni");
-        result->push_back("-XX:ParallelGCThreads=4");
-    }
-    return result;
-}
-
+#include "skjvmargs.h"
 
 /**
  * NOTE: 
@@ -94,7 +67,11 @@ int main(const int argc, char* argv[])
 		StaticVmLoader loader(JNI_VERSION_1_6);
 		OptionList list;
 		
-        vector<string>* pJvmArgs = getJvmArgsFromEnv();
+        // jvm profiles and SK_JVM_ARGS are handled exactly as by SKClient::init()
+        vector<string>* pJvmArgs = skJvmParseArgs(NULL);
+        if (pJvmArgs == NULL) {
+            return -1;
+        }
         vector<string>::iterator it ;
         for(it = pJvmArgs->begin(); it!=pJvmArgs->end(); it++ ) {
     		list.push_back(jace::CustomOption(*it));
@@ -0,0 +1,66 @@
+#include "SKAsyncOperationCompletionQueue.h"
+#include "SKAsyncOperation.h"
+#include "SKClientException.h"
+
+#include "jace/Jace.h"
+using jace::java_new;
+using namespace jace;
+#include "jace/JArray.h"
+using jace::JArray;
+#include "jace/proxy/types/JInt.h"
+using jace::proxy::types::JInt;
+#include "jace/proxy/types/JLong.h"
+using jace::proxy::types::JLong;
+
+#include "jace/proxy/java/lang/Throwable.h"
+using jace::proxy::java::lang::Throwable;
+#include "jace/proxy/com/ms/silverking/cloud/dht/client/AsyncOperation.h"
+using jace::proxy::com::ms::silverking::cloud::dht::client::AsyncOperation;
+#include "jace/proxy/com/ms/silverking/cloud/dht/client/AsyncOperationCompletionQueue.h"
+using jace::proxy::com::ms::silverking::cloud::dht::client::AsyncOperationCompletionQueue;
+
+typedef JArray< jace::proxy::types::JLong > LongArray;
+
+
+SKAsyncOperationCompletionQueue::SKAsyncOperationCompletionQueue() {
+	try {
+		pImpl = new AsyncOperationCompletionQueue(java_new<AsyncOperationCompletionQueue>());
+	} catch( Throwable &t ) {
+		throw SKClientException( &t, __FILE__, __LINE__ );
+	}
+}
+
+SKAsyncOperationCompletionQueue::~SKAsyncOperationCompletionQueue() {
+	if (pImpl != NULL) {
+		delete pImpl;
+		pImpl = NULL;
+	}
+}
+
+void SKAsyncOperationCompletionQueue::add(SKAsyncOperation * asyncOperation, int64_t tag) {
+	try {
+		AsyncOperation * pAsyncOp = (AsyncOperation *) asyncOperation->getPImpl();
+		pImpl->add(*pAsyncOp, JLong(tag));
+	} catch( Throwable &t ) {
+		throw SKClientException( &t, __FILE__, __LINE__ );
+	}
+}
+
+int SKAsyncOperationCompletionQueue::take(int64_t * tags, int maxTags, long timeoutMillis) {
+	int	numTags = 0;
+
+	try {
+		LongArray	completed = pImpl->take(JInt(maxTags), JLong(timeoutMillis));
+		numTags = completed.length();
+		if (numTags > maxTags) {
+			numTags = maxTags;
+		}
+		if (numTags > 0) {
+			JNIEnv* env = attach();
+			env->GetLongArrayRegion(static_cast<jlongArray>(completed.getJavaJniArray()), 0, numTags, (jlong *) tags);
+		}
+	} catch( Throwable &t ) {
+		throw SKClientException( &t, __FILE__, __LINE__ );
+	}
+	return numTags;
+}
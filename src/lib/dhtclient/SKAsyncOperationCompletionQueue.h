@@ -0,0 +1,47 @@
+#ifndef SKASYNCOPERATIONCOMPLETIONQUEUE_H
+#define SKASYNCOPERATIONCOMPLETIONQUEUE_H
+
+#include <stdint.h>
+#include "skconstants.h"
+
+namespace jace { namespace proxy { namespace com { namespace ms { 
+	namespace silverking {namespace cloud { namespace dht { namespace client {
+		class AsyncOperationCompletionQueue;
+} } } } } } } }
+typedef jace::proxy::com::ms::silverking::cloud::dht::client::AsyncOperationCompletionQueue AsyncOperationCompletionQueue;
+class SKAsyncOperation;
+
+/**
+ * Collects the completions of many asynchronous operations so that a single thread
+ * can wait for any of them to complete, rather than blocking on each operation in turn.
+ * Each operation is identified by a caller-supplied tag.
+ */
+class SKAsyncOperationCompletionQueue
+{
+public:
+	SKAPI SKAsyncOperationCompletionQueue();
+	SKAPI virtual ~SKAsyncOperationCompletionQueue();
+
+	/**
+	 * Add an operation; its tag will be returned by take() once it has completed.
+	 * The operation must remain open until then.
+	 */
+	SKAPI void add(SKAsyncOperation * asyncOperation, int64_t tag);
+	/**
+	 * Wait for at least one added operation to complete. The calling thread must be
+	 * attached to the jvm (see SKClient::attach()).
+	 * @param tags receives the tags of the completed operations
+	 * @param maxTags capacity of tags
+	 * @param timeoutMillis maximum time to wait
+	 * @return the number of tags returned; 0 if the timeout expired
+	 */
+	SKAPI int take(int64_t * tags, int maxTags, long timeoutMillis);
+
+private:
+	AsyncOperationCompletionQueue * pImpl;
+
+	SKAsyncOperationCompletionQueue(const SKAsyncOperationCompletionQueue & );
+	const SKAsyncOperationCompletionQueue& operator= (const SKAsyncOperationCompletionQueue & );
+};
+
+#endif // SKASYNCOPERATIONCOMPLETIONQUEUE_H
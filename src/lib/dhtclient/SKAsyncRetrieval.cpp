@@ -8,12 +8,19 @@
 #include "SKAsyncRetrieval.h"
 #include "SKAsyncNSPerspective.h"
 #include "SKStoredValue.h"
+#include "SKMetaDataBatch.h"
+#include "SKValueBatch.h"
 #include "SKClientException.h"
+#include "jenumutil.h"
+
+#include <stdexcept>
 
 #include "jace/Jace.h"
 using jace::java_new;
 using jace::java_cast;
 using namespace jace;
+#include "jace/JArray.h"
+using jace::JArray;
 
 #include "jace/proxy/java/lang/String.h"
 using jace::proxy::java::lang::String;
@@ -138,6 +145,69 @@ SKStoredValue *  SKAsyncRetrieval::getStoredValue(string& key) {
     return sv;
 }
 
+SKMetaDataBatch * SKAsyncRetrieval::getMetaDataBatch(SKVector<string> const & keys) {
+	typedef JArray<Object> ObjArray;
+	unsigned int		numKeys = keys.size();
+	SKMetaDataBatch		*batch = new SKMetaDataBatch(numKeys);
+
+	if (numKeys == 0) {
+		return batch;
+	}
+	try {
+		AsyncRetrieval *pAsync = (AsyncRetrieval*)getPImpl();
+		ObjArray	jkeys(numKeys);
+		for (unsigned int i = 0; i < numKeys; i++) {
+			jkeys[i] = String(keys.at(i));
+		}
+		ByteArray	packed = pAsync->getPackedMetaData(jkeys);
+		if ((size_t) packed.length() != numKeys * sizeof(SKMetaDataEntry)) {
+			Log::warning( "SKAsyncRetrieval::getMetaDataBatch unexpected packed length" );
+			delete batch;
+			throw std::runtime_error("SKAsyncRetrieval::getMetaDataBatch unexpected packed length");
+		}
+		JNIEnv* env = attach();
+		env->GetByteArrayRegion(static_cast<jbyteArray>(packed.getJavaJniArray()), 0, packed.length(), 
+		                        (jbyte *) batch->getEntries());
+	}  catch( Throwable &t ) {
+		delete batch;
+		batch = NULL;
+		repackException(__FILE__, __LINE__ );
+	}
+	return batch;
+}
+
+SKValueBatch * SKAsyncRetrieval::getValueBatch(SKVector<string> const & keys) {
+	typedef JArray<Object> ObjArray;
+	unsigned int		numKeys = keys.size();
+	SKValueBatch		*batch = NULL;
+
+	try {
+		AsyncRetrieval *pAsync = (AsyncRetrieval*)getPImpl();
+		ObjArray	jkeys(numKeys);
+		for (unsigned int i = 0; i < numKeys; i++) {
+			jkeys[i] = String(keys.at(i));
+		}
+		ByteArray	packed = pAsync->getPackedValues(jkeys);
+		if ((size_t) packed.length() < numKeys * sizeof(int32_t)) {
+			Log::warning( "SKAsyncRetrieval::getValueBatch unexpected packed length" );
+			throw std::runtime_error("SKAsyncRetrieval::getValueBatch unexpected packed length");
+		}
+		batch = new SKValueBatch(numKeys, packed.length());
+		JNIEnv* env = attach();
+		env->GetByteArrayRegion(static_cast<jbyteArray>(packed.getJavaJniArray()), 0, packed.length(), 
+		                        (jbyte *) batch->getPackedBuffer());
+		batch->buildOffsets();
+	}  catch( Throwable &t ) {
+		delete batch;
+		batch = NULL;
+		repackException(__FILE__, __LINE__ );
+	}  catch( std::runtime_error &e ) {
+		delete batch;
+		throw;
+	}
+	return batch;
+}
+
 /*
 SKStoredValue *  SKAsyncRetrieval::getStoredValue(string& key) {
     SKStoredValue * sv = NULL;
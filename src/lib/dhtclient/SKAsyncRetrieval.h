@@ -18,6 +18,8 @@ namespace jace { namespace proxy { namespace com { namespace ms {
 typedef jace::proxy::com::ms::silverking::cloud::dht::client::AsyncRetrieval AsyncRetrieval;
 
 class SKStoredValue;
+class SKMetaDataBatch;
+class SKValueBatch;
 
 class SKAsyncRetrieval : public SKAsyncKeyedOperation
 {
@@ -25,6 +27,18 @@ public:
     SKAPI SKMap<string,SKStoredValue * > *  getLatestStoredValues();
     SKAPI SKMap<string,SKStoredValue * > *  getStoredValues();
     SKAPI SKStoredValue *  getStoredValue(string& key);
+    /**
+     * MetaData of the given keys obtained with a single JNI call. Entries for keys
+     * without a successfully retrieved value are marked as not found.
+     * Intended for use with META_DATA retrievals. The batch is owned by the caller.
+     */
+    SKAPI SKMetaDataBatch * getMetaDataBatch(SKVector<string> const & keys);
+    /**
+     * Values of the given keys in a single contiguous buffer obtained with a single
+     * JNI call. Keys without a successfully retrieved value are marked as not found.
+     * The batch is owned by the caller.
+     */
+    SKAPI SKValueBatch * getValueBatch(SKVector<string> const & keys);
 	SKAPI virtual ~SKAsyncRetrieval();
 
 	SKAsyncRetrieval(AsyncRetrieval * pAsyncRetrieval);
@@ -6,6 +6,7 @@
 #include "SKValueCreator.h"
 #include "skconstants.h"
 #include "jenumutil.h"
+#include "skjvmargs.h"
 
 #include <string>
 #include <vector>
@@ -19,6 +20,8 @@ using std::endl;
 #include <boost/thread/recursive_mutex.hpp>
 #include <sys/types.h>
 #include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
 #include <exception>
 
 #include "jace/Jace.h"
@@ -62,15 +65,11 @@ using jace::proxy::com::ms::silverking::cloud::dht::ValueCreator;
   #include <io.h>
   #include "jace/Win32VmLoader.h"
   using jace::Win32VmLoader;
-  static const char * jvmHeapMax="-Xmx1G";
-  static const char * jvmHeapStart="-Xms16M";
 #else
   #include <unistd.h>
   #include <dlfcn.h>
   #include "jace/UnixVmLoader.h"
   using ::jace::UnixVmLoader;
-  static const char * jvmHeapStart="-Xms128M";
-  static const char * jvmHeapMax="-Xmx4G";
 #endif
 
 #define ppstringize(a) #a
@@ -112,43 +111,12 @@ using jace::proxy::com::ms::silverking::cloud::dht::ValueCreator;
 #define GC_SK_JVM_JDWP_OPT "GC_SK_JVM_JDWP_OPT"
 #define GC_SK_JVM_HPROF_OPT "GC_SK_JVM_HPROF_OPT"
 #define SK_CLASSPATH "SK_CLASSPATH"
-#define SK_JVM_ARGS "SK_JVM_ARGS"
 #ifndef _MSC_VER
   #define SK_LIB_PATH "LD_LIBRARY_PATH"
 #else
   #define SK_LIB_PATH "PATH"
 #endif
 
-vector<string> * parseJvmArgs(const char * str) {
-    vector<string> * result = new vector<string>();
-
-    char delim1 = ',';
-    if (!str || strlen(str) == 0) {
-        str = getenv(SK_JVM_ARGS);
-    } 
-
-    if (str) {
-        do {
-            const char *begin = str;
-
-            while(*str != delim1 && *str ) //&& *(str+1) != '-'
-                str++;
-
-            if ( str - begin > 1 ) {
-                result->push_back(string(begin, str));
-            }
-        } while (0 != *str++);
-        //result->push_back("-XX:ParallelGCThreads=4"); 
-    } 
-    if (result->size() == 0) {
-        result->push_back(jvmHeapMax);
-        result->push_back(jvmHeapStart);
-        result->push_back("-XX:ParallelGCThreads=4"); 
-        result->push_back("-Xcheck:jni");
-    }
-    return result;
-}
-
 std::string resolveLibPath(void) {
 	std::string path;
 	
@@ -321,7 +289,11 @@ static void vmInit(LoggingLevel level, const char * pJvmOptions) {
 
 		OptionList list;
 
-        vector<string> *pJvmArgs = parseJvmArgs(pJvmOptions);
+        vector<string> *pJvmArgs = skJvmParseArgs(pJvmOptions);
+        if (pJvmArgs == NULL) {
+            cout << "ERROR: invalid jvm options" << endl;
+            throw std::exception();
+        }
         vector<string>::iterator it ;
         for (it = pJvmArgs->begin(); it!=pJvmArgs->end(); it++) {
     		list.push_back(jace::CustomOption(*it));
@@ -20,6 +20,11 @@ typedef jace::proxy::com::ms::silverking::cloud::dht::client::DHTClient DHTClien
 class SKClient
 {
 public:
+  /* pJvmOptions: comma-separated jvm options; SK_JVM_ARGS is used if NULL or empty.
+	A "profile=debug" or "profile=production" entry selects a predefined set of 
+	jvm options (debug enables -Xcheck:jni); other entries override the profile. 
+	The production profile is used when no options are given.
+  */
   SKAPI static bool init(LoggingLevel level, const char * pJvmOptions = NULL) ; 
   SKAPI static void shutdown();
   SKAPI static SKClient *getClient();
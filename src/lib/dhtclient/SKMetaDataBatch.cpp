@@ -0,0 +1,70 @@
+/**
+*
+* $Header: $
+* $Change: $
+* $DateTime: $
+*/
+
+#include "SKMetaDataBatch.h"
+#include "skbasictypes.h"
+
+#include <string.h>
+#include <stdexcept>
+
+
+SKMetaDataBatch::SKMetaDataBatch(unsigned int numEntries) {
+	this->numEntries = numEntries;
+	entries = (SKMetaDataEntry *) skMemAlloc(numEntries > 0 ? numEntries : 1, sizeof(SKMetaDataEntry), __FILE__, __LINE__);
+}
+
+SKMetaDataBatch::~SKMetaDataBatch() {
+	if (entries) {
+		skMemFree((void **) &entries, __FILE__, __LINE__);
+	}
+}
+
+SKMetaDataEntry * SKMetaDataBatch::getEntries() {
+	return entries;
+}
+
+unsigned int SKMetaDataBatch::size() const {
+	return numEntries;
+}
+
+const SKMetaDataEntry * SKMetaDataBatch::at(unsigned int index) const {
+	if (index >= numEntries) {
+		throw std::out_of_range("SKMetaDataBatch::at");
+	}
+	return &entries[index];
+}
+
+bool SKMetaDataBatch::found(unsigned int index) const {
+	return at(index)->found != 0;
+}
+
+int64_t SKMetaDataBatch::getVersion(unsigned int index) const {
+	return at(index)->version;
+}
+
+int64_t SKMetaDataBatch::getCreationTime(unsigned int index) const {
+	return at(index)->creationTime;
+}
+
+int SKMetaDataBatch::getStoredLength(unsigned int index) const {
+	return at(index)->storedLength;
+}
+
+int SKMetaDataBatch::getUncompressedLength(unsigned int index) const {
+	return at(index)->uncompressedLength;
+}
+
+SKChecksumType::SKChecksumType SKMetaDataBatch::getChecksumType(unsigned int index) const {
+	return static_cast<SKChecksumType::SKChecksumType>(at(index)->checksumType);
+}
+
+const unsigned char * SKMetaDataBatch::getChecksum(unsigned int index, int * length) const {
+	const SKMetaDataEntry	*entry = at(index);
+
+	*length = entry->checksumLength;
+	return entry->checksumLength > 0 ? entry->checksum : NULL;
+}
@@ -0,0 +1,79 @@
+/**
+*
+* $Header: $
+* $Change: $
+* $DateTime: $
+*/
+
+#ifndef SKMETADATABATCH_H
+#define SKMETADATABATCH_H
+
+#include <stdint.h>  //int64_t
+#include <cstddef>
+#include "skconstants.h"
+
+// Must match AsyncRetrievalOperationImpl.packedMetaDataMaxChecksumLength
+#define SK_MD_BATCH_MAX_CHECKSUM_LENGTH 24
+
+/**
+ * MetaData for a single key of an SKMetaDataBatch.
+ */
+typedef struct SKMetaDataEntry {
+	/** non-zero if a value was found for this key; all other fields are zero otherwise */
+	int8_t		found;
+	int8_t		checksumType;
+	int8_t		checksumLength;
+	int8_t		reserved0;
+	int32_t		storedLength;
+	int32_t		uncompressedLength;
+	int32_t		reserved1;
+	int64_t		version;
+	/** creation time in nanoseconds */
+	int64_t		creationTime;
+	unsigned char	checksum[SK_MD_BATCH_MAX_CHECKSUM_LENGTH];
+} SKMetaDataEntry;
+
+/**
+ * MetaData for a batch of keys, filled in with a single JNI call. Avoids the
+ * per-key, per-field calls of SKMetaData for callers that only require the 
+ * fixed MetaData fields (e.g. versions) of many keys. Typically used with
+ * META_DATA retrievals.
+ */
+class SKMetaDataBatch
+{
+public:
+    SKAPI unsigned int size() const;
+    /**
+     * MetaData for the key at the given index of the batch.
+     * @return
+     */
+    SKAPI const SKMetaDataEntry * at(unsigned int index) const;
+    SKAPI bool found(unsigned int index) const;
+    SKAPI int64_t getVersion(unsigned int index) const;
+    SKAPI int64_t getCreationTime(unsigned int index) const;
+    SKAPI int getStoredLength(unsigned int index) const;
+    SKAPI int getUncompressedLength(unsigned int index) const;
+    SKAPI SKChecksumType::SKChecksumType getChecksumType(unsigned int index) const;
+    /**
+     * Checksum of the value for the key at the given index. Owned by the batch.
+     * @param length set to the checksum length in bytes (0 if no checksum)
+     * @return the checksum, or NULL if the key was not found or has no checksum
+     */
+    SKAPI const unsigned char * getChecksum(unsigned int index, int * length) const;
+
+    SKAPI virtual ~SKMetaDataBatch();
+
+protected:
+	friend class SKAsyncRetrieval;
+	SKMetaDataBatch(unsigned int numEntries);
+	SKMetaDataEntry * getEntries();
+
+	unsigned int	numEntries;
+	SKMetaDataEntry	* entries;
+
+private:
+	SKMetaDataBatch(const SKMetaDataBatch & );
+	const SKMetaDataBatch& operator= (const SKMetaDataBatch & );
+};
+
+#endif  //SKMETADATABATCH_H
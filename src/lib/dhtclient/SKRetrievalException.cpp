@@ -1,6 +1,9 @@
 #include "SKRetrievalException.h"
 #include "SKStoredValue.h"
+#include "jenumutil.h"
+#include "skbasictypes.h"
 
+#include <string.h>
 #include <iostream>
 using namespace std;
 
@@ -9,6 +12,8 @@ using jace::java_new;
 using jace::java_cast;
 using jace::instanceof;
 using namespace jace;
+#include "jace/JArray.h"
+using jace::JArray;
 
 #include "jace/proxy/java/util/Set.h"
 using jace::proxy::java::util::Set;
@@ -16,6 +21,8 @@ using jace::proxy::java::util::Set;
 using jace::proxy::java::util::Iterator;
 #include "jace/proxy/java/lang/String.h"
 using jace::proxy::java::lang::String;
+#include "jace/proxy/java/lang/Object.h"
+using jace::proxy::java::lang::Object;
 #include "jace/proxy/java/util/Map.h"
 using jace::proxy::java::util::Map;
 #include "jace/proxy/java/util/Map_Entry.h"
@@ -36,6 +43,7 @@ using jace::proxy::com::ms::silverking::cloud::dht::client::impl::RetrievalExcep
 SKRetrievalException::SKRetrievalException(RetrievalException * pe, const char * fileName, int lineNum)
  : SKClientException(pe, fileName, lineNum)
 {
+	pImpl = new RetrievalException(java_cast<RetrievalException>(*pe));
 	msg = (std::string) pe->getDetailedFailureMessage();
 	partialResults = new Map(java_cast<Map>(pe->partialResults()));
 	operationStates = new Map(java_cast<Map>(pe->operationState()));
@@ -53,6 +61,7 @@ SKRetrievalException::~SKRetrievalException(void) throw ()
 	delete operationStates;
 	delete failureCauses;
 	delete failedKeys;
+	delete pImpl;
 }
 
 SKStoredValue * SKRetrievalException::getStoredValue(string const & key) const {
@@ -116,3 +125,55 @@ string SKRetrievalException::getDetailedFailureMessage() const {
 	//string failureMsg =  (string)(((RetrievalException*)pImpl)->getDetailedFailureMessage());
 	//return failureMsg;
 }
+
+void SKRetrievalException::getKeyResults(SKVector<string> const & keys, SKOperationState::SKOperationState * states,
+                                         SKFailureCause::SKFailureCause * causes, SKVal ** values) const {
+	typedef JArray<Object> ObjArray;
+	unsigned int	numKeys = keys.size();
+	bool			anySucceeded = false;
+	
+	if (numKeys == 0) {
+		return;
+	}
+	
+	ObjArray	jkeys(numKeys);
+	for (unsigned int i = 0; i < numKeys; i++) {
+		jkeys[i] = String(keys.at(i));
+	}
+	
+	ByteArray	packedArr = pImpl->getOperationStatesAndFailureCauses(jkeys);
+	jbyte		*packed = (jbyte *) skMemAlloc(numKeys * 2, sizeof(jbyte), __FILE__, __LINE__);
+	JNIEnv		*env = attach();
+	env->GetByteArrayRegion(static_cast<jbyteArray>(packedArr.getJavaJniArray()), 0, numKeys * 2, packed);
+	for (unsigned int i = 0; i < numKeys; i++) {
+		jbyte	os = packed[2 * i];
+		jbyte	fc = packed[2 * i + 1];
+		
+		// Missing entries are reported as FAILED/ERROR, matching the per-key accessors
+		states[i] = os >= 0 ? (SKOperationState::SKOperationState) os : SKOperationState::FAILED;
+		if (causes != NULL) {
+			causes[i] = fc >= 0 ? (SKFailureCause::SKFailureCause) fc : SKFailureCause::ERROR;
+		}
+		if (states[i] == SKOperationState::SUCCEEDED) {
+			anySucceeded = true;
+		}
+	}
+	skMemFree((void **) &packed, __FILE__, __LINE__);
+	
+	if (values != NULL) {
+		memset(values, 0, numKeys * sizeof(SKVal *));
+		if (anySucceeded) {
+			ObjArray	jvalues = pImpl->getPartialValues(jkeys);
+			for (unsigned int i = 0; i < numKeys; i++) {
+				if (states[i] == SKOperationState::SUCCEEDED) {
+					Object	obj = jvalues[i];
+					
+					if (!obj.isNull()) {
+						ByteArray	barr = java_cast<ByteArray>(obj);
+						values[i] = ::convertToDhtVal(&barr);
+					}
+				}
+			}
+		}
+	}
+}
@@ -38,9 +38,18 @@ public:
 	SKAPI virtual SKFailureCause::SKFailureCause getFailureCause(string key) const ;
 	SKAPI virtual SKVector<string> * getFailedKeys() const ;
     SKAPI virtual string getDetailedFailureMessage() const ;
+	/**
+	 * Bulk form of getOperationState(), getFailureCause() and getStoredValue()->getValue().
+	 * Fills states[i], causes[i] and values[i] for keys.at(i) using a single JNI call for
+	 * the states and causes and a single JNI call for the values. Either causes or values
+	 * may be NULL if not required. values[i] is NULL for keys without a partial result;
+	 * non-NULL values are owned by the caller.
+	 */
+	SKAPI void getKeyResults(SKVector<string> const & keys, SKOperationState::SKOperationState * states,
+	                         SKFailureCause::SKFailureCause * causes, SKVal ** values) const;
 
 private:
-	//RetrievalException * pImpl;
+	RetrievalException * pImpl;
 	Map * partialResults;
 	Map * operationStates;
 	Map * failureCauses;
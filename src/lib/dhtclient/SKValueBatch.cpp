@@ -0,0 +1,91 @@
+/**
+*
+* $Header: $
+* $Change: $
+* $DateTime: $
+*/
+
+#include "SKValueBatch.h"
+#include "skbasictypes.h"
+
+#include <string.h>
+#include <stdexcept>
+
+
+SKValueBatch::SKValueBatch(unsigned int numEntries, size_t packedLength) {
+	this->numEntries = numEntries;
+	this->packedLength = packedLength;
+	packed = (unsigned char *) skMemAlloc(packedLength > 0 ? packedLength : 1, 1, __FILE__, __LINE__);
+	offsets = (int64_t *) skMemAlloc(numEntries > 0 ? numEntries : 1, sizeof(int64_t), __FILE__, __LINE__);
+}
+
+SKValueBatch::~SKValueBatch() {
+	if (packed) {
+		skMemFree((void **) &packed, __FILE__, __LINE__);
+	}
+	if (offsets) {
+		skMemFree((void **) &offsets, __FILE__, __LINE__);
+	}
+}
+
+unsigned char * SKValueBatch::getPackedBuffer() {
+	return packed;
+}
+
+// Computes value offsets once the packed buffer has been filled in
+void SKValueBatch::buildOffsets() {
+	int64_t	offset = 0;
+	int64_t	dataLength = (int64_t) packedLength - (int64_t) numEntries * (int64_t) sizeof(int32_t);
+
+	for (unsigned int i = 0; i < numEntries; i++) {
+		int	length = getLength(i);
+
+		offsets[i] = offset;
+		if (length > 0) {
+			offset += length;
+		}
+	}
+	if (offset != dataLength) {
+		throw std::runtime_error("SKValueBatch inconsistent packed lengths");
+	}
+}
+
+unsigned int SKValueBatch::size() const {
+	return numEntries;
+}
+
+int SKValueBatch::getLength(unsigned int index) const {
+	int32_t	length;
+
+	if (index >= numEntries) {
+		throw std::out_of_range("SKValueBatch::getLength");
+	}
+	memcpy(&length, packed + index * sizeof(int32_t), sizeof(int32_t));
+	return length;
+}
+
+bool SKValueBatch::found(unsigned int index) const {
+	return getLength(index) >= 0;
+}
+
+int64_t SKValueBatch::getOffset(unsigned int index) const {
+	if (index >= numEntries) {
+		throw std::out_of_range("SKValueBatch::getOffset");
+	}
+	return offsets[index];
+}
+
+const void * SKValueBatch::getValue(unsigned int index) const {
+	if (!found(index)) {
+		return NULL;
+	}
+	return (const unsigned char *) getData() + offsets[index];
+}
+
+const void * SKValueBatch::getData() const {
+	return packed + numEntries * sizeof(int32_t);
+}
+
+int64_t SKValueBatch::getDataLength() const {
+	return (int64_t) packedLength - (int64_t) numEntries * (int64_t) sizeof(int32_t);
+}
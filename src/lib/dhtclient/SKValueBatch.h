@@ -0,0 +1,65 @@
+/**
+*
+* $Header: $
+* $Change: $
+* $DateTime: $
+*/
+
+#ifndef SKVALUEBATCH_H
+#define SKVALUEBATCH_H
+
+#include <stdint.h>  //int64_t
+#include <cstddef>
+#include "skconstants.h"
+
+/**
+ * Values for a batch of keys, held in a single contiguous buffer and filled in
+ * with a single JNI call. Avoids the per-key SKVal allocations and map lookups 
+ * of SKMap<string,SKVal*> for callers that process many values at once 
+ * (e.g. vectorised bindings).
+ */
+class SKValueBatch
+{
+public:
+    SKAPI unsigned int size() const;
+    SKAPI bool found(unsigned int index) const;
+    /**
+     * Length of the value for the key at the given index of the batch.
+     * @return the value length, or -1 if no value was found
+     */
+    SKAPI int getLength(unsigned int index) const;
+    /**
+     * Offset of the value for the key at the given index within getData()
+     */
+    SKAPI int64_t getOffset(unsigned int index) const;
+    /**
+     * The value for the key at the given index; NULL if no value was found.
+     * Owned by the batch.
+     */
+    SKAPI const void * getValue(unsigned int index) const;
+    /**
+     * All found values, concatenated in key order
+     */
+    SKAPI const void * getData() const;
+    SKAPI int64_t getDataLength() const;
+
+    SKAPI virtual ~SKValueBatch();
+
+protected:
+	friend class SKAsyncRetrieval;
+	SKValueBatch(unsigned int numEntries, size_t packedLength);
+	unsigned char * getPackedBuffer();
+	void buildOffsets();
+
+	unsigned int	numEntries;
+	size_t			packedLength;
+	// packed layout: int32_t lengths[numEntries] followed by the concatenated values
+	unsigned char	* packed;
+	int64_t			* offsets;
+
+private:
+	SKValueBatch(const SKValueBatch & );
+	const SKValueBatch& operator= (const SKValueBatch & );
+};
+
+#endif  //SKVALUEBATCH_H
@@ -49,6 +49,8 @@ ChecksumType * getChecksumType(SKChecksumType::SKChecksumType checksumType)
 			return new ChecksumType (ChecksumType::valueOf("MURMUR3_32")); 
 		case SKChecksumType::MURMUR3_128: 
 			return new ChecksumType (ChecksumType::valueOf("MURMUR3_128")); 
+		case SKChecksumType::SYSTEM: 
+			return new ChecksumType (ChecksumType::valueOf("SYSTEM")); 
 		default: 
 			throw std::exception(); //FIXME:
 	}
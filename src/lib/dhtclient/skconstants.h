@@ -42,7 +42,7 @@ namespace SKCompression {
 
 namespace SKChecksumType {
  typedef enum SKChecksumType_t {
-    NONE, MD5, SHA_1, MURMUR3_32, MURMUR3_128
+    NONE, MD5, SHA_1, MURMUR3_32, MURMUR3_128, SYSTEM
  } SKChecksumType ;
 }
 
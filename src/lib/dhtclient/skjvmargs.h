@@ -0,0 +1,149 @@
+#ifndef SKJVMARGS_H
+#define SKJVMARGS_H
+
+// JVM argument construction shared by SKClient and the standalone apps (e.g. skc)
+// that create their own jvm. Header-only so that the apps need not link libsk.
+
+#include <string>
+#include <vector>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#define SK_JVM_ARGS "SK_JVM_ARGS"
+
+// JVM profiles. Selected by a "profile=<name>" entry in the comma-separated
+// jvm options passed to SKClient::init()/getClient() or in SK_JVM_ARGS; any
+// other entries are appended after the profile's arguments and hence override them.
+// When no options are given at all, the production profile is used.
+#define SK_JVM_PROFILE_PREFIX "profile="
+#define SK_JVM_PROFILE_DEBUG "debug"
+#define SK_JVM_PROFILE_PRODUCTION "production"
+
+#ifdef _MSC_VER
+  #define SK_JVM_HEAP_MAX "-Xmx1G"
+  #define SK_JVM_HEAP_START "-Xms16M"
+#else
+  #define SK_JVM_HEAP_MAX "-Xmx4G"
+  #define SK_JVM_HEAP_START "-Xms128M"
+#endif
+
+// compressed oops are only possible for heaps below ~32G
+#define SK_JVM_COMPRESSED_OOPS_HEAP_LIMIT_MB (31 * 1024)
+
+inline uint64_t skJvmParseHeapSizeMB(const std::string &arg) {
+    // arg is of the form -Xmx<n>[k|K|m|M|g|G]
+    const char  *p = arg.c_str() + 4;
+    char        *end;
+    uint64_t    size;
+
+    size = strtoull(p, &end, 10);
+    switch (*end) {
+    case 'k': case 'K': return size / 1024;
+    case 'm': case 'M': return size;
+    case 'g': case 'G': return size * 1024;
+    default: return size / (1024 * 1024);
+    }
+}
+
+// true for collector selections, i.e. -XX:+Use<name>GC
+inline bool skJvmIsGCSelection(const std::string &arg) {
+    size_t  prefixLength = strlen("-XX:+Use");
+
+    return arg.size() > prefixLength + 2
+        && arg.compare(0, prefixLength, "-XX:+Use") == 0
+        && arg.compare(arg.size() - 2, 2, "GC") == 0;
+}
+
+// returns false if the profile is unknown
+inline bool skJvmAddProfileArgs(std::vector<std::string> * result, const std::string & profile,
+                                std::vector<std::string> const & explicitArgs) {
+    bool        explicitHeapMax = false;
+    bool        explicitGC = false;
+    uint64_t    heapMaxMB = 0;
+
+    for (std::vector<std::string>::const_iterator it = explicitArgs.begin(); it != explicitArgs.end(); it++) {
+        if (it->compare(0, 4, "-Xmx") == 0) {
+            explicitHeapMax = true;
+            heapMaxMB = skJvmParseHeapSizeMB(*it);
+        } else if (skJvmIsGCSelection(*it)) {
+            explicitGC = true;
+        }
+    }
+    if (profile == SK_JVM_PROFILE_DEBUG) {
+        result->push_back(SK_JVM_HEAP_MAX);
+        result->push_back(SK_JVM_HEAP_START);
+        result->push_back("-XX:ParallelGCThreads=4");
+        result->push_back("-Xcheck:jni");
+    } else if (profile == SK_JVM_PROFILE_PRODUCTION) {
+        // The client heap only holds values in transit to/from native memory.
+        // Callers with large caches (e.g. skfs) size it via an explicit -Xmx.
+        result->push_back(SK_JVM_HEAP_MAX);
+        result->push_back(SK_JVM_HEAP_START);
+        // Low-pause collector unless one was chosen explicitly (the jvm
+        // refuses to start with two); JNI calls are not checked
+        if (!explicitGC) {
+            result->push_back("-XX:+UseG1GC");
+            result->push_back("-XX:MaxGCPauseMillis=20");
+        }
+        result->push_back("-XX:ParallelGCThreads=4");
+        result->push_back("-XX:+DisableExplicitGC");
+        if (!explicitHeapMax || heapMaxMB < SK_JVM_COMPRESSED_OOPS_HEAP_LIMIT_MB) {
+            result->push_back("-XX:+UseCompressedOops");
+        }
+    } else {
+        return false;
+    }
+    return true;
+}
+
+/**
+ * Parse comma-separated jvm options (falling back to SK_JVM_ARGS when str is empty)
+ * into jvm arguments, expanding any profile. Returns NULL if an unknown profile
+ * is requested. Caller owns the result.
+ */
+inline std::vector<std::string> * skJvmParseArgs(const char * str) {
+    std::vector<std::string> * result = new std::vector<std::string>();
+    std::vector<std::string> explicitArgs;
+    std::string profile;
+
+    char delim1 = ',';
+    if (!str || strlen(str) == 0) {
+        str = getenv(SK_JVM_ARGS);
+    }
+
+    if (str) {
+        do {
+            const char *begin = str;
+
+            while(*str != delim1 && *str ) //&& *(str+1) != '-'
+                str++;
+
+            if ( str - begin > 1 ) {
+                std::string  arg(begin, str);
+
+                if (arg.compare(0, strlen(SK_JVM_PROFILE_PREFIX), SK_JVM_PROFILE_PREFIX) == 0) {
+                    profile = arg.substr(strlen(SK_JVM_PROFILE_PREFIX));
+                } else {
+                    explicitArgs.push_back(arg);
+                }
+            }
+        } while (0 != *str++);
+    }
+    if (profile.size() == 0 && explicitArgs.size() == 0) {
+        profile = SK_JVM_PROFILE_PRODUCTION;
+    }
+    if (profile.size() > 0) {
+        if (!skJvmAddProfileArgs(result, profile, explicitArgs)) {
+            fprintf(stderr, "Unknown jvm profile %s. Known profiles: %s, %s\n",
+                    profile.c_str(), SK_JVM_PROFILE_DEBUG, SK_JVM_PROFILE_PRODUCTION);
+            delete result;
+            return NULL;
+        }
+    }
+    result->insert(result->end(), explicitArgs.begin(), explicitArgs.end());
+    return result;
+}
+
+#endif
@@ -12,11 +12,19 @@
 #include <iostream>
 #include <cstdio>
 #include <sstream>
+#include <cstring>
+#include <vector>
+#include <stdint.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
 using std::set;
 
 #include "sk.h"
 #include "k.h"
 #include "KTypes.h"
+#include "SKValueBatch.h"
+#include "SKAsyncOperationCompletionQueue.h"
 //#include "DHTLog.h"
 
 
@@ -828,6 +836,141 @@ namespace { // internal "static" functions and "global" data
 		return (pAvr==NULL) ? K(0) : make_symbol(pAvr);
 	}
 	
+	//------------------------ Vectorised (columnar) mget/mput --------------------------------
+	// Keys are passed as a q symbol vector. Values are passed/returned as one flat byte vector 
+	// plus offsets and lengths vectors, so the number of q allocations is independent of 
+	// the number of keys.
+	// these helpers return an error message, or NULL on success
+	const char * internal_symbols_to_keys( K keysymsq, SKVector<std::string> & keys )
+	{
+		if (keysymsq->t != KS) {
+			return "type: keys must be a symbol vector";
+		}
+		keys.reserve(keysymsq->n);
+		for (int i = 0; i < keysymsq->n; i++) 
+		{
+			keys.push_back(std::string(kS(keysymsq)[i]));
+		}
+		return NULL;
+	}
+
+	// returns (bytes; offsets; lengths) with a length of -1 for keys that have no value
+	K internal_arnsp_mgetv( SKAsyncReadableNSPerspective * ansp, K keysymsq, bool isWaitFor )
+	{
+		SKAsyncValueRetrieval * pAvr = NULL;
+		SKValueBatch * pBatch = NULL;
+		SKVector<std::string> keys; 
+		const char * err = internal_symbols_to_keys(keysymsq, keys);
+		if (err) return krr( const_cast<char*>(err) );
+
+		if(isWaitFor) {
+			pAvr = ansp->waitFor( &keys );
+		}
+		else {
+			pAvr = ansp->get( &keys );
+		}
+		if (pAvr == NULL) return K(0);
+		try {
+			pAvr->waitForCompletion();
+		} catch ( SKRetrievalException & re ) {
+			// partial results; keys without values are reported with a length of -1
+		}
+		try {
+			pBatch = pAvr->getValueBatch(keys);
+		} catch (...) {
+			pAvr->close();
+			delete pAvr;
+			throw;
+		}
+		pAvr->close();
+		delete pAvr;
+
+		size_t len = keys.size();
+		K data = ktn(KG, pBatch->getDataLength());
+		memcpy(kG(data), pBatch->getData(), pBatch->getDataLength());
+		K offsets = ktn(KJ, len);
+		K lengths = ktn(KJ, len);
+		for (size_t ii = 0; ii < len; ++ii)
+		{
+			kJ(offsets)[ii] = pBatch->getOffset(ii);
+			kJ(lengths)[ii] = pBatch->getLength(ii);
+		}
+		delete pBatch;
+		return knk(3, data, offsets, lengths);
+	}
+
+	// builds zero-copy SKVals over the flat byte vector; returned SKVals must be released with internal_release_vals_v
+	const char * internal_build_valuemap_v( K keysymsq, K dataq, K offsetsq, K lengthsq, 
+	                             SKMap<string,SKVal*> & valueMap, std::vector<SKVal*> & pValVec )
+	{
+		if (keysymsq->t != KS || (dataq->t != KG && dataq->t != KC) || offsetsq->t != KJ || lengthsq->t != KJ) {
+			return "type: expected symbol keys, byte/char data and long offsets/lengths";
+		}
+		if (keysymsq->n != offsetsq->n || keysymsq->n != lengthsq->n) {
+			return "length: keys, offsets and lengths sizes do not match";
+		}
+		pValVec.reserve(keysymsq->n);
+		for ( int ii = 0 ; ii < keysymsq->n ; ++ii ) {
+			J offset = kJ(offsetsq)[ii];
+			J length = kJ(lengthsq)[ii];
+			if (offset < 0 || length < 0 || offset + length > dataq->n) {
+				return "domain: value outside of data";
+			}
+			SKVal* pVal = sk_create_val();
+			sk_set_val_zero_copy(pVal, length, (char*)kG(dataq) + offset );
+			valueMap.insert( SKMap<string,SKVal*>::value_type( string(kS(keysymsq)[ii]), pVal ) );
+			pValVec.push_back(pVal);
+		}
+		return NULL;
+	}
+
+	void internal_release_vals_v( std::vector<SKVal*> & pValVec )
+	{
+		int sz = pValVec.size();
+		for(int i=0; i<sz; ++i){
+			SKVal* pVal = pValVec.at(i);
+			pVal->m_len = 0; pVal->m_pVal = 0; // internal val handled by external object
+			sk_destroy_val(& pVal );
+		}
+	}
+
+	K internal_mputv( SKSyncWritableNSPerspective * snsp, K keysymsq, K dataq, K offsetsq, K lengthsq )
+	{
+		SKMap<string,SKVal*>  valueMap;
+		std::vector<SKVal*> pValVec ;
+		const char * err = internal_build_valuemap_v(keysymsq, dataq, offsetsq, lengthsq, valueMap, pValVec);
+		if (!err) {
+			try {
+				snsp->put( &valueMap );
+			} catch (...) {
+				internal_release_vals_v(pValVec);
+				throw;
+			}
+		}
+		internal_release_vals_v(pValVec);
+		if (err) return krr( const_cast<char*>(err) );
+		return _kNULL ;
+	}
+
+	K internal_awnsp_mputv( SKAsyncWritableNSPerspective * ansp, K keysymsq, K dataq, K offsetsq, K lengthsq )
+	{
+		SKMap<string,SKVal*>  valueMap;
+		std::vector<SKVal*> pValVec ;
+		SKAsyncPut * pPut = NULL;
+		const char * err = internal_build_valuemap_v(keysymsq, dataq, offsetsq, lengthsq, valueMap, pValVec);
+		if (!err) {
+			try {
+				pPut = ansp->put( &valueMap );
+			} catch (...) {
+				internal_release_vals_v(pValVec);
+				throw;
+			}
+		}
+		internal_release_vals_v(pValVec);
+		if (err) return krr( const_cast<char*>(err) );
+		return make_symbol(pPut) ;
+	}
+	
 	//------------------------ SKAsyncKeyedOperation ----------------------------------------------
 	K internal_asynckeyedop_get_keys(SKAsyncKeyedOperation * asyncput, bool isIncomplete)
 	{
@@ -1133,6 +1276,151 @@ namespace { // internal "static" functions and "global" data
 	}
 */	
 	
+	//------------------------ Completion notification via the q event loop --------------------
+	// Operations registered with internal_notify_on_completion are watched by a single jvm-attached
+	// thread blocking on an SKAsyncOperationCompletionQueue. Completed handles are passed to the 
+	// q main thread through an eventfd registered with sd1, where the user callbacks are invoked.
+	// This lets a q process keep many operations in flight without blocking its main loop.
+	// Each registration is tagged with its own sequence number rather than the native handle,
+	// since a handle may be freed and its address reused while a stale completion is in flight.
+	#define	_COMPLETION_BATCH_SIZE		256
+	#define	_COMPLETION_TAKE_TIMEOUT_MS	200
+
+	SKAsyncOperationCompletionQueue	* _completionQueue = NULL;
+	int					_completionFd = -1;
+	pthread_t			_completionThread;
+	volatile bool		_completionThreadRunning = false;
+	pthread_mutex_t		_completionLock = PTHREAD_MUTEX_INITIALIZER;
+	std::vector<J>		_completedTags;			// guarded by _completionLock
+	J					_completionSeq = 0;		// q main thread only
+	std::map<J, std::pair<J, K> >	_completionCallbacks;	// tag -> (handle, callback); q main thread only
+
+	void * internal_completion_watcher( void * unused )
+	{
+		int64_t	tags[_COMPLETION_BATCH_SIZE];
+
+		SKClient::attach(true);
+		while (_completionThreadRunning) {
+			int	numCompleted = 0;
+
+			try {
+				numCompleted = _completionQueue->take(tags, _COMPLETION_BATCH_SIZE, _COMPLETION_TAKE_TIMEOUT_MS);
+			} catch (SKClientException const& ex) {
+				std::cout << "completion watcher exception: " << ex.what() << "\n";
+			}
+			if (numCompleted > 0) {
+				uint64_t	count = numCompleted;
+
+				pthread_mutex_lock(&_completionLock);
+				_completedTags.insert(_completedTags.end(), tags, tags + numCompleted);
+				pthread_mutex_unlock(&_completionLock);
+				if (write(_completionFd, &count, sizeof(count)) != sizeof(count)) {
+					std::cout << "completion eventfd write failed\n";
+				}
+			}
+		}
+		SKClient::detach();
+		return NULL;
+	}
+
+	// sd1 callback, runs in the q main thread
+	K internal_completion_ready( I fd )
+	{
+		uint64_t		count;
+		std::vector<J>	completed;
+
+		if (read(fd, &count, sizeof(count)) != sizeof(count)) {
+			return K(0);
+		}
+		pthread_mutex_lock(&_completionLock);
+		completed.swap(_completedTags);
+		pthread_mutex_unlock(&_completionLock);
+		for (size_t ii = 0; ii < completed.size(); ++ii) {
+			std::map<J, std::pair<J, K> >::iterator it = _completionCallbacks.find(completed[ii]);
+			if (it != _completionCallbacks.end()) {
+				J handle = it->second.first;
+				K callback = it->second.second;
+				_completionCallbacks.erase(it);
+
+				K args = knk(1, kj(handle));
+				K result = dot(callback, args);
+				if (result == NULL || result->t == -128) {
+					std::cout << "completion callback failed: " << (result != NULL ? result->s : "") << "\n";
+				}
+				if (result != NULL) {
+					r0(result);
+				}
+				r0(args);
+				r0(callback);
+			}
+		}
+		return K(0);
+	}
+
+	// returns an error message, or NULL on success
+	const char * internal_completion_init()
+	{
+		if (_completionQueue != NULL) {
+			return NULL;
+		}
+		_completionFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (_completionFd < 0) {
+			return "eventfd creation failed";
+		}
+		_completionQueue = new SKAsyncOperationCompletionQueue();
+		sd1(_completionFd, internal_completion_ready);
+		_completionThreadRunning = true;
+		if (pthread_create(&_completionThread, NULL, internal_completion_watcher, NULL) != 0) {
+			_completionThreadRunning = false;
+			sd0(_completionFd);
+			_completionFd = -1;
+			delete _completionQueue;
+			_completionQueue = NULL;
+			return "completion thread creation failed";
+		}
+		return NULL;
+	}
+
+	void internal_completion_shutdown()
+	{
+		if (_completionQueue == NULL) {
+			return;
+		}
+		_completionThreadRunning = false;
+		pthread_join(_completionThread, NULL);
+		sd0(_completionFd);  // also closes the eventfd
+		_completionFd = -1;
+		delete _completionQueue;
+		_completionQueue = NULL;
+		for (std::map<J, std::pair<J, K> >::iterator it = _completionCallbacks.begin(); it != _completionCallbacks.end(); ++it) {
+			r0(it->second.second);
+		}
+		_completionCallbacks.clear();
+		_completedTags.clear();
+	}
+
+	// callback is invoked with the operation handle once the operation has completed;
+	// each registration invokes its callback exactly once
+	K internal_notify_on_completion( SKAsyncOperation * asyncOp, K callbackq )
+	{
+		if (callbackq->t < 100 || callbackq->t > 112) {
+			return krr( "type: callback must be a function" );
+		}
+		const char * err = internal_completion_init();
+		if (err) return krr( const_cast<char*>(err) );
+
+		J tag = ++_completionSeq;
+		_completionCallbacks[tag] = std::make_pair((J) asyncOp, r1(callbackq));
+		try {
+			_completionQueue->add(asyncOp, tag);
+		} catch (...) {
+			_completionCallbacks.erase(tag);
+			r0(callbackq);
+			throw;
+		}
+		return _kNULL ;
+	}
+
 } // namespace (anonymous)
 
 extern "C" {
@@ -1159,6 +1447,7 @@ K dht_shutdown( K dummyq )
 {
 	// which resources to release?
 	try {
+		internal_completion_shutdown();
 		if(_client) {
 			delete _client ;
 			_client = NULL;
@@ -2113,6 +2402,16 @@ K dht_syncnsp_mputdict( K snspHandleq, K dictq )
 	return dht_syncnsp_mput(snspHandleq, keylistq, valuelistq );
 }
 
+K dht_syncnsp_mputv( K snspHandleq, K keysymsq, K dataq, K offsetsq, K lengthsq ) 
+{
+	try {
+		return internal_mputv( static_cast<SKSyncWritableNSPerspective*>((SKSyncNSPerspective *) snspHandleq->j), keysymsq, dataq, offsetsq, lengthsq );
+	} catch (...) {
+		exhandler( "syncnsp mputv failed", __FILE__, __LINE__);
+	}
+	return K(0) ;	
+}
+
 K dht_syncnsp_get( K snspHandleq, K keyq )
 {
 	try {
@@ -2457,6 +2756,36 @@ K dht_asyncnsp_mwaitwo( K anspHandleq, K keylistq, K waitoptsHandleq )
 	}
 }
 
+K dht_asyncnsp_mgetv( K anspHandleq, K keysymsq )
+{
+	try {
+		return internal_arnsp_mgetv( static_cast<SKAsyncReadableNSPerspective*>((SKAsyncNSPerspective *) anspHandleq->j), keysymsq, false ) ;
+	} catch (...) {
+		exhandler( "asyncnsp mgetv failed", __FILE__, __LINE__);
+	}
+	return K(0) ;
+}
+
+K dht_asyncnsp_mwaitv( K anspHandleq, K keysymsq )
+{
+	try {
+		return internal_arnsp_mgetv( static_cast<SKAsyncReadableNSPerspective*>((SKAsyncNSPerspective *) anspHandleq->j), keysymsq, true ) ;
+	} catch (...) {
+		exhandler( "asyncnsp mwaitv failed", __FILE__, __LINE__);
+	}
+	return K(0) ;
+}
+
+K dht_asyncnsp_mputv( K anspHandleq, K keysymsq, K dataq, K offsetsq, K lengthsq ) 
+{
+	try {
+		return internal_awnsp_mputv( static_cast<SKAsyncWritableNSPerspective*>((SKAsyncNSPerspective *) anspHandleq->j), keysymsq, dataq, offsetsq, lengthsq );
+	} catch (...) {
+		exhandler( "asyncnsp mputv failed", __FILE__, __LINE__);
+	}
+	return K(0) ;	
+}
+
 K dht_asyncnsp_getoptions( K anspHandleq )
 {
 	try {
@@ -2816,6 +3145,22 @@ K dht_aretrieval_getfailurecause( K aretievalHandleq )
 	}
 }
 
+// works for any async operation handle: aput, aretrieval, avalret, asnapshot, asyncreq
+K dht_asyncop_oncompletion( K asyncopHandleq, K callbackq )
+{
+	try {
+		return internal_notify_on_completion( (SKAsyncOperation *) asyncopHandleq->j, callbackq );
+	} catch (...) {
+		exhandler( "async operation oncompletion failed", __FILE__, __LINE__);
+	}
+	return K(0) ;
+}
+
+K dht_asyncop_pendingcompletions( K dummyq )
+{
+	return kj( (J) _completionCallbacks.size() );
+}
+
 K dht_aretrieval_waitforcompletion( K aretievalHandleq )
 {
 	try {
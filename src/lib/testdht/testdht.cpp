@@ -25,6 +25,7 @@
 #include <iostream>
 #include <fstream>
 #include <exception>
+#include <chrono>
 using namespace std;
 using std::string;
 using std::cout;
@@ -304,6 +305,11 @@ static void print_meta( SKOpResult::SKOpResult rc_, const char *ns_, const char
     }
 }
 
+static double secondsSince(std::chrono::steady_clock::time_point start_)
+{
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+}
+
 void usage(char const * const name_, char const * const pMsg_)
 {
   if (pMsg_) fprintf(stderr, "%s\n", pMsg_);
@@ -312,7 +318,7 @@ void usage(char const * const name_, char const * const pMsg_)
   fprintf(stderr, "\t-H             print this help page\n");
   fprintf(stderr, "\t-g GCNAME      Grid Configuration Name\n");
   fprintf(stderr, "\t-h HOST        DHT node server name\n");
-  fprintf(stderr, "\t-a ACTION      put|mput|get|waitfor|mget|mwaitfor|getmeta|mgetmeta|sync|snapshot|amput|amget|amwaitfor|amgetmeta|asnapshot|async|createns|clone|linkto|deletens|recoverns\n");
+  fprintf(stderr, "\t-a ACTION      put|mput|get|waitfor|mget|mwaitfor|getmeta|mgetmeta|sync|snapshot|amput|amget|amwaitfor|amgetmeta|asnapshot|async|createns|clone|linkto|deletens|recoverns|bench\n");
   fprintf(stderr, "\t-n NAMESPACE\n");
   fprintf(stderr, "\t-k KEY\n");
   fprintf(stderr, "\t-v VALUE\n");
@@ -336,6 +342,9 @@ void usage(char const * const name_, char const * const pMsg_)
   //fprintf(stderr, "\t-Z ZKLOCS      zookeeper addresses\n");
   fprintf(stderr, "\t-s             use file storage\n");
   fprintf(stderr, "\t-J jvmOptions    options to jvm e.g. \'-Xmx1024M,-Xcheck:jni\'\n");
+  fprintf(stderr, "\t                 profile=debug|production selects a predefined jvm profile\n");
+  fprintf(stderr, "\t                 bench reports jvm startup time and mput/mget throughput over -R runs of -K keys;\n");
+  fprintf(stderr, "\t                 run it once per profile to compare them\n");
   //fprintf(stderr, "\t-r disable randomisazion in zookeeper connect (for debugging)\n");
   //fprintf(stderr, "\t-O OPTIONS storage options for DHT\n");
 
@@ -732,11 +741,16 @@ int main(int argc, char *argv[])
   SKNamespacePerspectiveOptions * pNspOptions = NULL;
 
   try { 
+      std::chrono::steady_clock::time_point initStart = std::chrono::steady_clock::now();
       bool inited = SKClient::init(llvl, jvmOptions);
 	  if(!inited){
 		  fprintf( stderr, "Failed to initialize JVM \n");
 		  return 1;
 	  }
+	  if (strcmp(action, "bench") == 0) {
+		  fprintf( stdout, "bench jvmOptions: %s\n", jvmOptions ? jvmOptions : "default" );
+		  fprintf( stdout, "bench startup: %.3f s\n", secondsSince(initStart) );
+	  }
 	  if(logfile)
 	    SKClient::setLogFile(logfile);
       client = SKClient::getClient();
@@ -1607,6 +1621,63 @@ int main(int argc, char *argv[])
         delete pVc;
         delete waitOpt;
 	}
+    //-------------------------------- Bench  ---------------------------------------
+	else if (strcmp(action, "bench") == 0)
+	{
+		if (!key) usage(argv[0], "missing key");
+
+		StrValMap vals;
+		StrVector keys;
+		if ( NULL == value)
+		  value = "Default value";
+		getKeyValues( vals, numberOfKeys, key, value, putFile, argv[0]);
+		getKeys( keys, numberOfKeys, key, putFile, argv[0]);
+		// the first run warms up the jvm and is excluded from the steady-state figures
+		double putSecs = 0.0, getSecs = 0.0;
+		int timedRuns = 0;
+        try {
+		    for( int runCnt=0; runCnt < nRuns + 1; ++runCnt) {
+			    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+			    snsp->put(&vals);
+			    double putRunSecs = secondsSince(start);
+
+			    start = std::chrono::steady_clock::now();
+			    StrValMap * gotVals = snsp->get(&keys);
+			    double getRunSecs = secondsSince(start);
+				StrValMap::const_iterator cit ;
+				for(cit = gotVals->begin() ; cit != gotVals->end(); cit++ ){
+					SKVal * pVal = cit->second;
+					sk_destroy_val(&pVal);
+				}
+			    delete gotVals;
+
+			    if (runCnt == 0) {
+				    fprintf( stdout, "bench warmup: put %.3f s get %.3f s\n", putRunSecs, getRunSecs);
+			    } else {
+				    putSecs += putRunSecs;
+				    getSecs += getRunSecs;
+				    ++timedRuns;
+			    }
+		    }
+		    if (timedRuns > 0) {
+			    double nOps = (double)timedRuns * keys.size();
+			    fprintf( stdout, "bench steady state: %d runs x %d keys\n", timedRuns, (int)keys.size());
+			    fprintf( stdout, "bench put: %.1f keys/s\n", putSecs > 0.0 ? nOps / putSecs : 0.0);
+			    fprintf( stdout, "bench get: %.1f keys/s\n", getSecs > 0.0 ? nOps / getSecs : 0.0);
+		    }
+        } catch (SKClientException & ce ){
+			exhandler( "caught in bench", __FILE__, __LINE__, ns );
+        } catch (...){
+            exhandler( "caught in bench", __FILE__, __LINE__, ns );
+        }
+
+		StrValMap::const_iterator cit ;
+		for(cit = vals.begin() ; cit != vals.end(); cit++ ){
+			SKVal * pVal = cit->second;
+			sk_destroy_val(&pVal);
+		}
+        vals.clear();
+	}
 	else
 	{
 		usage(argv[0], "invalid action");
@@ -6,7 +6,13 @@
 #include "ActiveOp.h"
 #include "Util.h"
 
+#include <errno.h>
+#include <limits.h>
+#include <linux/futex.h>
 #include <string.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
 
 
 ///////////////////////
@@ -14,6 +20,18 @@
 
 static int _ao_find_empty_ref(ActiveOp *ao) ;
 static void ao_check_for_deletion(ActiveOp *ao);
+static void ao_publish_stage(ActiveOp *ao, int stage);
+static void ao_futex_wait(ActiveOp *ao, int observedStage, uint64_t timeoutMS);
+
+
+/////////////////
+// private data
+
+static pthread_mutex_t	aoPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static ActiveOp	*aoFreeList;
+static int	aoFreeListSize;
+static uint64_t	aoPoolHits;
+static uint64_t	aoPoolMisses;
 
 
 ///////////////////
@@ -21,17 +39,27 @@ static void ao_check_for_deletion(ActiveOp *ao);
 
 ActiveOp *ao_new(void *target, void (*delete_function)(void **)) {
 	ActiveOp	*ao;
-	int			i;
 
-	ao = (ActiveOp *)mem_alloc(1, sizeof(ActiveOp));
+	pthread_mutex_lock(&aoPoolLock);
+	ao = aoFreeList;
+	if (ao != NULL) {
+		aoFreeList = ao->nextFree;
+		aoFreeListSize--;
+		aoPoolHits++;
+	} else {
+		aoPoolMisses++;
+	}
+	pthread_mutex_unlock(&aoPoolLock);
+	if (ao == NULL) {
+		ao = (ActiveOp *)mem_alloc(1, sizeof(ActiveOp));
+		//for (i = 0; i < AO_MAX_REFS; i++) { // mem_alloc zeros out and AOR_Invalid is zero so not needed
+		//	ao->refStatus[i] = AOR_Invalid;
+		//}
+		pthread_mutex_init(&ao->lock, NULL);
+	}
+	// pooled ops were reset in ao_delete
 	ao->target = target;
-	ao->stage = 0;
 	ao->delete_function = delete_function;
-	//for (i = 0; i < AO_MAX_REFS; i++) { // mem_alloc zeros out and AOR_Invalid is zero so not needed
-	//	ao->refStatus[i] = AOR_Invalid;
-	//}
-	mutex_init(&ao->mutexInstance, &ao->mutex);
-	cv_init(&ao->cvInstance, &ao->cv);
 	srfsLog(LOG_FINE, "out ao_new %llx", ao);
 	return ao;
 }
@@ -39,18 +67,45 @@ ActiveOp *ao_new(void *target, void (*delete_function)(void **)) {
 void ao_delete(ActiveOp **ao) {
 	srfsLog(LOG_FINE, "in ao_delete %llx", ao);
 	if (ao != NULL && *ao != NULL) {
-		mutex_destroy(&(*ao)->mutex);
-		cv_destroy(&(*ao)->cv);
-		(*ao)->delete_function(&(*ao)->target);
-        if ((*ao)->target != NULL) {
-            mem_free(&(*ao)->target);
+		ActiveOp	*_ao;
+		int			pooled;
+
+		_ao = *ao;
+		_ao->delete_function(&_ao->target);
+        if (_ao->target != NULL) {
+            mem_free(&_ao->target);
         }
-        if ((*ao)->rValLength != 0) {
-            if ((*ao)->rVal != NULL) {
-                mem_free(&(*ao)->rVal);
+        if (_ao->rValLength != 0) {
+            if (_ao->rVal != NULL) {
+                mem_free(&_ao->rVal);
             }
         }
-		mem_free((void **)ao);
+		// Only refs below nextRef can have been used
+		memset(_ao->refStatus, 0, _ao->nextRef * sizeof(AORefStatus));
+		_ao->rVal = NULL;
+		_ao->rValLength = 0;
+		_ao->result = AOResult_Incomplete;
+		_ao->stage = 0;
+		_ao->waitingThreads = 0;
+		_ao->nextRef = 0;
+		_ao->toDelete = FALSE;
+		_ao->traceID = 0;
+		pthread_mutex_lock(&aoPoolLock);
+		if (aoFreeListSize < AO_POOL_SIZE) {
+			_ao->nextFree = aoFreeList;
+			aoFreeList = _ao;
+			aoFreeListSize++;
+			pooled = TRUE;
+		} else {
+			pooled = FALSE;
+		}
+		pthread_mutex_unlock(&aoPoolLock);
+		if (!pooled) {
+			pthread_mutex_destroy(&_ao->lock);
+			mem_free((void **)ao);
+		} else {
+			*ao = NULL;
+		}
 	} else {
 		fatalError("bad ptr passed to ao_delete");
 	}
@@ -73,8 +128,8 @@ int ao_create_ref(ActiveOp *ao) {
 	int	ref;
 
 	ref = -1;
-	pthread_mutex_lock(ao->mutex);
-    
+	pthread_mutex_lock(&ao->lock);
+
     if (ao->nextRef >= AO_RECYCLE_THRESHOLD) {
         ref = _ao_find_empty_ref(ao);
     }
@@ -91,8 +146,8 @@ int ao_create_ref(ActiveOp *ao) {
             fatalError("AO_MAX_REFS exceeded", __FILE__, __LINE__);
         }
     }
-    
-	pthread_mutex_unlock(ao->mutex);
+
+	pthread_mutex_unlock(&ao->lock);
 	return ref;
 }
 
@@ -113,7 +168,7 @@ static void ao_check_for_deletion(ActiveOp *ao) {
 	int	i;
 
 	doDelete = TRUE;
-	//pthread_mutex_lock(ao->mutex); - this must already be held
+	//pthread_mutex_lock(&ao->lock); - this must already be held
 	if (!ao->toDelete) {
 		for (i = 0; i < ao->nextRef; i++) {
 			if (ao->refStatus[i] != AOR_Destroyed) {
@@ -127,18 +182,15 @@ static void ao_check_for_deletion(ActiveOp *ao) {
 	} else {
 		doDelete = FALSE;
 	}
-	pthread_mutex_unlock(ao->mutex);
+	pthread_mutex_unlock(&ao->lock);
 	if (doDelete) {
-		ActiveOp	*oldAO;
-
 		srfsLog(LOG_FINE, "All ActiveOp references destroyed. Deleting %llx", ao);
-		oldAO = ao;
 		ao_delete(&ao);
 	}
 }
 
 void ao_delete_ref(ActiveOp *ao, int ref) {
-	pthread_mutex_lock(ao->mutex);
+	pthread_mutex_lock(&ao->lock);
 	if (ref >= ao->nextRef) {
 		fatalError("ref >= ao->nextRef", __FILE__, __LINE__);
 	}
@@ -146,83 +198,132 @@ void ao_delete_ref(ActiveOp *ao, int ref) {
 		fatalError("ao->refStatus[ref] != AOR_Created", __FILE__, __LINE__);
 	}
 	ao->refStatus[ref] = AOR_Destroyed;
-	//pthread_mutex_unlock(ao->mutex); - this is performed in check for deletion
+	//pthread_mutex_unlock(&ao->lock); - this is performed in check for deletion
 	ao_check_for_deletion(ao);
 }
 
+// lock must be held; stage must not decrease
+static void ao_publish_stage(ActiveOp *ao, int stage) {
+	// Sequentially consistent with the waiter's increment of waitingThreads:
+	// either we see the waiter, or its FUTEX_WAIT sees the new stage
+	__atomic_store_n(&ao->stage, stage, __ATOMIC_SEQ_CST);
+	if (__atomic_load_n(&ao->waitingThreads, __ATOMIC_SEQ_CST) > 0) {
+		syscall(SYS_futex, &ao->stage, FUTEX_WAKE_PRIVATE, INT_MAX, NULL, NULL, 0);
+	}
+}
+
+// Sleeps until stage may have changed from observedStage, or up to timeoutMS
+static void ao_futex_wait(ActiveOp *ao, int observedStage, uint64_t timeoutMS) {
+	struct timespec	timeout;
+	struct timespec	*_timeout;
+
+	if (timeoutMS != 0) {
+		timeout.tv_sec = timeoutMS / 1000;
+		timeout.tv_nsec = (timeoutMS % 1000) * 1000000;
+		_timeout = &timeout;
+	} else {
+		_timeout = NULL;
+	}
+	__atomic_fetch_add(&ao->waitingThreads, 1, __ATOMIC_SEQ_CST);
+	// Returns at once with EAGAIN if stage has already moved on
+	syscall(SYS_futex, &ao->stage, FUTEX_WAIT_PRIVATE, observedStage, _timeout, NULL, 0);
+	__atomic_fetch_sub(&ao->waitingThreads, 1, __ATOMIC_SEQ_CST);
+}
+
 AOResult ao_wait_for_stage(ActiveOp *ao, int minStage) {
-    AOResult    result;
-    
-	pthread_mutex_lock(ao->mutex);
-	while (ao->stage < minStage && ao->stage != AO_STAGE_COMPLETE) {
-		pthread_cond_wait(ao->cv, ao->mutex);
+	int	stage;
+
+	stage = __atomic_load_n(&ao->stage, __ATOMIC_ACQUIRE);
+	while (stage < minStage && stage != AO_STAGE_COMPLETE) {
+		ao_futex_wait(ao, stage, 0);
+		stage = __atomic_load_n(&ao->stage, __ATOMIC_ACQUIRE);
 	}
-    result = ao->result;
-	pthread_mutex_unlock(ao->mutex);
-    return result;
+	// result is written before the stage that publishes it
+	return (AOResult)__atomic_load_n((int *)&ao->result, __ATOMIC_ACQUIRE);
 }
 
 AOResult ao_wait_for_stage_timed(ActiveOp *ao, int minStage, uint64_t timeoutMS) {
-    AOResult    result;
 	uint64_t	deadline;
+	uint64_t	curTime;
+	int	stage;
 
 	deadline = curTimeMillis() + timeoutMS;
-	pthread_mutex_lock(ao->mutex);
-	while (ao->stage < minStage && ao->stage != AO_STAGE_COMPLETE && curTimeMillis() < deadline) {
-		cv_wait_abs(ao->mutex, ao->cv, deadline);
+	stage = __atomic_load_n(&ao->stage, __ATOMIC_ACQUIRE);
+	while (stage < minStage && stage != AO_STAGE_COMPLETE && (curTime = curTimeMillis()) < deadline) {
+		ao_futex_wait(ao, stage, deadline - curTime);
+		stage = __atomic_load_n(&ao->stage, __ATOMIC_ACQUIRE);
 	}
-	if (ao->stage < minStage && ao->stage != AO_STAGE_COMPLETE) {
-        result = AOResult_Timeout;
+	if (stage < minStage && stage != AO_STAGE_COMPLETE) {
+        return AOResult_Timeout;
     } else {
-        result = ao->result;
+        return (AOResult)__atomic_load_n((int *)&ao->result, __ATOMIC_ACQUIRE);
     }
-	pthread_mutex_unlock(ao->mutex);
-    return result;
 }
 
 void ao_set_stage(ActiveOp *ao, int stage) {
-	pthread_mutex_lock(ao->mutex);
+	pthread_mutex_lock(&ao->lock);
 	if (stage > ao->stage) {
-		ao->stage = stage;
         if (ao->result != AOResult_Incomplete) {
             srfsLog(LOG_ERROR, "Unexpected ao->result != AOResult_Incomplete in ao_set_stage");
         }
-		pthread_cond_broadcast(ao->cv);
+		ao_publish_stage(ao, stage);
     }
-	pthread_mutex_unlock(ao->mutex);
+	pthread_mutex_unlock(&ao->lock);
 }
 
 AOResult ao_wait_for_completion(ActiveOp *ao) {
 	return ao_wait_for_stage(ao, AO_STAGE_COMPLETE);
 }
 
-void ao_set_complete(ActiveOp *ao, AOResult result, void *rVal, size_t rValLength) {
+// Returns TRUE iff this call supplied the op's result
+int ao_set_complete(ActiveOp *ao, AOResult result, void *rVal, size_t rValLength) {
+    int completed;
+    void    *_rVal;
+
+    completed = FALSE;
     if (result == AOResult_Incomplete) {
         srfsLog(LOG_ERROR, "Unexpected result == AOResult_Incomplete in ao_set_complete");
     } else {
-        pthread_mutex_lock(ao->mutex);
-        ao->stage = AO_STAGE_COMPLETE;
+        // Copy outside of the lock; discarded if another caller completes first
+        if (rVal != NULL && rValLength != 0 && __atomic_load_n((int *)&ao->result, __ATOMIC_ACQUIRE) == AOResult_Incomplete) {
+            _rVal = mem_dup(rVal, rValLength);
+        } else {
+            _rVal = NULL;
+        }
+        pthread_mutex_lock(&ao->lock);
         if (ao->result == AOResult_Incomplete) {
-            ao->result = result;
             if (rVal != NULL) {
                 if (ao->rVal != NULL) {
                     fatalError("Result incomplete, but rVal already set", __FILE__, __LINE__);
                 }
                 if (rValLength != 0) {
-                    ao->rVal = mem_dup(rVal, rValLength);
+                    ao->rVal = _rVal;
+                    _rVal = NULL;
                 } else {
                     ao->rVal = rVal;
                 }
                 ao->rValLength = rValLength;
             }
-            pthread_cond_broadcast(ao->cv);
+            __atomic_store_n((int *)&ao->result, result, __ATOMIC_RELEASE);
+            completed = TRUE;
         } else {
             srfsLog(LOG_INFO, "Ignoring result for already complete op");
         }
-        pthread_mutex_unlock(ao->mutex);
+        ao_publish_stage(ao, AO_STAGE_COMPLETE);
+        pthread_mutex_unlock(&ao->lock);
+        if (_rVal != NULL) {
+            mem_free(&_rVal);
+        }
     }
+    return completed;
 }
 
 void ao_set_complete_error(ActiveOp *ao, int errorCode) {
     ao_set_complete(ao, AOResult_Error, (void *)(uint64_t)errorCode, 0);
 }
+
+void ao_display_stats() {
+	pthread_mutex_lock(&aoPoolLock);
+	srfsLog(LOG_WARNING, "ao pool free %d hits %lu misses %lu", aoFreeListSize, aoPoolHits, aoPoolMisses);
+	pthread_mutex_unlock(&aoPoolLock);
+}
@@ -19,6 +19,7 @@
 #define AO_STAGE_COMPLETE 65536
 #define AO_RECYCLE_THRESHOLD    500
 // AO_RECYCLE_THRESHOLD must be < AO_MAX_REFS for reference number recycling to be active
+#define AO_POOL_SIZE    4096
 
 
 //////////
@@ -27,20 +28,25 @@
 typedef enum {AOR_Invalid = 0, AOR_Created, AOR_Destroyed} AORefStatus;
 typedef enum {AOResult_Incomplete = 0, AOResult_Timeout, AOResult_Error, AOResult_Success} AOResult;
 
+// Waiters sleep on stage itself with futex(2) rather than on a condition
+// variable. stage and result are written under lock but read without it;
+// waitingThreads lets setters skip the wake system call when nobody is
+// waiting. Deleted ops are kept in a pool, so lock is initialized only
+// once per object.
 typedef struct ActiveOp {
 	void			*target;
     void            *rVal;
     size_t          rValLength;
     AOResult        result;
 	int				stage;
+	int				waitingThreads;
 	AORefStatus		refStatus[AO_MAX_REFS];
 	int				nextRef;
 	int				toDelete;
 	void (*delete_function)(void **);
-	pthread_mutex_t	mutexInstance;
-	pthread_mutex_t	*mutex;
-	pthread_cond_t	cvInstance;
-	pthread_cond_t	*cv;
+	pthread_mutex_t	lock;
+	uint64_t		traceID; // 0 unless the op was created for a traced request
+	struct ActiveOp	*nextFree;
 } ActiveOp;
 
 
@@ -55,12 +61,13 @@ size_t ao_get_rValLength(ActiveOp *ao);
 int ao_create_ref(ActiveOp *ao);
 void ao_delete_ref(ActiveOp *ao, int ref);
 AOResult ao_wait_for_completion(ActiveOp *ao);
-void ao_set_complete(ActiveOp *ao, AOResult result = AOResult_Success, void *rVal = NULL, size_t rValLength = 0);
+int ao_set_complete(ActiveOp *ao, AOResult result = AOResult_Success, void *rVal = NULL, size_t rValLength = 0);
 void ao_set_complete_error(ActiveOp *ao, int errorCode);
 AOResult ao_wait_for_stage(ActiveOp *ao, int minStage);
 AOResult ao_wait_for_stage_timed(ActiveOp *ao, int minStage, uint64_t timeoutMS);
 void ao_set_stage(ActiveOp *ao, int stage);
 void ao_set_pinned(ActiveOp *ao, char *pinned);
+void ao_display_stats();
 
 
 #endif
@@ -4,15 +4,33 @@
 // includes
 
 #include <stdlib.h>
+#include <string.h>
 #include <sys/syscall.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <stdio.h>
 
 #include "ArrayBlockingQueue.h"
+#include "LatencyHistogram.h"
 #include "Util.h"
 
 
+////////////////////
+// private members
+
+// percentage of the queue size that may be occupied before a class is shed
+static const int _abqAdmissionPercent[ABQ_NUM_PRIORITIES] = {100, 75};
+static const char *_abqPriorityNames[ABQ_NUM_PRIORITIES] = {"demand", "readahead"};
+
+
+///////////////////////
+// private prototypes
+
+static int _abq_admission_limit(ArrayBlockingQueue *abq, ABQPriority priority);
+static void _abq_push(ArrayBlockingQueue *abq, ABQPriority priority, void *data);
+static void *_abq_pop(ArrayBlockingQueue *abq);
+
+
 ///////////////////
 // implementation
 
@@ -21,6 +39,7 @@
  */
 ArrayBlockingQueue *abq_new(int size, ABQFullMode qFullMode) {
 	ArrayBlockingQueue	*abq;
+	int	i;
 
 	if (size <= 0) {
 		fatalError("Invalid queue size");
@@ -29,9 +48,11 @@ ArrayBlockingQueue *abq_new(int size, ABQFullMode qFullMode) {
 	abq->size = size;
 	abq->qFullMode = qFullMode;
 	srfsLog(LOG_FINE, "new abq size %d qFullMode", abq->size, abq->qFullMode);
-	abq->entries = (BQEntry *)mem_alloc(size, sizeof(BQEntry));
-	abq->head = 0;
-	abq->tail = 0;
+	// Class storage is allocated on first use; most queues only ever see demand entries
+	for (i = 0; i < ABQ_NUM_PRIORITIES; i++) {
+		abq->classes[i].capacity = _abq_admission_limit(abq, (ABQPriority)i);
+	}
+	abq->count = 0;
 	mutex_init(&abq->mutexInstance, &abq->mutex);
 	cv_init(&abq->emptyCVInstance, &abq->emptyCV);
 	cv_init(&abq->fullCVInstance, &abq->fullCV);
@@ -43,49 +64,104 @@ ArrayBlockingQueue *abq_new(int size, ABQFullMode qFullMode) {
  */
 void abq_delete(ArrayBlockingQueue **abq) {
 	if (abq != NULL && *abq != NULL) {
+		int	i;
+
 		mutex_destroy(&(*abq)->mutex);
 		cv_destroy(&(*abq)->emptyCV);
 		cv_destroy(&(*abq)->fullCV);
-		mem_free((void **) &((*abq)->entries) );
+		for (i = 0; i < ABQ_NUM_PRIORITIES; i++) {
+			if ((*abq)->classes[i].entries != NULL) {
+				mem_free((void **) &((*abq)->classes[i].entries) );
+			}
+		}
 		mem_free((void **)abq);
 	} else {
 		fatalError("bad ptr passed to abq_delete");
 	}
 }
 
-static int _abq_is_full(ArrayBlockingQueue *abq) {
-	int	modResult;
+static int _abq_admission_limit(ArrayBlockingQueue *abq, ABQPriority priority) {
+	int	limit;
+
+	limit = (int)(((int64_t)abq->size * _abqAdmissionPercent[priority]) / 100);
+	return limit > 0 ? limit : 1;
+}
+
+// lock must be held
+static void _abq_push(ArrayBlockingQueue *abq, ABQPriority priority, void *data) {
+	ABQClass	*c;
+	int			tail;
 
-	modResult = (abq->head - 1) % abq->size;
-	if (modResult < 0) {
-		// compilers can do whatever they want per standard; fix it
-		modResult += abq->size; 
+	c = &abq->classes[priority];
+	if (c->entries == NULL) {
+		c->entries = (BQEntry *)mem_alloc(c->capacity, sizeof(BQEntry));
 	}
-	return modResult == abq->tail;
+	if (c->count >= c->capacity) {
+		// admission limits make this impossible
+		fatalError("abq class overflow", __FILE__, __LINE__);
+	}
+	tail = (c->head + c->count) % c->capacity;
+	c->entries[tail].data = data;
+	c->entries[tail].enqueueMicros = curTimeMicros();
+	c->count++;
+	c->puts++;
+	abq->count++;
 }
 
-static int _abq_is_empty(ArrayBlockingQueue *abq) {
-	return abq->head == abq->tail;
+// lock must be held, and the queue must be non-empty
+static void *_abq_pop(ArrayBlockingQueue *abq) {
+	int	i;
+
+	for (i = 0; i < ABQ_NUM_PRIORITIES; i++) {
+		ABQClass	*c;
+
+		c = &abq->classes[i];
+		if (c->count > 0) {
+			void		*data;
+			uint64_t	waitMicros;
+			uint64_t	now;
+
+			data = c->entries[c->head].data;
+			now = curTimeMicros();
+			waitMicros = now > c->entries[c->head].enqueueMicros ? now - c->entries[c->head].enqueueMicros : 0;
+			c->totalWaitMicros += waitMicros;
+			if (waitMicros > c->maxWaitMicros) {
+				c->maxWaitMicros = waitMicros;
+			}
+			lh_record(LH_QUEUE_WAIT, waitMicros);
+			c->takes++;
+			c->head = (c->head + 1) % c->capacity;
+			c->count--;
+			abq->count--;
+			return data;
+		}
+	}
+	fatalError("_abq_pop on empty queue", __FILE__, __LINE__);
+	return NULL;
 }
 
 /**
- * Enqueue an entry. Block if no room.
+ * Enqueue an entry. Block if no room (demand entries in ABQ_FULL_BLOCK mode only).
  */
-int abq_put(ArrayBlockingQueue *abq, void *data) {
+int abq_put(ArrayBlockingQueue *abq, void *data, ABQPriority priority) {
 	int added;
 	
 	pthread_mutex_lock(abq->mutex);
-	//srfsLog(LOG_FINE, "abq_put %llx head %d tail %d data %llx", abq, abq->head, abq->tail, data);
-	if (abq->qFullMode == ABQ_FULL_DROP && _abq_is_full(abq)) {
+	//srfsLog(LOG_FINE, "abq_put %llx count %d data %llx", abq, abq->count, data);
+	if (priority != ABQ_PRIORITY_DEMAND && abq->count >= _abq_admission_limit(abq, priority)) {
+		srfsLog(LOG_FINE, "abq shedding %s %llx", _abqPriorityNames[priority], data);
+		abq->classes[priority].shed++;
+		added = FALSE;
+	} else if (abq->qFullMode == ABQ_FULL_DROP && abq->count >= abq->size) {
 		srfsLog(LOG_FINE, "abq full dropping %llx", data);
+		abq->classes[priority].shed++;
 		added = FALSE;
 	} else {
-		while (_abq_is_full(abq)) {
+		while (abq->count >= abq->size) {
 			//srfsLog(LOG_FINE, "abq full waiting %llx", abq);
 			pthread_cond_wait(abq->fullCV, abq->mutex);
 		}
-		abq->entries[abq->tail].data = data;
-		abq->tail = (abq->tail + 1) % abq->size;
+		_abq_push(abq, priority, data);
 		//srfsLog(LOG_FINE, "signal %llx", abq->emptyCV);
 		pthread_cond_signal(abq->emptyCV);
 		added = TRUE;
@@ -101,13 +177,12 @@ void *abq_take(ArrayBlockingQueue *abq) {
 	void	*data;
 
 	pthread_mutex_lock(abq->mutex);
-	while (_abq_is_empty(abq)) {
+	while (abq->count == 0) {
 		//srfsLog(LOG_FINE, "abq empty waiting %llx %llx", abq, abq->emptyCV);
 		pthread_cond_wait(abq->emptyCV, abq->mutex);
 	}
-	data = abq->entries[abq->head].data;
-	srfsLog(LOG_FINE, "abq_take head %d tail %d data %llx", abq->head, abq->tail, data);
-	abq->head = (abq->head + 1) % abq->size;
+	data = _abq_pop(abq);
+	srfsLog(LOG_FINE, "abq_take count %d data %llx", abq->count, data);
 	pthread_cond_signal(abq->fullCV);
 	pthread_mutex_unlock(abq->mutex);
 	return data;
@@ -115,6 +190,7 @@ void *abq_take(ArrayBlockingQueue *abq) {
 
 /**
  * Dequeue multiple entries. Block until at least one can be obtained.
+ * Batches are filled from the highest priority classes first.
  */
 int abq_take_multi(ArrayBlockingQueue *abq, void **batch, int batchLimit) {
 	int		batchSize;
@@ -123,19 +199,18 @@ int abq_take_multi(ArrayBlockingQueue *abq, void **batch, int batchLimit) {
 		fatalError("batchLimit <= 0", __FILE__, __LINE__);
 	}
 	pthread_mutex_lock(abq->mutex);
-	while (_abq_is_empty(abq)) {
-		//srfsLog(LOG_FINE, "abq empty waiting %llx %llx %d %d", abq, abq->emptyCV, abq->head, abq->tail);
+	while (abq->count == 0) {
+		//srfsLog(LOG_FINE, "abq empty waiting %llx %llx %d", abq, abq->emptyCV, abq->count);
 		//srfsLog(LOG_FINE, "abq cond_wait %llx %llx %d %d", abq->emptyCV, abq->mutex, pthread_self(), syscall(SYS_gettid));
 		pthread_cond_wait(abq->emptyCV, abq->mutex);
 		//srfsLog(LOG_FINE, "back abq cond_wait %llx %llx", abq->emptyCV, abq->mutex);
 	}
-	//srfsLog(LOG_FINE, "abq_take_multi out of wait loop %llx %llx %d %d", abq, abq->emptyCV, abq->head, abq->tail);
+	//srfsLog(LOG_FINE, "abq_take_multi out of wait loop %llx %llx %d", abq, abq->emptyCV, abq->count);
 	batchSize = 0;
-	while (!_abq_is_empty(abq) && batchSize < batchLimit) {
-		batch[batchSize] = abq->entries[abq->head].data;
-		//srfsLog(LOG_FINE, "abq_take_multi head %d tail %d batch[batchSize] %llx", abq, abq->head, abq->tail, batch[batchSize]);
+	while (abq->count > 0 && batchSize < batchLimit) {
+		batch[batchSize] = _abq_pop(abq);
+		//srfsLog(LOG_FINE, "abq_take_multi count %d batch[batchSize] %llx", abq->count, batch[batchSize]);
 		batchSize++;
-		abq->head = (abq->head + 1) % abq->size;
 		if(!batch[batchSize-1]) //stop on null-entries sent to QP upon graceful exit notification
 			break ;
 	}
@@ -145,3 +220,22 @@ int abq_take_multi(ArrayBlockingQueue *abq, void **batch, int batchLimit) {
 	return batchSize;
 }
 
+void abq_display_stats(ArrayBlockingQueue *abq, const char *name) {
+	ABQClass	classes[ABQ_NUM_PRIORITIES];
+	int	i;
+
+	pthread_mutex_lock(abq->mutex);
+	memcpy(classes, abq->classes, sizeof(classes));
+	pthread_mutex_unlock(abq->mutex);
+	for (i = 0; i < ABQ_NUM_PRIORITIES; i++) {
+		ABQClass	*c;
+
+		c = &classes[i];
+		if (c->puts == 0 && c->shed == 0) {
+			continue;
+		}
+		srfsLog(LOG_WARNING, "abq %s %s depth %d puts %lu shed %lu takes %lu avgWaitMicros %lu maxWaitMicros %lu",
+			name, _abqPriorityNames[i], c->count, c->puts, c->shed, c->takes,
+			c->takes > 0 ? c->totalWaitMicros / c->takes : 0, c->maxWaitMicros);
+	}
+}
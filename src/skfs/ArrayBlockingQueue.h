@@ -7,6 +7,13 @@
 // includes
 
 #include <pthread.h>
+#include <stdint.h>
+
+
+////////////
+// defines
+
+#define ABQ_NUM_PRIORITIES	2
 
 
 //////////
@@ -14,17 +21,36 @@
 
 typedef enum {ABQ_FULL_BLOCK, ABQ_FULL_DROP} ABQFullMode;
 
+// Takes always drain higher priorities (lower values) first. Classes below
+// demand are only admitted while the queue as a whole is below that
+// class's admission limit; beyond it they are shed regardless of
+// ABQFullMode so that speculative work can't crowd out demand work.
+typedef enum {ABQ_PRIORITY_DEMAND, ABQ_PRIORITY_READAHEAD} ABQPriority;
+
 /** private type used to store entries */
 typedef struct BQEntry {
 	void *data;
+	uint64_t	enqueueMicros;
 } BQEntry;
 
-typedef struct ArrayBlockingQueue {
+/** private type holding one priority class */
+typedef struct ABQClass {
 	BQEntry	*entries;
+	int		capacity;
+	int		head;
+	int		count;
+	uint64_t	puts;
+	uint64_t	shed;
+	uint64_t	takes;
+	uint64_t	totalWaitMicros;
+	uint64_t	maxWaitMicros;
+} ABQClass;
+
+typedef struct ArrayBlockingQueue {
+	ABQClass	classes[ABQ_NUM_PRIORITIES];
 	int		size;
+	int		count;
 	ABQFullMode	qFullMode;
-	int		head;
-	int		tail;
 	pthread_mutex_t	mutexInstance;
 	pthread_mutex_t	*mutex;
 	pthread_cond_t	emptyCVInstance;
@@ -39,9 +65,10 @@ typedef struct ArrayBlockingQueue {
 
 ArrayBlockingQueue *abq_new(int size, ABQFullMode qFullMode = ABQ_FULL_BLOCK);
 void abq_delete(ArrayBlockingQueue **abq);
-int abq_put(ArrayBlockingQueue *abq, void *data);
+int abq_put(ArrayBlockingQueue *abq, void *data, ABQPriority priority = ABQ_PRIORITY_DEMAND);
 void *abq_take(ArrayBlockingQueue *abq);
 int abq_take_multi(ArrayBlockingQueue *abq, void **batch, int batchLimit);
+void abq_display_stats(ArrayBlockingQueue *abq, const char *name);
 //void abq_peek(ArrayBlockingQueue *abq);
 
 #endif
@@ -19,6 +19,7 @@
 ///////////////////////
 // private prototypes
 
+static void ac_negative_stat_inc(AttrCache *aCache, uint64_t *stat);
 
 
 
@@ -37,6 +38,10 @@ AttrCache *ac_new(int numSubCaches, int size, int evictionBatchSize) {
 		aCache->attrCaches[i] = cache_new(AC_CACHE_NAME, size, evictionBatchSize,
 			(unsigned int (*)(void *))stringHash, (int(*)(void *, void *))strcmp);
 	}
+	for (i = 0; i < AC_NEGATIVE_LOCKS; i++) {
+		pthread_spin_init(&aCache->negativeLocks[i], 0);
+	}
+	pthread_spin_init(&aCache->negativeEpochLock, 0);
 	return aCache;
 }
 
@@ -48,6 +53,18 @@ void ac_delete(AttrCache **aCache) {
 			cache_delete(&(*aCache)->attrCaches[i]);
 		}
 		mem_free((void **)&(*aCache)->attrCaches);
+		for (i = 0; i < (*aCache)->negativeCacheSize; i++) {
+			if ((*aCache)->negativeEntries[i].path != NULL) {
+				mem_free((void **)&(*aCache)->negativeEntries[i].path);
+			}
+		}
+		if ((*aCache)->negativeEntries != NULL) {
+			mem_free((void **)&(*aCache)->negativeEntries);
+		}
+		for (i = 0; i < AC_NEGATIVE_LOCKS; i++) {
+			pthread_spin_destroy(&(*aCache)->negativeLocks[i]);
+		}
+		pthread_spin_destroy(&(*aCache)->negativeEpochLock);
 		mem_free((void **)aCache);
 	} else {
 		fatalError("bad ptr in ac_delete");
@@ -78,6 +95,7 @@ CacheReadResult ac_read_no_op_creation(AttrCache *aCache, char *path, FileAttr *
 
 CacheStoreResult ac_store_raw_data(AttrCache *aCache, char *path, FileAttr *data, int replace, uint64_t modificationTimeMicros, uint64_t timeoutMillis) {
 	srfsLog(LOG_FINE, "ac_store_raw_data %s %u %u", path, timeoutMillis, data->stat.st_size);
+	ac_negative_remove(aCache, path);
 	return cache_store_raw_data(ac_sub_cache(aCache, path), path, strlen(path) + 1, data, sizeof(FileAttr), replace, modificationTimeMicros, timeoutMillis);
 }
 
@@ -94,6 +112,15 @@ void ac_store_error(AttrCache *aCache, char *path, int errorCode, uint64_t modif
 	cache_store_error(ac_sub_cache(aCache, path), path, strlen(path) + 1, errorCode, notifyActiveOps_noStorage, modificationTimeMicros, timeoutMillis);
 }
 
+void ac_get_cache_stats(AttrCache *aCache, CacheStats *stats) {
+	int	i;
+
+	memset(stats, 0, sizeof(CacheStats));
+	for (i = 0; i < aCache->numSubCaches; i++) {
+		cache_get_stats(aCache->attrCaches[i], stats);
+	}
+}
+
 void ac_display_stats(AttrCache *aCache) {
 	int	i;
 	
@@ -102,3 +129,180 @@ void ac_display_stats(AttrCache *aCache) {
 		cache_display_stats(aCache->attrCaches[i]);
 	}
 }
+
+// negative cache
+
+static void ac_negative_stat_inc(AttrCache *aCache, uint64_t *stat) {
+	__atomic_fetch_add(stat, 1, __ATOMIC_RELAXED);
+}
+
+// Must be called before the cache is shared. A size of zero disables
+// negative caching.
+void ac_negative_set_size(AttrCache *aCache, int size) {
+	if (aCache->negativeEntries != NULL) {
+		fatalError("ac_negative_set_size called twice", __FILE__, __LINE__);
+	}
+	if (size > 0) {
+		aCache->negativeEntries = (ACNegativeEntry *)mem_alloc(size, sizeof(ACNegativeEntry));
+		aCache->negativeCacheSize = size;
+	}
+}
+
+static uint64_t *ac_negative_dir_epoch_slot(AttrCache *aCache, const char *dirPath, size_t length) {
+	return &aCache->negativeDirEpochs[fnv1a_64(dirPath, length) % AC_NEGATIVE_DIR_EPOCHS];
+}
+
+static size_t ac_parent_length(const char *path) {
+	const char	*lastSlash;
+
+	lastSlash = strrchr(path, '/');
+	return lastSlash != NULL ? (size_t)(lastSlash - path) : 0;
+}
+
+// Callers capture the epoch before looking a path up so that a creation
+// racing with the lookup prevents the resulting ENOENT from being cached.
+uint64_t ac_negative_epoch(AttrCache *aCache, const char *path) {
+	uint64_t	*slot;
+	uint64_t	epoch;
+
+	slot = ac_negative_dir_epoch_slot(aCache, path, ac_parent_length(path));
+	pthread_spin_lock(&aCache->negativeEpochLock);
+	epoch = *slot;
+	pthread_spin_unlock(&aCache->negativeEpochLock);
+	return epoch;
+}
+
+void ac_negative_store(AttrCache *aCache, const char *path, uint64_t dirEpoch, uint64_t timeoutMillis) {
+	ACNegativeEntry	*entry;
+	uint64_t	index;
+	char	*newPath;
+	char	*oldPath;
+
+	if (aCache->negativeCacheSize == 0 || timeoutMillis == 0) {
+		return;
+	}
+	if (ac_negative_epoch(aCache, path) != dirEpoch) {
+		srfsLog(LOG_FINE, "ac_negative_store %s parent modified during lookup", path);
+		return;
+	}
+	index = fnv1a_64(path, strlen(path)) % aCache->negativeCacheSize;
+	entry = &aCache->negativeEntries[index];
+	// Allocate outside of the spinlock
+	newPath = str_dup(path);
+	pthread_spin_lock(&aCache->negativeLocks[index % AC_NEGATIVE_LOCKS]);
+	oldPath = entry->path;
+	entry->path = newPath;
+	entry->expirationMillis = curTimeMillis() + timeoutMillis;
+	entry->dirEpoch = dirEpoch;
+	pthread_spin_unlock(&aCache->negativeLocks[index % AC_NEGATIVE_LOCKS]);
+	if (oldPath != NULL) {
+		mem_free((void **)&oldPath);
+	}
+	ac_negative_stat_inc(aCache, &aCache->negativeStats.stores);
+}
+
+// Returns TRUE if path is known not to exist
+int ac_negative_read(AttrCache *aCache, const char *path) {
+	ACNegativeEntry	*entry;
+	uint64_t	index;
+	uint64_t	dirEpoch;
+	char	*stalePath;
+	int		found;
+
+	if (aCache->negativeCacheSize == 0) {
+		return FALSE;
+	}
+	dirEpoch = ac_negative_epoch(aCache, path);
+	index = fnv1a_64(path, strlen(path)) % aCache->negativeCacheSize;
+	entry = &aCache->negativeEntries[index];
+	found = FALSE;
+	stalePath = NULL;
+	pthread_spin_lock(&aCache->negativeLocks[index % AC_NEGATIVE_LOCKS]);
+	if (entry->path != NULL && !strcmp(entry->path, path)) {
+		if (entry->dirEpoch == dirEpoch && curTimeMillis() < entry->expirationMillis) {
+			found = TRUE;
+		} else {
+			stalePath = entry->path;
+			entry->path = NULL;
+		}
+	}
+	pthread_spin_unlock(&aCache->negativeLocks[index % AC_NEGATIVE_LOCKS]);
+	if (stalePath != NULL) {
+		mem_free((void **)&stalePath);
+		ac_negative_stat_inc(aCache, &aCache->negativeStats.expirations);
+	}
+	ac_negative_stat_inc(aCache, found ? &aCache->negativeStats.hits : &aCache->negativeStats.misses);
+	return found;
+}
+
+// Forgets any negative entry for path; used when path is found to exist
+void ac_negative_remove(AttrCache *aCache, const char *path) {
+	ACNegativeEntry	*entry;
+	uint64_t	index;
+	char	*oldPath;
+
+	if (aCache->negativeCacheSize == 0) {
+		return;
+	}
+	index = fnv1a_64(path, strlen(path)) % aCache->negativeCacheSize;
+	entry = &aCache->negativeEntries[index];
+	oldPath = NULL;
+	pthread_spin_lock(&aCache->negativeLocks[index % AC_NEGATIVE_LOCKS]);
+	if (entry->path != NULL && !strcmp(entry->path, path)) {
+		oldPath = entry->path;
+		entry->path = NULL;
+	}
+	pthread_spin_unlock(&aCache->negativeLocks[index % AC_NEGATIVE_LOCKS]);
+	if (oldPath != NULL) {
+		mem_free((void **)&oldPath);
+	}
+}
+
+// Called when path is created locally
+void ac_negative_invalidate(AttrCache *aCache, const char *path) {
+	uint64_t	*slot;
+
+	if (aCache->negativeCacheSize == 0) {
+		return;
+	}
+	ac_negative_remove(aCache, path);
+	// Also discards lookups of path that are in flight
+	slot = ac_negative_dir_epoch_slot(aCache, path, ac_parent_length(path));
+	pthread_spin_lock(&aCache->negativeEpochLock);
+	(*slot)++;
+	pthread_spin_unlock(&aCache->negativeEpochLock);
+	ac_negative_stat_inc(aCache, &aCache->negativeStats.invalidations);
+}
+
+// Called when entries may have been added to dirPath, e.g. by another node
+void ac_negative_invalidate_dir(AttrCache *aCache, const char *dirPath) {
+	uint64_t	*slot;
+
+	if (aCache->negativeCacheSize == 0) {
+		return;
+	}
+	slot = ac_negative_dir_epoch_slot(aCache, dirPath, strlen(dirPath));
+	pthread_spin_lock(&aCache->negativeEpochLock);
+	(*slot)++;
+	pthread_spin_unlock(&aCache->negativeEpochLock);
+	ac_negative_stat_inc(aCache, &aCache->negativeStats.invalidations);
+}
+
+void ac_get_negative_stats(AttrCache *aCache, ACNegativeStats *stats) {
+	stats->hits = __atomic_load_n(&aCache->negativeStats.hits, __ATOMIC_RELAXED);
+	stats->misses = __atomic_load_n(&aCache->negativeStats.misses, __ATOMIC_RELAXED);
+	stats->stores = __atomic_load_n(&aCache->negativeStats.stores, __ATOMIC_RELAXED);
+	stats->expirations = __atomic_load_n(&aCache->negativeStats.expirations, __ATOMIC_RELAXED);
+	stats->invalidations = __atomic_load_n(&aCache->negativeStats.invalidations, __ATOMIC_RELAXED);
+}
+
+void ac_display_negative_stats(AttrCache *aCache) {
+	ACNegativeStats	stats;
+
+	if (aCache->negativeCacheSize == 0) {
+		return;
+	}
+	ac_get_negative_stats(aCache, &stats);
+	srfsLog(LOG_WARNING, "ac negative hits %lu misses %lu stores %lu expirations %lu invalidations %lu",
+		stats.hits, stats.misses, stats.stores, stats.expirations, stats.invalidations);
+}
@@ -10,16 +10,50 @@
 #include "Cache.h"
 #include "FileAttr.h"
 
+#include <pthread.h>
+#include <stdint.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 
+////////////
+// defines
+
+#define AC_NEGATIVE_LOCKS	64
+#define AC_NEGATIVE_DIR_EPOCHS	4096
+
+
 //////////
 // types
 
+// A recently observed ENOENT for a path. Only valid while its parent
+// directory's epoch is unchanged and it has not expired.
+typedef struct ACNegativeEntry {
+	char	*path;
+	uint64_t	expirationMillis;
+	uint64_t	dirEpoch;
+} ACNegativeEntry;
+
+typedef struct ACNegativeStats {
+	uint64_t	hits;
+	uint64_t	misses;
+	uint64_t	stores;
+	uint64_t	expirations;
+	uint64_t	invalidations;
+} ACNegativeStats;
+
 typedef struct AttrCache {
 	int	numSubCaches;
 	Cache	**attrCaches;
+	// Bounded, direct-mapped cache of missing paths. Creations bump the
+	// epoch of the parent directory's bucket, which invalidates all
+	// negative entries stored (or in flight) under it.
+	int	negativeCacheSize;
+	ACNegativeEntry	*negativeEntries;
+	pthread_spinlock_t	negativeLocks[AC_NEGATIVE_LOCKS];
+	uint64_t	negativeDirEpochs[AC_NEGATIVE_DIR_EPOCHS];
+	pthread_spinlock_t	negativeEpochLock;
+	ACNegativeStats	negativeStats; // updated atomically
 } AttrCache;
 
 
@@ -36,6 +70,16 @@ CacheStoreResult ac_store_raw_data(AttrCache *aCache, char *path, FileAttr *fa,
 void ac_store_active_op(AttrCache *aCache, char *path, ActiveOp *op);
 void ac_remove_active_op(AttrCache *aCache, char *path, int fatalErrorOnNotFound = FALSE);
 void ac_store_error(AttrCache *aCache, char *path, int errorCode, uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME, uint64_t timeoutMillis = CACHE_NO_TIMEOUT, int notifyActiveOps_noStorage = FALSE);
+void ac_get_cache_stats(AttrCache *aCache, CacheStats *stats);
 void ac_display_stats(AttrCache *aCache);
+void ac_negative_set_size(AttrCache *aCache, int size);
+uint64_t ac_negative_epoch(AttrCache *aCache, const char *path);
+void ac_negative_store(AttrCache *aCache, const char *path, uint64_t dirEpoch, uint64_t timeoutMillis);
+int ac_negative_read(AttrCache *aCache, const char *path);
+void ac_negative_remove(AttrCache *aCache, const char *path);
+void ac_negative_invalidate(AttrCache *aCache, const char *path);
+void ac_negative_invalidate_dir(AttrCache *aCache, const char *dirPath);
+void ac_get_negative_stats(AttrCache *aCache, ACNegativeStats *stats);
+void ac_display_negative_stats(AttrCache *aCache);
 
 #endif
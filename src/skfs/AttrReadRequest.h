@@ -20,6 +20,7 @@ typedef struct AttrReadRequest {
 	AttrReader	*attrReader;
 	char *path;
     uint64_t    minModificationTimeMicros;    
+    uint64_t    negativeDirEpoch;
 } AttrReadRequest;
 
 
@@ -10,6 +10,7 @@
 #include "FileID.h"
 #include "G2OutputDir.h"
 #include "G2TaskOutputReader.h"
+#include "LatencyHistogram.h"
 #include "OpenDirTable.h"
 #include "SRFSConstants.h"
 #include "Util.h"
@@ -45,6 +46,8 @@ static void ar_parse_native_alias(AttrReader *ar, char *mapping);
 static void ar_store_native_alias_attribs(AttrReader *ar);
 static void ar_translate_reverse_path(AttrReader *ar, char *path, const char *nativePath);
 static int ar_is_no_error_cache_path(AttrReader *ar, char *path);
+static void ar_store_negative(AttrReadRequest *arr);
+static int ar_parent_lacks_child(AttrReader *ar, char *path);
 static void _ar_store_dir_attribs(AttrReader *ar, char *path, uint16_t mode);
 static int _ar_get_attr(AttrReader *ar, char *path, FileAttr *fa, int isNativePath, char *nativePath, uint64_t minModificationTimeMicros);
 static void ar_store_attr_in_cache(AttrReadRequest *arr, FileAttr *fa, uint64_t timeoutMillis = CACHE_NO_TIMEOUT);
@@ -93,8 +96,10 @@ AttrReader *ar_new(FileIDToPathMap *f2p, SRFSDHT *sd, AttrWriter *aw,
 			
 			ar->pSession[i] = sd_new_session(ar->sd);
 			ns = ar->pSession[i]->getNamespace(SKFS_ATTR_NS);
-			nspOptions = ns->getDefaultNSPOptions();
+			// Lookups of missing paths are common; report them per-key rather than via exception
+			nspOptions = sd_new_null_value_nsp_options(ns);
 			ar->ansp[i] = ns->openAsyncPerspective(nspOptions);
+			delete nspOptions;
 			delete ns;
 		}
 	} catch(SKClientException & ex){
@@ -142,6 +147,9 @@ void ar_delete(AttrReader **ar) {
 		pg_delete(&(*ar)->noErrorCachePaths);
 		pg_delete(&(*ar)->noLinkCachePaths);
 		pg_delete(&(*ar)->snapshotOnlyPaths);
+		for (int i = 0; i < (*ar)->numNegativeCacheGroups; i++) {
+			pg_delete(&(*ar)->negativeCacheGroups[i]);
+		}
 		
 		if ((*ar)->pSession) {
 			int	i;
@@ -191,6 +199,112 @@ void ar_parse_snapshot_only_paths(AttrReader *ar, char *paths) {
 	pg_parse_paths(ar->snapshotOnlyPaths, paths);
 }
 
+// groupTimeouts is of the form <paths>=<millis>[+<paths>=<millis>...]
+// where <paths> is parsed as a PathGroup. The first matching group
+// determines the timeout; other paths use timeoutMillis.
+void ar_set_negative_cache(AttrReader *ar, int size, uint64_t timeoutMillis, char *groupTimeouts) {
+	ac_negative_set_size(ar->attrCache, size);
+	ar->negativeCacheTimeoutMillis = timeoutMillis;
+	if (groupTimeouts != NULL) {
+		char	*spec;
+		char	*cur;
+
+		spec = str_dup(groupTimeouts);
+		cur = spec;
+		while (cur != NULL && *cur != '\0') {
+			char	*div;
+			char	*next;
+			char	*eq;
+
+			div = strchr(cur, AR_NEGATIVE_CACHE_GROUP_DELIMITER);
+			if (div == NULL) {
+				next = NULL;
+			} else {
+				next = div + 1;
+				*div = '\0';
+			}
+			eq = strrchr(cur, '=');
+			if (eq == NULL) {
+				srfsLog(LOG_WARNING, "Ignoring negative cache group without timeout %s", cur);
+			} else if (ar->numNegativeCacheGroups == AR_MAX_NEGATIVE_CACHE_GROUPS) {
+				srfsLog(LOG_WARNING, "Too many negative cache groups. Ignoring %s", cur);
+			} else {
+				PathGroup	*pg;
+
+				*eq = '\0';
+				pg = pg_new("negativeCacheGroup");
+				pg_parse_paths(pg, cur);
+				ar->negativeCacheGroups[ar->numNegativeCacheGroups] = pg;
+				ar->negativeCacheGroupTimeoutMillis[ar->numNegativeCacheGroups] = strtoull(eq + 1, NULL, 10);
+				ar->numNegativeCacheGroups++;
+			}
+			cur = next;
+		}
+		mem_free((void **)&spec);
+	}
+	srfsLog(LOG_WARNING, "ar negative cache size %d timeoutMillis %lu groups %d", 
+			size, timeoutMillis, ar->numNegativeCacheGroups);
+}
+
+static uint64_t ar_negative_cache_timeout(AttrReader *ar, char *path) {
+	int	i;
+
+	// Explicit noErrorCachePaths always consult the source
+	if (pg_matches(ar->noErrorCachePaths, path)) {
+		return 0;
+	}
+	for (i = 0; i < ar->numNegativeCacheGroups; i++) {
+		if (pg_matches(ar->negativeCacheGroups[i], path)) {
+			return ar->negativeCacheGroupTimeoutMillis[i];
+		}
+	}
+	return ar->negativeCacheTimeoutMillis;
+}
+
+// Lookups of missing writable skfs paths may be answered from the parent's
+// cached DirData if it has been checked against the kvs within dirDataFreshnessMillis.
+void ar_set_open_dir_table(AttrReader *ar, OpenDirTable *odt, uint64_t dirDataFreshnessMillis) {
+	ar->odt = odt;
+	ar->dirDataFreshnessMillis = dirDataFreshnessMillis;
+}
+
+static int ar_parent_lacks_child(AttrReader *ar, char *path) {
+	char	*lastSlash;
+	char	parent[SRFS_MAX_PATH_LENGTH];
+	OpenDir	*od;
+	CacheReadResult	result;
+
+	if (ar->odt == NULL || ar->dirDataFreshnessMillis == 0 || !is_writable_path(path)
+			|| pg_matches(ar->noErrorCachePaths, path)) {
+		return FALSE;
+	}
+	lastSlash = strrchr(path, '/');
+	if (lastSlash == NULL || lastSlash == path) {
+		return FALSE;
+	}
+	memset(parent, 0, SRFS_MAX_PATH_LENGTH);
+	memcpy(parent, path, (size_t)(lastSlash - path));
+	od = NULL;
+	// Never fetches; only a parent that is already cached is consulted
+	result = odc_read_no_op_creation(ar->odt->odc, parent, &od);
+	if (result != CRR_FOUND || od == NULL) {
+		return FALSE;
+	}
+	if (od_getLastCheckMillis(od) == 0 || od_getElapsedSinceLastCheckMillis(od) > ar->dirDataFreshnessMillis) {
+		return FALSE;
+	}
+	return od_lacks_entry(od, lastSlash + 1);
+}
+
+static void ar_store_negative(AttrReadRequest *arr) {
+	AttrReader	*ar;
+
+	ar = arr->attrReader;
+	if (arr->minModificationTimeMicros == 0) {
+		ac_negative_store(ar->attrCache, arr->path, arr->negativeDirEpoch, ar_negative_cache_timeout(ar, arr->path));
+	}
+}
+
 AttrCache *ar_get_attrCache(AttrReader *ar) {
 	return ar->attrCache;
 }
@@ -227,6 +341,31 @@ static void ar_store_attr_in_cache(AttrReadRequest *arr, FileAttr *fa, uint64_t
 	}
 }
 
+// Bulk retrieval of per-key results from a retrieval exception. On failure,
+// all keys are reported as failed.
+static void ar_get_key_results(SKRetrievalException & e, StrVector *requestGroup, int numRequests,
+                               SKOperationState::SKOperationState *opStates,
+                               SKFailureCause::SKFailureCause *causes, SKVal **pvals) {
+	try {
+		uint64_t	t1;
+
+		t1 = curTimeMicros();
+		e.getKeyResults(*requestGroup, opStates, causes, pvals);
+		lh_record(LH_JNI_CONVERSION, curTimeMicros() - t1);
+	} catch (std::exception & e2) {
+		int	i;
+		
+		srfsLog(LOG_WARNING, "ar dhtErr getKeyResults at %s:%d\n%s\n", __FILE__, __LINE__, e2.what()); 
+		for (i = 0; i < numRequests; i++) {
+			opStates[i] = SKOperationState::FAILED;
+			if (causes != NULL) {
+				causes[i] = SKFailureCause::ERROR;
+			}
+			pvals[i] = NULL;
+		}
+	}
+}
+
 static void ar_process_dht_batch(void **requests, int numRequests, int curThreadIndex) {
 	SKOperationState::SKOperationState   dhtMgetErr;
 	AttrReader		*ar;
@@ -271,29 +410,37 @@ static void ar_process_dht_batch(void **requests, int numRequests, int curThread
     pValues = NULL;
     srfsLog(LOG_INFO, "got async nsp %s ", SKFS_ATTR_NS );
     try {
+        uint64_t    t1Micros;
+        uint64_t    t2Micros;
+
 	    t1 = curTimeMillis();
+        t1Micros = curTimeMicros();
 	    pValRetrieval = ar->ansp[curThreadIndex]->get(&requestGroup);
         pValRetrieval->waitForCompletion();
         t2 = curTimeMillis();
+        t2Micros = curTimeMicros();
         rts_add_sample(ar->rtsDHT, t2 - t1, numRequests);
+        lh_record(LH_DHT_MULTI_GET, t2Micros - t1Micros);
         dhtMgetErr = pValRetrieval->getState();
         srfsLog(LOG_FINE, "ar_process_dht_batch multi_get complete %d", dhtMgetErr);
         pValues = pValRetrieval->getValues();
+        lh_record(LH_JNI_CONVERSION, curTimeMicros() - t2Micros);
     } catch (SKRetrievalException & e) {
-		// The operation generated an exception. This is typically simply because
-		// values were not found for one or more keys.
-		// This could also, however, be caused by a true error.
+		// The operation generated an exception. As missing values are reported
+		// as null values (see ar_new), this indicates an error for one or more keys.
 		dhtMgetErr = SKOperationState::FAILED;
         //srfsLog(LOG_WARNING, e.getStackTrace().c_str() );
 		
-		// Go through the original requests and obtain the results
-			// FUTURE: probably should improve the efficiency of this approach.
-			// Can turn off the exception for not found.
+		// Go through the original requests and obtain the results in bulk
 			
-			// Also, this function contains a large amount of duplicative code for
+			// FUTURE: this function contains a large amount of duplicative code for
 			// the exception vs. non-exception case
 			// We should be able to make one pass over the values for either case
-			
+		SKOperationState::SKOperationState	opStates[numRequests];
+		SKFailureCause::SKFailureCause		causes[numRequests];
+		SKVal								*pvals[numRequests];
+		
+		ar_get_key_results(e, &requestGroup, numRequests, opStates, causes, pvals);
         for (int i = 0; i < numRequests; ++i){
             ActiveOp		*op;
             AttrReadRequest	*arr;
@@ -304,56 +451,48 @@ static void ar_process_dht_batch(void **requests, int numRequests, int curThread
             successful = FALSE;
             op = refs[i]->ao;
             arr = (AttrReadRequest *)ao_get_target(op);
-            SKOperationState::SKOperationState opState = e.getOperationState(arr->path);
+            SKOperationState::SKOperationState opState = opStates[i];
 
             if (opState == SKOperationState::SUCCEEDED) {
-                SKStoredValue   *pStoredVal;
-                
                 // these are successfully retrieved keys
-                pStoredVal = NULL; 
-				pStoredVal = e.getStoredValue(arr->path);
-				if (!pStoredVal) {
-					srfsLog(LOG_WARNING, "ar dhtErr no pStoredVal %s %d %d", arr->path, opState, __LINE__);
+				SKVal   *pval;
+                
+				pval = pvals[i];
+				pvals[i] = NULL;
+				if (!pval){
+					// missing values are reported as null values (see ar_new)
+					srfsLog(LOG_FINE, "ar no val %s %d %d", arr->path, opState, __LINE__);
 				} else {
-					SKVal   *pval;
+					if (pval->m_len == sizeof(FileAttr) ){
+                        uint64_t	attrTimeoutMillis;
                     
-					pval = NULL;
-					pval = pStoredVal->getValue();
-					if (!pval){
-						srfsLog(LOG_WARNING, "ar dhtErr no val %s %d %d", arr->path, opState, __LINE__);
-					} else {
-						if (pval->m_len == sizeof(FileAttr) ){
-                            uint64_t	attrTimeoutMillis;
-                        
-                            attrTimeoutMillis = is_writable_path(arr->path) ? ar->attrTimeoutMillis : CACHE_NO_TIMEOUT;
-							if (memcmp(pval->m_pVal, &_attr_does_not_exist, sizeof(FileAttr))) {
+                        attrTimeoutMillis = is_writable_path(arr->path) ? ar->attrTimeoutMillis : CACHE_NO_TIMEOUT;
+						if (memcmp(pval->m_pVal, &_attr_does_not_exist, sizeof(FileAttr))) {
 
-								// a normal data item, store in cache
-                                ao_set_complete(op, AOResult_Success, pval->m_pVal, sizeof(FileAttr));
-								ar_store_attr_in_cache(arr, (FileAttr *)pval->m_pVal, attrTimeoutMillis);
+							// a normal data item, store in cache
+                            ao_set_complete(op, AOResult_Success, pval->m_pVal, sizeof(FileAttr));
+							ar_store_attr_in_cache(arr, (FileAttr *)pval->m_pVal, attrTimeoutMillis);
+							successful = TRUE;
+						} else {
+							if (SRFS_ENABLE_DHT_ENOENT_CACHING) {
+								// non-existence, store as an error
+								srfsLog(LOG_FINE, "%s not found in DHT. Storing ENOENT. %s %d", arr->path, __FILE__, __LINE__);
+                                ao_set_complete_error(op, ENOENT);
+								ac_store_error(arr->attrReader->attrCache, arr->path, ENOENT, arr->minModificationTimeMicros, attrTimeoutMillis);
 								successful = TRUE;
 							} else {
-								if (SRFS_ENABLE_DHT_ENOENT_CACHING) {
-									// non-existence, store as an error
-									srfsLog(LOG_FINE, "%s not found in DHT. Storing ENOENT. %s %d", arr->path, __FILE__, __LINE__);
-                                    ao_set_complete_error(op, ENOENT);
-									ac_store_error(arr->attrReader->attrCache, arr->path, ENOENT, arr->minModificationTimeMicros, attrTimeoutMillis);
-									successful = TRUE;
-								} else {
-									srfsLog(LOG_FINE, "!SRFS_ENABLE_DHT_ENOENT_CACHING. Ignoring ENOENT found in DHT.");
-								}
+								srfsLog(LOG_FINE, "!SRFS_ENABLE_DHT_ENOENT_CACHING. Ignoring ENOENT found in DHT.");
 							}
-						} else {
-							srfsLog(LOG_WARNING, "val->size() != sizeof(FileAttr) %s %d", __FILE__, __LINE__);
-							pval = NULL; // temp workaround the problem - FUTURE improve
 						}
+					} else {
+						srfsLog(LOG_WARNING, "val->size() != sizeof(FileAttr) %s %d", __FILE__, __LINE__);
+						pval = NULL; // temp workaround the problem - FUTURE improve
 					}
-					if (pval != NULL) {
-                        // No need to check for duplicates here as this value
-                        // is created from SKRetrievalException on each iteration
-						sk_destroy_val(&pval);
-					}
-					delete pStoredVal;
+				}
+				if (pval != NULL) {
+                    // No need to check for duplicates here as this value
+                    // is converted separately for each key
+					sk_destroy_val(&pval);
 				}
             } else if (opState == SKOperationState::INCOMPLETE){
                 sd_op_failed(ar->sd, opState, __FILE__, __LINE__);
@@ -363,17 +502,7 @@ static void ar_process_dht_batch(void **requests, int numRequests, int curThread
                 errorCode = EIO;
             } else /*(opState == SKOperationState::FAILED) */ {
 				// these keys are failed with cause
-				SKFailureCause::SKFailureCause cause = SKFailureCause::ERROR;
-				try {
-					cause = e.getFailureCause(arr->path);
-				} catch(SKClientException & e2) { 
-					srfsLog(LOG_WARNING, "ar dhtErr getFailureCause at %s:%d\n%s\n", __FILE__, __LINE__, e2.what()); 
-					sd_op_failed(ar->sd, opState, __FILE__, __LINE__);
-				} catch(std::exception& e2) { 
-					//should this be fatal error?
-					srfsLog(LOG_WARNING, "ar dhtErr getFailureCause at %s:%d\n%s\n", __FILE__, __LINE__, e2.what()); 
-					sd_op_failed(ar->sd, opState, __FILE__, __LINE__);
-				}
+				SKFailureCause::SKFailureCause cause = causes[i];
 				
 				if (cause == SKFailureCause::NO_SUCH_VALUE) { 
 					srfsLog(LOG_FINE, "ar dhtErr %s %d %d %d/%d line %d", arr->path, opState, cause, i, numRequests, __LINE__);
@@ -398,11 +527,17 @@ static void ar_process_dht_batch(void **requests, int numRequests, int curThread
                     if (errorCode == 0) {
                         errorCode = ENOENT;
                     }
+                    if (errorCode == ENOENT) {
+                        ar_store_negative(arr);
+                    }
                     ac_remove_active_op(arr->attrReader->attrCache, arr->path);
                     ao_set_complete_error(op, errorCode);
                     //ac_store_error(arr->attrReader->attrCache, arr->path, errorCode, ar->attrTimeoutMillis);
 				}
             }
+			if (pvals[i] != NULL) {
+				sk_destroy_val(&pvals[i]);
+			}
             aor_delete(&refs[i]);
 		}
 
@@ -545,6 +680,9 @@ static void ar_process_dht_batch(void **requests, int numRequests, int curThread
                         if (errorCode == 0) {
                             errorCode = ENOENT;
                         }
+                        if (errorCode == ENOENT) {
+                            ar_store_negative(arr);
+                        }
                         
                         ac_remove_active_op(arr->attrReader->attrCache, arr->path);
                         ao_set_complete_error(op, errorCode);
@@ -810,6 +948,7 @@ ActiveOp *ar_create_active_op(void *_ar, void *_nativePath, uint64_t minModifica
 	nativePath = (char *)_nativePath;
 	srfsLog(LOG_FINE, "ar_create_active_op %s", nativePath);
 	attrReadRequest = arr_new(ar, nativePath, minModificationTimeMicros);
+	attrReadRequest->negativeDirEpoch = ac_negative_epoch(ar->attrCache, nativePath);
 	arr_display(attrReadRequest, LOG_FINE);
 	op = ao_new(attrReadRequest, (void (*)(void **))arr_delete);
 	return op;
@@ -995,6 +1134,7 @@ static int _ar_get_attr(AttrReader *ar, char *path, FileAttr *fa, int isNativePa
     AOResult        aoResult;
 	ActiveOpRef		*activeOpRef;
 	int				returnCode;
+	uint64_t		cacheT1;
 	
     aoResult = AOResult_Incomplete;
 	returnCode = 0;
@@ -1003,8 +1143,20 @@ static int _ar_get_attr(AttrReader *ar, char *path, FileAttr *fa, int isNativePa
 	// Look in the AttrCache for an existing operation
 	// Create a new operation if none exists
 
+	if (minModificationTimeMicros == 0 && ac_negative_read(ar->attrCache, nativePath)) {
+		srfsLog(LOG_FINE, "negative cache hit %s", nativePath);
+		rs_cache_inc(ar->rs);
+		return ENOENT;
+	}
+	if (!isNativePath && minModificationTimeMicros == 0 && ar_parent_lacks_child(ar, nativePath)) {
+		srfsLog(LOG_FINE, "parent DirData lacks %s", nativePath);
+		rs_dirData_inc(ar->rs);
+		return ENOENT;
+	}
 	srfsLog(LOG_FINE, "looking in cache for %s", nativePath);
+	cacheT1 = curTimeMicros();
 	result = ac_read(ar->attrCache, nativePath, fa, &activeOpRef, ar, minModificationTimeMicros);
+	lh_record(LH_CACHE_LOOKUP, curTimeMicros() - cacheT1);
 	srfsLog(LOG_FINE, "cache result %d %s", result, crr_strings[result]);
 	if (result == CRR_FOUND && !memcmp(fa, &_attr_does_not_exist, sizeof(FileAttr))) {
 		if (SRFS_ENABLE_DHT_ENOENT_CACHING) {
@@ -1205,70 +1357,67 @@ static void ar_process_prefetch(void **requests, int numRequests, int curThreadI
         srfsLog(LOG_FINE, "ar_process_prefetch multi_get complete %d", dhtMgetErr);
         pValues = pValRetrieval->getValues();
     } catch (SKRetrievalException & e) {
-		// The operation generated an exception. This is typically simply because
-		// values were not found for one or more keys.
-		// This could also, however, be caused by a true error.
+		// The operation generated an exception. As missing values are reported
+		// as null values (see ar_new), this indicates an error for one or more keys.
 		dhtMgetErr = SKOperationState::FAILED;
         //srfsLog(LOG_WARNING, e.getStackTrace().c_str() );
 		
-		// Go through the original requests and obtain the results
-			// FUTURE: probably should improve the efficiency of this approach.
-			// Can turn off the exception for not found.
+		// Go through the original requests and obtain the results in bulk
 			
-			// Also, this function contains a large amount of duplicative code for
+			// FUTURE: this function contains a large amount of duplicative code for
 			// the exception vs. non-exception case
 			// We should be able to make one pass over the values for either case
-			
+		SKOperationState::SKOperationState	opStates[numRequests];
+		SKVal								*pvals[numRequests];
+		
+		ar_get_key_results(e, &requestGroup, numRequests, opStates, NULL, pvals);
         for (int i = 0; i < numRequests; ++i){
             int		successful;
 			char	*path;
 			
             successful = FALSE;
             path = paths[i];
-            SKOperationState::SKOperationState opState = e.getOperationState(path);
+            SKOperationState::SKOperationState opState = opStates[i];
 
 			srfsLog(LOG_FINE, "a: prefetch %s %d", path, opState);
             if (opState == SKOperationState::SUCCEEDED) {
                 // these are successfully retrieved keys
-                SKStoredValue *pStoredVal = NULL; 
-				pStoredVal = e.getStoredValue(path);
-				if (!pStoredVal) {
-					srfsLog(LOG_WARNING, "ar dhtErr no pStoredVal %s %d %d", path, opState, __LINE__);
+				SKVal *pval = pvals[i];
+				
+				pvals[i] = NULL;
+				if (!pval){
+					srfsLog(LOG_FINE, "ar no val %s %d %d", path, opState, __LINE__);
 				} else {
-					SKVal *pval = NULL;
-					pval = pStoredVal->getValue();
-					if (!pval){
-						srfsLog(LOG_WARNING, "ar dhtErr no val %s %d %d", path, opState, __LINE__);
-					} else {
-						if (pval->m_len == sizeof(FileAttr) ){
-							if (memcmp(pval->m_pVal, &_attr_does_not_exist, sizeof(FileAttr))) {
-								uint64_t	attrTimeoutMillis;
-                                uint64_t    modificationTimeMicros;
-							
-								attrTimeoutMillis = is_writable_path(path) ? ar->attrTimeoutMillis : CACHE_NO_TIMEOUT;
-                                modificationTimeMicros = is_writable_path(path) ? stat_mtime_micros( &((FileAttr *)pval->m_pVal)->stat ) : CACHE_NO_MODIFICATION_TIME;
-
-								// a normal data item, store in cache
-								ar_store_attr_in_cache_static(path, (FileAttr *)pval->m_pVal, FALSE, modificationTimeMicros, attrTimeoutMillis);
-								successful = TRUE;
-							} else {
-								// ignore not found when prefetching
-							}
+					if (pval->m_len == sizeof(FileAttr) ){
+						if (memcmp(pval->m_pVal, &_attr_does_not_exist, sizeof(FileAttr))) {
+							uint64_t	attrTimeoutMillis;
+                            uint64_t    modificationTimeMicros;
+						
+							attrTimeoutMillis = is_writable_path(path) ? ar->attrTimeoutMillis : CACHE_NO_TIMEOUT;
+                            modificationTimeMicros = is_writable_path(path) ? stat_mtime_micros( &((FileAttr *)pval->m_pVal)->stat ) : CACHE_NO_MODIFICATION_TIME;
+
+							// a normal data item, store in cache
+							ar_store_attr_in_cache_static(path, (FileAttr *)pval->m_pVal, FALSE, modificationTimeMicros, attrTimeoutMillis);
+							successful = TRUE;
 						} else {
-							srfsLog(LOG_WARNING, "val->size() != sizeof(FileAttr) %s %d", __FILE__, __LINE__);
-							pval = NULL; // FIXME - temp workaround the problem
+							// ignore not found when prefetching
 						}
+					} else {
+						srfsLog(LOG_WARNING, "val->size() != sizeof(FileAttr) %s %d", __FILE__, __LINE__);
+						pval = NULL; // FIXME - temp workaround the problem
 					}
-					if (pval != NULL) {
-						sk_destroy_val(&pval);
-					}
-					delete pStoredVal;
+				}
+				if (pval != NULL) {
+					sk_destroy_val(&pval);
 				}
             } else if (opState == SKOperationState::INCOMPLETE){
 				// ignore this failure for prefetch
             } else {
 				// ignore this failure for prefetch
             }
+			if (pvals[i] != NULL) {
+				sk_destroy_val(&pvals[i]);
+			}
 			mem_free((void **)&paths[i]);
 		}
 		pValRetrieval->close();
@@ -1371,6 +1520,7 @@ void ar_prefetch(AttrReader *ar, char *parent, char *child) {
 void ar_display_stats(AttrReader *ar, int detailedStats) {
 	srfsLog(LOG_WARNING, "AttrReader Stats");
 	rs_display(ar->rs);
+	ac_display_negative_stats(ar->attrCache);
 	if (detailedStats) {
 		ac_display_stats(ar->attrCache);
 	}
@@ -27,6 +27,13 @@
 struct OpenDirTable;
 
 
+////////////
+// defines
+
+#define AR_MAX_NEGATIVE_CACHE_GROUPS	16
+#define AR_NEGATIVE_CACHE_GROUP_DELIMITER	'+'
+
+
 //////////
 // types
 
@@ -54,6 +61,12 @@ typedef struct AttrReader {
 	ResponseTimeStats	*rtsNFS;
 	ReaderStats	*rs;
 	G2TaskOutputReader	*g2tor;
+	uint64_t	negativeCacheTimeoutMillis;
+	int			numNegativeCacheGroups;
+	PathGroup	*negativeCacheGroups[AR_MAX_NEGATIVE_CACHE_GROUPS];
+	uint64_t	negativeCacheGroupTimeoutMillis[AR_MAX_NEGATIVE_CACHE_GROUPS];
+	struct OpenDirTable	*odt;
+	uint64_t	dirDataFreshnessMillis;
 } AttrReader;
 
 
@@ -68,8 +81,10 @@ void ar_set_g2tor(AttrReader *ar, G2TaskOutputReader *g2tor);
 void ar_parse_no_error_cache_paths(AttrReader *ar, char *paths);
 void ar_parse_no_link_cache_paths(AttrReader *ar, char *paths);
 void ar_parse_snapshot_only_paths(AttrReader *ar, char *paths);
+void ar_set_negative_cache(AttrReader *ar, int size, uint64_t timeoutMillis, char *groupTimeouts);
 void ar_parse_native_aliases(AttrReader *ar, char *nfsMapping);
 void ar_create_alias_dirs(AttrReader *ar, OpenDirTable *odt);
+void ar_set_open_dir_table(AttrReader *ar, OpenDirTable *odt, uint64_t dirDataFreshnessMillis);
 void ar_store_dir_attribs(AttrReader *ar, char *path, uint16_t mode = 0755);
 int ar_get_attr_stat(AttrReader *ar, char *path, struct stat *st);
 int ar_get_attr(AttrReader *ar, char *path, FileAttr *fa, uint64_t minModificationTimeMicros = 0);
@@ -0,0 +1,674 @@
+// BinaryLog.c
+
+/////////////
+// includes
+
+#include "BinaryLog.h"
+#include "Util.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/uio.h>
+#include <time.h>
+#include <unistd.h>
+
+
+////////////////////
+// private defines
+
+#define _BL_RECORD_PAD	1
+#define _BL_RECORD_ARGS	2
+#define _BL_RECORD_FORMATTED	3
+#define _BL_ALIGN(x)	(((x) + 7) & ~((size_t)7))
+#define _BL_OUT_SIZE	(256 * 1024)
+#define _BL_MAX_IOV	64
+#define _BL_MAX_SPEC	64
+
+// argument types, as captured from the format's conversion specifiers
+#define _BL_ARG_INT	'i'
+#define _BL_ARG_UINT	'u'
+#define _BL_ARG_LONG	'l'
+#define _BL_ARG_ULONG	'L'
+#define _BL_ARG_LONGLONG	'q'
+#define _BL_ARG_ULONGLONG	'Q'
+#define _BL_ARG_DOUBLE	'f'
+#define _BL_ARG_POINTER	'p'
+#define _BL_ARG_STRING	's'
+
+
+//////////
+// types
+
+// size and flags come first so that a pad marker needs only 8 bytes
+typedef struct BLRecordHeader {
+	uint32_t	size;
+	uint32_t	flags;
+	uint64_t	timeNanos;
+	const char	*format;
+	uint32_t	threadTag;
+	uint32_t	numArgs;
+} BLRecordHeader;
+
+typedef struct BLOutput {
+	char	buf[_BL_OUT_SIZE];
+	size_t	used;
+	struct iovec	iov[_BL_MAX_IOV];
+	int		numIOV;
+	char	*segmentStart;
+	time_t	cachedSecond;
+	struct tm	cachedTM;
+} BLOutput;
+
+
+///////////////////////
+// private prototypes
+
+static void bl_create_ring_key();
+static void bl_retire_ring(void *ring);
+static BLRing *bl_get_ring();
+static void bl_unlink_ring(BLRing *ring, BLRing *prev);
+static int bl_parse_format(const char *format, char *types);
+static int bl_write_record(BLRing *ring, uint32_t flags, const char *format, const char *types, int numArgs, va_list ap);
+static int bl_log_formatted(BLRing *ring, const char *format, va_list ap);
+static void bl_format_record(BLOutput *out, const BLRecordHeader *header);
+static void bl_output_end_segment(BLOutput *out);
+static void bl_output_write(BLOutput *out);
+static int bl_drain();
+static void *bl_writer_run(void *arg);
+
+
+/////////////////
+// private data
+
+static BLRing	*blRings;
+static __thread BLRing	*blThreadRing;
+static pthread_key_t	blRingKey;
+static pthread_once_t	blRingKeyOnce = PTHREAD_ONCE_INIT;
+// counts of freed rings; blDrainLock must be held
+static uint64_t	blRetiredRecords;
+static uint64_t	blRetiredDropped;
+static volatile int	blFD = -1;
+static pthread_t	blWriterThread;
+static int	blWriterStarted;
+// held by whichever thread is draining: the writer, or a flushing thread
+static pthread_mutex_t	blDrainLock = PTHREAD_MUTEX_INITIALIZER;
+static BLOutput	blOutput;
+
+
+///////////////////
+// implementation
+
+void bl_start(int fd) {
+	bl_set_fd(fd);
+	if (!blWriterStarted) {
+		blWriterStarted = TRUE;
+		if (pthread_create(&blWriterThread, NULL, bl_writer_run, NULL)) {
+			fatalError("pthread_create failed", __FILE__, __LINE__);
+		}
+	}
+}
+
+// Records already published are written to the previous fd before the
+// swap, so the caller may close it once this returns.
+void bl_set_fd(int fd) {
+	pthread_mutex_lock(&blDrainLock);
+	if (blFD >= 0) {
+		bl_drain();
+	}
+	blFD = fd;
+	pthread_mutex_unlock(&blDrainLock);
+}
+
+static void bl_create_ring_key() {
+	if (pthread_key_create(&blRingKey, bl_retire_ring) != 0) {
+		fatalError("pthread_key_create failed", __FILE__, __LINE__);
+	}
+}
+
+// pthread_key destructor; runs on the owning thread as it exits
+static void bl_retire_ring(void *ring) {
+	// later logging from other destructors gets a fresh ring
+	blThreadRing = NULL;
+	// publishes the ring's final tail to the writer
+	__atomic_store_n(&((BLRing *)ring)->retired, TRUE, __ATOMIC_RELEASE);
+}
+
+static BLRing *bl_get_ring() {
+	BLRing	*ring;
+
+	ring = blThreadRing;
+	if (ring == NULL) {
+		pthread_once(&blRingKeyOnce, bl_create_ring_key);
+		ring = (BLRing *)mem_alloc(1, sizeof(BLRing));
+		ring->threadTag = (unsigned int)pthread_self() & 0xffff;
+		ring->next = __atomic_load_n(&blRings, __ATOMIC_RELAXED);
+		while (!__atomic_compare_exchange_n(&blRings, &ring->next, ring, FALSE, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+		}
+		blThreadRing = ring;
+		pthread_setspecific(blRingKey, ring);
+	}
+	return ring;
+}
+
+// Logging threads only ever push onto the head of blRings, so only the
+// head needs a CAS; other links belong to the writer.
+// blDrainLock must be held
+static void bl_unlink_ring(BLRing *ring, BLRing *prev) {
+	if (prev == NULL) {
+		BLRing	*head;
+
+		head = ring;
+		if (__atomic_compare_exchange_n(&blRings, &head, ring->next, FALSE, __ATOMIC_RELEASE, __ATOMIC_ACQUIRE)) {
+			return;
+		}
+		// rings were pushed since the drain began; ring is no longer the head
+		for (prev = head; prev->next != ring; prev = prev->next) {
+		}
+	}
+	prev->next = ring->next;
+}
+
+// Returns the number of arguments that the format consumes, with their
+// types in types[], or -1 if the format uses a conversion that is not
+// captured (e.g. %n or %Lf) or has too many arguments.
+static int bl_parse_format(const char *format, char *types) {
+	const char	*p;
+	int	numArgs;
+
+	numArgs = 0;
+	for (p = format; *p != '\0'; p++) {
+		int	longs;
+
+		if (*p != '%') {
+			continue;
+		}
+		p++;
+		if (*p == '%') {
+			continue;
+		}
+		while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {
+			p++;
+		}
+		// width and precision; '*' consumes an int
+		while (*p != '\0' && (strchr("0123456789.", *p) != NULL || *p == '*')) {
+			if (*p == '*') {
+				if (numArgs >= BL_MAX_ARGS) {
+					return -1;
+				}
+				types[numArgs++] = _BL_ARG_INT;
+			}
+			p++;
+		}
+		longs = 0;
+		while (*p != '\0' && strchr("hlzjt", *p) != NULL) {
+			if (*p == 'l') {
+				longs++;
+			} else if (*p == 'z' || *p == 'j' || *p == 't') {
+				longs = 2;
+			}
+			p++;
+		}
+		if (numArgs >= BL_MAX_ARGS) {
+			return -1;
+		}
+		switch (*p) {
+		case 'd':
+		case 'i':
+		case 'c':
+			types[numArgs++] = longs == 0 ? _BL_ARG_INT : (longs == 1 ? _BL_ARG_LONG : _BL_ARG_LONGLONG);
+			break;
+		case 'u':
+		case 'x':
+		case 'X':
+		case 'o':
+			types[numArgs++] = longs == 0 ? _BL_ARG_UINT : (longs == 1 ? _BL_ARG_ULONG : _BL_ARG_ULONGLONG);
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			types[numArgs++] = _BL_ARG_DOUBLE;
+			break;
+		case 'p':
+			types[numArgs++] = _BL_ARG_POINTER;
+			break;
+		case 's':
+			if (longs != 0) {
+				return -1;
+			}
+			types[numArgs++] = _BL_ARG_STRING;
+			break;
+		default:
+			return -1;
+		}
+	}
+	return numArgs;
+}
+
+// Reserves size bytes of contiguous space, padding to the start of the
+// ring if necessary. Returns NULL if the ring is too full.
+static unsigned char *bl_reserve(BLRing *ring, size_t size) {
+	uint64_t	head;
+	uint64_t	tail;
+	size_t	offset;
+	size_t	contiguous;
+	size_t	needed;
+
+	head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+	tail = ring->tail;
+	offset = tail % BL_RING_SIZE;
+	contiguous = BL_RING_SIZE - offset;
+	needed = size <= contiguous ? size : contiguous + size;
+	if (needed > BL_RING_SIZE - (tail - head)) {
+		return NULL;
+	}
+	if (size > contiguous) {
+		uint32_t	*pad;
+
+		pad = (uint32_t *)(ring->data + offset);
+		pad[0] = (uint32_t)contiguous;
+		pad[1] = _BL_RECORD_PAD;
+		// a pad is a complete record, so it may be published on its own
+		__atomic_store_n(&ring->tail, tail + contiguous, __ATOMIC_RELEASE);
+		return ring->data;
+	}
+	return ring->data + offset;
+}
+
+static void bl_publish(BLRing *ring, size_t size) {
+	__atomic_store_n(&ring->tail, ring->tail + size, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->records, ring->records + 1, __ATOMIC_RELAXED);
+}
+
+static void bl_drop(BLRing *ring) {
+	__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+}
+
+static void bl_fill_header(BLRecordHeader *header, size_t size, uint32_t flags, const char *format, int numArgs, unsigned int threadTag) {
+	struct timespec	ts;
+
+	clock_gettime(CLOCK_REALTIME, &ts);
+	header->size = (uint32_t)size;
+	header->flags = flags;
+	header->timeNanos = (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+	header->format = format;
+	header->threadTag = threadTag;
+	header->numArgs = numArgs;
+}
+
+static int bl_write_record(BLRing *ring, uint32_t flags, const char *format, const char *types, int numArgs, va_list ap) {
+	size_t	stringLengths[BL_MAX_ARGS];
+	const char	*strings[BL_MAX_ARGS];
+	uint64_t	values[BL_MAX_ARGS];
+	size_t	size;
+	unsigned char	*record;
+	unsigned char	*p;
+	int	i;
+
+	// capture arguments first; only then is the record size known
+	size = sizeof(BLRecordHeader);
+	for (i = 0; i < numArgs; i++) {
+		strings[i] = NULL;
+		switch (types[i]) {
+		case _BL_ARG_INT: values[i] = (uint64_t)(int64_t)va_arg(ap, int); break;
+		case _BL_ARG_UINT: values[i] = va_arg(ap, unsigned int); break;
+		case _BL_ARG_LONG: values[i] = (uint64_t)va_arg(ap, long); break;
+		case _BL_ARG_ULONG: values[i] = va_arg(ap, unsigned long); break;
+		case _BL_ARG_LONGLONG: values[i] = (uint64_t)va_arg(ap, long long); break;
+		case _BL_ARG_ULONGLONG: values[i] = va_arg(ap, unsigned long long); break;
+		case _BL_ARG_DOUBLE:
+			{
+				double	d;
+
+				d = va_arg(ap, double);
+				memcpy(&values[i], &d, sizeof(d));
+			}
+			break;
+		case _BL_ARG_POINTER: values[i] = (uint64_t)(uintptr_t)va_arg(ap, void *); break;
+		case _BL_ARG_STRING:
+			strings[i] = va_arg(ap, const char *);
+			if (strings[i] == NULL) {
+				strings[i] = "(null)";
+			}
+			stringLengths[i] = strnlen(strings[i], BL_MAX_STRING_ARG);
+			size += sizeof(uint64_t) + _BL_ALIGN(stringLengths[i]);
+			continue;
+		default: fatalError("panic", __FILE__, __LINE__);
+		}
+		size += sizeof(uint64_t);
+	}
+	record = bl_reserve(ring, size);
+	if (record == NULL) {
+		bl_drop(ring);
+		return FALSE;
+	}
+	bl_fill_header((BLRecordHeader *)record, size, flags, format, numArgs, ring->threadTag);
+	p = record + sizeof(BLRecordHeader);
+	for (i = 0; i < numArgs; i++) {
+		if (strings[i] != NULL) {
+			*(uint64_t *)p = stringLengths[i];
+			p += sizeof(uint64_t);
+			memcpy(p, strings[i], stringLengths[i]);
+			p += _BL_ALIGN(stringLengths[i]);
+		} else {
+			*(uint64_t *)p = values[i];
+			p += sizeof(uint64_t);
+		}
+	}
+	bl_publish(ring, size);
+	return TRUE;
+}
+
+// Fallback for formats whose arguments are not captured: format now and
+// store the text.
+static int bl_log_formatted(BLRing *ring, const char *format, va_list ap) {
+	char	text[BL_MAX_STRING_ARG];
+	size_t	length;
+	size_t	size;
+	unsigned char	*record;
+
+	if (vsnprintf(text, sizeof(text), format, ap) < 0) {
+		return FALSE;
+	}
+	length = strnlen(text, sizeof(text));
+	size = sizeof(BLRecordHeader) + sizeof(uint64_t) + _BL_ALIGN(length);
+	record = bl_reserve(ring, size);
+	if (record == NULL) {
+		bl_drop(ring);
+		return FALSE;
+	}
+	bl_fill_header((BLRecordHeader *)record, size, _BL_RECORD_FORMATTED, "%s", 1, ring->threadTag);
+	*(uint64_t *)(record + sizeof(BLRecordHeader)) = length;
+	memcpy(record + sizeof(BLRecordHeader) + sizeof(uint64_t), text, length);
+	bl_publish(ring, size);
+	return TRUE;
+}
+
+// format must have static storage duration; only its address is recorded
+int bl_log(const char *format, va_list ap) {
+	BLRing	*ring;
+	char	types[BL_MAX_ARGS];
+	int	numArgs;
+
+	ring = bl_get_ring();
+	numArgs = bl_parse_format(format, types);
+	if (numArgs < 0) {
+		return bl_log_formatted(ring, format, ap);
+	} else {
+		return bl_write_record(ring, _BL_RECORD_ARGS, format, types, numArgs, ap);
+	}
+}
+
+static void bl_output_append(BLOutput *out, int length) {
+	if (length > 0) {
+		out->used += int_min(length, (int)(_BL_OUT_SIZE - out->used - 1));
+	}
+}
+
+// Formats one record by handing each conversion specifier its captured
+// argument; the prefix matches that of srfsLog().
+static void bl_format_record(BLOutput *out, const BLRecordHeader *header) {
+	const unsigned char	*arg;
+	const char	*p;
+	time_t	second;
+	uint32_t	i;
+	char	*end;
+
+	end = out->buf + _BL_OUT_SIZE - 1;
+	second = (time_t)(header->timeNanos / 1000000000ULL);
+	if (second != out->cachedSecond) {
+		localtime_r(&second, &out->cachedTM);
+		out->cachedSecond = second;
+	}
+	bl_output_append(out, snprintf(out->buf + out->used, end - (out->buf + out->used), "%02u %02u:%02u:%02u.%06lu %4x ",
+		out->cachedTM.tm_mday, out->cachedTM.tm_hour, out->cachedTM.tm_min, out->cachedTM.tm_sec,
+		(unsigned long)(header->timeNanos % 1000000000ULL) / 1000, header->threadTag));
+	arg = (const unsigned char *)(header + 1);
+	i = 0;
+	p = header->format;
+	while (*p != '\0' && out->buf + out->used < end) {
+		char	spec[_BL_MAX_SPEC];
+		int	stars[2];
+		int	numStars;
+		int	longs;
+		int	specLength;
+		const char	*specStart;
+		char	*dst;
+		size_t	avail;
+		uint64_t	value;
+		int	length;
+
+		if (*p != '%' || p[1] == '%') {
+			out->buf[out->used++] = *p;
+			p += *p == '%' ? 2 : 1;
+			continue;
+		}
+		specStart = p++;
+		numStars = 0;
+		longs = 0;
+		while (*p != '\0' && strchr("-+ #0'0123456789.*hlzjt", *p) != NULL) {
+			if (*p == '*' && numStars < 2 && i < header->numArgs) {
+				stars[numStars++] = (int)*(const uint64_t *)arg;
+				arg += sizeof(uint64_t);
+				i++;
+			} else if (*p == 'l' || *p == 'z' || *p == 'j' || *p == 't') {
+				longs++;
+			}
+			p++;
+		}
+		if (*p == '\0' || i >= header->numArgs) {
+			break;
+		}
+		p++;
+		specLength = int_min((int)(p - specStart), _BL_MAX_SPEC - 1);
+		memcpy(spec, specStart, specLength);
+		spec[specLength] = '\0';
+		dst = out->buf + out->used;
+		avail = end - dst;
+		value = *(const uint64_t *)arg;
+		arg += sizeof(uint64_t);
+		i++;
+		switch (p[-1]) {
+		case 's':
+			{
+				char	s[BL_MAX_STRING_ARG + 1];
+
+				memcpy(s, arg, value);
+				s[value] = '\0';
+				arg += _BL_ALIGN(value);
+				if (numStars == 0) {
+					length = snprintf(dst, avail, spec, s);
+				} else if (numStars == 1) {
+					length = snprintf(dst, avail, spec, stars[0], s);
+				} else {
+					length = snprintf(dst, avail, spec, stars[0], stars[1], s);
+				}
+			}
+			break;
+		case 'f': case 'F': case 'e': case 'E': case 'g': case 'G': case 'a': case 'A':
+			{
+				double	d;
+
+				memcpy(&d, &value, sizeof(d));
+				if (numStars == 0) {
+					length = snprintf(dst, avail, spec, d);
+				} else if (numStars == 1) {
+					length = snprintf(dst, avail, spec, stars[0], d);
+				} else {
+					length = snprintf(dst, avail, spec, stars[0], stars[1], d);
+				}
+			}
+			break;
+		case 'p':
+			length = snprintf(dst, avail, spec, (void *)(uintptr_t)value);
+			break;
+		default:
+			// pass integers at the width that the conversion expects
+			if (longs > 0) {
+				if (numStars == 0) {
+					length = snprintf(dst, avail, spec, (unsigned long long)value);
+				} else if (numStars == 1) {
+					length = snprintf(dst, avail, spec, stars[0], (unsigned long long)value);
+				} else {
+					length = snprintf(dst, avail, spec, stars[0], stars[1], (unsigned long long)value);
+				}
+			} else {
+				if (numStars == 0) {
+					length = snprintf(dst, avail, spec, (unsigned int)value);
+				} else if (numStars == 1) {
+					length = snprintf(dst, avail, spec, stars[0], (unsigned int)value);
+				} else {
+					length = snprintf(dst, avail, spec, stars[0], stars[1], (unsigned int)value);
+				}
+			}
+			break;
+		}
+		bl_output_append(out, length);
+	}
+	out->buf[out->used++] = '\n';
+}
+
+static void bl_output_end_segment(BLOutput *out) {
+	char	*segmentEnd;
+
+	segmentEnd = out->buf + out->used;
+	if (segmentEnd > out->segmentStart) {
+		out->iov[out->numIOV].iov_base = out->segmentStart;
+		out->iov[out->numIOV].iov_len = segmentEnd - out->segmentStart;
+		out->numIOV++;
+	}
+	out->segmentStart = segmentEnd;
+	if (out->numIOV == _BL_MAX_IOV) {
+		bl_output_write(out);
+	}
+}
+
+static void bl_output_write(BLOutput *out) {
+	int	iovIndex;
+	int	fd;
+
+	fd = blFD;
+	iovIndex = 0;
+	while (iovIndex < out->numIOV && fd >= 0) {
+		ssize_t	written;
+
+		written = writev(fd, out->iov + iovIndex, out->numIOV - iovIndex);
+		if (written < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			break;
+		}
+		while (iovIndex < out->numIOV && (size_t)written >= out->iov[iovIndex].iov_len) {
+			written -= out->iov[iovIndex].iov_len;
+			iovIndex++;
+		}
+		if (iovIndex < out->numIOV) {
+			out->iov[iovIndex].iov_base = (char *)out->iov[iovIndex].iov_base + written;
+			out->iov[iovIndex].iov_len -= written;
+		}
+	}
+	out->used = 0;
+	out->numIOV = 0;
+	out->segmentStart = out->buf;
+}
+
+// Formats everything published so far; one iovec per ring per pass.
+// Returns the number of records formatted. blDrainLock must be held.
+static int bl_drain() {
+	BLOutput	*out;
+	BLRing	*ring;
+	BLRing	*prev;
+	BLRing	*next;
+	int	numRecords;
+
+	out = &blOutput;
+	out->segmentStart = out->buf + out->used;
+	numRecords = 0;
+	prev = NULL;
+	for (ring = __atomic_load_n(&blRings, __ATOMIC_ACQUIRE); ring != NULL; ring = next) {
+		uint64_t	head;
+		uint64_t	tail;
+		uint64_t	dropped;
+		int	retired;
+
+		next = ring->next;
+		// read before the tail so that a retired ring is drained completely
+		retired = __atomic_load_n(&ring->retired, __ATOMIC_ACQUIRE);
+		head = ring->head;
+		tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+		while (head < tail) {
+			const BLRecordHeader	*header;
+
+			header = (const BLRecordHeader *)(ring->data + head % BL_RING_SIZE);
+			if (header->flags != _BL_RECORD_PAD) {
+				if (_BL_OUT_SIZE - out->used < BL_MAX_LINE) {
+					bl_output_end_segment(out);
+					bl_output_write(out);
+				}
+				bl_format_record(out, header);
+				numRecords++;
+			}
+			head += header->size;
+		}
+		__atomic_store_n(&ring->head, head, __ATOMIC_RELEASE);
+		dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+		if (dropped != ring->droppedReported) {
+			bl_output_append(out, snprintf(out->buf + out->used, _BL_OUT_SIZE - out->used,
+				"%4x dropped %lu log records\n", ring->threadTag, dropped - ring->droppedReported));
+			ring->droppedReported = dropped;
+		}
+		bl_output_end_segment(out);
+		if (retired) {
+			// records have been copied into the output, which never points into a ring
+			bl_unlink_ring(ring, prev);
+			blRetiredRecords += ring->records;
+			blRetiredDropped += dropped;
+			mem_free((void **)&ring);
+		} else {
+			prev = ring;
+		}
+	}
+	bl_output_write(out);
+	return numRecords;
+}
+
+static void *bl_writer_run(void *arg) {
+	while (TRUE) {
+		int	numRecords;
+
+		pthread_mutex_lock(&blDrainLock);
+		numRecords = bl_drain();
+		pthread_mutex_unlock(&blDrainLock);
+		if (numRecords == 0) {
+			usleep(BL_WRITER_SLEEP_MICROS);
+		}
+	}
+	return NULL;
+}
+
+void bl_flush() {
+	pthread_mutex_lock(&blDrainLock);
+	bl_drain();
+	pthread_mutex_unlock(&blDrainLock);
+}
+
+void bl_get_stats(uint64_t *records, uint64_t *dropped) {
+	BLRing	*ring;
+
+	// retired rings are freed under blDrainLock
+	pthread_mutex_lock(&blDrainLock);
+	*records = blRetiredRecords;
+	*dropped = blRetiredDropped;
+	for (ring = __atomic_load_n(&blRings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+		*records += __atomic_load_n(&ring->records, __ATOMIC_RELAXED);
+		*dropped += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	}
+	pthread_mutex_unlock(&blDrainLock);
+}
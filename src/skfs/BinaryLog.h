@@ -0,0 +1,55 @@
+// BinaryLog.h
+
+#ifndef _BINARY_LOG_H_
+#define _BINARY_LOG_H_
+
+/////////////
+// includes
+
+#include <stdarg.h>
+#include <stdint.h>
+
+
+////////////
+// defines
+
+#define BL_RING_SIZE	(64 * 1024)
+#define BL_MAX_ARGS	16
+#define BL_MAX_STRING_ARG	2048
+#define BL_MAX_LINE	16384
+#define BL_WRITER_SLEEP_MICROS	2000
+
+
+//////////
+// types
+
+// Each logging thread owns a single-producer/single-consumer ring of
+// binary records: the format pointer (format strings must have static
+// storage duration) and the raw arguments. String arguments are copied.
+// The writer thread formats records and writes them with writev(). A
+// record that does not fit is dropped and counted rather than blocking
+// the logging thread. When the owning thread exits, its ring is marked
+// retired; the writer frees it once it has been drained.
+typedef struct BLRing {
+	unsigned char	data[BL_RING_SIZE];
+	uint64_t	head; // written by the writer thread only
+	uint64_t	tail; // written by the owning thread only
+	uint64_t	records;
+	uint64_t	dropped;
+	uint64_t	droppedReported;
+	unsigned int	threadTag;
+	int	retired; // set by the owning thread's exit
+	struct BLRing	*next; // modified by the writer only, other than when pushed
+} BLRing;
+
+
+///////////////
+// prototypes
+
+void bl_start(int fd);
+void bl_set_fd(int fd);
+int bl_log(const char *format, va_list ap);
+void bl_flush();
+void bl_get_stats(uint64_t *records, uint64_t *dropped);
+
+#endif
@@ -0,0 +1,176 @@
+// BlockBuffer.c
+
+/////////////
+// includes
+
+#include "BlockBuffer.h"
+#include "Util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+
+////////////////////
+// private defines
+
+#define _BBP_SHM_TEMPLATE	"/dev/shm/" BBP_NAME ".XXXXXX"
+
+
+///////////////////////
+// private prototypes
+
+static int bbp_create_fd();
+
+
+///////////////////
+// implementation
+
+// Prefers memfd_create(); older kernels fall back to an unlinked tmpfs file
+static int bbp_create_fd() {
+	int	fd;
+
+#ifdef SYS_memfd_create
+	fd = syscall(SYS_memfd_create, BBP_NAME, 0);
+	if (fd >= 0) {
+		return fd;
+	}
+#endif
+	{
+		char	name[] = _BBP_SHM_TEMPLATE;
+
+		fd = mkstemp(name);
+		if (fd >= 0) {
+			unlink(name);
+		}
+	}
+	return fd;
+}
+
+BlockBufferPool *bbp_new(uint32_t numSlots) {
+	BlockBufferPool	*bbp;
+	size_t	length;
+	uint32_t	i;
+
+	bbp = (BlockBufferPool *)mem_alloc(1, sizeof(BlockBufferPool));
+	length = (size_t)numSlots * SRFS_BLOCK_SIZE;
+	bbp->fd = bbp_create_fd();
+	if (bbp->fd < 0) {
+		srfsLog(LOG_ERROR, "bbp_new unable to create buffer fd %d", errno);
+		mem_free((void **)&bbp);
+		return NULL;
+	}
+	if (ftruncate(bbp->fd, length) != 0) {
+		srfsLog(LOG_ERROR, "bbp_new ftruncate failed %d", errno);
+		close(bbp->fd);
+		mem_free((void **)&bbp);
+		return NULL;
+	}
+	// pages are populated lazily as slots are first used
+	bbp->base = (unsigned char *)mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_SHARED, bbp->fd, 0);
+	if (bbp->base == MAP_FAILED) {
+		srfsLog(LOG_ERROR, "bbp_new mmap failed %d", errno);
+		close(bbp->fd);
+		mem_free((void **)&bbp);
+		return NULL;
+	}
+	bbp->numSlots = numSlots;
+	bbp->buffers = (BlockBuffer *)mem_alloc(numSlots, sizeof(BlockBuffer));
+	for (i = numSlots; i > 0; i--) {
+		BlockBuffer	*bb;
+
+		bb = &bbp->buffers[i - 1];
+		bb->pool = bbp;
+		bb->data = bbp->base + (size_t)(i - 1) * SRFS_BLOCK_SIZE;
+		bb->nextFree = bbp->freeList;
+		bbp->freeList = bb;
+	}
+	pthread_spin_init(&bbp->lock, 0);
+	srfsLog(LOG_WARNING, "bbp_new %u slots fd %d", numSlots, bbp->fd);
+	return bbp;
+}
+
+// Only valid once no BlockBuffer from this pool is referenced
+void bbp_delete(BlockBufferPool **bbp) {
+	if (bbp != NULL && *bbp != NULL) {
+		munmap((*bbp)->base, (size_t)(*bbp)->numSlots * SRFS_BLOCK_SIZE);
+		close((*bbp)->fd);
+		pthread_spin_destroy(&(*bbp)->lock);
+		mem_free((void **)&(*bbp)->buffers);
+		mem_free((void **)bbp);
+	} else {
+		fatalError("bad ptr in bbp_delete");
+	}
+}
+
+// Returns a buffer holding a copy of data with a single reference, or NULL
+// if the pool is exhausted; callers then keep the block on the heap.
+BlockBuffer *bbp_alloc(BlockBufferPool *bbp, const void *data, size_t size) {
+	BlockBuffer	*bb;
+
+	if (size > SRFS_BLOCK_SIZE) {
+		fatalError("size > SRFS_BLOCK_SIZE", __FILE__, __LINE__);
+	}
+	pthread_spin_lock(&bbp->lock);
+	bb = bbp->freeList;
+	if (bb != NULL) {
+		bbp->freeList = bb->nextFree;
+		bbp->slotsInUse++;
+		bbp->allocations++;
+	} else {
+		bbp->allocationFailures++;
+	}
+	pthread_spin_unlock(&bbp->lock);
+	if (bb != NULL) {
+		bb->nextFree = NULL;
+		bb->size = size;
+		memcpy(bb->data, data, size);
+		__atomic_store_n(&bb->refCount, 1, __ATOMIC_RELEASE);
+	}
+	return bb;
+}
+
+void bbp_display_stats(BlockBufferPool *bbp) {
+	pthread_spin_lock(&bbp->lock);
+	srfsLog(LOG_WARNING, "bbp slots %u inUse %u allocations %lu allocationFailures %lu",
+		bbp->numSlots, bbp->slotsInUse, bbp->allocations, bbp->allocationFailures);
+	pthread_spin_unlock(&bbp->lock);
+}
+
+void bb_ref(BlockBuffer *bb) {
+	__atomic_fetch_add(&bb->refCount, 1, __ATOMIC_RELAXED);
+}
+
+void bb_release(BlockBuffer **bb) {
+	if (bb != NULL && *bb != NULL) {
+		BlockBuffer	*_bb;
+
+		_bb = *bb;
+		*bb = NULL;
+		if (__atomic_sub_fetch(&_bb->refCount, 1, __ATOMIC_ACQ_REL) == 0) {
+			BlockBufferPool	*bbp;
+
+			bbp = _bb->pool;
+			pthread_spin_lock(&bbp->lock);
+			_bb->nextFree = bbp->freeList;
+			bbp->freeList = _bb;
+			bbp->slotsInUse--;
+			pthread_spin_unlock(&bbp->lock);
+		}
+	} else {
+		fatalError("bad ptr in bb_release");
+	}
+}
+
+int bb_fd(BlockBuffer *bb) {
+	return bb->pool->fd;
+}
+
+off_t bb_fd_offset(BlockBuffer *bb) {
+	return (off_t)(bb->data - bb->pool->base);
+}
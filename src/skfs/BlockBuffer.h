@@ -0,0 +1,67 @@
+// BlockBuffer.h
+
+#ifndef _BLOCK_BUFFER_H_
+#define _BLOCK_BUFFER_H_
+
+/////////////
+// includes
+
+#include "SRFSConstants.h"
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+
+////////////
+// defines
+
+#define BBP_NAME	"skfsBlockBuffers"
+
+
+//////////
+// types
+
+struct BlockBufferPool;
+
+// An immutable, reference-counted copy of a file block, held in one
+// SRFS_BLOCK_SIZE slot of a pool. The cache holds one reference; readers
+// that hand a block to FUSE without copying hold another until FUSE has
+// sent the reply.
+typedef struct BlockBuffer {
+	struct BlockBufferPool	*pool;
+	unsigned char	*data;
+	size_t	size;
+	uint32_t	refCount;
+	struct BlockBuffer	*nextFree;
+} BlockBuffer;
+
+// All slots live in a single memfd-backed mapping, so a block can also be
+// addressed as (fd, offset) and spliced to /dev/fuse.
+typedef struct BlockBufferPool {
+	int		fd;
+	unsigned char	*base;
+	uint32_t	numSlots;
+	BlockBuffer	*buffers;
+	BlockBuffer	*freeList;
+	uint32_t	slotsInUse;
+	pthread_spinlock_t	lock;
+	uint64_t	allocations;
+	uint64_t	allocationFailures;
+} BlockBufferPool;
+
+
+///////////////
+// prototypes
+
+BlockBufferPool *bbp_new(uint32_t numSlots);
+void bbp_delete(BlockBufferPool **bbp);
+BlockBuffer *bbp_alloc(BlockBufferPool *bbp, const void *data, size_t size);
+void bbp_display_stats(BlockBufferPool *bbp);
+
+void bb_ref(BlockBuffer *bb);
+void bb_release(BlockBuffer **bb);
+int bb_fd(BlockBuffer *bb);
+off_t bb_fd_offset(BlockBuffer *bb);
+
+#endif
@@ -0,0 +1,288 @@
+// BlockDedup.c
+
+/////////////
+// includes
+
+#include "BlockDedup.h"
+#include "Util.h"
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+
+////////////////////
+// private defines
+
+#define _BD_ROTR(x, n) (((x) >> (n)) | ((x) << (32 - (n))))
+
+
+///////////////////////
+// private prototypes
+
+static void bd_sha256_block(uint32_t *state, const unsigned char *block);
+static uint64_t bd_ref_check(const BlockDedupRef *ref);
+
+
+/////////////////
+// private data
+
+static const uint32_t _bd_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+// Hashes of content recently confirmed to be stored. Direct-mapped; a
+// collision merely evicts an entry and costs an extra existence probe.
+static pthread_spinlock_t	bdKnownLock;
+static pthread_once_t	bdKnownOnce = PTHREAD_ONCE_INIT;
+static unsigned char	bdKnown[BD_KNOWN_HASH_SLOTS][BD_HASH_BYTES];
+
+static pthread_mutex_t	bdStatLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t	bdBlocksWritten;
+static uint64_t	bdBlocksDeduplicated;
+static uint64_t	bdBytesWritten;
+static uint64_t	bdBytesSaved;
+static uint64_t	bdProbes;
+static uint64_t	bdProbeHits;
+static uint64_t	bdRefsResolved;
+static uint64_t	bdRefsUnresolved;
+
+
+///////////////////
+// implementation
+
+static void bd_sha256_block(uint32_t *state, const unsigned char *block) {
+	uint32_t	w[64];
+	uint32_t	a, b, c, d, e, f, g, h;
+	int	i;
+
+	for (i = 0; i < 16; i++) {
+		w[i] = ((uint32_t)block[i * 4] << 24) | ((uint32_t)block[i * 4 + 1] << 16)
+			| ((uint32_t)block[i * 4 + 2] << 8) | (uint32_t)block[i * 4 + 3];
+	}
+	for (i = 16; i < 64; i++) {
+		uint32_t	s0;
+		uint32_t	s1;
+
+		s0 = _BD_ROTR(w[i - 15], 7) ^ _BD_ROTR(w[i - 15], 18) ^ (w[i - 15] >> 3);
+		s1 = _BD_ROTR(w[i - 2], 17) ^ _BD_ROTR(w[i - 2], 19) ^ (w[i - 2] >> 10);
+		w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+	}
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for (i = 0; i < 64; i++) {
+		uint32_t	t1;
+		uint32_t	t2;
+
+		t1 = h + (_BD_ROTR(e, 6) ^ _BD_ROTR(e, 11) ^ _BD_ROTR(e, 25)) + ((e & f) ^ (~e & g)) + _bd_k[i] + w[i];
+		t2 = (_BD_ROTR(a, 2) ^ _BD_ROTR(a, 13) ^ _BD_ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+		h = g; g = f; f = e; e = d + t1;
+		d = c; c = b; b = a; a = t1 + t2;
+	}
+	state[0] += a; state[1] += b; state[2] += c; state[3] += d;
+	state[4] += e; state[5] += f; state[6] += g; state[7] += h;
+}
+
+// SHA-256 of the given data. No crypto library is linked into skfs, and a
+// block is hashed at most once per write, so a plain implementation suffices.
+void bd_hash(const void *data, size_t size, unsigned char *hash) {
+	uint32_t	state[8] = {
+		0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+		0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+	};
+	const unsigned char	*p;
+	unsigned char	tail[128];
+	size_t	remaining;
+	size_t	tailLength;
+	uint64_t	bits;
+	int	i;
+
+	p = (const unsigned char *)data;
+	remaining = size;
+	while (remaining >= 64) {
+		bd_sha256_block(state, p);
+		p += 64;
+		remaining -= 64;
+	}
+	memset(tail, 0, sizeof(tail));
+	memcpy(tail, p, remaining);
+	tail[remaining] = 0x80;
+	tailLength = remaining < 56 ? 64 : 128;
+	bits = (uint64_t)size * 8;
+	for (i = 0; i < 8; i++) {
+		tail[tailLength - 1 - i] = (unsigned char)(bits >> (i * 8));
+	}
+	bd_sha256_block(state, tail);
+	if (tailLength == 128) {
+		bd_sha256_block(state, tail + 64);
+	}
+	for (i = 0; i < 8; i++) {
+		hash[i * 4] = (unsigned char)(state[i] >> 24);
+		hash[i * 4 + 1] = (unsigned char)(state[i] >> 16);
+		hash[i * 4 + 2] = (unsigned char)(state[i] >> 8);
+		hash[i * 4 + 3] = (unsigned char)state[i];
+	}
+}
+
+// Checks bd_hash against the NIST known-answer vectors for SHA-256 (FIPS 180-4),
+// covering one- and two-block padding and a long message. Returns TRUE iff all match.
+int bd_hash_self_test() {
+	static const char	*messages[] = {
+		"abc",
+		"",
+		"abcdbcdecdefdefgefghfghighijhijkijkljklmklmnlmnomnopnopq",
+		"abcdefghbcdefghicdefghijdefghijkefghijklfghijklmghijklmnhijklmnoijklmnopjklmnopqklmnopqrlmnopqrsmnopqrstnopqrstu"
+	};
+	static const char	*digests[] = {
+		"ba7816bf8f01cfea414140de5dae2223b00361a396177a9cb410ff61f20015ad",
+		"e3b0c44298fc1c149afbf4c8996fb92427ae41e4649b934ca495991b7852b855",
+		"248d6a61d20638b8e5c026930c3e6039a33ce45964ff2167f6ecedd419db06c1",
+		"cf5b16a778af8380036ce59e7b0492370b249b11e8f07a51afac45037afee9d1"
+	};
+	static const char	*millionADigest = "cdc76e5c9914fb9281a1c7e284d73e67f1809a48a497200e046d39ccc7112cd0";
+	unsigned char	hash[BD_HASH_BYTES];
+	char	key[BD_KEY_SIZE];
+	char	*millionA;
+	size_t	prefixLength;
+	size_t	i;
+	int	ok;
+
+	ok = TRUE;
+	prefixLength = strlen(BD_KEY_PREFIX);
+	for (i = 0; i < sizeof(messages) / sizeof(messages[0]); i++) {
+		bd_hash(messages[i], strlen(messages[i]), hash);
+		bd_hash_to_key(hash, key);
+		if (strcmp(key + prefixLength, digests[i])) {
+			srfsLog(LOG_ERROR, "bd_hash_self_test failed for vector %lu: %s", i, key + prefixLength);
+			ok = FALSE;
+		}
+	}
+	millionA = (char *)mem_alloc(1000000, 1);
+	memset(millionA, 'a', 1000000);
+	bd_hash(millionA, 1000000, hash);
+	mem_free((void **)&millionA);
+	bd_hash_to_key(hash, key);
+	if (strcmp(key + prefixLength, millionADigest)) {
+		srfsLog(LOG_ERROR, "bd_hash_self_test failed for one million a: %s", key + prefixLength);
+		ok = FALSE;
+	}
+	return ok;
+}
+
+void bd_hash_to_key(const unsigned char *hash, char *key) {
+	int	i;
+
+	strcpy(key, BD_KEY_PREFIX);
+	key += strlen(BD_KEY_PREFIX);
+	for (i = 0; i < BD_HASH_BYTES; i++) {
+		sprintf(key + i * 2, "%02x", hash[i]);
+	}
+}
+
+static uint64_t bd_ref_check(const BlockDedupRef *ref) {
+	// over all fields preceding check
+	return fnv1a_64(ref, offsetof(BlockDedupRef, check));
+}
+
+void bd_ref_init(BlockDedupRef *ref, const unsigned char *hash, size_t size) {
+	memset(ref, 0, sizeof(BlockDedupRef));
+	ref->magic = BD_REF_MAGIC;
+	ref->version = BD_REF_VERSION;
+	ref->size = size;
+	memcpy(ref->hash, hash, BD_HASH_BYTES);
+	ref->check = bd_ref_check(ref);
+}
+
+int bd_is_ref(const void *data, size_t size) {
+	const BlockDedupRef	*ref;
+
+	if (data == NULL || size != sizeof(BlockDedupRef)) {
+		return FALSE;
+	}
+	ref = (const BlockDedupRef *)data;
+	return ref->magic == BD_REF_MAGIC
+		&& ref->version == BD_REF_VERSION
+		&& ref->size <= SRFS_BLOCK_SIZE
+		&& ref->check == bd_ref_check(ref);
+}
+
+static void bd_known_init() {
+	pthread_spin_init(&bdKnownLock, 0);
+}
+
+static unsigned char *bd_known_slot(const unsigned char *hash) {
+	uint32_t	index;
+
+	pthread_once(&bdKnownOnce, bd_known_init);
+	// The hash is uniformly distributed, so any of its bytes will do as an index
+	memcpy(&index, hash, sizeof(index));
+	return bdKnown[index % BD_KNOWN_HASH_SLOTS];
+}
+
+int bd_is_known(const unsigned char *hash) {
+	unsigned char	*slot;
+	int	known;
+
+	slot = bd_known_slot(hash);
+	pthread_spin_lock(&bdKnownLock);
+	known = !memcmp(slot, hash, BD_HASH_BYTES);
+	pthread_spin_unlock(&bdKnownLock);
+	return known;
+}
+
+void bd_note_stored(const unsigned char *hash) {
+	unsigned char	*slot;
+
+	slot = bd_known_slot(hash);
+	pthread_spin_lock(&bdKnownLock);
+	memcpy(slot, hash, BD_HASH_BYTES);
+	pthread_spin_unlock(&bdKnownLock);
+}
+
+void bd_record_write(size_t size, int contentWritten) {
+	pthread_mutex_lock(&bdStatLock);
+	bdBlocksWritten++;
+	bdBytesWritten += size;
+	if (!contentWritten) {
+		bdBlocksDeduplicated++;
+		bdBytesSaved += size;
+	}
+	pthread_mutex_unlock(&bdStatLock);
+}
+
+void bd_record_probe(int found) {
+	pthread_mutex_lock(&bdStatLock);
+	bdProbes++;
+	if (found) {
+		bdProbeHits++;
+	}
+	pthread_mutex_unlock(&bdStatLock);
+}
+
+void bd_record_resolution(int resolved) {
+	pthread_mutex_lock(&bdStatLock);
+	if (resolved) {
+		bdRefsResolved++;
+	} else {
+		bdRefsUnresolved++;
+	}
+	pthread_mutex_unlock(&bdStatLock);
+}
+
+void bd_display_stats() {
+	pthread_mutex_lock(&bdStatLock);
+	srfsLog(LOG_WARNING, "bd blocksWritten %lu blocksDeduplicated %lu bytesWritten %lu bytesSaved %lu (%.1f%%)",
+		bdBlocksWritten, bdBlocksDeduplicated, bdBytesWritten, bdBytesSaved,
+		bdBytesWritten > 0 ? (double)bdBytesSaved * 100.0 / (double)bdBytesWritten : 0.0);
+	srfsLog(LOG_WARNING, "bd probes %lu probeHits %lu refsResolved %lu refsUnresolved %lu",
+		bdProbes, bdProbeHits, bdRefsResolved, bdRefsUnresolved);
+	pthread_mutex_unlock(&bdStatLock);
+}
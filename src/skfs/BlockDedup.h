@@ -0,0 +1,61 @@
+// BlockDedup.h
+
+#ifndef _BLOCK_DEDUP_H_
+#define _BLOCK_DEDUP_H_
+
+/////////////
+// includes
+
+#include "SRFSConstants.h"
+
+#include <stdint.h>
+#include <unistd.h>
+
+
+////////////
+// defines
+
+#define BD_HASH_BYTES	32
+#define BD_KEY_PREFIX	"dd."
+#define BD_KEY_SIZE	(sizeof(BD_KEY_PREFIX) + 2 * BD_HASH_BYTES)
+#define BD_REF_MAGIC	0x534b4444
+#define BD_REF_VERSION	1
+
+
+//////////
+// types
+
+// Files created with deduplication enabled carry FID_SKFS_DEDUP in their
+// FileID. The content of each of their blocks is stored once in the file
+// block namespace under a key derived from its SHA-256 (BD_KEY_PREFIX
+// followed by the hex digest). The block's usual FileBlockID key then holds
+// only a BlockDedupRef, so a file's block keys form its block map.
+// Values are only ever interpreted as references for such files; the
+// magic and check fields merely validate them.
+// Content keys cannot collide with FileBlockID keys, which never start
+// with BD_KEY_PREFIX.
+typedef struct BlockDedupRef {
+	uint32_t	magic;
+	uint32_t	version;
+	uint64_t	size;
+	unsigned char	hash[BD_HASH_BYTES];
+	uint64_t	check;
+} BlockDedupRef;
+
+
+///////////////
+// prototypes
+
+void bd_hash(const void *data, size_t size, unsigned char *hash);
+int bd_hash_self_test();
+void bd_hash_to_key(const unsigned char *hash, char *key);
+void bd_ref_init(BlockDedupRef *ref, const unsigned char *hash, size_t size);
+int bd_is_ref(const void *data, size_t size);
+int bd_is_known(const unsigned char *hash);
+void bd_note_stored(const unsigned char *hash);
+void bd_record_write(size_t size, int contentWritten);
+void bd_record_probe(int found);
+void bd_record_resolution(int resolved);
+void bd_display_stats();
+
+#endif
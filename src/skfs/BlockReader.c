@@ -18,47 +18,82 @@
 #include <stdlib.h>
 #include <string.h>     
 #include <sys/socket.h> // socket creating and binding
+#include <sys/time.h>
 #include <sys/types.h>
 
 ////////////
 // defines
 
-#define BR_MAX_MESSAGE_SIZE (SRFS_MAX_PATH_LENGTH + sizeof(FileAttr) + sizeof(size_t) + sizeof(off_t) + sizeof(int))
-#define BR_TYPE_OFFSET    0
-#define BR_LENGTH_OFFSET  (BR_TYPE_OFFSET + sizeof(uint32_t)) // use uint32 for alignment
-#define BR_FA_OFFSET  (BR_LENGTH_OFFSET + sizeof(size_t))
-#define BR_READ_OFFSET_OFFSET (BR_FA_OFFSET + sizeof(FileAttr))
-#define BR_READ_SIZE_OFFSET (BR_READ_OFFSET_OFFSET + sizeof(off_t))
-#define BR_MAX_READAHEAD_OFFSET (BR_READ_SIZE_OFFSET + sizeof(int))
-#define BR_PATH_OFFSET (BR_MAX_READAHEAD_OFFSET + sizeof(int))
-
-#define BR_MT_READ_BLOCK    0
+#define BR_MAGIC    0x534b4252
+#define BR_MT_READ_BLOCKS   1
+#define BR_MT_ACK   2
 
 #define BR_SOCKET_BUFFER_SIZE   (16 * 1024 * 1024)
 
 #define BR_TMP_NUM_ADDRESSES    1024
 #define _IP_ADDRESS_BYTES   4
 
+#define BR_FLUSH_DELAY_MILLIS   1
+#define BR_ACK_TIMEOUT_MILLIS   20
+#define BR_MAX_ATTEMPTS 3
+#define BR_IDLE_WAIT_MILLIS 1000
+#define BR_RECV_BATCH   16
+#define BR_COALESCE_MILLIS  500
+#define BR_ALIGN(X) (((X) + 7) & ~(size_t)7)
+
 
 /////////////
 // protocol
 
 /*
- message type
- message length
- FileAttr
- read offset
- read length
- path
+ Each datagram carries a batch of read requests:
+
+ BRHeader
+ numPaths x (BRPathEntry, NUL-terminated path padded to 8 bytes)
+ numReads x BRRead, each naming its path by index
+
+ The receiver answers each batch with a BRHeader of type BR_MT_ACK and the
+ same seq. Unacknowledged batches are resent, to the next peer, up to
+ BR_MAX_ATTEMPTS times. Requests for a block already requested within
+ BR_COALESCE_MILLIS are dropped by the receiver, so resends and
+ overlapping requests from several clients cost one read.
 */
 
+typedef struct BRHeader {
+    uint32_t    magic;
+    uint16_t    type;
+    uint16_t    numPaths;
+    uint16_t    numReads;
+    uint16_t    reserved[3];
+    uint64_t    seq;
+} BRHeader;
+
+typedef struct BRPathEntry {
+    FileAttr    fa;
+    uint32_t    pathLength; // including the NUL
+    uint32_t    reserved;
+} BRPathEntry;
+
+typedef struct BRRead {
+    uint16_t    pathIndex;
+    uint16_t    reserved;
+    int32_t     maxReadAhead;
+    uint64_t    readSize;
+    int64_t     readOffset;
+} BRRead;
+
 
 ///////////////////////
 // private prototypes
 
 void br_read_block(BlockReader *br, char *path, FileAttr *fa, size_t readSize, off_t readOffset, int maxReadAhead);
-size_t br_message_length_for_path(char *path);
 static void *br_run(void *_br);
+static void *br_sender_run(void *_br);
+static void br_seal_pending(BlockReader *br);
+static uint32_t br_remote_address(BlockReader *br, int *index, int attempt);
+static void br_handle_ack(BlockReader *br, BRHeader *header);
+static int br_handle_read_blocks(BlockReader *br, char *buf, size_t length);
+static int br_is_recent_read(BlockReader *br, FileID *fid, BRRead *read, uint64_t curTime);
 
 
 //////////////////////
@@ -94,53 +129,199 @@ BlockReader *br_new(int port, PartialBlockReader *pbr, AttrReader *ar) {
         srfsLog(LOG_WARNING, "BlockReader bound to port %d", port);
     }
     
-    br->running = TRUE;
-    pthread_create(&br->thread, NULL, br_run, br);
-    
     br->numRemoteAddresses = 0;
     br->remoteAddresses = NULL;
 	pthread_spin_init(&br->addrLock, 0);
+    pthread_mutex_init(&br->batchLock, NULL);
+    pthread_cond_init(&br->batchCV, NULL);
+    br->nextSeq = 1;
+    br->recentBlocks = (BRRecentBlock *)mem_alloc(BR_RECENT_BLOCKS, sizeof(BRRecentBlock));
+    
+    br->running = TRUE;
+    pthread_create(&br->thread, NULL, br_run, br);
+    pthread_create(&br->senderThread, NULL, br_sender_run, br);
   
     return br;
 }
 
 void br_stop(BlockReader *br) {
+    pthread_mutex_lock(&br->batchLock);
     br->running = FALSE;
+    pthread_cond_broadcast(&br->batchCV);
+    pthread_mutex_unlock(&br->batchLock);
 }
 
 void br_server_loop(BlockReader *br) {
-    char buf[BR_MAX_MESSAGE_SIZE];
-    struct sockaddr_in claddr;  // address of the client
-    long recvlen;
+    char    *bufs;
+    struct mmsghdr  msgs[BR_RECV_BATCH];
+    struct iovec    iovs[BR_RECV_BATCH];
+    struct sockaddr_in  claddrs[BR_RECV_BATCH];  // addresses of the clients
+    struct mmsghdr  acks[BR_RECV_BATCH];
+    struct iovec    ackIovs[BR_RECV_BATCH];
+    BRHeader    ackHeaders[BR_RECV_BATCH];
+    int     i;
 
     srfsLog(LOG_WARNING, "br server loop start");
+    bufs = (char *)mem_alloc(BR_RECV_BATCH, BR_MAX_DATAGRAM_SIZE);
     while (br->running) {
-        srfsLog(LOG_INFO, "br calling recvfrom()");
-        recvlen = recvfrom(br->fd, buf, BR_MAX_MESSAGE_SIZE, 0, NULL, 0);
-        if (recvlen < 0) {
-            srfsLog(LOG_WARNING, "errno %d %x", errno, errno);
-            srfsLog(LOG_WARNING, "Ignoring recvfrom() error");
-        } else {
-            int         *type;
-            size_t      *length;
-            FileAttr    *fa;
-            off_t       *readOffset;
-            size_t      *readSize;
-            int         *maxReadAhead;
-            char        *path;
-            
-            srfsLog(LOG_INFO, "br received %ld", recvlen);
-            type = (int *)(buf + BR_TYPE_OFFSET);
-            length = (size_t *)(buf + BR_LENGTH_OFFSET);
-            fa = (FileAttr *)(buf + BR_FA_OFFSET);
-            readOffset = (off_t *)(buf + BR_READ_OFFSET_OFFSET);
-            readSize = (size_t *)(buf + BR_READ_SIZE_OFFSET);
-            maxReadAhead = (int *)(buf + BR_MAX_READAHEAD_OFFSET);
-            path = (char *)(buf + BR_PATH_OFFSET);
+        int numReceived;
+        int numAcks;
+
+        for (i = 0; i < BR_RECV_BATCH; i++) {
+            iovs[i].iov_base = bufs + i * BR_MAX_DATAGRAM_SIZE;
+            iovs[i].iov_len = BR_MAX_DATAGRAM_SIZE;
+            memset(&msgs[i], 0, sizeof(struct mmsghdr));
+            msgs[i].msg_hdr.msg_name = &claddrs[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+            msgs[i].msg_hdr.msg_iov = &iovs[i];
+            msgs[i].msg_hdr.msg_iovlen = 1;
+        }
+        srfsLog(LOG_INFO, "br calling recvmmsg()");
+        // Block for the first datagram, then take whatever else has arrived
+        numReceived = recvmmsg(br->fd, msgs, BR_RECV_BATCH, MSG_WAITFORONE, NULL);
+        if (numReceived < 0) {
+            if (errno != EINTR) {
+                srfsLog(LOG_WARNING, "errno %d %x", errno, errno);
+                srfsLog(LOG_WARNING, "Ignoring recvmmsg() error");
+            }
+            continue;
+        }
+        srfsLog(LOG_INFO, "br received %d", numReceived);
+        
+        // Acknowledge all batches before starting any reads
+        numAcks = 0;
+        for (i = 0; i < numReceived; i++) {
+            BRHeader    *header;
             
-            br_read_block(br, path, fa, *readSize, *readOffset, *maxReadAhead);
+            header = (BRHeader *)iovs[i].iov_base;
+            if (msgs[i].msg_len < sizeof(BRHeader) || header->magic != BR_MAGIC) {
+                srfsLog(LOG_WARNING, "br ignoring bad datagram length %u", msgs[i].msg_len);
+                msgs[i].msg_len = 0;
+            } else if (header->type == BR_MT_ACK) {
+                br_handle_ack(br, header);
+                msgs[i].msg_len = 0;
+            } else if (header->type == BR_MT_READ_BLOCKS) {
+                memset(&ackHeaders[numAcks], 0, sizeof(BRHeader));
+                ackHeaders[numAcks].magic = BR_MAGIC;
+                ackHeaders[numAcks].type = BR_MT_ACK;
+                ackHeaders[numAcks].seq = header->seq;
+                ackIovs[numAcks].iov_base = &ackHeaders[numAcks];
+                ackIovs[numAcks].iov_len = sizeof(BRHeader);
+                memset(&acks[numAcks], 0, sizeof(struct mmsghdr));
+                acks[numAcks].msg_hdr.msg_name = &claddrs[i];
+                acks[numAcks].msg_hdr.msg_namelen = msgs[i].msg_hdr.msg_namelen;
+                acks[numAcks].msg_hdr.msg_iov = &ackIovs[numAcks];
+                acks[numAcks].msg_hdr.msg_iovlen = 1;
+                numAcks++;
+            } else {
+                srfsLog(LOG_WARNING, "br ignoring unknown type %d", header->type);
+                msgs[i].msg_len = 0;
+            }
+        }
+        if (numAcks > 0 && sendmmsg(br->fd, acks, numAcks, 0) < 0) {
+            srfsLog(LOG_WARNING, "br ack sendmmsg errno %d", errno);
+        }
+        for (i = 0; i < numReceived; i++) {
+            if (msgs[i].msg_len > 0) {
+                if (!br_handle_read_blocks(br, (char *)iovs[i].iov_base, msgs[i].msg_len)) {
+                    srfsLog(LOG_WARNING, "br ignoring malformed batch");
+                }
+            }
+        }
+    }
+    mem_free((void **)&bufs);
+}
+
+static void br_handle_ack(BlockReader *br, BRHeader *header) {
+    int i;
+    
+    pthread_mutex_lock(&br->batchLock);
+    for (i = 0; i < BR_MAX_OUTSTANDING; i++) {
+        if (br->outstanding[i].inUse && br->outstanding[i].seq == header->seq) {
+            br->outstanding[i].inUse = FALSE;
+            break;
         }
     }
+    pthread_mutex_unlock(&br->batchLock);
+}
+
+// Validates a received batch and issues its reads. Returns FALSE if the
+// batch is malformed; reads preceding the problem may have been issued.
+static int br_handle_read_blocks(BlockReader *br, char *buf, size_t length) {
+    BRHeader    *header;
+    BRPathEntry *paths[BR_MAX_BATCH_PATHS];
+    BRRead  *reads;
+    size_t  offset;
+    uint64_t    curTime;
+    int     i;
+    
+    header = (BRHeader *)buf;
+    if (header->numPaths > BR_MAX_BATCH_PATHS) {
+        return FALSE;
+    }
+    offset = sizeof(BRHeader);
+    for (i = 0; i < header->numPaths; i++) {
+        BRPathEntry *entry;
+        
+        if (offset + sizeof(BRPathEntry) > length) {
+            return FALSE;
+        }
+        entry = (BRPathEntry *)(buf + offset);
+        offset += sizeof(BRPathEntry);
+        if (entry->pathLength == 0 || entry->pathLength > SRFS_MAX_PATH_LENGTH
+                || offset + entry->pathLength > length || buf[offset + entry->pathLength - 1] != '\0') {
+            return FALSE;
+        }
+        paths[i] = entry;
+        offset += BR_ALIGN(entry->pathLength);
+    }
+    if (offset + (size_t)header->numReads * sizeof(BRRead) > length) {
+        return FALSE;
+    }
+    reads = (BRRead *)(buf + offset);
+    curTime = curTimeMillis();
+    for (i = 0; i < header->numReads; i++) {
+        BRPathEntry *entry;
+        
+        if (reads[i].pathIndex >= header->numPaths) {
+            return FALSE;
+        }
+        entry = paths[reads[i].pathIndex];
+        if (br_is_recent_read(br, &entry->fa.fid, &reads[i], curTime)) {
+            __atomic_fetch_add(&br->readsCoalesced, 1, __ATOMIC_RELAXED);
+        } else {
+            __atomic_fetch_add(&br->readsServed, 1, __ATOMIC_RELAXED);
+            br_read_block(br, (char *)(entry + 1), &entry->fa, reads[i].readSize, reads[i].readOffset, 
+                          reads[i].maxReadAhead);
+        }
+    }
+    return TRUE;
+}
+
+// Records the read as requested; returns TRUE if a recent request starting
+// at the same block already covered all of it, read-ahead included.
+// Called only by the server thread.
+static int br_is_recent_read(BlockReader *br, FileID *fid, BRRead *read, uint64_t curTime) {
+    BRRecentBlock   *recent;
+    uint64_t    block;
+    uint64_t    lastBlock;
+    
+    block = read->readOffset / SRFS_BLOCK_SIZE;
+    lastBlock = (read->readOffset + (read->readSize > 0 ? read->readSize - 1 : 0)) / SRFS_BLOCK_SIZE;
+    if (read->maxReadAhead > 0) {
+        lastBlock += read->maxReadAhead;
+    }
+    recent = &br->recentBlocks[(fid->hash ^ (block * 0x9e3779b97f4a7c15ULL)) % BR_RECENT_BLOCKS];
+    if (recent->block == block && recent->lastBlock >= lastBlock && curTime - recent->timeMillis < BR_COALESCE_MILLIS
+            && fid_compare(&recent->fid, fid) == 0) {
+        return TRUE;
+    } else {
+        recent->fid = *fid;
+        recent->block = block;
+        recent->lastBlock = lastBlock;
+        recent->timeMillis = curTime;
+        return FALSE;
+    }
 }
 
 static uint32_t br_read_ip(char *ip) {
@@ -297,63 +478,208 @@ void br_set_remote_addresses(BlockReader *br, int numRemoteAddresses, uint32_t *
     }
 }
 
+// Queues a read for the next batch sent by the sender thread
 void br_request_remote_read(BlockReader *br, char *path, FileAttr *fa, size_t readSize, off_t readOffset, int maxReadAhead) {
-    char buf[BR_MAX_MESSAGE_SIZE];
-    struct sockaddr_in serverAddr;
-    int         *_type;
-    size_t      *_length;
-    FileAttr    *_fa;
-    off_t       *_readOffset;
-    size_t      *_readSize;
-    int         *_maxReadAhead;
-    char        *_path;
-    uint32_t    remoteAddress;
+    BRPendingBatch  *pending;
+    size_t  pathLength;
+    size_t  entrySize;
+    BRRead  *read;
+    int     pathIndex;
+    int     i;
     
     srfsLog(LOG_INFO, "br br_request_remote_read %s", path);
-    socklen_t slen = sizeof(struct sockaddr_in);
+    pathLength = strlen(path) + 1;
+    if (pathLength > SRFS_MAX_PATH_LENGTH) {
+        srfsLog(LOG_WARNING, "br path too long %s", path);
+        return;
+    }
+    entrySize = sizeof(BRPathEntry) + BR_ALIGN(pathLength);
+    pending = &br->pending;
+    
+    pthread_mutex_lock(&br->batchLock);
+    pathIndex = -1;
+    for (i = 0; i < pending->numPaths; i++) {
+        BRPathEntry *entry;
+        
+        entry = (BRPathEntry *)(pending->pathData + pending->pathOffsets[i]);
+        if (fid_compare(&entry->fa.fid, &fa->fid) == 0 && !strcmp((char *)(entry + 1), path)) {
+            pathIndex = i;
+            break;
+        }
+    }
+    if (pending->numReads == BR_MAX_BATCH_READS
+            || sizeof(BRHeader) + pending->pathBytes + (pathIndex < 0 ? entrySize : 0) 
+                + (pending->numReads + 1) * sizeof(BRRead) > BR_MAX_DATAGRAM_SIZE
+            || (pathIndex < 0 && pending->numPaths == BR_MAX_BATCH_PATHS)) {
+        br_seal_pending(br);
+        pathIndex = -1;
+    }
+    if (pathIndex < 0) {
+        BRPathEntry *entry;
+        
+        pathIndex = pending->numPaths++;
+        pending->pathOffsets[pathIndex] = pending->pathBytes;
+        entry = (BRPathEntry *)(pending->pathData + pending->pathBytes);
+        memset(entry, 0, entrySize);
+        entry->fa = *fa;
+        entry->pathLength = pathLength;
+        memcpy(entry + 1, path, pathLength);
+        pending->pathBytes += entrySize;
+    }
+    read = (BRRead *)pending->readData + pending->numReads;
+    memset(read, 0, sizeof(BRRead));
+    read->pathIndex = pathIndex;
+    read->maxReadAhead = maxReadAhead;
+    read->readSize = readSize;
+    read->readOffset = readOffset;
+    if (pending->numReads++ == 0) {
+        pending->firstQueuedMillis = curTimeMillis();
+        pthread_cond_signal(&br->batchCV);
+    }
+    pthread_mutex_unlock(&br->batchLock);
+    __atomic_fetch_add(&br->readsQueued, 1, __ATOMIC_RELAXED);
+}
+
+// Moves the pending batch to a free outstanding slot, from which the sender
+// thread will send it. If no slot is free, the oldest batch is abandoned.
+// batchLock must be held.
+static void br_seal_pending(BlockReader *br) {
+    BRPendingBatch  *pending;
+    BROutstandingBatch  *slot;
+    BRHeader    *header;
+    int     i;
+    
+    pending = &br->pending;
+    if (pending->numReads == 0) {
+        return;
+    }
+    slot = NULL;
+    for (i = 0; i < BR_MAX_OUTSTANDING; i++) {
+        if (!br->outstanding[i].inUse) {
+            slot = &br->outstanding[i];
+            break;
+        } else if (slot == NULL || br->outstanding[i].seq < slot->seq) {
+            slot = &br->outstanding[i];
+        }
+    }
+    if (slot->inUse) {
+        __atomic_fetch_add(&br->datagramsLost, 1, __ATOMIC_RELAXED);
+    }
+    header = (BRHeader *)slot->data;
+    memset(header, 0, sizeof(BRHeader));
+    header->magic = BR_MAGIC;
+    header->type = BR_MT_READ_BLOCKS;
+    header->numPaths = pending->numPaths;
+    header->numReads = pending->numReads;
+    header->seq = br->nextSeq++;
+    memcpy(slot->data + sizeof(BRHeader), pending->pathData, pending->pathBytes);
+    memcpy(slot->data + sizeof(BRHeader) + pending->pathBytes, pending->readData, pending->numReads * sizeof(BRRead));
+    slot->length = sizeof(BRHeader) + pending->pathBytes + pending->numReads * sizeof(BRRead);
+    slot->seq = header->seq;
+    slot->attempts = 0;
+    slot->nextSendMillis = 0;
+    slot->inUse = TRUE;
+    pending->numPaths = 0;
+    pending->pathBytes = 0;
+    pending->numReads = 0;
+    pthread_cond_signal(&br->batchCV);
+}
 
-    memset((char*)&serverAddr, 0, sizeof(struct sockaddr_in));
-    serverAddr.sin_family = AF_INET;
-    serverAddr.sin_port = htons(br->port);
+// The first attempt takes the next address round-robin and records its
+// index; later attempts walk on from there so that each tries another peer
+static uint32_t br_remote_address(BlockReader *br, int *index, int attempt) {
+    uint32_t    remoteAddress;
     
     // lock
     pthread_spin_lock(&br->addrLock);
-    if (br->remoteAddresses == NULL) {
+    if (br->remoteAddresses == NULL || br->numRemoteAddresses == 0) {
         remoteAddress = 0x7f000001;
     } else {
-        br->remoteAddressIndex = (br->remoteAddressIndex + 1) % br->numRemoteAddresses;
-        remoteAddress = br->remoteAddresses[br->remoteAddressIndex];
+        if (attempt == 0) {
+            br->remoteAddressIndex = (br->remoteAddressIndex + 1) % br->numRemoteAddresses;
+            *index = br->remoteAddressIndex;
+        }
+        remoteAddress = br->remoteAddresses[(*index + attempt) % br->numRemoteAddresses];
     }
     pthread_spin_unlock(&br->addrLock);
     // unlock
-    //srfsLog(LOG_WARNING, "Sending remote request to %x", remoteAddress);
-    serverAddr.sin_addr.s_addr = htonl(remoteAddress);
-
-    _type = (int *)(buf + BR_TYPE_OFFSET);
-    _length = (size_t *)(buf + BR_LENGTH_OFFSET);
-    _fa = (FileAttr *)(buf + BR_FA_OFFSET);
-    _readOffset = (off_t *)(buf + BR_READ_OFFSET_OFFSET);
-    _readSize = (size_t *)(buf + BR_READ_SIZE_OFFSET);
-    _maxReadAhead = (int *)(buf + BR_MAX_READAHEAD_OFFSET);
-    _path = (char *)(buf + BR_PATH_OFFSET);
+    return remoteAddress;
+}
+
+// Sends sealed batches, flushes the pending batch once it has waited
+// BR_FLUSH_DELAY_MILLIS, and resends batches not acknowledged in time.
+static void *br_sender_run(void *_br) {
+    BlockReader *br;
+    struct mmsghdr  msgs[BR_MAX_OUTSTANDING];
+    struct iovec    iovs[BR_MAX_OUTSTANDING];
+    struct sockaddr_in  serverAddrs[BR_MAX_OUTSTANDING];
     
-    memset(buf, 0, BR_MAX_MESSAGE_SIZE);
-    *_type = BR_MT_READ_BLOCK;
-    *_length = br_message_length_for_path(path);
-    *_fa = *fa;
-    *_readOffset = readOffset;
-    *_readSize = readSize;
-    *_maxReadAhead = maxReadAhead;
-    strcpy(_path, path);
-
-    if (sendto(br->fd, buf, *_length, 0, (struct sockaddr *)&serverAddr, /*slen*/sizeof(struct sockaddr)) < 0) {
-        srfsLog(LOG_WARNING, "errno %d %x", errno, errno);
-        srfsLog(LOG_WARNING, "%d %d", sizeof(struct sockaddr), sizeof(struct sockaddr_in));
-        srfsLog(LOG_WARNING, "%d %d %d %d %d", *_type, *_length, *_readOffset, *_readSize, *_maxReadAhead);
-        srfsLog(LOG_WARNING, "BlockReader failed to send message");
-    } else {
-        srfsLog(LOG_INFO, "br_request_remote_read sent OK");
+    br = (BlockReader *)_br;
+    pthread_mutex_lock(&br->batchLock);
+    while (br->running) {
+        uint64_t    curTime;
+        uint64_t    nextWakeMillis;
+        int     numToSend;
+        int     i;
+        
+        curTime = curTimeMillis();
+        if (br->pending.numReads > 0 && curTime - br->pending.firstQueuedMillis >= BR_FLUSH_DELAY_MILLIS) {
+            br_seal_pending(br);
+        }
+        nextWakeMillis = curTime + BR_IDLE_WAIT_MILLIS;
+        if (br->pending.numReads > 0) {
+            nextWakeMillis = br->pending.firstQueuedMillis + BR_FLUSH_DELAY_MILLIS;
+        }
+        numToSend = 0;
+        for (i = 0; i < BR_MAX_OUTSTANDING; i++) {
+            BROutstandingBatch  *slot;
+            
+            slot = &br->outstanding[i];
+            if (slot->inUse && slot->nextSendMillis <= curTime) {
+                if (slot->attempts == BR_MAX_ATTEMPTS) {
+                    srfsLog(LOG_INFO, "br giving up on batch %lu", slot->seq);
+                    slot->inUse = FALSE;
+                    __atomic_fetch_add(&br->datagramsLost, 1, __ATOMIC_RELAXED);
+                    continue;
+                }
+                if (slot->attempts > 0) {
+                    __atomic_fetch_add(&br->retransmits, 1, __ATOMIC_RELAXED);
+                }
+                memset(&serverAddrs[numToSend], 0, sizeof(struct sockaddr_in));
+                serverAddrs[numToSend].sin_family = AF_INET;
+                serverAddrs[numToSend].sin_port = htons(br->port);
+                serverAddrs[numToSend].sin_addr.s_addr = htonl(br_remote_address(br, &slot->remoteAddressIndex, slot->attempts));
+                slot->attempts++;
+                slot->nextSendMillis = curTime + BR_ACK_TIMEOUT_MILLIS * slot->attempts;
+                iovs[numToSend].iov_base = slot->data;
+                iovs[numToSend].iov_len = slot->length;
+                memset(&msgs[numToSend], 0, sizeof(struct mmsghdr));
+                msgs[numToSend].msg_hdr.msg_name = &serverAddrs[numToSend];
+                msgs[numToSend].msg_hdr.msg_namelen = sizeof(struct sockaddr_in);
+                msgs[numToSend].msg_hdr.msg_iov = &iovs[numToSend];
+                msgs[numToSend].msg_hdr.msg_iovlen = 1;
+                numToSend++;
+            }
+            if (slot->inUse && slot->nextSendMillis < nextWakeMillis) {
+                nextWakeMillis = slot->nextSendMillis;
+            }
+        }
+        if (numToSend > 0) {
+            int numSent;
+            
+            // Slots are reused only under batchLock, so they are sent before releasing it
+            numSent = sendmmsg(br->fd, msgs, numToSend, 0);
+            if (numSent < 0) {
+                srfsLog(LOG_WARNING, "errno %d %x", errno, errno);
+                srfsLog(LOG_WARNING, "BlockReader failed to send batch");
+            } else {
+                __atomic_fetch_add(&br->datagramsSent, numSent, __ATOMIC_RELAXED);
+            }
+        }
+        cv_wait_abs(&br->batchLock, &br->batchCV, nextWakeMillis);
     }
+    pthread_mutex_unlock(&br->batchLock);
+    return NULL;
 }
 
 void br_read_block(BlockReader *br, char *path, FileAttr *fa, size_t readSize, off_t readOffset, int maxReadAhead) {
@@ -362,8 +688,11 @@ void br_read_block(BlockReader *br, char *path, FileAttr *fa, size_t readSize, o
     pbr_read_given_attr(br->pbr, path, NULL, readSize, readOffset, fa, FALSE, maxReadAhead, TRUE);
 }
 
-size_t br_message_length_for_path(char *path) {
-    return BR_PATH_OFFSET + strlen(path) + 1;
+void br_display_stats(BlockReader *br) {
+    srfsLog(LOG_WARNING, "br readsQueued %lu datagramsSent %lu retransmits %lu datagramsLost %lu readsServed %lu readsCoalesced %lu",
+        __atomic_load_n(&br->readsQueued, __ATOMIC_RELAXED), __atomic_load_n(&br->datagramsSent, __ATOMIC_RELAXED),
+        __atomic_load_n(&br->retransmits, __ATOMIC_RELAXED), __atomic_load_n(&br->datagramsLost, __ATOMIC_RELAXED),
+        __atomic_load_n(&br->readsServed, __ATOMIC_RELAXED), __atomic_load_n(&br->readsCoalesced, __ATOMIC_RELAXED));
 }
 
 static void *br_run(void *_br) {
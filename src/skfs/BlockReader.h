@@ -12,6 +12,7 @@
 // includes
 
 #include "AttrReader.h"
+#include "FileID.h"
 #include "PartialBlockReader.h"
 #include "Util.h"
 
@@ -26,11 +27,48 @@
 // public defines
 
 #define BR_DEFAULT_PORT 33777
+#define BR_MAX_DATAGRAM_SIZE	8192
+#define BR_MAX_BATCH_PATHS	64
+#define BR_MAX_BATCH_READS	256
+#define BR_MAX_OUTSTANDING	64
+#define BR_RECENT_BLOCKS	4096
 
 
 //////////
 // types
 
+// Reads queued for the next datagram. Paths are interned: each distinct
+// path is sent once per datagram and reads refer to it by index.
+typedef struct BRPendingBatch {
+    int         numPaths;
+    int         pathOffsets[BR_MAX_BATCH_PATHS];
+    size_t      pathBytes;
+    char        pathData[BR_MAX_DATAGRAM_SIZE] __attribute__((aligned(8)));
+    int         numReads;
+    char        readData[BR_MAX_DATAGRAM_SIZE] __attribute__((aligned(8)));
+    uint64_t    firstQueuedMillis;
+} BRPendingBatch;
+
+// A sent datagram awaiting acknowledgement
+typedef struct BROutstandingBatch {
+    int         inUse;
+    uint64_t    seq;
+    int         attempts;
+    int         remoteAddressIndex; // of the first attempt
+    uint64_t    nextSendMillis;
+    size_t      length;
+    char        data[BR_MAX_DATAGRAM_SIZE] __attribute__((aligned(8)));
+} BROutstandingBatch;
+
+// Recently requested reads, by first block, for dropping duplicate requests.
+// lastBlock is the last block the read covers, including read-ahead.
+typedef struct BRRecentBlock {
+    FileID      fid;
+    uint64_t    block;
+    uint64_t    lastBlock;
+    uint64_t    timeMillis;
+} BRRecentBlock;
+
 typedef struct BlockReader {
     uint16_t    port;
     PartialBlockReader *pbr;
@@ -44,6 +82,22 @@ typedef struct BlockReader {
     uint32_t    *remoteAddresses;
 	pthread_spinlock_t	addrLock;
     // addresses of others...
+                                // client side; batchLock protects the batches and seq
+    pthread_mutex_t batchLock;
+    pthread_cond_t  batchCV;
+	pthread_t   senderThread;
+    uint64_t    nextSeq;
+    BRPendingBatch  pending;
+    BROutstandingBatch  outstanding[BR_MAX_OUTSTANDING];
+                                // server side; used only by thread
+    BRRecentBlock   *recentBlocks;
+                                // stats, updated atomically
+    uint64_t    readsQueued;
+    uint64_t    datagramsSent;
+    uint64_t    retransmits;
+    uint64_t    datagramsLost;
+    uint64_t    readsServed;
+    uint64_t    readsCoalesced;
 } BlockReader;
 
 
@@ -55,5 +109,6 @@ void br_stop(BlockReader *br);
 void br_request_remote_read(BlockReader *br, char *path, FileAttr *fa, size_t readSize, off_t readOffset, int maxReadAhead);
 void br_read_addresses(BlockReader *br, char *remoteAddressFile);
 void br_set_remote_addresses(BlockReader *br, int numRemoteAddresses, uint32_t *remoteAddresses);
+void br_display_stats(BlockReader *br);
 
 #endif
@@ -24,7 +24,7 @@
 /////////////////
 // private types
 
-typedef enum {CACHE_RAW_DATA, CACHE_DHT_VALUE, CACHE_ACTIVE_OP, CACHE_ERROR_CODE, CACHE_DELETED_ENTRY} CacheEntryType;
+typedef enum {CACHE_RAW_DATA, CACHE_DHT_VALUE, CACHE_ACTIVE_OP, CACHE_ERROR_CODE, CACHE_DELETED_ENTRY, CACHE_BLOCK_BUFFER} CacheEntryType;
 
 typedef enum {CRM_WARN, CRM_FATAL_ERROR, CRM_ALLOW} CacheReplacementMode;
 
@@ -96,7 +96,6 @@ Cache *cache_new(char *name, int size, int evictionBatchSize, unsigned int (*has
     //cache->ht = create_hashtable(_cacheMinHashSize, hash, compare);
     cache->ht = create_hashtable(size, hash, compare);
     pthread_rwlock_init(&cache->rwLock, 0); 
-	pthread_spin_init(&cache->statLock, 0);
     srfsLog(LOG_WARNING, "faondf %d", _cache_fatal_error_on_double_free);
 	return cache;
 }
@@ -169,7 +168,6 @@ void cache_delete(Cache **cache) {
 			pthread_rwlock_unlock(&(*cache)->rwLock);
 		}
         */
-		pthread_spin_destroy(&(*cache)->statLock);
 		pthread_rwlock_destroy(&(*cache)->rwLock);
 		mem_free((void **)cache);
 	} else {
@@ -292,6 +290,15 @@ CacheReadResult cache_read(Cache *cache, void *key, size_t keySize, unsigned cha
 				memcpy(buf, (unsigned char *)pRVal->m_pVal + sourceOffset, numToRead);
 				result = CRR_FOUND;
 				break;
+			case CACHE_BLOCK_BUFFER:
+				end = size_min(sourceOffset + size, ((BlockBuffer *)entry->data)->size);
+				numToRead = end - sourceOffset;
+				if (cacheNumRead != NULL) {
+					*cacheNumRead = numToRead;
+				}
+				memcpy(buf, ((BlockBuffer *)entry->data)->data + sourceOffset, numToRead);
+				result = CRR_FOUND;
+				break;
 			case CACHE_ACTIVE_OP:
 				if (activeOpRef != NULL) {
 					ActiveOpRef	*aor;
@@ -387,13 +394,9 @@ CacheReadResult cache_read(Cache *cache, void *key, size_t keySize, unsigned cha
     }
 	pthread_rwlock_unlock(&cache->rwLock);
 	if (!speculativeRead) {
-		pthread_spin_lock(&cache->statLock);
-		cache->stats.readResults[result]++;
-		pthread_spin_unlock(&cache->statLock);
+		__atomic_fetch_add(&cache->stats.readResults[result], 1, __ATOMIC_RELAXED);
 	} else {
-		pthread_spin_lock(&cache->statLock);
-		cache->stats.specReadResults[result]++;
-		pthread_spin_unlock(&cache->statLock);
+		__atomic_fetch_add(&cache->stats.specReadResults[result], 1, __ATOMIC_RELAXED);
 	}
     return result;
 }
@@ -558,14 +561,10 @@ static void cache_evict_if_needed(Cache *cache) {
 		numEvicted = cache_evict_list(cache, &lruList);
 		
 		if (numEvicted > 0) {
-			pthread_spin_lock(&cache->statLock);
-			cache->stats.evictions += numEvicted;
-			pthread_spin_unlock(&cache->statLock);
+			__atomic_fetch_add(&cache->stats.evictions, numEvicted, __ATOMIC_RELAXED);
 		}
 		if (numFailedEvictions > 0) {
-			pthread_spin_lock(&cache->statLock);
-			cache->stats.failed_evictions += numFailedEvictions;
-			pthread_spin_unlock(&cache->statLock);
+			__atomic_fetch_add(&cache->stats.failed_evictions, numFailedEvictions, __ATOMIC_RELAXED);
 		}
 	}
 }
@@ -606,9 +605,7 @@ static CacheStoreResult cache_store_entry(Cache *cache, CacheEntry *entry, int a
 	if (!alreadyLocked) {
 		pthread_rwlock_wrlock(&cache->rwLock);
 	}
-	//pthread_spin_lock(&cache->statLock);
-	cache->stats.writes++;
-	//pthread_spin_unlock(&cache->statLock);
+	__atomic_fetch_add(&cache->stats.writes, 1, __ATOMIC_RELAXED);
 	//oldEntry = (CacheEntry *)hashtable_remove(cache->ht, entry->key);
 	// can't remove here since we might need to leave it in and
 	// the hashtable destroys keys upon removal
@@ -635,6 +632,7 @@ static CacheStoreResult cache_store_entry(Cache *cache, CacheEntry *entry, int a
 			break;
 		case CACHE_RAW_DATA: // fall through to next case
 		case CACHE_DHT_VALUE:
+		case CACHE_BLOCK_BUFFER:
 			if (crm == CRM_ALLOW) {
 				if (_cache_logging_in_critical_section) {
 					srfsLog(LOG_FINE, "allowing replacement %llx in place of %llx", entry, oldEntry);
@@ -736,6 +734,44 @@ CacheStoreResult cache_store_raw_data(Cache *cache, void *key, int keySize, void
                 modificationTimeMicros, timeoutMillis), FALSE, FALSE, replace ? CRM_ALLOW : CRM_FATAL_ERROR);
 }
 
+// The cache takes over one reference to bb if the result is CACHE_STORE_SUCCESS
+CacheStoreResult cache_store_block_buffer(Cache *cache, void *key, int keySize, BlockBuffer *bb, int replace, uint64_t modificationTimeMicros, uint64_t timeoutMillis) {
+	return cache_store_entry(cache, cache_entry_new(CACHE_BLOCK_BUFFER, key, keySize, bb, bb->size, 
+                modificationTimeMicros, timeoutMillis), FALSE, FALSE, replace ? CRM_ALLOW : CRM_WARN);
+}
+
+// Returns CRR_FOUND with a new reference to the cached BlockBuffer, without
+// copying. Entries of any other type, and stale entries, yield
+// CRR_NOT_FOUND; callers fall back to cache_read(), which also handles
+// expiration and op creation.
+CacheReadResult cache_read_block_buffer(Cache *cache, void *key, BlockBuffer **bb, uint64_t minModificationTimeMicros) {
+	CacheEntry	*entry;
+	CacheReadResult	result;
+	uint64_t	_curTimeMillis;
+
+	result = CRR_NOT_FOUND;
+	*bb = NULL;
+    pthread_rwlock_rdlock(&cache->rwLock);
+    entry = (CacheEntry *)hashtable_search(cache->ht, (void *)key); 
+	if (entry != NULL && entry->type == CACHE_BLOCK_BUFFER) {
+		_curTimeMillis = curTimeMillis();
+		if (_curTimeMillis <= entry->expirationTime
+                && minModificationTimeMicros <= entry->modificationTime) {
+			entry->lastAccess = _curTimeMillis; // safe since we are on 64-bit machines
+			*bb = (BlockBuffer *)entry->data;
+			// entries are only deleted under the write lock, so the cache's reference keeps bb alive here
+			bb_ref(*bb);
+			result = CRR_FOUND;
+		}
+	}
+	pthread_rwlock_unlock(&cache->rwLock);
+	// misses are counted by the cache_read() that follows
+	if (result == CRR_FOUND) {
+		__atomic_fetch_add(&cache->stats.readResults[result], 1, __ATOMIC_RELAXED);
+	}
+	return result;
+}
+
 void cache_store_active_op(Cache *cache, void *key, int keySize, ActiveOp *op) {
 	fatalError("deprecated", __FILE__, __LINE__);
 	(void) cache; (void) key; (void) keySize; (void) op; //fix for "unused parameter" warning
@@ -780,9 +816,7 @@ static CacheEntry	*_cache_remove(Cache *cache, void *key, int removeActiveOps) {
     }    
     pthread_rwlock_unlock(&cache->rwLock);
     if (removed) {
-        pthread_spin_lock(&cache->statLock);
-        cache->stats.removals++;
-        pthread_spin_unlock(&cache->statLock);
+        __atomic_fetch_add(&cache->stats.removals, 1, __ATOMIC_RELAXED);
     }
 	return entry;
 }
@@ -855,7 +889,7 @@ static CacheEntry *cache_entry_new(CacheEntryType type, void *key, size_t keySiz
 }
 
 static int cache_entry_is_data_type(CacheEntry *entry) {
-	return entry->type == CACHE_RAW_DATA || entry->type == CACHE_DHT_VALUE;
+	return entry->type == CACHE_RAW_DATA || entry->type == CACHE_DHT_VALUE || entry->type == CACHE_BLOCK_BUFFER;
 }
 
 static size_t cache_entry_get_data_size(CacheEntry *entry) {
@@ -864,6 +898,8 @@ static size_t cache_entry_get_data_size(CacheEntry *entry) {
 			return entry->size;
 		case CACHE_DHT_VALUE:
 			return ((SKVal *)entry->data)->m_len;
+		case CACHE_BLOCK_BUFFER:
+			return ((BlockBuffer *)entry->data)->size;
 		default:
 			fatalError("detected invalid CacheEntry", __FILE__, __LINE__);
 			return 0;
@@ -910,6 +946,9 @@ static void cache_entry_delete(CacheEntry **entry, int deleteData, char *file, i
 				sk_destroy_val((SKVal **)&(*entry)->data);
                 }
 				break;
+			case CACHE_BLOCK_BUFFER:
+				bb_release((BlockBuffer **)&(*entry)->data);
+				break;
 			case CACHE_ACTIVE_OP:
 				if ((*entry)->data != NULL) {
                     if (curTimeMillis() < (*entry)->expirationTime) {
@@ -1027,6 +1066,21 @@ static void cache_display(Cache *cache) {
 }
 
 
+// Adds this cache's counters to stats. Lock-free; counters are read
+// individually, so the result is not a consistent cut.
+void cache_get_stats(Cache *cache, CacheStats *stats) {
+	int	i;
+
+	stats->writes += __atomic_load_n(&cache->stats.writes, __ATOMIC_RELAXED);
+	for (i = 0; i < CRR_CODE_TRAILER; i++) {
+		stats->readResults[i] += __atomic_load_n(&cache->stats.readResults[i], __ATOMIC_RELAXED);
+		stats->specReadResults[i] += __atomic_load_n(&cache->stats.specReadResults[i], __ATOMIC_RELAXED);
+	}
+	stats->evictions += __atomic_load_n(&cache->stats.evictions, __ATOMIC_RELAXED);
+	stats->failed_evictions += __atomic_load_n(&cache->stats.failed_evictions, __ATOMIC_RELAXED);
+	stats->removals += __atomic_load_n(&cache->stats.removals, __ATOMIC_RELAXED);
+}
+
 void cache_display_stats(Cache *cache) {
 	int	i;
 	int	entries;
@@ -7,6 +7,7 @@
 // includes
 
 #include "ActiveOpRef.h"
+#include "BlockBuffer.h"
 #include "skbasictypes.h"
 #include "hashtable.h"
 #include "hashtable_itr.h"
@@ -47,9 +48,8 @@ typedef struct Cache {
     int			size;
     int			evictionBatchSize;
     hashtable	*ht;
-	CacheStats	stats;
+	CacheStats	stats; // updated atomically
 	pthread_rwlock_t	rwLock;
-	pthread_spinlock_t	statLock;
 } Cache;
 
 typedef struct CacheKeyList {
@@ -74,10 +74,13 @@ CacheReadResult cache_read(Cache *cache, void *key, size_t keySize, unsigned cha
 CacheStoreResult cache_store_dht_value(Cache *cache, void *key, int keySize, SKVal *pRVal, 
     uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME, uint64_t timeoutMillis = CACHE_NO_TIMEOUT);
 CacheStoreResult cache_store_raw_data(Cache *cache, void *key, int keySize, void *data, size_t length, int replace = FALSE, uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME, uint64_t timeoutMillis = CACHE_NO_TIMEOUT);
+CacheStoreResult cache_store_block_buffer(Cache *cache, void *key, int keySize, BlockBuffer *bb, int replace = FALSE, uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME, uint64_t timeoutMillis = CACHE_NO_TIMEOUT);
+CacheReadResult cache_read_block_buffer(Cache *cache, void *key, BlockBuffer **bb, uint64_t minModificationTimeMicros = 0);
 void cache_store_active_op(Cache *cache, void *key, int keySize, ActiveOp *op);
 void cache_store_error(Cache *cache, void *key, int keySize, int errorCode, int notifyActiveOps_noStorage /*= FALSE*/, uint64_t modificationTimeMicros, uint64_t timeoutMillis);
 void cache_remove(Cache *cache, void *key, int removeActiveOps = TRUE);
 void cache_remove_active_op(Cache *cache, void *key, int fatalErrorOnNotFound = FALSE);
+void cache_get_stats(Cache *cache, CacheStats *stats);
 void cache_display_stats(Cache *cache);
 void cache_unpin(Cache *cache, void *key);
 CacheKeyList cache_key_list(Cache *cache);
@@ -15,6 +15,7 @@
 #include "Util.h"
 #include "SKVersionConstraint.h"
 #include "SKAsyncSingleValueRetrieval.h"
+#include "SKMetaDataBatch.h"
 
 #include <errno.h>
 #include <string.h>
@@ -43,7 +44,7 @@ static void ddr_store_DirData_as_OpenDir_in_cache(DirDataReadRequest *ddrr, DirD
 static void ddr_process_dht_batch(void **requests, int numRequests, int curThreadIndex);
 static int _ddr_get_OpenDir(DirDataReader *ddr, char *path, OpenDir **od, int createIfNotFound);
 static void ddr_update_dir(DirDataReader *ddr, int curThreadIndex, DirDataReadRequest *ddrr, SKMetaData	*metaData);
-static SKStoredValue *ddr_retrieve_specific_dir_version(DirDataReader *ddr, int curThreadIndex, char *path, uint64_t lowerVersionLimit);
+static SKVal *ddr_retrieve_specific_dir_version(DirDataReader *ddr, int curThreadIndex, char *path, uint64_t upperVersionLimit, uint64_t *version);
 static uint64_t ddr_get_least_version(DirDataReader *ddr, int curThreadIndex, char *path);
 
 ///////////////////
@@ -59,7 +60,7 @@ extern OpenDirWriter	*od_odw;
 ///////////////////
 // implementation
 
-DirDataReader *ddr_new(SRFSDHT *sd, ResponseTimeStats *rtsDirData, OpenDirCache *openDirCache) {
+DirDataReader *ddr_new(SRFSDHT *sd, ResponseTimeStats *rtsDirData, OpenDirCache *openDirCache, AttrCache *attrCache) {
 	DirDataReader *ddr;
 
 	ddr = (DirDataReader*)mem_alloc(1, sizeof(DirDataReader));
@@ -68,6 +69,7 @@ DirDataReader *ddr_new(SRFSDHT *sd, ResponseTimeStats *rtsDirData, OpenDirCache
 	ddr->sd = sd;
 	ddr->rtsDirData = rtsDirData;
 	ddr->openDirCache = openDirCache;
+	ddr->attrCache = attrCache;
 	try {
 		SKNamespacePerspectiveOptions *nspOptions;
         SKNamespace	*ns;
@@ -158,7 +160,7 @@ static void ddr_store_DirData_as_OpenDir_in_cache(DirDataReadRequest *ddrr, DirD
 	OpenDir	*od;
 
 	srfsLog(LOG_FINE, "Storing od in cache %s", ddrr->path);
-	od = od_new(ddrr->path, dd);
+	od = od_new(ddrr->path, dd, ddrr->dirDataReader->attrCache);
 	result = odc_store(ddrr->dirDataReader->openDirCache, ddrr->path, od);
 	if (result == CACHE_STORE_SUCCESS) {
 		srfsLog(LOG_FINE, "Cache store success %s", ddrr->path);
@@ -400,66 +402,52 @@ static void ddr_update_dir(DirDataReader *ddr, int curThreadIndex, DirDataReadRe
                 curMaxVersion = latestKVSVersion;
                 scanning = TRUE;
                 while (scanning) {
-                    SKStoredValue   *ppval;
+                    SKVal   *p;
+                    uint64_t    version;
                     
                     if (srfsLogLevelMet(LOG_INFO)) {
                         srfsLog(LOG_INFO, "ddrr->path %s _od->lastMergedVersion %lu curMaxVersion %lu", 
                                        ddrr->path, _od->lastMergedVersion, curMaxVersion);
                     }
-                    //ppval = retrieve val with greatest version <= upperMergeLimit
-                    ppval = ddr_retrieve_specific_dir_version(ddr, curThreadIndex, ddrr->path, curMaxVersion);
-                    if (ppval != NULL) {
-                        SKMetaData      *storedValMetaData;
-                        
-                        storedValMetaData = ppval->getMetaData();
-                        if (storedValMetaData != NULL) {
-                            if (storedValMetaData->getVersion() > _od->lastMergedVersion) { // ensure scan is active
-                                SKVal	*p;
+                    //p = retrieve val with greatest version <= upperMergeLimit
+                    version = 0;
+                    p = ddr_retrieve_specific_dir_version(ddr, curThreadIndex, ddrr->path, curMaxVersion, &version);
+                    if (p != NULL) {
+                        if (version > _od->lastMergedVersion) { // ensure scan is active
+                            DirData *dd; // points into p; merged (copied) by od_add_DirData, freed with p by sk_destroy_val()
+                            int _updateKVSWithLocal;
                                 
-                                p = ppval->getValue();
-                                if (p != NULL) {
-                                    DirData *dd; // deleted by the pval
-                                    int _updateKVSWithLocal;
-                                        
-                                    _updateKVSWithLocal = FALSE;
-                                    //merge storedVal
-                                    dd = (DirData *)p->m_pVal;
-                                    if (dd != NULL) {
-                                        _updateKVSWithLocal = od_add_DirData(_od, dd, metaData);
-                                        // Only update kvs if the value retrieved is the most recent value in the
-                                        // kvs, and if the local DirData has updates with respect to it
-                                        if (_updateKVSWithLocal && (storedValMetaData->getVersion() == latestKVSVersion)) {
-                                            updateKVSWithLocal = TRUE;
-                                        }
-                                    } else {
-                                        srfsLog(LOG_WARNING, "Unexpected NULL dd %s %d", __FILE__, __LINE__);
-                                    }
-                                    if (srfsLogLevelMet(LOG_INFO)) {
-                                        srfsLog(LOG_INFO, "ddrr->path %s storedValMetaData->getVersion() %lu", ddrr->path, storedValMetaData->getVersion());
-                                        srfsLog(LOG_INFO, "ddrr->path %s _updateKVSWithLocal %d updateKVSWithLocal %d", ddrr->path, _updateKVSWithLocal, updateKVSWithLocal);
-                                    }
-                                    sk_destroy_val(&p);
-                                } else {
-                                    srfsLog(LOG_WARNING, "Unexpected NULL p %s %d", __FILE__, __LINE__);
+                            _updateKVSWithLocal = FALSE;
+                            //merge storedVal
+                            dd = (DirData *)p->m_pVal;
+                            if (dd != NULL) {
+                                _updateKVSWithLocal = od_add_DirData(_od, dd, metaData);
+                                // Only update kvs if the value retrieved is the most recent value in the
+                                // kvs, and if the local DirData has updates with respect to it
+                                if (_updateKVSWithLocal && (version == latestKVSVersion)) {
+                                    updateKVSWithLocal = TRUE;
                                 }
-                                curMaxVersion = storedValMetaData->getVersion() - 1;
-                                if (storedValMetaData->getVersion() == scanLimit) {
-                                    if (srfsLogLevelMet(LOG_INFO)) {
-                                        srfsLog(LOG_INFO, "Reached merged version scan limit %s %lu", ddrr->path, storedValMetaData->getVersion());
-                                    }
-                                    scanning = FALSE;
-                                }
-                            } else { // end of scan found
+                            } else {
+                                srfsLog(LOG_WARNING, "Unexpected NULL dd %s %d", __FILE__, __LINE__);
+                            }
+                            if (srfsLogLevelMet(LOG_INFO)) {
+                                srfsLog(LOG_INFO, "ddrr->path %s version %lu", ddrr->path, version);
+                                srfsLog(LOG_INFO, "ddrr->path %s _updateKVSWithLocal %d updateKVSWithLocal %d", ddrr->path, _updateKVSWithLocal, updateKVSWithLocal);
+                            }
+                            curMaxVersion = version - 1;
+                            if (version == scanLimit) {
                                 if (srfsLogLevelMet(LOG_INFO)) {
-                                    srfsLog(LOG_INFO, "Found already merged version %s %lu", ddrr->path, storedValMetaData->getVersion());
+                                    srfsLog(LOG_INFO, "Reached merged version scan limit %s %lu", ddrr->path, version);
                                 }
                                 scanning = FALSE;
                             }
-                            delete storedValMetaData;
-                        } else {
-                            srfsLog(LOG_WARNING, "Unexpected NULL storedValMetaData %s %d", __FILE__, __LINE__);
+                        } else { // end of scan found
+                            if (srfsLogLevelMet(LOG_INFO)) {
+                                srfsLog(LOG_INFO, "Found already merged version %s %lu", ddrr->path, version);
+                            }
+                            scanning = FALSE;
                         }
-                        delete ppval;
+                        sk_destroy_val(&p);
                     } else {
                         srfsLog(LOG_WARNING, "null val for %s %lu", ddrr->path, curMaxVersion);
                         scanning = FALSE;
@@ -482,14 +470,17 @@ static void ddr_update_dir(DirDataReader *ddr, int curThreadIndex, DirDataReadRe
 	srfsLog(LOG_FINE, "out ddr_update_dir %llx %s %llx", ddrr, ddrr->path, metaData);
 }
 
-static SKStoredValue *ddr_retrieve_specific_dir_version(DirDataReader *ddr, int curThreadIndex, char *path, uint64_t upperVersionLimit) {
-    SKStoredValue   *storedValue;
+// Returns the value with the greatest version <= upperVersionLimit, and sets
+// *version to its version. The version comes from a single batched metadata
+// call; only the value itself is obtained via SKStoredValue.
+static SKVal *ddr_retrieve_specific_dir_version(DirDataReader *ddr, int curThreadIndex, char *path, uint64_t upperVersionLimit, uint64_t *version) {
+    SKVal   *value;
     SKAsyncRetrieval   *pRetrieval;
 	SKOperationState::SKOperationState   dhtMgetErr;
 	uint64_t		t1;
 	uint64_t		t2;
 
-    storedValue = NULL;
+    value = NULL;
     pRetrieval = NULL;
     try {
         SKGetOptions	*getOptions;
@@ -509,10 +500,25 @@ static SKStoredValue *ddr_retrieve_specific_dir_version(DirDataReader *ddr, int
         dhtMgetErr = pRetrieval->getState();
         srfsLog(LOG_FINE, "ddr_retrieve_specific_dir_version get complete %d", dhtMgetErr);
         _path = string(path);
-        if (pRetrieval->getState() != SKOperationState::SUCCEEDED) {
-            storedValue = NULL;
-        } else {
-            storedValue = pRetrieval->getStoredValue(_path);
+        if (pRetrieval->getState() == SKOperationState::SUCCEEDED) {
+            StrVector       keys;
+            SKMetaDataBatch *mdBatch;
+            
+            keys.push_back(_path);
+            mdBatch = pRetrieval->getMetaDataBatch(keys);
+            if (mdBatch != NULL) {
+                if (mdBatch->found(0)) {
+                    SKStoredValue   *storedValue;
+                    
+                    *version = mdBatch->getVersion(0);
+                    storedValue = pRetrieval->getStoredValue(_path);
+                    if (storedValue != NULL) {
+                        value = storedValue->getValue();
+                        delete storedValue;
+                    }
+                }
+                delete mdBatch;
+            }
         }
         
         delete getOptions;
@@ -531,7 +537,7 @@ static SKStoredValue *ddr_retrieve_specific_dir_version(DirDataReader *ddr, int
 		fatalError("ddr unexpected SKClientException", __FILE__, __LINE__);
 	}
     delete pRetrieval;
-    return storedValue;
+    return value;
 }
 
 static uint64_t ddr_get_least_version(DirDataReader *ddr, int curThreadIndex, char *path) {
@@ -559,18 +565,18 @@ static uint64_t ddr_get_least_version(DirDataReader *ddr, int curThreadIndex, ch
         if (pRetrieval->getState() != SKOperationState::SUCCEEDED) {
             leastVersion = 0;
         } else {
-            SKStoredValue   *storedValue;
+            StrVector       keys;
+            SKMetaDataBatch *mdBatch;
             
-            storedValue = pRetrieval->getStoredValue(_path);
-            if (storedValue != NULL) {
-                SKMetaData  *storedValMetaData;
-                
-                storedValMetaData = storedValue->getMetaData();
-                if (storedValMetaData != NULL) {
-                    leastVersion = storedValMetaData->getVersion();
-                    delete storedValMetaData;
+            // Only the version is required; fetch it with a single call
+            // rather than walking SKStoredValue -> SKMetaData
+            keys.push_back(_path);
+            mdBatch = pRetrieval->getMetaDataBatch(keys);
+            if (mdBatch != NULL) {
+                if (mdBatch->found(0)) {
+                    leastVersion = mdBatch->getVersion(0);
                 }
-                delete storedValue;
+                delete mdBatch;
             }
         }
         
@@ -940,7 +946,7 @@ static int _ddr_get_OpenDir(DirDataReader *ddr, char *path, OpenDir **od, int cr
 		if (createIfNotFound == DDR_AUTO_CREATE) {
 			CacheStoreResult	result;
 			
-			*od = od_new(path, NULL);
+			*od = od_new(path, NULL, ddr->attrCache);
 			result = odc_store(ddr->openDirCache, path, *od);
 			if (result == CACHE_STORE_SUCCESS) {
 				returnCode = 0;
@@ -6,6 +6,7 @@
 /////////////
 // includes
 
+#include "AttrCache.h"
 #include "FileIDToPathMap.h"
 #include "G2TaskOutputReader.h"
 #include "OpenDirCache.h"
@@ -34,6 +35,7 @@
 
 typedef struct DirDataReader {
 	OpenDirCache	*openDirCache;
+	AttrCache		*attrCache;
 	QueueProcessor	*dirDataQueueProcessor;
 	SRFSDHT			*sd;
 	SKSession		*(pSession[DDR_DHT_THREADS]);
@@ -47,7 +49,7 @@ typedef struct DirDataReader {
 ///////////////
 // prototypes
 
-DirDataReader *ddr_new(SRFSDHT *sd, ResponseTimeStats *rtsDirData, OpenDirCache *openDirCache);
+DirDataReader *ddr_new(SRFSDHT *sd, ResponseTimeStats *rtsDirData, OpenDirCache *openDirCache, AttrCache *attrCache);
 void ddr_delete(DirDataReader **ddr);
 ActiveOp *ddr_create_active_op(void *_ddr, void *_path, uint64_t noMinModificationTime);
 int ddr_get_OpenDir(DirDataReader *ddr, char *path, OpenDir **od, int createIfNotFound);
@@ -116,3 +116,22 @@ FileAttr *fa_dup(FileAttr *fa) {
 FileAttr *fa_get_deletion_fa() {
     return &deletion_fa;
 }
+
+// Sparse SKFS files report fewer blocks than their size implies. Their hole
+// blocks are not stored; a bitmap of them is stored under the file's
+// SRFS_HOLE_MAP_BLOCK_INDEX block (see wf_skip_ahead).
+int fa_has_holes(FileAttr *fa) {
+    if (fid_is_native_fs(&fa->fid) || !S_ISREG(fa->stat.st_mode) || fa->stat.st_size == 0) {
+        return FALSE;
+    } else {
+        return (uint64_t)fa->stat.st_blocks < ((uint64_t)fa->stat.st_size - 1) / SRFS_BLOCK_SIZE + 1;
+    }
+}
+
+// Size of the stored hole bitmap. Blocks beyond SRFS_HOLE_MAP_MAX_BLOCKS are never holes.
+size_t fa_hole_map_size(FileAttr *fa) {
+    uint64_t    numBlocks;
+    
+    numBlocks = uint64_min(((uint64_t)fa->stat.st_size - 1) / SRFS_BLOCK_SIZE + 1, SRFS_HOLE_MAP_MAX_BLOCKS);
+    return (numBlocks + 7) / 8;
+}
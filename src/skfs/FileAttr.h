@@ -42,5 +42,7 @@ int fa_compare(FileAttr *a, FileAttr *b);
 int fa_to_string(FileAttr *fa, char *dest, size_t bufSize);
 FileAttr *fa_dup(FileAttr *fa);
 FileAttr *fa_get_deletion_fa();
+int fa_has_holes(FileAttr *fa);
+size_t fa_hole_map_size(FileAttr *fa);
 
 #endif
@@ -30,7 +30,7 @@ static Cache *fbc_select_cache(FileBlockCache *fbCache, FileBlockID *fbid);
 ///////////////////
 // implementation
 
-FileBlockCache *fbc_new(char *name, int transientCacheSize, int transientCacheEvictionBatch, FileIDToPathMap *f2p, int numSubCaches) {
+FileBlockCache *fbc_new(char *name, int transientCacheSize, int transientCacheEvictionBatch, FileIDToPathMap *f2p, int numSubCaches, BlockBufferPool *bbp) {
 	FileBlockCache	*fbCache;
 	int		i;
 	int 		transientSubCacheSize;
@@ -52,6 +52,7 @@ FileBlockCache *fbc_new(char *name, int transientCacheSize, int transientCacheEv
 			(unsigned int (*)(void *))fbid_hash, (int(*)(void *, void *))fbid_compare);
 	}
 	fbCache->f2p = f2p;
+	fbCache->bbp = bbp;
 	return fbCache;
 }
 
@@ -121,6 +122,35 @@ CacheReadResult fbc_read_no_op_creation(FileBlockCache *fbCache, FileBlockID *fb
 					 NULL, NULL, minModificationTimeMicros);
 }
 
+CacheReadResult fbc_read_block_buffer(FileBlockCache *fbCache, FileBlockID *fbid, BlockBuffer **bb,
+                                      uint64_t minModificationTimeMicros) {
+	if (fbCache->bbp == NULL) {
+		*bb = NULL;
+		return CRR_NOT_FOUND;
+	}
+	return cache_read_block_buffer(fbc_select_cache(fbCache, fbid), fbid, bb, minModificationTimeMicros);
+}
+
+// Returns NULL if pooled buffers are disabled or exhausted
+BlockBuffer *fbc_block_buffer_new(FileBlockCache *fbCache, const void *data, size_t size) {
+	if (fbCache->bbp == NULL) {
+		return NULL;
+	}
+	return bbp_alloc(fbCache->bbp, data, size);
+}
+
+CacheStoreResult fbc_store_block_buffer(FileBlockCache *fbCache, FileBlockID *fbid, BlockBuffer *bb, int replace,
+                                        uint64_t modificationTimeMicros) {
+	if (srfsLogLevelMet(LOG_FINE)) {
+		char	_fbid[SRFS_MAX_PATH_LENGTH];
+
+		fbid_to_string(fbid, _fbid);
+		srfsLog(LOG_FINE, "fbc_store_block_buffer %llx %s %u", fbid, _fbid, bb->size);
+	}
+	return cache_store_block_buffer(fbc_select_cache(fbCache, fbid), fbid, sizeof(FileBlockID), bb,
+                                    replace, modificationTimeMicros, CACHE_NO_TIMEOUT);
+}
+
 CacheStoreResult fbc_store_dht_value(FileBlockCache *fbCache, FileBlockID *fbid, SKVal *pRVal,
                             uint64_t modificationTimeMicros) {
 	if (srfsLogLevelMet(LOG_FINE)) {
@@ -202,6 +232,18 @@ static int fbc_is_permanent_path(FileBlockCache *fbCache, char *path) {
     return false;
 }
 
+void fbc_get_cache_stats(FileBlockCache *fbCache, CacheStats *stats) {
+	int	i;
+
+	memset(stats, 0, sizeof(CacheStats));
+#ifdef _FBC_USE_PERMANENT_CACHE
+	cache_get_stats(fbCache->permanentCache, stats);
+#endif
+	for (i = 0; i < fbCache->numSubCaches; i++) {
+		cache_get_stats(fbCache->transientCaches[i], stats);
+	}
+}
+
 void fbc_display_stats(FileBlockCache *fbCache) {
 	int	i;
 	
@@ -7,6 +7,7 @@
 // includes
 
 #include "ActiveOpRef.h"
+#include "BlockBuffer.h"
 #include "Cache.h"
 #include "FileBlockID.h"
 #include "FileIDToPathMap.h"
@@ -24,13 +25,14 @@ typedef struct FileBlockCache {
 	char permanentSuffixes[SRFS_MAX_PERMANENT_SUFFIXES][SRFS_MAX_PATH_LENGTH];
 	int numPermanentSuffixes;
 	FileIDToPathMap	*f2p;
+	BlockBufferPool	*bbp; // NULL unless blocks are cached in pooled BlockBuffers
 } FileBlockCache;
 
 
 //////////////////////
 // public prototypes
 
-FileBlockCache *fbc_new(char *name, int transientCacheSize, int transientCacheEvictionBatch, FileIDToPathMap *f2p, int numSubCaches);
+FileBlockCache *fbc_new(char *name, int transientCacheSize, int transientCacheEvictionBatch, FileIDToPathMap *f2p, int numSubCaches, BlockBufferPool *bbp = NULL);
 void fbc_delete(FileBlockCache **fbCache);
 CacheReadResult fbc_read(FileBlockCache *fbCache, FileBlockID *fbid, unsigned char *buf, 
 						size_t sourceOffset, size_t size, ActiveOpRef **activeOpRef, int *cacheNumRead, 
@@ -41,12 +43,18 @@ CacheReadResult fbc_read_no_op_creation(FileBlockCache *fbCache, FileBlockID *fb
 						 uint64_t minModificationTimeMicros);
 CacheStoreResult fbc_store_dht_value(FileBlockCache *fbCache, FileBlockID *fbid, SKVal *pRVal,
                                     uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME);
+CacheReadResult fbc_read_block_buffer(FileBlockCache *fbCache, FileBlockID *fbid, BlockBuffer **bb,
+                                      uint64_t minModificationTimeMicros);
+BlockBuffer *fbc_block_buffer_new(FileBlockCache *fbCache, const void *data, size_t size);
+CacheStoreResult fbc_store_block_buffer(FileBlockCache *fbCache, FileBlockID *fbid, BlockBuffer *bb, int replace = FALSE,
+                                        uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME);
 CacheStoreResult fbc_store_raw_data(FileBlockCache *fbCache, FileBlockID *fbid, void *data, size_t size, int replace = FALSE, uint64_t modificationTimeMicros = CACHE_NO_MODIFICATION_TIME);
 void fbc_remove(FileBlockCache *fbCache, FileBlockID *fbid, int removeActiveOps = TRUE);
 void fbc_store_active_op(FileBlockCache *fbCache, FileBlockID *fbid, ActiveOp *op);
 void fbc_remove_active_op(FileBlockCache *fbCache, FileBlockID *fbid, int fatalErrorOnNotFound = FALSE);
 void fbc_store_error(FileBlockCache *fbCache, FileBlockID *key, int errorCode, uint64_t modificationTimeMicros, uint64_t timeoutMillis);
 void fbc_parse_permanent_suffixes(FileBlockCache *fbCache, char *permanentSuffixes);
+void fbc_get_cache_stats(FileBlockCache *fbCache, CacheStats *stats);
 void fbc_display_stats(FileBlockCache *fbCache);
 
 #endif
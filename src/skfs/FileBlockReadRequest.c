@@ -25,6 +25,9 @@ FileBlockReadRequest *fbrr_new(FileBlockReader *fileBlockReader, FileBlockID *fb
 void fbrr_delete(FileBlockReadRequest **fbrr) {
 	if (fbrr != NULL && *fbrr != NULL) {
 		fbid_delete(&(*fbrr)->fbid);
+		if ((*fbrr)->blockBuffer != NULL) {
+			bb_release(&(*fbrr)->blockBuffer);
+		}
 		mem_free((void **)fbrr);
 	} else {
 		fatalError("bad ptr in fbrr_delete");
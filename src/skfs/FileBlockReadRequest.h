@@ -6,6 +6,7 @@
 /////////////
 // includes
 
+#include "BlockBuffer.h"
 #include "FileBlockID.h"
 #include "FileBlockReader.h"
 #include "Util.h"
@@ -18,6 +19,10 @@ typedef struct FileBlockReadRequest {
 	FileBlockReader	*fileBlockReader;
 	FileBlockID	*fbid;
     uint64_t    minModificationTimeMicros;
+    int         hedged; // native read issued while the kvs read was still outstanding
+    uint64_t    dhtQueuedMicros; // set for traced ops only
+    uint64_t    nfsQueuedMicros;
+    BlockBuffer *blockBuffer; // backs the op's result when it was completed from a pooled copy
 } FileBlockReadRequest;
 
 
@@ -5,10 +5,14 @@
 
 #include "ActiveOp.h"
 #include "ActiveOpRef.h"
+#include "BlockDedup.h"
 #include "FileBlockID.h"
 #include "FileBlockReader.h"
 #include "FileBlockReadRequest.h"
+#include "LatencyHistogram.h"
+#include "PeerBlockCache.h"
 #include "SRFSConstants.h"
+#include "Trace.h"
 #include "Util.h"
 
 #include <errno.h>
@@ -43,6 +47,13 @@ using std::exception;
 
 static void fbr_process_dht_batch(void **requests, int numRequests, int curThreadIndex);
 static void fbr_process_nfs_request(void *_requestOp, int curThreadIndex);
+static void fbr_record_hedge_result(FileBlockReader *fbr, int won);
+static void fbr_trace_queued(ActiveOp *op, int nfs);
+static int fbr_complete_with_block_buffer(FileBlockReadRequest *fbrr, ActiveOp *op, const void *data, size_t size,
+                                          int replace, int *won, CacheStoreResult *result);
+static void fbr_trace_batch(ActiveOpRef **refs, int numRequests, const char *name, uint64_t startMicros, uint64_t endMicros);
+static void fbr_resolve_dedup_refs(FileBlockReader *fbr, int curThreadIndex, ActiveOpRef **refs, SKVal **pvals, int *unresolved, int numVals);
+static int fbr_fetch_from_peers(FileBlockReader *fbr, ActiveOpRef **refs, int numRequests);
 
 
 /////////////////
@@ -88,8 +99,10 @@ FileBlockReader *fbr_new(FileIDToPathMap *f2p,
 			
 			fbr->pSession[i] = sd_new_session(fbr->sd);
 			ns = fbr->pSession[i]->getNamespace(SKFS_FB_NS);
-			nspOptions = ns->getDefaultNSPOptions();
+			// Missing blocks are common; report them per-key rather than via exception
+			nspOptions = sd_new_null_value_nsp_options(ns);
 			fbr->ansp[i] = ns->openAsyncPerspective(nspOptions);
+			delete nspOptions;
 			delete ns;
 		}
     } catch(std::exception &ex) {
@@ -156,6 +169,10 @@ void fbr_parse_no_fbw_paths(FileBlockReader *fbr, char *paths) {
 	pg_parse_paths(fbr->noFBWPaths, paths);
 }
 
+void fbr_set_peer_block_cache(FileBlockReader *fbr, PeerBlockCache *pbc) {
+	fbr->pbc = pbc;
+}
+
 static int fbr_is_no_fbw_path(FileBlockReader *fbr, char *path) {
 	srfsLog(LOG_FINE, "fbr_is_no_fbw_path %s", path);
 	return pg_matches(fbr->noFBWPaths, path);
@@ -181,6 +198,224 @@ static void fbr_mark_op_failed(int numRequests, ActiveOpRef **refs, SRFSDHT* sd,
 	}
 }
 
+// Replace the deduplication references (see BlockDedup.h) among the given
+// values with the content that they reference. Only blocks of files created
+// with FID_SKFS_DEDUP hold references; the values of any other file are
+// never interpreted. All content is fetched in a single batch. References
+// that can't be resolved, and non-empty values of deduplicated files that
+// are not valid references, are destroyed, replaced with NULL, and flagged
+// in unresolved.
+static void fbr_resolve_dedup_refs(FileBlockReader *fbr, int curThreadIndex, ActiveOpRef **refs, SKVal **pvals, int *unresolved, int numVals) {
+	StrVector	contentKeys;
+	int			refIndices[numVals];
+	int			numRefs;
+	int			i;
+	int			j;
+	int			k;
+	
+	numRefs = 0;
+	for (i = 0; i < numVals; i++) {
+		FileBlockReadRequest	*fbrr;
+		
+		unresolved[i] = FALSE;
+		fbrr = (FileBlockReadRequest *)ao_get_target(refs[i]->ao);
+		if (pvals[i] == NULL || pvals[i]->m_len == 0 || !fid_is_dedup(fbid_get_id(fbrr->fbid))) {
+			continue;
+		}
+		if (bd_is_ref(pvals[i]->m_pVal, pvals[i]->m_len)) {
+			char	contentKey[BD_KEY_SIZE];
+			
+			bd_hash_to_key(((BlockDedupRef *)pvals[i]->m_pVal)->hash, contentKey);
+			contentKeys.push_back(contentKey);
+			refIndices[numRefs++] = i;
+		} else {
+			srfsLog(LOG_ERROR, "fbr invalid dedup ref %u", pvals[i]->m_len);
+			sk_destroy_val(&pvals[i]);
+			pvals[i] = NULL;
+			unresolved[i] = TRUE;
+			bd_record_resolution(FALSE);
+		}
+	}
+	if (numRefs > 0) {
+		SKOperationState::SKOperationState	opStates[numRefs];
+		SKFailureCause::SKFailureCause		causes[numRefs];
+		SKVal								*contentVals[numRefs];
+		SKAsyncValueRetrieval				*pRetrieval;
+		
+		srfsLog(LOG_FINE, "fbr resolving %d dedup refs", numRefs);
+		for (j = 0; j < numRefs; j++) {
+			opStates[j] = SKOperationState::FAILED;
+			contentVals[j] = NULL;
+		}
+		pRetrieval = NULL;
+		try {
+			StrValMap	*pValues;
+			
+			pRetrieval = fbr->ansp[curThreadIndex]->get(&contentKeys);
+			pRetrieval->waitForCompletion();
+			pValues = pRetrieval->getValues();
+			for (j = 0; j < numRefs; j++) {
+				StrValMap::iterator	it;
+				
+				it = pValues->find(contentKeys.at(j));
+				if (it != pValues->end() && it->second != NULL) {
+					opStates[j] = SKOperationState::SUCCEEDED;
+					// Identical blocks in one batch share a single retrieved value
+					for (k = 0; k < j; k++) {
+						if (contentKeys.at(k) == contentKeys.at(j)) {
+							break;
+						}
+					}
+					if (k < j) {
+						contentVals[j] = sk_create_val();
+						sk_set_val(contentVals[j], it->second->m_len, it->second->m_pVal);
+					} else {
+						contentVals[j] = it->second;
+					}
+				}
+			}
+			delete pValues;
+		} catch (SKRetrievalException &e) {
+			try {
+				e.getKeyResults(contentKeys, opStates, causes, contentVals);
+			} catch (std::exception &e2) {
+				srfsLog(LOG_ERROR, "fbr dedup getKeyResults exception at %s:%d\n%s\n", __FILE__, __LINE__, e2.what());
+			}
+		} catch (std::exception &e) {
+			srfsLog(LOG_WARNING, "fbr dedup exception at %s:%d\n%s\n", __FILE__, __LINE__, e.what());
+		}
+		if (pRetrieval != NULL) {
+			pRetrieval->close();
+			delete pRetrieval;
+		}
+		for (j = 0; j < numRefs; j++) {
+			BlockDedupRef	*ref;
+			
+			i = refIndices[j];
+			ref = (BlockDedupRef *)pvals[i]->m_pVal;
+			if (opStates[j] == SKOperationState::SUCCEEDED && contentVals[j] != NULL 
+					&& contentVals[j]->m_len == ref->size) {
+				sk_destroy_val(&pvals[i]);
+				pvals[i] = contentVals[j];
+				bd_record_resolution(TRUE);
+			} else {
+				srfsLog(LOG_WARNING, "fbr unresolved dedup ref %s", contentKeys.at(j).c_str());
+				if (contentVals[j] != NULL) {
+					sk_destroy_val(&contentVals[j]);
+				}
+				sk_destroy_val(&pvals[i]);
+				pvals[i] = NULL;
+				unresolved[i] = TRUE;
+				bd_record_resolution(FALSE);
+			}
+		}
+	}
+}
+
+// With pooled block buffers enabled, completes op with a pooled copy of the
+// block and caches that copy. The request keeps a reference so that
+// waiters can copy from the op's result even after the cache drops the
+// block. Returns FALSE, having done nothing, if no buffer is available.
+static int fbr_complete_with_block_buffer(FileBlockReadRequest *fbrr, ActiveOp *op, const void *data, size_t size,
+                                          int replace, int *won, CacheStoreResult *result) {
+	FileBlockCache	*fbc;
+	BlockBuffer	*bb;
+	BlockBuffer	*cacheRef;
+	int			_won;
+
+	fbc = fbrr->fileBlockReader->fileBlockCache;
+	bb = fbc_block_buffer_new(fbc, data, size);
+	if (bb == NULL) {
+		return FALSE;
+	}
+	srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
+	_won = ao_set_complete(op, AOResult_Success, bb->data, bb->size);
+	cacheRef = bb;
+	bb_ref(cacheRef);
+	*result = fbc_store_block_buffer(fbc, fbrr->fbid, cacheRef, replace, fbrr->minModificationTimeMicros);
+	if (*result != CACHE_STORE_SUCCESS) {
+		srfsLog(LOG_FINE, "Cache store rejected");
+		bb_release(&cacheRef);
+	}
+	if (_won && fbrr->blockBuffer == NULL) {
+		fbrr->blockBuffer = bb;
+	} else {
+		// the op was completed by a hedged read, and is backed by that result
+		bb_release(&bb);
+	}
+	if (won != NULL) {
+		*won = _won;
+	}
+	return TRUE;
+}
+
+// Emits a span for each traced request in a batch
+static void fbr_trace_batch(ActiveOpRef **refs, int numRequests, const char *name, uint64_t startMicros, uint64_t endMicros) {
+	char	detail[32];
+	int		i;
+
+	for (i = 0; i < numRequests; i++) {
+		if (refs[i]->ao->traceID != 0) {
+			sprintf(detail, "batch %d", numRequests);
+			tr_span(refs[i]->ao->traceID, name, startMicros, endMicros, detail);
+		}
+	}
+}
+
+// Completes the ops whose blocks the owning peers hold. Satisfied refs are
+// deleted and the rest compacted to the front of refs; returns their number.
+static int fbr_fetch_from_peers(FileBlockReader *fbr, ActiveOpRef **refs, int numRequests) {
+	FileBlockID	*fbids[numRequests];
+	uint64_t	minModificationTimesMicros[numRequests];
+	void		*blocks[numRequests];
+	size_t		blockSizes[numRequests];
+	uint64_t	t1Micros;
+	int			numFound;
+	int			numRemaining;
+	int			i;
+
+	for (i = 0; i < numRequests; i++) {
+		FileBlockReadRequest	*fbrr;
+
+		fbrr = (FileBlockReadRequest *)ao_get_target(refs[i]->ao);
+		fbids[i] = fbrr->fbid;
+		minModificationTimesMicros[i] = fbrr->minModificationTimeMicros;
+	}
+	t1Micros = curTimeMicros();
+	numFound = pbc_fetch(fbr->pbc, fbids, minModificationTimesMicros, numRequests, blocks, blockSizes);
+	fbr_trace_batch(refs, numRequests, "peer_fetch", t1Micros, curTimeMicros());
+	if (numFound == 0) {
+		return numRequests;
+	}
+	numRemaining = 0;
+	for (i = 0; i < numRequests; i++) {
+		if (blocks[i] != NULL) {
+			FileBlockReadRequest	*fbrr;
+			ActiveOp	*op;
+			CacheStoreResult	result;
+
+			op = refs[i]->ao;
+			fbrr = (FileBlockReadRequest *)ao_get_target(op);
+			if (fbr_complete_with_block_buffer(fbrr, op, blocks[i], blockSizes[i], FALSE, NULL, &result)) {
+				mem_free(&blocks[i]);
+			} else {
+				srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
+				ao_set_complete(op, AOResult_Success, blocks[i], blockSizes[i]);
+				result = fbc_store_raw_data(fbr->fileBlockCache, fbrr->fbid, blocks[i], blockSizes[i], FALSE,
+											fbrr->minModificationTimeMicros);
+				if (result != CACHE_STORE_SUCCESS) {
+					srfsLog(LOG_FINE, "Cache store rejected");
+					mem_free(&blocks[i]);
+				}
+			}
+			aor_delete(&refs[i]);
+		} else {
+			refs[numRemaining++] = refs[i];
+		}
+	}
+	return numRemaining;
+}
+
 static void fbr_process_dht_batch(void **requests, int numRequests, int curThreadIndex) {
 	SKOperationState::SKOperationState	dhtMgetErr = SKOperationState::FAILED;
 	FileBlockReader	*fbr;
@@ -201,8 +436,6 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
 
     memset(isDuplicate, 0, sizeof(int) * numRequests);
     
-	// Create requestGroup
-    hasSKFSRequests = FALSE;
 	for (i = 0; i < numRequests; i++) {
 		FileBlockReadRequest	*fbrr;
 		ActiveOp	*op;
@@ -210,7 +443,9 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
 		refs[i] = (ActiveOpRef *)requests[i];
 		op = refs[i]->ao;
 		fbrr = (FileBlockReadRequest *)ao_get_target(op);
-		fbrr_display(fbrr, LOG_FINE);
+		if (op->traceID != 0) {
+			tr_span(op->traceID, "dht_queue_wait", fbrr->dhtQueuedMicros, curTimeMicros());
+		}
 		if (fbr == NULL) {
 			fbr = fbrr->fileBlockReader;
 		} else {
@@ -218,6 +453,24 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
 				fatalError("multi fbr batch");
 			}
 		}
+	}
+
+	// Ask the blocks' owners before going to the kvs
+	if (fbr->pbc != NULL) {
+		numRequests = fbr_fetch_from_peers(fbr, refs, numRequests);
+		if (numRequests == 0) {
+			srfsLog(LOG_FINE, "out fbr_process_dht_batch all from peers");
+			return;
+		}
+	}
+
+	// Create requestGroup
+    hasSKFSRequests = FALSE;
+	for (i = 0; i < numRequests; i++) {
+		FileBlockReadRequest	*fbrr;
+
+		fbrr = (FileBlockReadRequest *)ao_get_target(refs[i]->ao);
+		fbrr_display(fbrr, LOG_FINE);
         // Simple heuristic to display errors when pure SKFS block reads fail
         // FUTURE - handle all cases
         if (!fid_is_native_fs(fbid_get_id(fbrr->fbid))) {
@@ -231,16 +484,54 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
 	// Retrieve from kvs
 	srfsLog(LOG_FINE, "fbr_process_dht_batch call get %d %d %d %d", numRequests, requestGroup.size(), defaultChecksum, defaultCompression);
     try {
+        uint64_t    t1Micros;
+        uint64_t    t2Micros;
+
     	t1 = curTimeMillis();
+        t1Micros = curTimeMicros();
         pValRetrieval = fbr->ansp[curThreadIndex]->get(&requestGroup);
     	// FUTURE - could loop through completed results instead of blocking up front
         // (would pipeline the result processing)
         pValRetrieval->waitForCompletion();
 	    t2 = curTimeMillis();
+	    t2Micros = curTimeMicros();
+	    lh_record(LH_DHT_MULTI_GET, t2Micros - t1Micros);
+	    fbr_trace_batch(refs, numRequests, "dht_multi_get", t1Micros, t2Micros);
 	    rts_add_sample(fbr->rtsDHT, t2 - t1, numRequests);
         dhtMgetErr = pValRetrieval->getState();
     } catch (SKRetrievalException & e ){
-        // No need to handle duplicates here as each ppval is created on each iteration
+		SKOperationState::SKOperationState	opStates[numRequests];
+		SKFailureCause::SKFailureCause		causes[numRequests];
+		SKVal								*pvals[numRequests];
+		
+		// Obtain all per-key results in bulk rather than with several JNI calls per key
+		try {
+			uint64_t	jniT1;
+
+			jniT1 = curTimeMicros();
+			e.getKeyResults(requestGroup, opStates, causes, pvals);
+			lh_record(LH_JNI_CONVERSION, curTimeMicros() - jniT1);
+			fbr_trace_batch(refs, numRequests, "jni_conversion", jniT1, curTimeMicros());
+		} catch (std::exception & e2) {
+			srfsLog(LOG_ERROR, "fbr getKeyResults exception at %s:%d\n%s\n", __FILE__, __LINE__, e2.what()); 
+			for (i = 0; i < numRequests; i++) {
+				opStates[i] = SKOperationState::FAILED;
+				causes[i] = SKFailureCause::ERROR;
+				pvals[i] = NULL;
+			}
+		}
+		{
+			int	unresolved[numRequests];
+			
+			fbr_resolve_dedup_refs(fbr, curThreadIndex, refs, pvals, unresolved, numRequests);
+			for (i = 0; i < numRequests; i++) {
+				if (unresolved[i]) {
+					opStates[i] = SKOperationState::FAILED;
+					causes[i] = SKFailureCause::ERROR;
+				}
+			}
+		}
+        // Each key has its own ppval here (duplicate keys are converted separately)
 		for (i = 0; i < numRequests; i++) {
 			ActiveOp		      *op;
 			FileBlockReadRequest  *fbrr;
@@ -252,43 +543,36 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
 			successful  = FALSE;
 			op = refs[i]->ao;
 			fbrr = (FileBlockReadRequest *)ao_get_target(op);
-			opState = e.getOperationState(keys[i]);
+			opState = opStates[i];
 			if (opState == SKOperationState::SUCCEEDED) {
-				SKStoredValue   *pStoredVal; 
+				SKVal   *ppval;
                 
-				pStoredVal = NULL;
-				pStoredVal = e.getStoredValue(keys[i]);
-				if (pStoredVal == NULL) {
-					//assume op has failed
-					sd_op_failed(fbr->sd, dhtMgetErr, __FILE__, __LINE__);
-					srfsLog(LOG_WARNING, "fbr dhtErr no pStoredVal %s %d line %d", keys[i], opState, __LINE__);
+				ppval = pvals[i];
+				if (ppval == NULL ) {  
+					// missing values are reported as null values (see fbr_new)
+					srfsLog(LOG_FINE, "fbr no pval %llx %s : %s line %d", fbrr, SKFS_FB_NS, keys[i], __LINE__);
 				} else {
-					SKVal   *ppval;
-                    
-					ppval = pStoredVal->getValue();
-					if (ppval == NULL ) {  
-						//assume op has failed
-						sd_op_failed(fbr->sd, dhtMgetErr, __FILE__, __LINE__);
-						srfsLog(LOG_WARNING, "fbr dhtErr no pval %llx %s : %s line %d", fbrr, SKFS_FB_NS, keys[i], __LINE__);
+					if ((ppval->m_len == 0) || (ppval->m_len > SRFS_BLOCK_SIZE)) {
+						srfsLog(LOG_WARNING, "Ignoring block with bogus size fbid->block %d m_len %d %s %d", fbrr->fbid->block, ppval->m_len, __FILE__, __LINE__);
+						sk_destroy_val(&ppval);
 					} else {
-						if ((ppval->m_len == 0) || (ppval->m_len > SRFS_BLOCK_SIZE)) {
-							srfsLog(LOG_WARNING, "Ignoring block with bogus size fbid->block %d m_len %d %s %d", fbrr->fbid->block, ppval->m_len, __FILE__, __LINE__);
+						CacheStoreResult	result;
+							
+						// FUTURE - could add sanity check of this specific block size
+						if (fbr_complete_with_block_buffer(fbrr, op, ppval->m_pVal, ppval->m_len, FALSE, NULL, &result)) {
+							sk_destroy_val(&ppval);
 						} else {
-							CacheStoreResult	result;
-								
-                            // FUTURE - could add sanity check of this specific block size
-                            srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
-                            ao_set_complete(op, AOResult_Success, ppval->m_pVal, ppval->m_len);
-						    successful = TRUE;
-                            srfsLog(LOG_FINE, "Storing block cache");
-                            result = fbc_store_dht_value(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid, ppval, fbrr->minModificationTimeMicros);
-                            if (result != CACHE_STORE_SUCCESS) {
-                                srfsLog(LOG_FINE, "Cache store rejected");
-                                sk_destroy_val(&ppval);
-                            }
+							srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
+							ao_set_complete(op, AOResult_Success, ppval->m_pVal, ppval->m_len);
+							srfsLog(LOG_FINE, "Storing block cache");
+							result = fbc_store_dht_value(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid, ppval, fbrr->minModificationTimeMicros);
+							if (result != CACHE_STORE_SUCCESS) {
+								srfsLog(LOG_FINE, "Cache store rejected");
+								sk_destroy_val(&ppval);
+							}
 						}
+						successful = TRUE;
 					}
-					delete pStoredVal;
 				}
 			} //opState == SKOperationState::SUCCEEDED
 			 else { //SKOperationState::INCOMPLETE or SKOperationState::FAILED 
@@ -296,15 +580,10 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
                 
 				cause = SKFailureCause::ERROR;
 				if (opState == SKOperationState::FAILED){
-					try {
-						cause = e.getFailureCause(keys[i]); 
-					} catch(SKClientException & e2) {
-                        srfsLog(LOG_ERROR, "fbr getFailureCause exception at %s:%d\n%s\n", __FILE__, __LINE__, e2.what()); 
-                    } catch(std::exception& e2) {
-                        srfsLog(LOG_ERROR, "fbr getFailureCause exception at %s:%d\n%s\n", __FILE__, __LINE__, e2.what()); 
-                    } catch (...) {
-                        srfsLog(LOG_WARNING, "exception fbr failed to query FailureCause"); 
-                    }
+					cause = causes[i];
+				}
+				if (pvals[i] != NULL) {
+					sk_destroy_val(&pvals[i]);
 				}
 				//mark all except SKFailureCause::NO_SUCH_VALUE
 				if (cause == SKFailureCause::NO_SUCH_VALUE) {
@@ -371,8 +650,11 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
         srfsLog(LOG_FINE, "fbr dht batch got %d", dhtMgetErr);
     }
 
+    uint64_t    jniT1 = curTimeMicros();
     StrValMap   *pValues = pValRetrieval->getValues();
 	OpStateMap  *opStateMap = pValRetrieval->getOperationStateMap();
+    lh_record(LH_JNI_CONVERSION, curTimeMicros() - jniT1);
+    fbr_trace_batch(refs, numRequests, "jni_conversion", jniT1, curTimeMicros());
     int foundDuplicate = FALSE;
 
     // Check for duplicates
@@ -388,6 +670,32 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
         }
     }
     
+    {
+        SKVal   *vals[numRequests];
+        int     unresolved[numRequests];
+        
+        for (i = 0; i < numRequests; i++) {
+            vals[i] = NULL;
+            if (!isDuplicate[i]) {
+                StrValMap::iterator it;
+                
+                it = pValues->find(keys[i]);
+                if (it != pValues->end()) {
+                    vals[i] = it->second;
+                }
+            }
+        }
+        fbr_resolve_dedup_refs(fbr, curThreadIndex, refs, vals, unresolved, numRequests);
+        for (i = 0; i < numRequests; i++) {
+            if (unresolved[i]) {
+                (*pValues)[keys[i]] = NULL;
+                (*opStateMap)[keys[i]] = SKOperationState::FAILED;
+            } else if (vals[i] != NULL) {
+                (*pValues)[keys[i]] = vals[i];
+            }
+        }
+    }
+    
     for (i = 0; i < numRequests; i++) {
         if (!isDuplicate[i]) {
             ActiveOp		      *op;
@@ -452,16 +760,20 @@ static void fbr_process_dht_batch(void **requests, int numRequests, int curThrea
                             // Below will create a copy of the zero block for now.
                             sk_set_val(ppval, SRFS_BLOCK_SIZE, (void *)zeroBlock);
                         }
-                        srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
-                        ao_set_complete(op, AOResult_Success, ppval->m_pVal, ppval->m_len);
-                        successful = TRUE;
-                        srfsLog(LOG_FINE, "Storing block cache");
-                        result = fbc_store_dht_value(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid,
-                                                     ppval, fbrr->minModificationTimeMicros);
-                        if (result != CACHE_STORE_SUCCESS) {
-                            srfsLog(LOG_FINE, "Cache store rejected");
+                        if (fbr_complete_with_block_buffer(fbrr, op, ppval->m_pVal, ppval->m_len, FALSE, NULL, &result)) {
                             sk_destroy_val(&ppval);
+                        } else {
+                            srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
+                            ao_set_complete(op, AOResult_Success, ppval->m_pVal, ppval->m_len);
+                            srfsLog(LOG_FINE, "Storing block cache");
+                            result = fbc_store_dht_value(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid,
+                                                         ppval, fbrr->minModificationTimeMicros);
+                            if (result != CACHE_STORE_SUCCESS) {
+                                srfsLog(LOG_FINE, "Cache store rejected");
+                                sk_destroy_val(&ppval);
+                            }
                         }
+                        successful = TRUE;
                     }
                 }
             } //opState == SKOperationState::SUCCEEDED
@@ -590,7 +902,11 @@ static void *fbr_read_block_raw(FileBlockReadRequest *fbrr, size_t *_blockSize,
 		totalRead = 0;
 		zeroReadRetries = 0;
 		while (totalRead < blockSize) {
+			uint64_t	preadT1;
+
+			preadT1 = curTimeMicros();
 			numRead = pread(fd, dest, blockSize - totalRead, offset);
+			lh_record(LH_NFS_PREAD, curTimeMicros() - preadT1);
 			if (numRead > 0) {
 				totalRead += numRead;
 				dest += numRead;
@@ -710,6 +1026,25 @@ static void *fbr_read_block(FileBlockReadRequest *fbrr, size_t *_blockSize, int
 	}
 }
 
+// A hedge wins if the native read completes the op before the kvs does
+static void fbr_record_hedge_result(FileBlockReader *fbr, int won) {
+	__atomic_fetch_add(won ? &fbr->hedgeWins : &fbr->hedgeLosses, 1, __ATOMIC_RELAXED);
+}
+
+// Notes when a traced op was queued so that its queue wait can be reported
+static void fbr_trace_queued(ActiveOp *op, int nfs) {
+	FileBlockReadRequest	*fbrr;
+
+	if (op->traceID != 0) {
+		fbrr = (FileBlockReadRequest *)ao_get_target(op);
+		if (nfs) {
+			fbrr->nfsQueuedMicros = curTimeMicros();
+		} else {
+			fbrr->dhtQueuedMicros = curTimeMicros();
+		}
+	}
+}
+
 static void fbr_process_nfs_request(void *_requestOpRef, int curThreadIndex) {
 	FileBlockReadRequest	*fbrr;
 	ActiveOpRef	*aor;
@@ -718,6 +1053,7 @@ static void fbr_process_nfs_request(void *_requestOpRef, int curThreadIndex) {
 	size_t		blockSize;
 	uint64_t	t1;
 	uint64_t	t2;
+	uint64_t	traceT1;
 	int			cacheInDHT;
 
 	srfsLog(LOG_FINE, "in fbr_process_nfs_request %d %llx", curThreadIndex, _requestOpRef);
@@ -727,33 +1063,55 @@ static void fbr_process_nfs_request(void *_requestOpRef, int curThreadIndex) {
 	fbrr_display(fbrr, LOG_FINE);
 
 	cacheInDHT = TRUE;
+	traceT1 = 0;
+	if (op->traceID != 0) {
+		traceT1 = curTimeMicros();
+		tr_span(op->traceID, "nfs_queue_wait", fbrr->nfsQueuedMicros, traceT1);
+	}
 	t1 = curTimeMillis();
 	blockData = fbr_read_block(fbrr, &blockSize, &cacheInDHT);
 	t2 = curTimeMillis();
+	tr_span(op->traceID, "nfs_read", traceT1, curTimeMicros(), fbrr->hedged ? "hedge" : NULL);
 	rts_add_sample(fbrr->fileBlockReader->rtsNFS, t2 - t1, 1);
 	if (blockData != NULL) {
 		CacheStoreResult	result;
         void		        *blockDataForWrite;
+        int                 won;
 		
-        srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
-        ao_set_complete(op, AOResult_Success, blockData, blockSize);
-        blockDataForWrite = mem_dup(blockData, blockSize);
-		srfsLog(LOG_FINE, "Storing block cache %d", blockSize);
-		result = fbc_store_raw_data(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid,      
-                            blockData, blockSize, TRUE, fbrr->minModificationTimeMicros);
+        if (fbr_complete_with_block_buffer(fbrr, op, blockData, blockSize, TRUE, &won, &result)) {
+            // the op and the cache reference the pooled copy, so blockData itself can be written
+            blockDataForWrite = blockData;
+            blockData = NULL;
+        } else {
+            srfsLog(LOG_FINE, "set op complete %llx %s %d", op, __FILE__, __LINE__);
+            won = ao_set_complete(op, AOResult_Success, blockData, blockSize);
+            blockDataForWrite = mem_dup(blockData, blockSize);
+            srfsLog(LOG_FINE, "Storing block cache %d", blockSize);
+            result = fbc_store_raw_data(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid,      
+                                blockData, blockSize, TRUE, fbrr->minModificationTimeMicros);
+        }
+        if (fbrr->hedged) {
+            fbr_record_hedge_result(fbrr->fileBlockReader, won);
+        }
 		if (result == CACHE_STORE_SUCCESS) {
 			if (cacheInDHT) {
                 fbw_write_file_block(fbrr->fileBlockReader->fbwCompress, fbrr->fbid, blockSize, blockDataForWrite, NULL);
                 //fbw_write_file_block(fbrr->fileBlockReader->fbwCompress, fbrr->fbid, blockSize, blockData, aor_new(op, __FILE__, __LINE__));
 			} else {
 				srfsLog(LOG_FINE, "non fbw path");
+				mem_free(&blockDataForWrite);
 			}
 		} else {
 			srfsLog(LOG_FINE, "Cache store rejected");
-			mem_free(&blockData);
+			if (blockData != NULL) {
+				mem_free(&blockData);
+			}
 			mem_free(&blockDataForWrite);
 		}
 	} else {
+        if (fbrr->hedged) {
+            fbr_record_hedge_result(fbrr->fileBlockReader, FALSE);
+        }
         srfsLog(LOG_FINE, "set op complete error %llx %d %s %d", op, ETIMEDOUT, __FILE__, __LINE__);
         fbc_remove_active_op(fbrr->fileBlockReader->fileBlockCache, fbrr->fbid);
         ao_set_complete_error(op, ETIMEDOUT);                    
@@ -804,6 +1162,7 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
 	ActiveOpRef		*activeOpRefs[numRequests];
 	int				cacheNumRead[numRequests];
 	char			statCounted[numRequests];
+	char			dhtRejected[numRequests];
 	int				returnCode;
 	int				i;
 	uint64_t		timeout;
@@ -814,6 +1173,7 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
 		activeOpRefs[i] = NULL;
 		cacheNumRead[i] = 0;
         aoResults[i] = AOResult_Incomplete;
+		dhtRejected[i] = FALSE;
 	}
 	
 	// This function works on the group of requests for efficiency.
@@ -821,8 +1181,15 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
 	// First look in the cache, and begin key value store requests for any missing values
 	srfsLog(LOG_FINE, "looking in cache for block");
 	for (i = 0; i < numRequests; i++) {
+		uint64_t	cacheT1;
+		uint64_t	cacheT2;
+
+		cacheT1 = curTimeMicros();
 		results[i] = fbc_read(fbr->fileBlockCache, pbrrs[i]->fbid, (unsigned char *)pbrrs[i]->dest, 
 							pbrrs[i]->readOffset, pbrrs[i]->readSize, &activeOpRefs[i], &cacheNumRead[i], fbr, pbrrs[i]->minModificationTimeMicros, _FBR_READ_OP_TIMEOUT_MILLIS);
+		cacheT2 = curTimeMicros();
+		lh_record(LH_CACHE_LOOKUP, cacheT2 - cacheT1);
+		tr_span(pbrrs[i]->traceID, "cache_lookup", cacheT1, cacheT2, crr_strings[results[i]]);
 		statCounted[i] = 0;
 		srfsLog(LOG_FINE, "cache results[%d] %d cacheNumRead[i] %d", i, results[i], cacheNumRead[i]);
 		if (results[i] == CRR_ACTIVE_OP_CREATED) {
@@ -835,11 +1202,23 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
 			srfsLog(LOG_FINE, "Queueing op %llx %llx", pbrrs[i]->fbid, op);
 			aor = aor_new(op, __FILE__, __LINE__);
             // value was not in the cache, look in the kvs
+            if (pbrrs[i]->traceID != 0) {
+                op->traceID = pbrrs[i]->traceID;
+                fbr_trace_queued(op, FALSE);
+            }
 			added = qp_add(fbr->dhtFileBlockQueueProcessor, aor);
 			if (!added) {
 				aor_delete(&aor);
-                // FUTURE - currently, any rejected requests are still waited on (below)
-                // as if the kvs request is active. Could remove that wait
+				srfsLog(LOG_WARNING, "kvs queue rejected %llx", pbrrs[i]->fbid);
+				dhtRejected[i] = TRUE;
+				if (!fid_is_native_fs(&pbrrs[i]->fbid->fid)) {
+					// No kvs read will be issued; fail the op so that neither we
+					// nor any other waiter sits out the stage timeout
+					fbc_remove_active_op(fbr->fileBlockCache, pbrrs[i]->fbid);
+					ao_set_complete_error(op, EIO);
+					aoResults[i] = AOResult_Error;
+				}
+				// Native fs blocks go straight to the native fs below
 			}
 		} else if (results[i] == CRR_FOUND) {
 			if ((unsigned int)cacheNumRead[i] == pbrrs[i]->readSize) {
@@ -875,11 +1254,16 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
 			// since we don't need the result.
 			//srfsLog(LOG_WARNING, "Ahead: CRR_ACTIVE_OP_CREATED %s", fbid);
 			//srfsLog(LOG_WARNING, "Ahead: Queueing op %llx %llx", pbrrsReadAhead[i]->fbid, aor->ao);
+            // Read-ahead must not delay demand misses; it is shed when the queue backs up
+            if (pbrrsReadAhead[i]->traceID != 0) {
+                aor->ao->traceID = pbrrsReadAhead[i]->traceID;
+                fbr_trace_queued(aor->ao, useNFSReadAhead);
+            }
             if (!useNFSReadAhead) {
-                added = qp_add(fbr->dhtFileBlockQueueProcessor, aor);
+                added = qp_add(fbr->dhtFileBlockQueueProcessor, aor, ABQ_PRIORITY_READAHEAD);
             } else {
                 srfsLog(LOG_FINE, "adding request %d to nfs q", i);
-                added = qp_add(fbr->nfsFileBlockQueueProcessor, aor);
+                added = qp_add(fbr->nfsFileBlockQueueProcessor, aor, ABQ_PRIORITY_READAHEAD);
             }
 			if (!added) {
 				aor_delete(&aor);
@@ -914,15 +1298,31 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
     }
 	srfsLog(LOG_FINE, "stage timeout %u", timeout);
 	for (i = 0; i < numRequests; i++) {
-        if (aoResults[i] != AOResult_Success) {
-			aoResults[i] = aor_wait_for_stage_timed(activeOpRefs[i], SRFS_OP_STAGE_DHT, timeout);
+        if (aoResults[i] != AOResult_Success && aoResults[i] != AOResult_Error) {
+            if (!dhtRejected[i]) {
+                uint64_t    waitT1;
+
+                waitT1 = curTimeMicros();
+                aoResults[i] = aor_wait_for_stage_timed(activeOpRefs[i], SRFS_OP_STAGE_DHT, timeout);
+                tr_span(pbrrs[i]->traceID, "dht_wait", waitT1, curTimeMicros(),
+                        aoResults[i] == AOResult_Timeout ? "timeout" : NULL);
+            }
 			if (aoResults[i] != AOResult_Success) {
 				if (fid_is_native_fs(&pbrrs[i]->fbid->fid)) {
                     int         added;
                     ActiveOpRef *aor;
 
+                    if (aoResults[i] == AOResult_Timeout) {
+                        FileBlockReadRequest    *fbrr;
+
+                        // the kvs read is still outstanding; this is a hedge rather than a fallback
+                        fbrr = (FileBlockReadRequest *)ao_get_target(activeOpRefs[i]->ao);
+                        fbrr->hedged = TRUE;
+                        __atomic_fetch_add(&fbr->hedgesIssued, 1, __ATOMIC_RELAXED);
+                    }
                     aor = NULL;
 					srfsLog(LOG_FINE, "adding request %d to nfs q", i);
+                    fbr_trace_queued(activeOpRefs[i]->ao, TRUE);
                     aor = aor_new(activeOpRefs[i]->ao, __FILE__, __LINE__);
 					added = qp_add(fbr->nfsFileBlockQueueProcessor, aor);
                     if (!added) {
@@ -947,12 +1347,16 @@ int fbr_read(FileBlockReader *fbr, PartialBlockReadRequest **pbrrs, int numReque
 	for (i = 0; i < numRequests; i++) {
 		srfsLog(LOG_FINE, "results[%d] %d", i, results[i]);
         if (aoResults[i] != AOResult_Success && aoResults[i] != AOResult_Error) {
+            uint64_t    waitT1;
+
+            waitT1 = curTimeMicros();
 			if (fid_is_native_fs(&pbrrs[i]->fbid->fid)) {
                 aoResults[i] = aor_wait_for_stage_timed(activeOpRefs[i], AO_STAGE_COMPLETE, FBR_NFS_STAGE_TIMEOUT_MS);
             } else {
                 aoResults[i] = aor_wait_for_stage_timed(activeOpRefs[i], SRFS_OP_STAGE_DHT,
                                          FBR_DHT_STAGE_WRITABLE_FS_TIMEOUT_MS);
             }
+            tr_span(pbrrs[i]->traceID, "completion_wait", waitT1, curTimeMicros());
 			if (!statCounted[i]) {
 				statCounted[i] = TRUE;
 				if (fid_is_native_fs(&pbrrs[i]->fbid->fid)) {
@@ -1072,9 +1476,14 @@ void fbr_display_stats(FileBlockReader *fbr, int detailedStats) {
     rts_display(fbr->rtsDHT);
     srfsLog(LOG_WARNING, "fbr ResponseTimeStats: NFS");
     rts_display(fbr->rtsNFS);
+	qp_display_stats(fbr->dhtFileBlockQueueProcessor, "fbrDHT");
+	qp_display_stats(fbr->nfsFileBlockQueueProcessor, "fbrNFS");
 	pthread_spin_lock(&fbr->statLock);
     srfsLog(LOG_WARNING, "NFS source");
 	srfsLog(LOG_WARNING, "directNFS: \t%lu", fbr->directNFS);
 	srfsLog(LOG_WARNING, "compressedNFS: \t%lu", fbr->compressedNFS);
 	pthread_spin_unlock(&fbr->statLock);
+	srfsLog(LOG_WARNING, "hedgesIssued: \t%lu\thedgeWins: %lu\thedgeLosses: %lu",
+		__atomic_load_n(&fbr->hedgesIssued, __ATOMIC_RELAXED), __atomic_load_n(&fbr->hedgeWins, __ATOMIC_RELAXED),
+		__atomic_load_n(&fbr->hedgeLosses, __ATOMIC_RELAXED));
 }
@@ -27,6 +27,8 @@
 //////////
 // types
 
+struct PeerBlockCache;
+
 typedef struct FileBlockReader {
 	FileIDToPathMap *f2p;
 	FileBlockCache	*fileBlockCache;
@@ -41,9 +43,13 @@ typedef struct FileBlockReader {
 	ReaderStats		*rs;
 	PathGroup		*compressedPaths;
 	PathGroup		*noFBWPaths;
+	struct PeerBlockCache	*pbc; // NULL unless peer caching is enabled
 							// stats
 	uint64_t		directNFS;
 	uint64_t		compressedNFS;
+	uint64_t		hedgesIssued; // hedge counters are updated atomically
+	uint64_t		hedgeWins;
+	uint64_t		hedgeLosses;
 	SKSession		*(pSession[FBR_DHT_THREADS]);
     SKAsyncNSPerspective *(ansp[FBR_DHT_THREADS]);
 	pthread_spinlock_t	statLock;
@@ -69,5 +75,6 @@ void fbr_display_stats(FileBlockReader *fbr, int detailedStats);
 void *fbr_read_block_compressed_test(void *fbrr, size_t *_blockSize, char *path);
 void fbr_parse_compressed_paths(FileBlockReader *fbr, char *paths);
 void fbr_parse_no_fbw_paths(FileBlockReader *fbr, char *paths);
+void fbr_set_peer_block_cache(FileBlockReader *fbr, struct PeerBlockCache *pbc);
 
 #endif
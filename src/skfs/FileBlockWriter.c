@@ -33,6 +33,7 @@ static void fbw_process_dht_batch(void **requests, int numRequests, int curThrea
 static int fbw_write_not_sane(FileBlockWriteRequest *fbwr, size_t dataLength);
 static FBW_ActiveDirectPut *fbwadp_new();
 static void fbwadp_delete(FBW_ActiveDirectPut **adp);
+static SKOperationState::SKOperationState fbw_wait_for_dedup_content(FileBlockWriter *fbw, FBW_ActiveDirectPut *adp);
 
 
 ///////////////////
@@ -65,6 +66,7 @@ FileBlockWriter *fbw_new(SRFSDHT *sd, int useCompression, FileBlockCache *fbc, i
 		}
 		pPutOptions = pPutOptions->checksumType(defaultChecksum);
 		nspOptions = nspOptions->defaultPutOptions(pPutOptions);
+		fbw->existenceGetOptions = nspOptions->getDefaultGetOptions()->retrievalType(EXISTENCE);
 		
 		fbw->ansp = ns->openAsyncPerspective(nspOptions);
 		delete ns;
@@ -107,6 +109,10 @@ void fbw_delete(FileBlockWriter **fbw) {
 			fatalError("exception in fbw_delete", __FILE__, __LINE__ );
 		}
 		qp_delete(&(*fbw)->qp);
+		if ((*fbw)->existenceGetOptions) {
+			delete (*fbw)->existenceGetOptions;
+			(*fbw)->existenceGetOptions = NULL;
+		}
 		
 		if ((*fbw)->pSession) {
 			delete (*fbw)->pSession;
@@ -345,7 +351,22 @@ FBW_ActiveDirectPut *fbw_put_direct(FileBlockWriter *fbw, FileBlockID *fbid, Wri
 	adp = fbwadp_new();
 	fbid_to_string(fbid, adp->key);
 	adp->pVal = sk_create_val();
-	sk_set_val_zero_copy(adp->pVal, wfb->size, (void *)wfb->block);	
+	// Deduplication is a property of the file (see FID_SKFS_DEDUP) and applies to direct puts only.
+	// Empty blocks are already cheap to store, so they bypass it.
+	if (fid_is_dedup(fbid_get_id(fbid)) && wfb->size > 0) {
+		unsigned char	hash[BD_HASH_BYTES];
+		
+		adp->dedup = TRUE;
+		bd_hash(wfb->block, wfb->size, hash);
+		bd_hash_to_key(hash, adp->contentKey);
+		bd_ref_init(&adp->ref, hash, wfb->size);
+		adp->contentKnown = bd_is_known(hash);
+		adp->pContentVal = sk_create_val();
+		sk_set_val_zero_copy(adp->pContentVal, wfb->size, (void *)wfb->block);
+		sk_set_val_zero_copy(adp->pVal, sizeof(BlockDedupRef), (void *)&adp->ref);
+	} else {
+		sk_set_val_zero_copy(adp->pVal, wfb->size, (void *)wfb->block);	
+	}
 	if (srfsLogLevelMet(LOG_FINE)) {
 		srfsLog(LOG_FINE, "fbw_put_direct adp->key %s wfb->size %u pVal->m_len %u", adp->key, wfb->size, adp->pVal->m_len);	
 	}
@@ -355,7 +376,14 @@ FBW_ActiveDirectPut *fbw_put_direct(FileBlockWriter *fbw, FileBlockID *fbid, Wri
     try {
         //adp->pPut = fbw->ansp->put(adp->key, adp->pVal);
         //adp->pPut = fbw->_ansp[fbid_hash(fbid) % FBW_DHT_SESSIONS]->put(adp->key, adp->pVal);
-        adp->pPut = fbw->_ansp[_fbw_round_robin++ % FBW_DHT_SESSIONS]->put(adp->key, adp->pVal);
+        adp->sessionIndex = _fbw_round_robin++ % FBW_DHT_SESSIONS;
+        if (adp->dedup && !adp->contentKnown) {
+            // Probe for the content concurrently with the reference put.
+            // The reference is not visible to readers until the file's
+            // attribute is written, which waits for this put to complete.
+            adp->pProbe = fbw->_ansp[adp->sessionIndex]->get(adp->contentKey, fbw->existenceGetOptions);
+        }
+        adp->pPut = fbw->_ansp[adp->sessionIndex]->put(adp->key, adp->pVal);
     } catch (exception &e) {
         srfsLog(LOG_WARNING, "fbw_put_direct put exception %s", e.what());
     }	
@@ -365,13 +393,22 @@ FBW_ActiveDirectPut *fbw_put_direct(FileBlockWriter *fbw, FileBlockID *fbid, Wri
 
 SKOperationState::SKOperationState fbw_wait_for_direct_put(FileBlockWriter *fbw, FBW_ActiveDirectPut **_adp) {
 	SKOperationState::SKOperationState	dhtErr = SKOperationState::INCOMPLETE;
+	SKOperationState::SKOperationState	contentErr = SKOperationState::SUCCEEDED;
 	FBW_ActiveDirectPut *adp;
 	
 	srfsLog(LOG_FINE, "in fbw_wait_for_direct_put");
 	adp = *_adp;
     try {
+        if (adp->dedup) {
+            contentErr = fbw_wait_for_dedup_content(fbw, adp);
+        }
         adp->pPut->waitForCompletion();
-		dhtErr = adp->pPut->getState();
+		if (contentErr != SKOperationState::SUCCEEDED) {
+			// The reference is useless without the content
+			dhtErr = contentErr;
+		} else {
+			dhtErr = adp->pPut->getState();
+		}
 		if (dhtErr == SKOperationState::SUCCEEDED) {
 			if (srfsLogLevelMet(LOG_FINE)) {
 				srfsLog(LOG_FINE, "fbw %s SUCCEEDED", adp->key);
@@ -395,6 +432,81 @@ SKOperationState::SKOperationState fbw_wait_for_direct_put(FileBlockWriter *fbw,
 	return dhtErr;
 }
 
+// Ensure that the content referenced by a deduplicated block is stored.
+// Content is written only if it is neither known locally nor found by the probe.
+static SKOperationState::SKOperationState fbw_wait_for_dedup_content(FileBlockWriter *fbw, FBW_ActiveDirectPut *adp) {
+	SKOperationState::SKOperationState	dhtErr;
+	int	found;
+	
+	if (adp->contentKnown) {
+		bd_record_write(adp->ref.size, FALSE);
+		return SKOperationState::SUCCEEDED;
+	}
+	found = FALSE;
+	if (adp->pProbe != NULL) {
+		try {
+			adp->pProbe->waitForCompletion();
+			found = adp->pProbe->getState() == SKOperationState::SUCCEEDED;
+		} catch (SKRetrievalException &e) {
+			// Typically NO_SUCH_VALUE. Any other failure is handled by writing the content.
+			srfsLog(LOG_FINE, "fbw dedup probe %s not found", adp->contentKey);
+		} catch (exception &e) {
+			srfsLog(LOG_WARNING, "fbw dedup probe %s: %s", adp->contentKey, e.what());
+		}
+		bd_record_probe(found);
+	}
+	if (found) {
+		dhtErr = SKOperationState::SUCCEEDED;
+	} else {
+		dhtErr = SKOperationState::FAILED;
+		try {
+			adp->pContentPut = fbw->_ansp[adp->sessionIndex]->put(adp->contentKey, adp->pContentVal);
+			adp->pContentPut->waitForCompletion();
+			dhtErr = adp->pContentPut->getState();
+		} catch (SKPutException &e) {
+			SKFailureCause::SKFailureCause	cause;
+			
+			cause = SKFailureCause::ERROR;
+			try {
+				cause = e.getFailureCause(adp->contentKey);
+			} catch (...) {
+				srfsLog(LOG_WARNING, "fbw dedup failed to query FailureCause %s", adp->contentKey);
+			}
+			// Content keys are immutable in practice; a racing writer stored the same bytes
+			if (cause == SKFailureCause::INVALID_VERSION || cause == SKFailureCause::MUTATION
+					|| cause == SKFailureCause::SIMULTANEOUS_PUT) {
+				dhtErr = SKOperationState::SUCCEEDED;
+			} else {
+				srfsLog(LOG_WARNING, "fbw dedup content put %s failed cause %d", adp->contentKey, cause);
+			}
+		} catch (exception &e) {
+			srfsLog(LOG_WARNING, "fbw dedup content put %s: %s", adp->contentKey, e.what());
+		}
+	}
+	if (dhtErr == SKOperationState::SUCCEEDED) {
+		bd_note_stored(adp->ref.hash);
+		bd_record_write(adp->ref.size, !found);
+	}
+	return dhtErr;
+}
+
+// Non-blocking check. A completed put must still be reaped with fbw_wait_for_direct_put().
+int fbw_is_direct_put_complete(FileBlockWriter *fbw, FBW_ActiveDirectPut *adp) {
+	int	complete;
+	
+	complete = FALSE;
+	if (adp->pPut != NULL) {
+		try {
+			complete = adp->pPut->getState() != SKOperationState::INCOMPLETE
+				&& (adp->pProbe == NULL || adp->pProbe->getState() != SKOperationState::INCOMPLETE);
+		} catch (exception &e) {
+			srfsLog(LOG_WARNING, "fbw_is_direct_put_complete: %s", e.what());
+			complete = TRUE; // let fbw_wait_for_direct_put() handle the failure
+		}
+	}
+	return complete;
+}
+
 static FBW_ActiveDirectPut *fbwadp_new() {
 	FBW_ActiveDirectPut *adp;
 	
@@ -413,6 +525,12 @@ static void fbwadp_delete(FBW_ActiveDirectPut **adp) {
 			}
 			delete (*adp)->pPut;
 		}
+		if ((*adp)->pProbe) {
+			delete (*adp)->pProbe;
+		}
+		if ((*adp)->pContentPut) {
+			delete (*adp)->pContentPut;
+		}
 		if ((*adp)->pVal) {
 			if (srfsLogLevelMet(LOG_FINE)) {
 				srfsLog(LOG_FINE, "(*adp)->pVal %llx", (*adp)->pVal);
@@ -428,21 +546,24 @@ static void fbwadp_delete(FBW_ActiveDirectPut **adp) {
 ////////////////////////
 // File block deletion
 
-void fbw_invalidate_file_blocks(FileBlockWriter *fbw, FileID *fid, int numRequests) {
+// Invalidates blocks [0, numBlocks) of the file and, optionally, its hole map pseudo-block
+void fbw_invalidate_file_blocks(FileBlockWriter *fbw, FileID *fid, int numBlocks, int includeHoleMap) {
 	SKOperationState::SKOperationState	dhtErr = SKOperationState::INCOMPLETE;
    	StrVector           requestGroup;  // sets of keys 
 	int					i;
+	int					numRequests;
 	char				**keys;
 
 	srfsLog(LOG_FINE, "in fbw_invalidate_file_blocks");
 
+	numRequests = numBlocks + (includeHoleMap ? 1 : 0);
     keys = str_alloc_array(numRequests, SRFS_FBID_KEY_SIZE);
     
     // First, construct the requestGroup
 	for (i = 0; i < numRequests; i++) {
         FileBlockID *fbid;
         
-        fbid = fbid_new(fid, i);
+        fbid = fbid_new(fid, i < numBlocks ? (uint64_t)i : SRFS_HOLE_MAP_BLOCK_INDEX);
 		fbid_to_string(fbid, keys[i]);
 		srfsLog(LOG_FINE, "fbw inv adding to group %llx %s", keys[i], keys[i]);
         requestGroup.push_back(keys[i]);
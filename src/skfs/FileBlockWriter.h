@@ -7,6 +7,7 @@
 // includes
 
 #include "ActiveOpRef.h"
+#include "BlockDedup.h"
 #include "FileBlockID.h"
 #include "FileBlockCache.h"
 #include "QueueProcessor.h"
@@ -33,12 +34,22 @@ typedef struct FileBlockWriter {
 	SKSession		*_pSession[FBW_DHT_SESSIONS];
     SKAsyncNSPerspective *_ansp[FBW_DHT_SESSIONS];
     FileBlockCache  *fbc;
+	SKGetOptions	*existenceGetOptions;
 } FileBlockWriter;
 
 typedef struct FBW_ActiveDirectPut {
 	char		key[SRFS_FBID_KEY_SIZE];
 	SKVal		*pVal;
 	SKAsyncPut	*pPut;
+					// deduplication (see BlockDedup.h); pVal then holds ref
+	int			dedup;
+	int			contentKnown;
+	int			sessionIndex;
+	char		contentKey[BD_KEY_SIZE];
+	BlockDedupRef	ref;
+	SKVal		*pContentVal;
+	SKAsyncRetrieval	*pProbe;
+	SKAsyncPut	*pContentPut;
 } FBW_ActiveDirectPut;
 
 
@@ -50,6 +61,7 @@ void fbw_delete(FileBlockWriter **fbw);
 void fbw_write_file_block(FileBlockWriter *fbw, FileBlockID *fbid, size_t dataLength, void *data, ActiveOpRef *aor);
 FBW_ActiveDirectPut *fbw_put_direct(FileBlockWriter *fbw, FileBlockID *fbid, WritableFileBlock *wfb);
 SKOperationState::SKOperationState fbw_wait_for_direct_put(FileBlockWriter *fbw, FBW_ActiveDirectPut **_adp);
-void fbw_invalidate_file_blocks(FileBlockWriter *fbw, FileID *fid, int numRequests);
+int fbw_is_direct_put_complete(FileBlockWriter *fbw, FBW_ActiveDirectPut *adp);
+void fbw_invalidate_file_blocks(FileBlockWriter *fbw, FileID *fid, int numBlocks, int includeHoleMap);
 
 #endif
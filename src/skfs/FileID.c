@@ -36,6 +36,7 @@ static inline int atomic_inc(uint64_t *x, pthread_spinlock_t *lock) {
 // private prototypes
 
 static unsigned int _fid_hash(FileID *fid);
+static void _fid_init_skfs(FileID *fid, uint64_t instance, uint64_t sequence, uint64_t flags);
 static FileID *_fid_generate_new_skfs(uint64_t *nextSequence);
 
 //////////////////////////
@@ -87,9 +88,14 @@ FileID *fid_new_native(struct stat *_stat) {
 }
 
 void fid_init_skfs(FileID *fid, uint64_t instance, uint64_t sequence) {
+	_fid_init_skfs(fid, instance, sequence, 0);
+}
+
+static void _fid_init_skfs(FileID *fid, uint64_t instance, uint64_t sequence, uint64_t flags) {
 	fid->fileSystem = fsSKFS;
 	fid->skfs.instance = instance;
 	fid->skfs.sequence = sequence;
+	fid->skfs.flags = flags;
 	fid->hash = _fid_hash(fid);
     if (srfsLogLevelMet(LOG_FINE)) {
 		char	_fid[SRFS_MAX_PATH_LENGTH];
@@ -127,22 +133,26 @@ FileID *fid_generate_new_skfs_internal() {
 	return _fid_generate_new_skfs(&_fid_skfs_internal_nextSequence);
 }
 
-static void _fid_generate_and_init_skfs(FileID *fid, uint64_t *nextSequence) {
+static void _fid_generate_and_init_skfs(FileID *fid, uint64_t *nextSequence, uint64_t flags) {
 	uint64_t	sequence;
 	
 	if (_fid_skfs_instance == 0) {
 		fatalError("fid_module_init() not called", __FILE__, __LINE__);
 	}
 	sequence = atomic_inc(nextSequence, &_fid_sequence_lock);
-	fid_init_skfs(fid, _fid_skfs_instance, sequence);
+	_fid_init_skfs(fid, _fid_skfs_instance, sequence, flags);
 }
 
 void fid_generate_and_init_skfs(FileID *fid) {
-	_fid_generate_and_init_skfs(fid, &_fid_skfs_nextSequence);
+	_fid_generate_and_init_skfs(fid, &_fid_skfs_nextSequence, 0);
+}
+
+void fid_generate_and_init_skfs_flags(FileID *fid, uint64_t flags) {
+	_fid_generate_and_init_skfs(fid, &_fid_skfs_nextSequence, flags);
 }
 
 void fid_generate_and_init_skfs_internal(FileID *fid) {
-	_fid_generate_and_init_skfs(fid, &_fid_skfs_internal_nextSequence);
+	_fid_generate_and_init_skfs(fid, &_fid_skfs_internal_nextSequence, 0);
 }
 
 void fid_delete(FileID **fid) {
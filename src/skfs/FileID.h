@@ -17,6 +17,9 @@
 
 #define FID_MAX_STRING_SIZE 128
 #define fid_is_native_fs(X) ((X)->fileSystem == fsNative)
+// SKFSFileID flags. Fixed when the fid is generated and part of its identity.
+#define FID_SKFS_DEDUP 0x1 // all non-empty blocks are stored as BlockDedupRefs
+#define fid_is_dedup(X) ((X)->fileSystem == fsSKFS && ((X)->skfs.flags & FID_SKFS_DEDUP) != 0)
 
 
 //////////
@@ -34,6 +37,7 @@ typedef struct NativeFileID {
 typedef struct SKFSFileID {
 	uint64_t	instance;
 	uint64_t	sequence;
+	uint64_t	flags;
 } SKFSFileID;
 
 typedef struct FileID {
@@ -63,6 +67,7 @@ int fid_compare(FileID *a, FileID *b);
 int fid_to_string(FileID *fid, char *dest);
 ino_t fid_get_inode(FileID *fid);
 void fid_generate_and_init_skfs(FileID *fid);
+void fid_generate_and_init_skfs_flags(FileID *fid, uint64_t flags);
 void fid_generate_and_init_skfs_internal(FileID *fid);
 
 #endif
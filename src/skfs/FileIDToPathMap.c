@@ -10,66 +10,168 @@
 #include <string.h>
 
 
-////////////////////
-// private members
+///////////////////////
+// private prototypes
 
-//static int _f2pMinHashSize = 1024;
-// using larger size until ht expand is fixed
-static int _f2pMinHashSize = 128 * 1024;
+static unsigned int f2p_mix(unsigned int hash);
+static F2PEntry *f2p_find(F2PEntry *entry, FileID *fid, unsigned int hash);
+static F2PEntry **f2p_bucket(FileIDToPathMap *f2p, F2PShard *shard, unsigned int hash);
 
 
 ///////////////////
 // implementation
 
-FileIDToPathMap *f2p_new() {
+// Entries are never removed and readers are lock-free, so the table is
+// never resized; it is sized up front for the expected number of fids.
+FileIDToPathMap *f2p_new(uint64_t expectedEntries) {
 	FileIDToPathMap *f2p;
+	uint64_t	targetBuckets;
+	int	i;
 
 	f2p = (FileIDToPathMap *)mem_alloc(1, sizeof(FileIDToPathMap));
-    f2p->ht = create_hashtable(_f2pMinHashSize, (unsigned int (*)(void *))fid_hash, (int (*)(void *a, void *b))fid_compare);
-    pthread_rwlock_init(&f2p->rwLock, 0); 
+	targetBuckets = expectedEntries / F2P_SHARDS / F2P_TARGET_LOAD;
+	f2p->shardBuckets = F2P_MIN_SHARD_BUCKETS;
+	while (f2p->shardBuckets < targetBuckets) {
+		f2p->shardBuckets <<= 1;
+	}
+	for (i = 0; i < F2P_SHARDS; i++) {
+		f2p->shards[i].buckets = (F2PEntry **)mem_alloc(f2p->shardBuckets, sizeof(F2PEntry *));
+		pthread_mutex_init(&f2p->shards[i].writeLock, 0);
+	}
+	srfsLog(LOG_INFO, "f2p_new expectedEntries %lu shards %d shardBuckets %lu", expectedEntries, F2P_SHARDS, f2p->shardBuckets);
 	return f2p;
 }
 
 void f2p_delete(FileIDToPathMap **f2p) {
 	if (f2p != NULL && *f2p != NULL) {
-		pthread_rwlock_wrlock(&(*f2p)->rwLock);
-		hashtable_destroy((*f2p)->ht, 1);
-		pthread_rwlock_unlock(&(*f2p)->rwLock);
-		pthread_rwlock_destroy(&(*f2p)->rwLock);
+		int	i;
+
+		for (i = 0; i < F2P_SHARDS; i++) {
+			F2PShard	*shard;
+			uint64_t	j;
+
+			shard = &(*f2p)->shards[i];
+			pthread_mutex_lock(&shard->writeLock);
+			for (j = 0; j < (*f2p)->shardBuckets; j++) {
+				F2PEntry	*entry;
+
+				entry = shard->buckets[j];
+				while (entry != NULL) {
+					F2PEntry	*next;
+					PathListEntry	*ple;
+
+					next = entry->next;
+					ple = entry->pathListEntry;
+					while (ple != NULL) {
+						PathListEntry	*pleNext;
+
+						pleNext = ple->next;
+						free(ple->path);
+						mem_free((void **)&ple);
+						ple = pleNext;
+					}
+					free(entry->fid);
+					mem_free((void **)&entry);
+					entry = next;
+				}
+				shard->buckets[j] = NULL;
+			}
+			pthread_mutex_unlock(&shard->writeLock);
+			pthread_mutex_destroy(&shard->writeLock);
+			mem_free((void **)&shard->buckets);
+		}
 		mem_free((void **)f2p);
 	} else {
 		fatalError("bad ptr passed to f2p_delete");
 	}
 }
 
+// fid hashes are computed over the raw FileID; spread them before
+// selecting a shard and bucket so that neither is biased
+static unsigned int f2p_mix(unsigned int hash) {
+	hash += ~(hash << 9);
+	hash ^= ((hash >> 14) | (hash << 18));
+	hash += (hash << 4);
+	hash ^= ((hash >> 10) | (hash << 22));
+	return hash;
+}
+
+static F2PEntry **f2p_bucket(FileIDToPathMap *f2p, F2PShard *shard, unsigned int hash) {
+	return &shard->buckets[(hash / F2P_SHARDS) & (f2p->shardBuckets - 1)];
+}
+
+static F2PEntry *f2p_find(F2PEntry *entry, FileID *fid, unsigned int hash) {
+	while (entry != NULL) {
+		if (entry->hash == hash && !fid_compare(fid, entry->fid)) {
+			return entry;
+		}
+		entry = entry->next;
+	}
+	return NULL;
+}
+
+// f2p takes ownership of fid
 void f2p_put(FileIDToPathMap *f2p, FileID *fid, char *_path) {
 	char			*path;
-	PathListEntry	*pathListEntry;
+	unsigned int	hash;
+	F2PShard		*shard;
+	F2PEntry		**bucket;
+	F2PEntry		*entry;
 
 	srfsLog(LOG_FINE, "f2p_put %s", _path);
-	path = strdup(_path);
-    pthread_rwlock_wrlock(&f2p->rwLock);
 	if (srfsLogLevelMet(LOG_FINE)) {
 		char	_fid[SRFS_MAX_PATH_LENGTH];
 
 		fid_to_string(fid, _fid);
-		srfsLog(LOG_FINE, "f2p_put inserting %llx %s  %s", fid, _fid, path);
+		srfsLog(LOG_FINE, "f2p_put inserting %llx %s  %s", fid, _fid, _path);
+	}
+	hash = f2p_mix(fid_hash(fid));
+	shard = &f2p->shards[hash % F2P_SHARDS];
+	bucket = f2p_bucket(f2p, shard, hash);
+	pthread_mutex_lock(&shard->writeLock);
+	entry = f2p_find(*bucket, fid, hash);
+	if (entry != NULL) {
+		PathListEntry	*existing;
+
+		existing = entry->pathListEntry;
+		// Repeated puts of the same path are common (e.g. re-reading the
+		// same attribute); don't grow the list for them
+		if (existing == NULL || strcmp(existing->path, _path)) {
+			path = strdup(_path);
+			__atomic_store_n(&entry->pathListEntry, ple_prepend(existing, path), __ATOMIC_RELEASE);
+		}
+		pthread_mutex_unlock(&shard->writeLock);
+		free(fid);
+	} else {
+		path = strdup(_path);
+		entry = (F2PEntry *)mem_alloc(1, sizeof(F2PEntry));
+		entry->fid = fid;
+		entry->hash = hash;
+		entry->pathListEntry = ple_prepend(NULL, path);
+		entry->next = *bucket;
+		__atomic_store_n(bucket, entry, __ATOMIC_RELEASE);
+		shard->numEntries++;
+		pthread_mutex_unlock(&shard->writeLock);
 	}
-    pathListEntry = (PathListEntry *)hashtable_search(f2p->ht, (void *)fid); 
-	if (pathListEntry != NULL) {
-        hashtable_remove(f2p->ht, (void *)fid);
-    }
-	hashtable_insert(f2p->ht, fid, ple_prepend(pathListEntry, path)); 
-    pthread_rwlock_unlock(&f2p->rwLock);
 }
 
+// lock-free; see F2PEntry
 PathListEntry *f2p_get(FileIDToPathMap *f2p, FileID *fid) {
 	PathListEntry	*pathListEntry;
+	unsigned int	hash;
+	F2PShard		*shard;
+	F2PEntry		*entry;
 
 	srfsLog(LOG_FINE, "f2p_get");
-    pthread_rwlock_rdlock(&f2p->rwLock);
-    pathListEntry = (PathListEntry *)hashtable_search(f2p->ht, (void *)fid); 
-    pthread_rwlock_unlock(&f2p->rwLock);
+	hash = f2p_mix(fid_hash(fid));
+	shard = &f2p->shards[hash % F2P_SHARDS];
+	entry = __atomic_load_n(f2p_bucket(f2p, shard, hash), __ATOMIC_ACQUIRE);
+	entry = f2p_find(entry, fid, hash);
+	if (entry != NULL) {
+		pathListEntry = __atomic_load_n(&entry->pathListEntry, __ATOMIC_ACQUIRE);
+	} else {
+		pathListEntry = NULL;
+	}
 	if (srfsLogLevelMet(LOG_FINE)) {
 		char	_fid[SRFS_MAX_PATH_LENGTH];
 		char	*entry;
@@ -84,3 +186,25 @@ PathListEntry *f2p_get(FileIDToPathMap *f2p, FileID *fid) {
 	}
 	return pathListEntry;
 }
+
+void f2p_display_stats(FileIDToPathMap *f2p) {
+	uint64_t	total;
+	uint64_t	maxShard;
+	int	i;
+
+	total = 0;
+	maxShard = 0;
+	for (i = 0; i < F2P_SHARDS; i++) {
+		uint64_t	n;
+
+		n = __atomic_load_n(&f2p->shards[i].numEntries, __ATOMIC_RELAXED);
+		total += n;
+		if (n > maxShard) {
+			maxShard = n;
+		}
+	}
+	srfsLog(LOG_WARNING, "f2p entries %lu shards %d shardBuckets %lu maxShardEntries %lu", total, F2P_SHARDS, f2p->shardBuckets, maxShard);
+	if (total > (uint64_t)F2P_SHARDS * f2p->shardBuckets * F2P_TARGET_LOAD * 2) {
+		srfsLog(LOG_WARNING, "f2p mean chain length exceeds %d; consider raising f2pExpectedEntries", F2P_TARGET_LOAD * 2);
+	}
+}
@@ -7,27 +7,53 @@
 // includes
 
 #include "FileID.h"
-#include "hashtable.h"
 #include "PathListEntry.h"
 
 #include <pthread.h>
+#include <stdint.h>
+
+
+////////////
+// defines
+
+#define F2P_SHARDS	64
+#define F2P_MIN_SHARD_BUCKETS	256
+// target mean chain length when the map holds the expected number of entries
+#define F2P_TARGET_LOAD	2
 
 
 //////////
 // types
 
+// Entries are never removed, and an entry's fid and next are immutable
+// once it has been published. Readers may therefore walk a bucket without
+// any lock; writers serialize per shard and publish with release stores.
+typedef struct F2PEntry {
+	FileID	*fid;
+	unsigned int	hash;
+	PathListEntry	*pathListEntry;
+	struct F2PEntry	*next;
+} F2PEntry;
+
+typedef struct F2PShard {
+	F2PEntry	**buckets;
+	pthread_mutex_t	writeLock;
+	uint64_t	numEntries;
+} __attribute__((aligned(64))) F2PShard;
+
 typedef struct FileIDToPathMap {
-    hashtable	*ht;
-	pthread_rwlock_t	rwLock;
+	F2PShard	shards[F2P_SHARDS];
+	uint64_t	shardBuckets; // power of two
 } FileIDToPathMap;
 
 
 ///////////////
 // prototypes
 
-FileIDToPathMap *f2p_new();
+FileIDToPathMap *f2p_new(uint64_t expectedEntries);
 void f2p_delete(FileIDToPathMap **f2p);
 void f2p_put(FileIDToPathMap *f2p, FileID *fid, char *path);
 PathListEntry *f2p_get(FileIDToPathMap *f2p, FileID *fid);
+void f2p_display_stats(FileIDToPathMap *f2p);
 
 #endif
@@ -19,6 +19,7 @@
 #include <sys/types.h>
 #include <sys/socket.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
 #include <netdb.h> 
 
 /*
@@ -39,16 +40,45 @@
 #define G2_SFS_ST_BLOCK_DIVISOR 196
 
 #define G2_SFS_CONNECT_TIMEOUT_SECONDS 5
+#define G2_SFS_IO_TIMEOUT_SECONDS 30
+#define G2_SFS_MAX_IDLE_CONNECTIONS_PER_HOST 8
+#define G2_SFS_IDLE_TIMEOUT_MILLIS (60 * 1000)
+#define G2_NSP_CACHE_SIZE 64
+
+// The task output server is not part of this tree. Its only known framing
+// is one request per connection, with the response ending at close. Set to
+// 1 only for a server that keeps connections alive and frames responses as
+// described at G2SFSRequest; connections are then pooled and pipelined.
+#define G2_SFS_FRAMED_RESPONSES 0
+
+#define G2_KEEP_ALIVE_UNKNOWN 0
+#define G2_KEEP_ALIVE_YES 1
+#define G2_KEEP_ALIVE_NO 2
 
 //////////////////
 // private types
 
+// One request/response exchange with a task output server. With
+// G2_SFS_FRAMED_RESPONSES, size responses must be a newline-terminated
+// decimal length and content responses exactly the requested number of
+// bytes; otherwise a response is whatever arrives before the server closes.
+typedef struct G2SFSRequest {
+	const char	*sfsRequest;
+	char	*fileName;
+	char	*buffer;
+	int		bufferSize;
+	int		result;
+} G2SFSRequest;
+
 
 ///////////////////////
 // private prototypes
 
 static int g2tor_sfs_read(G2TaskOutputReader *g2tor, char *host, int port, 
 				   char *fileName, char *sfsRequest, char *buffer, int bufferSize);
+static int g2tor_sfs_exchange(G2TaskOutputReader *g2tor, char *host, int port, 
+				   G2SFSRequest *requests, int numRequests);
+static void g2tor_nsp_entry_delete(G2NSPEntry **entry);
 
 
 ////////////////////
@@ -83,11 +113,51 @@ G2TaskOutputReader *g2tor_new(PathGroup *taskOutputPaths, int taskOutPort, char
 	g2tor->taskOutputPort    = taskOutPort;
 	g2tor->host              = hostName;
     pthread_rwlock_init(&g2tor->rwLock, 0); 
+    g2tor->hostHT = create_hashtable(_cacheMinHashSize, 
+									(unsigned int (*)(void *))stringHash, 
+									(int(*)(void *, void *))strcmp);
+	pthread_mutex_init(&g2tor->poolLock, NULL);
+    g2tor->nspHT = create_hashtable(_cacheMinHashSize, 
+									(unsigned int (*)(void *))stringHash, 
+									(int(*)(void *, void *))strcmp);
+	pthread_mutex_init(&g2tor->nspLock, NULL);
 	return g2tor;
 }
 
 void g2tor_delete(G2TaskOutputReader **g2tor) {
 	if (g2tor != NULL && *g2tor != NULL) {
+		G2SFSHost	*h;
+		G2NSPEntry	*entry;
+
+		h = (*g2tor)->hostList;
+		while (h != NULL) {
+			G2SFSHost	*next;
+
+			while (h->idle != NULL) {
+				G2SFSConnection	*c;
+
+				c = h->idle;
+				h->idle = c->next;
+				close(c->fd);
+				mem_free((void **)&c);
+			}
+			next = h->next;
+			mem_free((void **)&h->host);
+			mem_free((void **)&h);
+			h = next;
+		}
+		hashtable_destroy((*g2tor)->hostHT, FALSE);
+		pthread_mutex_destroy(&(*g2tor)->poolLock);
+		entry = (*g2tor)->nspHead;
+		while (entry != NULL) {
+			G2NSPEntry	*next;
+
+			next = entry->next;
+			g2tor_nsp_entry_delete(&entry);
+			entry = next;
+		}
+		hashtable_destroy((*g2tor)->nspHT, FALSE);
+		pthread_mutex_destroy(&(*g2tor)->nspLock);
 		hashtable_destroy((*g2tor)->dirHT, TRUE);
 		mem_free((void **)&(*g2tor)->dirStat);
 		mem_free((void **)&(*g2tor)->regStat);
@@ -129,6 +199,7 @@ static int connectSocket(char *host, int port, int timeoutSeconds) {
 	if (connect(sockfd, (struct sockaddr *)&serv_addr, sizeof(serv_addr)) < 0) {
         printf("ERROR connecting\n");
 		srfsLog(LOG_WARNING, "ERROR connecting %s %d", host, port);
+		close(sockfd);
 		return -1;
 	}
  
@@ -153,56 +224,307 @@ static int connectSocket(char *host, int port, int timeoutSeconds) {
 }
 
 
-static int g2tor_sfs_read(G2TaskOutputReader *g2tor, char *host, int port, 
-						  char *fileName, char *sfsRequest, char *buffer, int bufferSize) {
-	int	n;
-	char	commandBuf[SRFS_COMMAND_BUF_SIZE];
-	int	totalRead;
-	unsigned int	totalWritten = 0;
+static int g2tor_connect(char *host, int port) {
 	int	sockfd;
 
 	sockfd = connectSocket(host, port, G2_SFS_CONNECT_TIMEOUT_SECONDS);
+	if (sockfd >= 0) {
+		struct timeval	tv;
+		int	one;
+
+		// Pooled connections must not block a reader indefinitely
+		tv.tv_sec = G2_SFS_IO_TIMEOUT_SECONDS;
+		tv.tv_usec = 0;
+		setsockopt(sockfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+		setsockopt(sockfd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+		// Pipelined requests are small; don't let Nagle hold them back
+		one = 1;
+		setsockopt(sockfd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	}
+	return sockfd;
+}
+
+// Returns TRUE if an idle connection has neither been closed by the peer
+// nor received unsolicited data.
+static int g2tor_connection_is_open(G2SFSConnection *c) {
+	char	b;
+	int		n;
 
-    bzero(commandBuf, SRFS_COMMAND_BUF_SIZE);
-    sprintf(commandBuf, "%s %s\n", sfsRequest, fileName);
-	do {
-		n = write(sockfd, commandBuf, strlen(commandBuf));
-		if (n < 0)  {
+	if (c->bufStart != c->bufEnd) {
+		return FALSE;
+	}
+	n = recv(c->fd, &b, 1, MSG_PEEK | MSG_DONTWAIT);
+	if (n < 0) {
+		return errno == EAGAIN || errno == EWOULDBLOCK;
+	} else {
+		return FALSE;
+	}
+}
+
+static G2SFSHost *g2tor_get_host(G2TaskOutputReader *g2tor, char *host, int port) {
+	G2SFSHost	*h;
+	char	key[SRFS_MAX_PATH_LENGTH];
+
+	snprintf(key, SRFS_MAX_PATH_LENGTH, "%s:%d", host, port);
+	pthread_mutex_lock(&g2tor->poolLock);
+	h = (G2SFSHost *)hashtable_search(g2tor->hostHT, (void *)key);
+	if (h == NULL) {
+		h = (G2SFSHost *)mem_alloc(1, sizeof(G2SFSHost));
+		h->host = str_dup(host);
+		h->port = port;
+		h->keepAlive = G2_KEEP_ALIVE_UNKNOWN;
+		h->next = g2tor->hostList;
+		g2tor->hostList = h;
+		hashtable_insert(g2tor->hostHT, str_dup(key), h);
+	}
+	pthread_mutex_unlock(&g2tor->poolLock);
+	return h;
+}
+
+static G2SFSConnection *g2tor_checkout_connection(G2TaskOutputReader *g2tor, G2SFSHost *h, int *reused) {
+	G2SFSConnection	*c;
+	uint64_t	curTime;
+	int		sockfd;
+
+	curTime = curTimeMillis();
+	pthread_mutex_lock(&g2tor->poolLock);
+	while ((c = h->idle) != NULL) {
+		h->idle = c->next;
+		h->numIdle--;
+		if (curTime - c->lastUseMillis < G2_SFS_IDLE_TIMEOUT_MILLIS && g2tor_connection_is_open(c)) {
+			break;
+		}
+		if (h->keepAlive == G2_KEEP_ALIVE_UNKNOWN) {
+			// The server closed the connection without ever serving a second
+			// request on it; stop pooling for this host.
+			h->keepAlive = G2_KEEP_ALIVE_NO;
+			srfsLog(LOG_INFO, "g2tor %s:%d does not keep connections alive", h->host, h->port);
+		}
+		close(c->fd);
+		mem_free((void **)&c);
+	}
+	pthread_mutex_unlock(&g2tor->poolLock);
+	if (c != NULL) {
+		*reused = TRUE;
+		return c;
+	}
+	*reused = FALSE;
+	sockfd = g2tor_connect(h->host, h->port);
+	if (sockfd < 0) {
+		return NULL;
+	}
+	c = (G2SFSConnection *)mem_alloc(1, sizeof(G2SFSConnection));
+	c->fd = sockfd;
+	return c;
+}
+
+static void g2tor_checkin_connection(G2TaskOutputReader *g2tor, G2SFSHost *h, G2SFSConnection *c, int reusable) {
+	pthread_mutex_lock(&g2tor->poolLock);
+	if (G2_SFS_FRAMED_RESPONSES && reusable && h->keepAlive != G2_KEEP_ALIVE_NO
+			&& h->numIdle < G2_SFS_MAX_IDLE_CONNECTIONS_PER_HOST) {
+		c->lastUseMillis = curTimeMillis();
+		c->next = h->idle;
+		h->idle = c;
+		h->numIdle++;
+		c = NULL;
+	}
+	pthread_mutex_unlock(&g2tor->poolLock);
+	if (c != NULL) {
+		close(c->fd);
+		mem_free((void **)&c);
+	}
+}
+
+static int g2tor_sfs_write_request(G2SFSConnection *c, G2SFSRequest *request) {
+	char	commandBuf[SRFS_COMMAND_BUF_SIZE];
+	int		commandLength;
+	int		totalWritten;
+
+	commandLength = snprintf(commandBuf, SRFS_COMMAND_BUF_SIZE, "%s %s\n", request->sfsRequest, request->fileName);
+	if (commandLength >= SRFS_COMMAND_BUF_SIZE) {
+		srfsLog(LOG_WARNING, "g2tor request too long %s", request->fileName);
+		return -1;
+	}
+	totalWritten = 0;
+	while (totalWritten < commandLength) {
+		int	n;
+
+		n = write(c->fd, commandBuf + totalWritten, commandLength - totalWritten);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n <= 0) {
 			srfsLog(LOG_WARNING, "ERROR writing to socket");
-			close(sockfd);
 			return -1;
-		} else {
-			totalWritten += n;
 		}
-	} while (totalWritten < strlen(commandBuf) && n > 0);
+		totalWritten += n;
+	}
+	return 0;
+}
+
+// Reads one response into request->buffer. Clears *open if the server
+// closed the connection or the response could not be framed, in which
+// case the connection must not be reused.
+static int g2tor_sfs_read_response(G2SFSConnection *c, G2SFSRequest *request, int *open) {
+	int	lineTerminated;
+	int	capacity;
+	int	totalRead;
+
+	lineTerminated = !strcmp(request->sfsRequest, SFS_READ_SIZE);
+	// Leave room to terminate size responses
+	capacity = lineTerminated ? request->bufferSize - 1 : request->bufferSize;
 	totalRead = 0;
-	do {
-		n = read(sockfd, buffer + totalRead, bufferSize);
+	*open = TRUE;
+	while (totalRead < capacity) {
+		int	n;
+
+		if (c->bufStart < c->bufEnd) {
+			if (lineTerminated) {
+				char	*nl;
+				int		available;
+				int		length;
+
+				available = c->bufEnd - c->bufStart;
+				nl = (char *)memchr(c->buf + c->bufStart, '\n', available);
+				length = nl != NULL ? nl - (c->buf + c->bufStart) : available;
+				length = int_min(length, capacity - totalRead);
+				memcpy(request->buffer + totalRead, c->buf + c->bufStart, length);
+				totalRead += length;
+				c->bufStart += length;
+				if (nl != NULL && c->buf + c->bufStart == nl) {
+					c->bufStart++;
+					break;
+				}
+			} else {
+				int	length;
+
+				length = int_min(c->bufEnd - c->bufStart, capacity - totalRead);
+				memcpy(request->buffer + totalRead, c->buf + c->bufStart, length);
+				totalRead += length;
+				c->bufStart += length;
+			}
+			continue;
+		}
+		if (lineTerminated) {
+			c->bufStart = 0;
+			n = read(c->fd, c->buf, G2_SFS_CONNECTION_BUF_SIZE);
+			if (n > 0) {
+				c->bufEnd = n;
+				continue;
+			}
+			c->bufEnd = 0;
+		} else {
+			n = read(c->fd, request->buffer + totalRead, capacity - totalRead);
+			if (n > 0) {
+				totalRead += n;
+				continue;
+			}
+		}
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		*open = FALSE;
 		if (n < 0) {
 			srfsLog(LOG_WARNING, "ERROR reading from socket");
-			close(sockfd);
-			return -1;
-		} else {
-			totalRead += n;
+			if (totalRead == 0) {
+				return -1;
+			}
 		}
-	} while (totalRead < bufferSize && n > 0);
-    close(sockfd);
-	(void) g2tor; //fix for "unused parameter" warning
+		break;
+	}
+	if (lineTerminated) {
+		if (totalRead == capacity) {
+			// No newline within the buffer; framing is lost
+			*open = FALSE;
+		}
+		request->buffer[totalRead] = '\0';
+	}
 	return totalRead;
 }
 
-static off_t g2tor_read_length(G2TaskOutputReader *g2tor, char *host, int port, char *fileName) {
-	char	sizeBuf[SRFS_OUTPUT_SIZE_BUF_SIZE];
-	off_t	fileSize;
-	int		rc;
+// Performs the given requests against host:port. Unless responses are known
+// to be framed (G2_SFS_FRAMED_RESPONSES), each request gets its own
+// connection. Otherwise connections are pooled, and once the server is
+// known to keep them alive, all outstanding requests are written before the
+// first response is read. Requests that cannot be completed are left with a
+// negative result.
+static int g2tor_sfs_exchange(G2TaskOutputReader *g2tor, char *host, int port, 
+						  G2SFSRequest *requests, int numRequests) {
+	G2SFSHost	*h;
+	int		completed;
+	int		i;
+
+	for (i = 0; i < numRequests; i++) {
+		requests[i].result = -1;
+	}
+	h = g2tor_get_host(g2tor, host, port);
+	completed = 0;
+	while (completed < numRequests) {
+		G2SFSConnection	*c;
+		int		reused;
+		int		pipelined;
+		int		ok;
+		int		open;
+		int		attemptStart;
+
+		c = g2tor_checkout_connection(g2tor, h, &reused);
+		if (c == NULL) {
+			break;
+		}
+		attemptStart = completed;
+		pipelined = G2_SFS_FRAMED_RESPONSES && h->keepAlive == G2_KEEP_ALIVE_YES;
+		ok = TRUE;
+		open = TRUE;
+		if (pipelined) {
+			for (i = completed; i < numRequests && ok; i++) {
+				ok = g2tor_sfs_write_request(c, &requests[i]) == 0;
+			}
+		}
+		while (ok && open && completed < numRequests) {
+			int	rc;
 
-	rc = g2tor_sfs_read(g2tor, host, port, fileName, SFS_READ_SIZE, sizeBuf, SRFS_OUTPUT_SIZE_BUF_SIZE);
-	if (rc >= 0) {
-		fileSize = atoi(sizeBuf);
-		return fileSize;
-	} else {
-		return rc;
+			if (!pipelined) {
+				ok = g2tor_sfs_write_request(c, &requests[completed]) == 0;
+				if (!ok) {
+					break;
+				}
+			}
+			rc = g2tor_sfs_read_response(c, &requests[completed], &open);
+			if (rc < 0 || (rc == 0 && !open)) {
+				ok = FALSE;
+			} else {
+				requests[completed].result = rc;
+				completed++;
+				if (!G2_SFS_FRAMED_RESPONSES) {
+					// The response ended at close, or we can't tell where it ended
+					open = FALSE;
+				} else if (reused && h->keepAlive != G2_KEEP_ALIVE_YES) {
+					pthread_mutex_lock(&g2tor->poolLock);
+					h->keepAlive = G2_KEEP_ALIVE_YES;
+					pthread_mutex_unlock(&g2tor->poolLock);
+				}
+			}
+		}
+		// A pipelined connection with unread responses can't be reused
+		g2tor_checkin_connection(g2tor, h, c, ok && open && (!pipelined || completed == numRequests));
+		if (completed == attemptStart && !reused) {
+			// A fresh connection made no progress
+			break;
+		}
 	}
+	return completed;
+}
+
+static int g2tor_sfs_read(G2TaskOutputReader *g2tor, char *host, int port, 
+						  char *fileName, char *sfsRequest, char *buffer, int bufferSize) {
+	G2SFSRequest	request;
+
+	request.sfsRequest = sfsRequest;
+	request.fileName = fileName;
+	request.buffer = buffer;
+	request.bufferSize = bufferSize;
+	g2tor_sfs_exchange(g2tor, host, port, &request, 1);
+	return request.result;
 }
 
 int g2tor_read_content(G2TaskOutputReader *g2tor, char *host, int port, char *fileName, off_t offset, int length, char *dest) {
@@ -212,20 +534,161 @@ int g2tor_read_content(G2TaskOutputReader *g2tor, char *host, int port, char *fi
 	if (dest == NULL) {
 		fatalError("NULL dest", __FILE__, __LINE__);
 	}
+	if (length <= 0) {
+		return 0;
+	}
 	sprintf(filePathAndOffsets, "%s %lu %lu", fileName, offset, offset + length);
 	return g2tor_sfs_read(g2tor, host, port, filePathAndOffsets, SFS_READ_CONTENT, dest, length);
 }
 
+static void g2tor_nsp_entry_delete(G2NSPEntry **entry) {
+	if (entry != NULL && *entry != NULL) {
+		try {
+			(*entry)->ansp->waitForActiveOps();
+			(*entry)->ansp->close();
+		} catch (std::exception &e) {
+			srfsLog(LOG_WARNING, "g2tor_nsp_entry_delete exception %s %s", (*entry)->jobUUID, e.what());
+		}
+		delete (*entry)->ansp;
+		mem_free((void **)&(*entry)->jobUUID);
+		mem_free((void **)entry);
+	} else {
+		fatalError("bad ptr in g2tor_nsp_entry_delete");
+	}
+}
+
+// lock must be held
+static void g2tor_nsp_unlink(G2TaskOutputReader *g2tor, G2NSPEntry *entry) {
+	if (entry->prev != NULL) {
+		entry->prev->next = entry->next;
+	} else {
+		g2tor->nspHead = entry->next;
+	}
+	if (entry->next != NULL) {
+		entry->next->prev = entry->prev;
+	} else {
+		g2tor->nspTail = entry->prev;
+	}
+	entry->prev = NULL;
+	entry->next = NULL;
+}
+
+// lock must be held
+static void g2tor_nsp_push_front(G2TaskOutputReader *g2tor, G2NSPEntry *entry) {
+	entry->prev = NULL;
+	entry->next = g2tor->nspHead;
+	if (g2tor->nspHead != NULL) {
+		g2tor->nspHead->prev = entry;
+	} else {
+		g2tor->nspTail = entry;
+	}
+	g2tor->nspHead = entry;
+}
+
+// Returns a referenced perspective for the job's namespace, opening it
+// (and, if create is set, creating the namespace) on a cache miss. The
+// least recently used perspectives beyond G2_NSP_CACHE_SIZE are closed.
+static G2NSPEntry *g2tor_acquire_nsp(G2TaskOutputReader *g2tor, char *jobUUID, int create) {
+	G2NSPEntry	*entry;
+	G2NSPEntry	*existing;
+	G2NSPEntry	*victims;
+	SKAsyncNSPerspective	*ansp;
+
+	pthread_mutex_lock(&g2tor->nspLock);
+	entry = (G2NSPEntry *)hashtable_search(g2tor->nspHT, (void *)jobUUID);
+	if (entry != NULL) {
+		entry->refCount++;
+		g2tor_nsp_unlink(g2tor, entry);
+		g2tor_nsp_push_front(g2tor, entry);
+		pthread_mutex_unlock(&g2tor->nspLock);
+		return entry;
+	}
+	pthread_mutex_unlock(&g2tor->nspLock);
+
+	try {
+		if (create) {
+			SKNamespace	*pNs;
+
+			pNs = pGlobalSession->createNamespace(jobUUID);
+			delete pNs;
+		}
+		ansp = pGlobalSession->openAsyncNamespacePerspective(jobUUID);
+	} catch (std::exception &e) {
+		srfsLog(LOG_WARNING, "g2tor_acquire_nsp exception %s %s", jobUUID, e.what());
+		return NULL;
+	}
+	entry = (G2NSPEntry *)mem_alloc(1, sizeof(G2NSPEntry));
+	entry->jobUUID = str_dup(jobUUID);
+	entry->ansp = ansp;
+	entry->refCount = 1;
+
+	victims = NULL;
+	pthread_mutex_lock(&g2tor->nspLock);
+	existing = (G2NSPEntry *)hashtable_search(g2tor->nspHT, (void *)jobUUID);
+	if (existing != NULL) {
+		// Another thread opened the same namespace concurrently
+		existing->refCount++;
+		g2tor_nsp_unlink(g2tor, existing);
+		g2tor_nsp_push_front(g2tor, existing);
+	} else {
+		hashtable_insert(g2tor->nspHT, str_dup(jobUUID), entry);
+		g2tor_nsp_push_front(g2tor, entry);
+		g2tor->numNSPs++;
+		while (g2tor->numNSPs > G2_NSP_CACHE_SIZE) {
+			G2NSPEntry	*lru;
+
+			lru = g2tor->nspTail;
+			g2tor_nsp_unlink(g2tor, lru);
+			hashtable_remove(g2tor->nspHT, (void *)lru->jobUUID);
+			g2tor->numNSPs--;
+			if (lru->refCount == 0) {
+				lru->next = victims;
+				victims = lru;
+			} else {
+				lru->evicted = TRUE;
+			}
+		}
+	}
+	pthread_mutex_unlock(&g2tor->nspLock);
+
+	if (existing != NULL) {
+		g2tor_nsp_entry_delete(&entry);
+		entry = existing;
+	}
+	while (victims != NULL) {
+		G2NSPEntry	*next;
+
+		next = victims->next;
+		srfsLog(LOG_FINE, "g2tor evicting perspective %s", victims->jobUUID);
+		g2tor_nsp_entry_delete(&victims);
+		victims = next;
+	}
+	return entry;
+}
+
+static void g2tor_release_nsp(G2TaskOutputReader *g2tor, G2NSPEntry *entry) {
+	int	deleteEntry;
+
+	pthread_mutex_lock(&g2tor->nspLock);
+	entry->refCount--;
+	deleteEntry = entry->evicted && entry->refCount == 0;
+	pthread_mutex_unlock(&g2tor->nspLock);
+	if (deleteEntry) {
+		g2tor_nsp_entry_delete(&entry);
+	}
+}
+
 OutputDir *g2tor_read_task_ids(G2TaskOutputReader *g2tor, char *jobUUID) {
 	SKOperationState::SKOperationState	rc;
 	OutputDir	        *od = NULL;
     StrVector           requestGroup;
 
-	(void) g2tor; //fix for "unused parameter" warning
     requestGroup.push_back(_jobTaskIDs);
-    SKNamespace * pNs = pGlobalSession->createNamespace(jobUUID);
-    SKAsyncNSPerspective * ansp = pGlobalSession->openAsyncNamespacePerspective(jobUUID);
-    SKAsyncValueRetrieval * pValRetrieval = ansp->get(&requestGroup);
+    G2NSPEntry * nspEntry = g2tor_acquire_nsp(g2tor, jobUUID, TRUE);
+    if (nspEntry == NULL) {
+        return NULL;
+    }
+    SKAsyncValueRetrieval * pValRetrieval = nspEntry->ansp->get(&requestGroup);
 	//FIXME : consider changing wait  to (some form of) looping thru results?
     pValRetrieval->waitForCompletion();
     rc = pValRetrieval->getState();
@@ -245,8 +708,7 @@ OutputDir *g2tor_read_task_ids(G2TaskOutputReader *g2tor, char *jobUUID) {
 	} 
     pValRetrieval->close();
     delete pValRetrieval;
-    delete pNs;
-    delete ansp;
+    g2tor_release_nsp(g2tor, nspEntry);
     return od;
 }
 
@@ -255,11 +717,12 @@ static int g2tor_read_task_location(G2TaskOutputReader *g2tor, char *jobUUID, ch
 	int		            result = FALSE;
     StrVector           requestGroup;
 
-	(void) g2tor; //fix for "unused parameter" warning
     requestGroup.push_back(taskID);
-    //pSession->createNamespace(jobUUID);  //FIXME: keep/remove
-    SKAsyncNSPerspective * ansp = pGlobalSession->openAsyncNamespacePerspective(jobUUID);
-    SKAsyncValueRetrieval * pValRetrieval = ansp->get(&requestGroup);
+    G2NSPEntry * nspEntry = g2tor_acquire_nsp(g2tor, jobUUID, FALSE);
+    if (nspEntry == NULL) {
+        return FALSE;
+    }
+    SKAsyncValueRetrieval * pValRetrieval = nspEntry->ansp->get(&requestGroup);
     pValRetrieval->waitForCompletion();
     rc = pValRetrieval->getState();
 	if (rc == SKOperationState::SUCCEEDED) {
@@ -279,6 +742,7 @@ static int g2tor_read_task_location(G2TaskOutputReader *g2tor, char *jobUUID, ch
 	}
     pValRetrieval->close();
     delete pValRetrieval;
+    g2tor_release_nsp(g2tor, nspEntry);
     return result;
 }
 
@@ -438,17 +902,34 @@ static off_t g2tor_get_task_output_length(G2TaskOutputReader *g2tor, char *jobUU
 
 			result = g2tor_read_task_hostname(g2tor, jobUUID, taskID, hostname, od);
 			if (result == TRUE) {
-				char	fileName[SRFS_MAX_PATH_LENGTH];
-
-				sprintf(fileName, "/%s/%s%s", jobUUID, taskID, suffix[mode]);
-				srfsLog(LOG_FINE, "Reading srfs %s %d %s", hostname, G2_SFS_PORT, fileName);
-				length = g2tor_read_length(g2tor, hostname, G2_SFS_PORT, fileName);
-				srfsLog(LOG_FINE, "length %d", length);
-				if (length < 0) {
-					length = 0;
-				} else {
-					g2od_set_file_length(od, taskID, length, mode);
+				char	fileNames[2][SRFS_MAX_PATH_LENGTH];
+				char	sizeBufs[2][SRFS_OUTPUT_SIZE_BUF_SIZE];
+				G2SFSRequest	requests[2];
+				int		i;
+
+				// Listings stat both streams, so fetch both lengths in one round trip
+				for (i = 0; i < 2; i++) {
+					sprintf(fileNames[i], "/%s/%s%s", jobUUID, taskID, suffix[i]);
+					requests[i].sfsRequest = SFS_READ_SIZE;
+					requests[i].fileName = fileNames[i];
+					requests[i].buffer = sizeBufs[i];
+					requests[i].bufferSize = SRFS_OUTPUT_SIZE_BUF_SIZE;
 				}
+				srfsLog(LOG_FINE, "Reading srfs %s %d %s %s", hostname, G2_SFS_PORT, fileNames[0], fileNames[1]);
+				g2tor_sfs_exchange(g2tor, hostname, G2_SFS_PORT, requests, 2);
+				length = 0;
+				for (i = 0; i < 2; i++) {
+					if (requests[i].result >= 0) {
+						off_t	streamLength;
+
+						streamLength = atoi(sizeBufs[i]);
+						g2od_set_file_length(od, taskID, streamLength, i);
+						if (i == mode) {
+							length = streamLength;
+						}
+					}
+				}
+				srfsLog(LOG_FINE, "length %d", length);
 			} else {
 				length = 0;
 			}
@@ -9,16 +9,57 @@
 #include "hashtable.h"
 #include "G2OutputDir.h"
 #include "PathGroup.h"
+#include "SRFSDHT.h"
 
 #include <fuse.h>
 #include <pthread.h>
+#include <stdint.h>
 #include <sys/stat.h>
 #include <unistd.h>
 
 
+////////////
+// defines
+
+#define G2_SFS_CONNECTION_BUF_SIZE	256
+
+
 //////////
 // types
 
+// An idle keep-alive connection to a task output server. Bytes read
+// past the end of a line-terminated response remain in buf.
+typedef struct G2SFSConnection {
+	int		fd;
+	uint64_t	lastUseMillis;
+	char	buf[G2_SFS_CONNECTION_BUF_SIZE];
+	int		bufStart;
+	int		bufEnd;
+	struct G2SFSConnection	*next;
+} G2SFSConnection;
+
+// Per host:port pool of idle connections. keepAlive records whether the
+// server has been seen to serve more than one request per connection.
+typedef struct G2SFSHost {
+	char	*host;
+	int		port;
+	int		keepAlive;
+	G2SFSConnection	*idle;
+	int		numIdle;
+	struct G2SFSHost	*next;
+} G2SFSHost;
+
+// Cached namespace perspective for a job. Entries evicted while in use
+// are deleted by the last release.
+typedef struct G2NSPEntry {
+	char	*jobUUID;
+	SKAsyncNSPerspective	*ansp;
+	int		refCount;
+	int		evicted;
+	struct G2NSPEntry	*prev;
+	struct G2NSPEntry	*next;
+} G2NSPEntry;
+
 typedef struct G2TaskOutputReader {
 	PathGroup			*taskOutputPaths;
     hashtable			*dirHT;
@@ -27,6 +68,14 @@ typedef struct G2TaskOutputReader {
 	struct stat			*regStat;
 	int                 taskOutputPort;
 	char                *host;
+	hashtable			*hostHT;
+	G2SFSHost			*hostList;
+	pthread_mutex_t		poolLock;
+	hashtable			*nspHT;
+	G2NSPEntry			*nspHead;
+	G2NSPEntry			*nspTail;
+	int					numNSPs;
+	pthread_mutex_t		nspLock;
 } G2TaskOutputReader;
 
 
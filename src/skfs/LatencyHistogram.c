@@ -0,0 +1,226 @@
+// LatencyHistogram.c
+
+/////////////
+// includes
+
+#include "LatencyHistogram.h"
+#include "Util.h"
+
+#include <pthread.h>
+#include <string.h>
+
+
+//////////////////
+// private types
+
+// Written only by its owning thread; read (racily, but with atomic loads)
+// by lh_merge(). When the thread exits its counts are added to lhRetired
+// and the block is freed.
+typedef struct LHThreadHistograms {
+	uint64_t	counts[LH_NUM_METRICS][LH_BUCKETS];
+	uint64_t	sumMicros[LH_NUM_METRICS];
+	uint64_t	maxMicros[LH_NUM_METRICS];
+	struct LHThreadHistograms	*next;
+} LHThreadHistograms;
+
+
+////////////////////
+// private members
+
+static const char *_lhMetricNames[LH_NUM_METRICS] = {
+	"getattr", "read", "write", "readdir", "open", "release",
+	"cacheLookup", "queueWait", "dhtMultiGet", "nfsPread", "jniConversion"
+};
+
+static __thread LHThreadHistograms	*lhThread;
+static pthread_key_t	lhThreadKey;
+static pthread_once_t	lhThreadKeyOnce = PTHREAD_ONCE_INIT;
+// lhListLock protects lhThreadList membership and lhRetired, not the counts
+static pthread_mutex_t	lhListLock = PTHREAD_MUTEX_INITIALIZER;
+static LHThreadHistograms	*lhThreadList;
+static LHThreadHistograms	lhRetired;
+
+static pthread_mutex_t	lhDisplayLock = PTHREAD_MUTEX_INITIALIZER;
+static LHHistogram	lhPrevious[LH_NUM_METRICS];
+
+
+///////////////////////
+// private prototypes
+
+static void lh_create_thread_key();
+static void lh_retire_thread_histograms(void *_t);
+static LHThreadHistograms *lh_get_thread_histograms();
+static void lh_add(LHHistogram *histograms, LHThreadHistograms *t);
+
+
+///////////////////
+// implementation
+
+static void lh_create_thread_key() {
+	if (pthread_key_create(&lhThreadKey, lh_retire_thread_histograms) != 0) {
+		fatalError("pthread_key_create failed", __FILE__, __LINE__);
+	}
+}
+
+// pthread key destructor. fuse retires idle worker threads, so blocks of
+// exited threads are folded into lhRetired rather than kept.
+static void lh_retire_thread_histograms(void *_t) {
+	LHThreadHistograms	*t;
+	LHThreadHistograms	**prev;
+	int	i;
+
+	t = (LHThreadHistograms *)_t;
+	// samples recorded by later destructors go to a fresh block
+	lhThread = NULL;
+	pthread_mutex_lock(&lhListLock);
+	for (i = 0; i < LH_NUM_METRICS; i++) {
+		int	j;
+
+		for (j = 0; j < LH_BUCKETS; j++) {
+			lhRetired.counts[i][j] += t->counts[i][j];
+		}
+		lhRetired.sumMicros[i] += t->sumMicros[i];
+		if (t->maxMicros[i] > lhRetired.maxMicros[i]) {
+			lhRetired.maxMicros[i] = t->maxMicros[i];
+		}
+	}
+	for (prev = &lhThreadList; *prev != NULL && *prev != t; prev = &(*prev)->next) {
+	}
+	if (*prev == t) {
+		*prev = t->next;
+	} else {
+		srfsLog(LOG_ERROR, "lh_retire_thread_histograms %llx not found", t);
+	}
+	pthread_mutex_unlock(&lhListLock);
+	mem_free((void **)&t);
+}
+
+static LHThreadHistograms *lh_get_thread_histograms() {
+	if (lhThread == NULL) {
+		pthread_once(&lhThreadKeyOnce, lh_create_thread_key);
+		lhThread = (LHThreadHistograms *)mem_alloc(1, sizeof(LHThreadHistograms));
+		pthread_mutex_lock(&lhListLock);
+		lhThread->next = lhThreadList;
+		lhThreadList = lhThread;
+		pthread_mutex_unlock(&lhListLock);
+		pthread_setspecific(lhThreadKey, lhThread);
+	}
+	return lhThread;
+}
+
+// Lock-free; each thread only ever writes its own histograms
+void lh_record(LHMetric metric, uint64_t micros) {
+	LHThreadHistograms	*t;
+	uint64_t	*count;
+
+	t = lh_get_thread_histograms();
+	count = &t->counts[metric][log_bucket_index(micros, LH_BUCKETS)];
+	__atomic_store_n(count, *count + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&t->sumMicros[metric], t->sumMicros[metric] + micros, __ATOMIC_RELAXED);
+	if (micros > t->maxMicros[metric]) {
+		__atomic_store_n(&t->maxMicros[metric], micros, __ATOMIC_RELAXED);
+	}
+}
+
+// Adds t's counts into histograms[LH_NUM_METRICS]
+static void lh_add(LHHistogram *histograms, LHThreadHistograms *t) {
+	int	i;
+
+	for (i = 0; i < LH_NUM_METRICS; i++) {
+		uint64_t	maxMicros;
+		int	j;
+
+		for (j = 0; j < LH_BUCKETS; j++) {
+			uint64_t	count;
+
+			count = __atomic_load_n(&t->counts[i][j], __ATOMIC_RELAXED);
+			histograms[i].counts[j] += count;
+			histograms[i].total += count;
+		}
+		histograms[i].sumMicros += __atomic_load_n(&t->sumMicros[i], __ATOMIC_RELAXED);
+		maxMicros = __atomic_load_n(&t->maxMicros[i], __ATOMIC_RELAXED);
+		if (maxMicros > histograms[i].maxMicros) {
+			histograms[i].maxMicros = maxMicros;
+		}
+	}
+}
+
+// Sums all threads' histograms, including those of exited threads, into
+// histograms[LH_NUM_METRICS]
+void lh_merge(LHHistogram *histograms) {
+	LHThreadHistograms	*t;
+
+	memset(histograms, 0, sizeof(LHHistogram) * LH_NUM_METRICS);
+	pthread_mutex_lock(&lhListLock);
+	lh_add(histograms, &lhRetired);
+	for (t = lhThreadList; t != NULL; t = t->next) {
+		lh_add(histograms, t);
+	}
+	pthread_mutex_unlock(&lhListLock);
+}
+
+uint64_t lh_percentile(LHHistogram *histogram, double percentile) {
+	uint64_t	target;
+	uint64_t	cumulative;
+	int	i;
+
+	if (histogram->total == 0) {
+		return 0;
+	}
+	target = (uint64_t)((double)histogram->total * percentile / 100.0 + 0.5);
+	if (target == 0) {
+		target = 1;
+	}
+	cumulative = 0;
+	for (i = 0; i < LH_BUCKETS; i++) {
+		cumulative += histogram->counts[i];
+		if (cumulative >= target) {
+			uint64_t	bound;
+
+			bound = log_bucket_upper_bound(i);
+			return (histogram->maxMicros != 0 && bound > histogram->maxMicros) ? histogram->maxMicros : bound;
+		}
+	}
+	return histogram->maxMicros;
+}
+
+const char *lh_metric_name(LHMetric metric) {
+	return _lhMetricNames[metric];
+}
+
+// Displays quantiles for the samples recorded since the previous call
+void lh_display_stats() {
+	LHHistogram	*current;
+	LHHistogram	*interval;
+	int	i;
+
+	current = (LHHistogram *)mem_alloc(LH_NUM_METRICS, sizeof(LHHistogram));
+	interval = (LHHistogram *)mem_alloc(1, sizeof(LHHistogram));
+	lh_merge(current);
+	pthread_mutex_lock(&lhDisplayLock);
+	for (i = 0; i < LH_NUM_METRICS; i++) {
+		int	j;
+
+		interval->total = current[i].total - lhPrevious[i].total;
+		interval->maxMicros = 0;
+		for (j = 0; j < LH_BUCKETS; j++) {
+			interval->counts[j] = current[i].counts[j] - lhPrevious[i].counts[j];
+			if (interval->counts[j] > 0) {
+				interval->maxMicros = log_bucket_upper_bound(j);
+			}
+		}
+		if (interval->maxMicros > current[i].maxMicros) {
+			interval->maxMicros = current[i].maxMicros;
+		}
+		if (interval->total > 0) {
+			srfsLog(LOG_WARNING, "lh %s count %lu p50 %lu p99 %lu p999 %lu max %lu allTimeMax %lu (us)",
+				_lhMetricNames[i], interval->total,
+				lh_percentile(interval, 50.0), lh_percentile(interval, 99.0), lh_percentile(interval, 99.9),
+				interval->maxMicros, current[i].maxMicros);
+		}
+	}
+	memcpy(lhPrevious, current, sizeof(LHHistogram) * LH_NUM_METRICS);
+	pthread_mutex_unlock(&lhDisplayLock);
+	mem_free((void **)&interval);
+	mem_free((void **)&current);
+}
@@ -0,0 +1,58 @@
+// LatencyHistogram.h
+
+#ifndef _LATENCY_HISTOGRAM_H_
+#define _LATENCY_HISTOGRAM_H_
+
+/////////////
+// includes
+
+#include "Util.h"
+
+#include <stdint.h>
+
+
+////////////
+// defines
+
+// Log buckets (see LOG_BUCKET_COUNT) over microseconds, up to ~19 hours
+#define LH_MAX_EXPONENT	35
+#define LH_BUCKETS	LOG_BUCKET_COUNT(LH_MAX_EXPONENT)
+
+
+//////////
+// types
+
+typedef enum {
+	LH_GETATTR,
+	LH_READ,
+	LH_WRITE,
+	LH_READDIR,
+	LH_OPEN,
+	LH_RELEASE,
+	LH_CACHE_LOOKUP,
+	LH_QUEUE_WAIT,
+	LH_DHT_MULTI_GET,
+	LH_NFS_PREAD,
+	LH_JNI_CONVERSION,
+	LH_NUM_METRICS
+} LHMetric;
+
+// Merged view of one metric across all threads
+typedef struct LHHistogram {
+	uint64_t	counts[LH_BUCKETS];
+	uint64_t	total;
+	uint64_t	sumMicros;
+	uint64_t	maxMicros;
+} LHHistogram;
+
+
+///////////////
+// prototypes
+
+void lh_record(LHMetric metric, uint64_t micros);
+void lh_merge(LHHistogram *histograms);
+uint64_t lh_percentile(LHHistogram *histogram, double percentile);
+const char *lh_metric_name(LHMetric metric);
+void lh_display_stats();
+
+#endif
@@ -0,0 +1,186 @@
+// MetricsServer.c
+
+/////////////
+// includes
+
+#include "MetricsServer.h"
+#include "Util.h"
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+
+////////////////////
+// private defines
+
+#define _MS_INITIAL_BUFFER_SIZE	(64 * 1024)
+#define _MS_LISTEN_BACKLOG	16
+#define _MS_SEND_TIMEOUT_SECS	5
+
+
+///////////////////////
+// private prototypes
+
+static void *ms_run(void *_ms);
+static void ms_serve(MetricsServer *ms, int fd);
+
+
+///////////////////
+// implementation
+
+MetricsServer *ms_new(const char *socketPath, void (*render)(MetricsBuffer *mb)) {
+	MetricsServer	*ms;
+	struct sockaddr_un	addr;
+
+	if (strlen(socketPath) >= sizeof(addr.sun_path)) {
+		srfsLog(LOG_ERROR, "ms_new socket path too long %s", socketPath);
+		return NULL;
+	}
+	ms = (MetricsServer *)mem_alloc(1, sizeof(MetricsServer));
+	ms->socketPath = str_dup((char *)socketPath);
+	ms->render = render;
+	ms->listenFD = socket(AF_UNIX, SOCK_STREAM, 0);
+	if (ms->listenFD < 0) {
+		srfsLog(LOG_ERROR, "ms_new socket failed %d", errno);
+		mem_free((void **)&ms->socketPath);
+		mem_free((void **)&ms);
+		return NULL;
+	}
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strcpy(addr.sun_path, socketPath);
+	// remove a socket left behind by a previous instance
+	unlink(socketPath);
+	if (bind(ms->listenFD, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(ms->listenFD, _MS_LISTEN_BACKLOG) < 0) {
+		srfsLog(LOG_ERROR, "ms_new unable to listen on %s %d", socketPath, errno);
+		close(ms->listenFD);
+		mem_free((void **)&ms->socketPath);
+		mem_free((void **)&ms);
+		return NULL;
+	}
+	ms->running = TRUE;
+	pthread_create(&ms->thread, NULL, ms_run, ms);
+	srfsLog(LOG_WARNING, "metrics available at %s", socketPath);
+	return ms;
+}
+
+void ms_delete(MetricsServer **ms) {
+	if (ms != NULL && *ms != NULL) {
+		(*ms)->running = FALSE;
+		// unblocks accept()
+		shutdown((*ms)->listenFD, SHUT_RDWR);
+		pthread_join((*ms)->thread, NULL);
+		close((*ms)->listenFD);
+		unlink((*ms)->socketPath);
+		mem_free((void **)&(*ms)->socketPath);
+		mem_free((void **)ms);
+	} else {
+		fatalError("bad ptr passed to ms_delete");
+	}
+}
+
+static void *ms_run(void *_ms) {
+	MetricsServer	*ms;
+
+	ms = (MetricsServer *)_ms;
+	while (ms->running) {
+		int	fd;
+
+		fd = accept(ms->listenFD, NULL, NULL);
+		if (fd < 0) {
+			if (errno != EINTR && ms->running) {
+				srfsLog(LOG_WARNING, "ms_run accept failed %d", errno);
+				sleep(1);
+			}
+			continue;
+		}
+		ms_serve(ms, fd);
+		close(fd);
+	}
+	return NULL;
+}
+
+static void ms_serve(MetricsServer *ms, int fd) {
+	MetricsBuffer	mb;
+	struct timeval	tv;
+	size_t	written;
+
+	// a stalled client must not wedge the server thread
+	tv.tv_sec = _MS_SEND_TIMEOUT_SECS;
+	tv.tv_usec = 0;
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	memset(&mb, 0, sizeof(mb));
+	ms->render(&mb);
+	ms->requests++;
+	mb_family(&mb, "skfs_metrics_requests_total", "counter", "Metrics requests served");
+	mb_sample(&mb, "skfs_metrics_requests_total", NULL, ms->requests);
+	written = 0;
+	while (written < mb.length) {
+		ssize_t	result;
+
+		result = send(fd, mb.data + written, mb.length - written, MSG_NOSIGNAL);
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			srfsLog(LOG_FINE, "ms_serve send failed %d", errno);
+			break;
+		}
+		written += result;
+	}
+	if (mb.data != NULL) {
+		mem_free((void **)&mb.data);
+	}
+}
+
+void mb_append(MetricsBuffer *mb, const char *format, ...) {
+	va_list	args;
+	int		needed;
+
+	if (mb->data == NULL) {
+		mb->capacity = _MS_INITIAL_BUFFER_SIZE;
+		mb->data = (char *)mem_alloc(1, mb->capacity);
+		mb->length = 0;
+	}
+	va_start(args, format);
+	needed = vsnprintf(mb->data + mb->length, mb->capacity - mb->length, format, args);
+	va_end(args);
+	if (needed < 0) {
+		return;
+	}
+	if ((size_t)needed >= mb->capacity - mb->length) {
+		char	*data;
+
+		while ((size_t)needed >= mb->capacity - mb->length) {
+			mb->capacity *= 2;
+		}
+		data = (char *)mem_alloc(1, mb->capacity);
+		memcpy(data, mb->data, mb->length);
+		mem_free((void **)&mb->data);
+		mb->data = data;
+		va_start(args, format);
+		vsnprintf(mb->data + mb->length, mb->capacity - mb->length, format, args);
+		va_end(args);
+	}
+	mb->length += needed;
+}
+
+// Must precede the samples of the named metric family
+void mb_family(MetricsBuffer *mb, const char *name, const char *type, const char *help) {
+	mb_append(mb, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+// labels are given without braces, e.g. "cache=\"attr\""
+void mb_sample(MetricsBuffer *mb, const char *name, const char *labels, uint64_t value) {
+	if (labels != NULL && labels[0] != '\0') {
+		mb_append(mb, "%s{%s} %lu\n", name, labels, value);
+	} else {
+		mb_append(mb, "%s %lu\n", name, value);
+	}
+}
@@ -0,0 +1,46 @@
+// MetricsServer.h
+
+#ifndef _METRICS_SERVER_H_
+#define _METRICS_SERVER_H_
+
+/////////////
+// includes
+
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+
+//////////
+// types
+
+typedef struct MetricsBuffer {
+	char	*data;
+	size_t	length;
+	size_t	capacity;
+} MetricsBuffer;
+
+// Serves metrics in the Prometheus text exposition format on a Unix domain
+// socket. Each connection receives one rendering and is then closed, e.g.
+//   socat - UNIX-CONNECT:<socketPath>
+typedef struct MetricsServer {
+	char	*socketPath;
+	int		listenFD;
+	void	(*render)(MetricsBuffer *mb);
+	pthread_t	thread;
+	volatile int	running;
+	uint64_t	requests;
+} MetricsServer;
+
+
+///////////////
+// prototypes
+
+MetricsServer *ms_new(const char *socketPath, void (*render)(MetricsBuffer *mb));
+void ms_delete(MetricsServer **ms);
+
+void mb_append(MetricsBuffer *mb, const char *format, ...) __attribute__((format(printf, 2, 3)));
+void mb_family(MetricsBuffer *mb, const char *name, const char *type, const char *help);
+void mb_sample(MetricsBuffer *mb, const char *name, const char *labels, uint64_t value);
+
+#endif
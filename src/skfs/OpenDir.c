@@ -3,6 +3,7 @@
 ///////////////
 // includes
 
+#include "AttrCache.h"
 #include "OpenDir.h"
 #include "OpenDirUpdate.h"
 #include "OpenDirWriter.h"
@@ -40,7 +41,7 @@ static void od_remove_from_reconciliation(OpenDir *od);
 ///////////////
 // implementation
 
-OpenDir *od_new(const char *path, DirData *dirData) {
+OpenDir *od_new(const char *path, DirData *dirData, AttrCache *ac) {
 	OpenDir	*od;
 	int	i;
 	pthread_mutexattr_t mutexAttr;
@@ -48,6 +49,7 @@ OpenDir *od_new(const char *path, DirData *dirData) {
 	od = (OpenDir *)mem_alloc(1, sizeof(OpenDir));
     srfsLog(LOG_FINE, "od_new:\t%s\n", path);
 	strncpy(od->path, path, SRFS_MAX_PATH_LENGTH);
+	od->ac = ac;
 	
 	if (dirData != NULL) {
 		od->dd = dd_dup(dirData);
@@ -64,6 +66,7 @@ OpenDir *od_new(const char *path, DirData *dirData) {
 	cv_init(&od->cvInstance, &od->cv);
     // Force an update
 	od->lastUpdateMillis = 0;
+	od->lastCheckMillis = 0;
 	od->needsReconciliation = TRUE;
 	rcst_add_to_reconciliation_set(od->path);
 	
@@ -101,6 +104,14 @@ uint64_t od_getElapsedSinceLastUpdateMillis(OpenDir *od) {
 	return curTimeMillis() - od->lastUpdateMillis;
 }
 
+uint64_t od_getLastCheckMillis(OpenDir *od) {
+	return od->lastCheckMillis;
+}
+
+uint64_t od_getElapsedSinceLastCheckMillis(OpenDir *od) {
+	return curTimeMillis() - od->lastCheckMillis;
+}
+
 uint64_t od_getLastWriteMillis(OpenDir *od) {
     return od->lastWriteMillis;
 }
@@ -242,6 +253,7 @@ int od_add_DirData(OpenDir *od, DirData *dd, SKMetaData *metaData) {
         metaDataVersion = metaData->getVersion();
     }
     pthread_mutex_lock(od->mutex);	
+	od->lastCheckMillis = _curTimeMillis;
 	srfsLog(_OD_DEBUG_MERGE ? LOG_WARNING : LOG_INFO, "od->ddVersion %ld\tmetaDataVersion %ld\tlastMergedVersion %ld", od->ddVersion, metaDataVersion, od->lastMergedVersion);
 	//if (od->ddVersion < metaDataVersion && od->lastMergedVersion != metaDataVersion) {
 	if (od->ddVersion <= metaDataVersion && od->lastMergedVersion != metaDataVersion) {
@@ -262,6 +274,10 @@ int od_add_DirData(OpenDir *od, DirData *dd, SKMetaData *metaData) {
 			od->dd = mr.dd;
 			od->lastUpdateMillis = _curTimeMillis;
 			od->ddVersion = metaDataVersion;
+			// Names may have been added elsewhere
+			if (od->ac != NULL) {
+				ac_negative_invalidate_dir(od->ac, od->path);
+			}
 		}
         // if local data had entries not in the kvs, update kvs with merged result
 		if (mr.dd0NotIn1) {
@@ -362,3 +378,30 @@ int od_record_get_attr(OpenDir *od, char *child, uint64_t curTime) {
 	// resolve this as prefetch provides a critical speed boost
 	return FALSE;
 }
+
+// Returns TRUE if name is neither present in the DirData nor pending
+// addition. Entries marked deleted are treated as absent.
+int od_lacks_entry(OpenDir *od, const char *name) {
+	int	i;
+	int	lacks;
+	int	pending;
+
+	lacks = FALSE;
+	pending = FALSE;
+    pthread_mutex_lock(od->mutex);	
+	for (i = 0; i < od->numPendingUpdates; i++) {
+		if (!strncmp(name, od->pendingUpdates[i].name, SRFS_MAX_PATH_LENGTH)) {
+			pending = TRUE;
+			lacks = od->pendingUpdates[i].type == ODU_T_DELETION;
+			break;
+		}
+	}
+	if (!pending) {
+		DirEntry	*de;
+
+		de = dd_get_entry_by_name(od->dd, name);
+		lacks = de == NULL || de_is_deleted(de);
+	}
+    pthread_mutex_unlock(od->mutex);	
+	return lacks;
+}
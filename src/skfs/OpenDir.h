@@ -6,6 +6,7 @@
 /////////////
 // includes
 
+#include "AttrCache.h"
 #include "DirData.h"
 #include "OpenDirUpdate.h"
 
@@ -38,22 +39,26 @@ typedef struct OpenDir {
 	pthread_cond_t	cvInstance;
 	pthread_cond_t	*cv;
 	uint64_t	lastUpdateMillis;
+	uint64_t	lastCheckMillis; // last time kvs DirData was merged, whether or not it was new
 	uint64_t	ddVersion;
 	uint64_t	lastMergedVersion;
 	uint64_t	lastGetAttr;
 	uint64_t	lastPrefetch;
     uint64_t    lastWriteMillis;
 	int		needsReconciliation;
+	AttrCache	*ac; // negative entries under this dir are invalidated on remote changes
 } OpenDir;
 
 
 //////////////////////
 // public prototypes
 
-OpenDir *od_new(const char *path, DirData *dd);
+OpenDir *od_new(const char *path, DirData *dd, AttrCache *ac);
 void od_delete(OpenDir **od);
 uint64_t od_getLastUpdateMillis(OpenDir *od);
 uint64_t od_getElapsedSinceLastUpdateMillis(OpenDir *od);
+uint64_t od_getLastCheckMillis(OpenDir *od);
+uint64_t od_getElapsedSinceLastCheckMillis(OpenDir *od);
 uint64_t od_getLastWriteMillis(OpenDir *od);
 void od_setLastWriteMillis(OpenDir *od, uint64_t lastWriteMillis);
 void od_waitForWrite(OpenDir *od, uint64_t writeTimeMillis);
@@ -66,5 +71,6 @@ int od_updates_pending(OpenDir *od);
 int od_set_queued_for_write(OpenDir *od, int queuedForWrite);
 void od_display(OpenDir *od, FILE *file = stdout);
 int od_record_get_attr(OpenDir *od, char *child, uint64_t curTime);
+int od_lacks_entry(OpenDir *od, const char *name);
 
 #endif /* _OPEN_DIR_H_ */
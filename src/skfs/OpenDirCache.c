@@ -105,6 +105,15 @@ void odc_store_error(OpenDirCache *odCache, char *path, int errorCode) {
         FALSE, CACHE_NO_MODIFICATION_TIME, CACHE_NO_TIMEOUT);
 }
 
+void odc_get_cache_stats(OpenDirCache *odCache, CacheStats *stats) {
+	int	i;
+
+	memset(stats, 0, sizeof(CacheStats));
+	for (i = 0; i < odCache->numSubCaches; i++) {
+		cache_get_stats(odCache->subCaches[i], stats);
+	}
+}
+
 void odc_display_stats(OpenDirCache *odCache) {
 	int	i;
 	
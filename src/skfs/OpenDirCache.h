@@ -37,6 +37,7 @@ CacheStoreResult odc_store(OpenDirCache *odCache, char *path, OpenDir *od);
 void odc_store_active_op(OpenDirCache *odCache, char *path, ActiveOp *op);
 void odc_remove_active_op(OpenDirCache *odCache, char *path, int fatalErrorOnNotFound = FALSE);
 void odc_store_error(OpenDirCache *odCache, char *path, int errorCode);
+void odc_get_cache_stats(OpenDirCache *odCache, CacheStats *stats);
 void odc_display_stats(OpenDirCache *odCache);
 CacheKeyList odc_key_list(OpenDirCache *odCache);
 
@@ -69,7 +69,7 @@ OpenDirTable *odt_new(const char *name, SRFSDHT *sd, AttrWriter *aw, AttrReader
     srfsLog(LOG_FINE, "odt_new:\t%s\n", name);
     odt->name = name;
 	odt->odc = odc_new(ODT_ODC_NAME, ODT_ODC_CACHE_SIZE, ODT_ODC_CACHE_EVICTION_BATCH, ODT_ODC_SUB_CACHES);
-	odt->ddr = ddr_new(sd, rtsDirData, odt->odc);
+	odt->ddr = ddr_new(sd, rtsDirData, odt->odc, ar != NULL ? ar_get_attrCache(ar) : NULL);
 	odt->odw = odw_new(sd/*, odt->ddr*/, odwMinWriteIntervalMillis);
 	odt->aw = aw;
 	odt->ar = ar;
@@ -300,6 +300,12 @@ int odt_add_entry(OpenDirTable *odt, char *path, char *child, OpenDir **_od) {
 			srfsLog(LOG_WARNING, "od before addition");
 			od_display(od, stderr);
 		}
+		if (odt->ar != NULL) {
+			char	childPath[SRFS_MAX_PATH_LENGTH];
+
+			snprintf(childPath, SRFS_MAX_PATH_LENGTH, "%s/%s", path, child);
+			ac_negative_invalidate(ar_get_attrCache(odt->ar), childPath);
+		}
 		od_add_entry(od, child, version);
 		if (srfsLogLevelMet(LOG_FINE)) {
 			srfsLog(LOG_WARNING, "od after addition");
@@ -5,6 +5,7 @@
 
 #include "PartialBlockReadRequest.h"
 #include "SRFSConstants.h"
+#include "Trace.h"
 #include "Util.h"
 
 
@@ -27,6 +28,8 @@ PartialBlockReadRequest *pbrr_new(FileBlockID *fbid, void *dest, size_t readOffs
 	pbrr->readOffset = readOffset;
 	pbrr->readSize = readSize;
     pbrr->minModificationTimeMicros = minModificationTimeMicros;
+    // requests are created by the thread serving the traced operation
+    pbrr->traceID = tr_current();
 	return pbrr;
 }
 
@@ -21,6 +21,7 @@ typedef struct PartialBlockReadRequest {
 	size_t		readOffset;
 	size_t		readSize;
     uint64_t    minModificationTimeMicros;
+    uint64_t    traceID;
 } PartialBlockReadRequest;
 
 
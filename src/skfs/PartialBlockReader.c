@@ -10,6 +10,7 @@
 
 #include <errno.h>
 #include <stdint.h>
+#include <string.h>
 
 
 ////////////
@@ -122,6 +123,109 @@ static int _pbr_native_read(PartialBlockReader *pbr, const char *path, char *des
     return totalRead;
 }
     
+// Reads the portion of a sparse file's hole bitmap (see fa_has_holes) covering
+// the given blocks. dest receives bytes firstBlock / 8 onwards; bytes beyond the
+// stored bitmap are zeroed. Returns 0 on success.
+int pbr_read_hole_map(PartialBlockReader *pbr, FileAttr *fa, uint64_t firstBlock, uint64_t numBlocks, unsigned char *dest) {
+    FileBlockID *fbid;
+    PartialBlockReadRequest *pbrr;
+    size_t  mapSize;
+    size_t  readOffset;
+    size_t  readSize;
+    size_t  destSize;
+    int     totalRead;
+    int     i;
+    
+    mapSize = fa_hole_map_size(fa);
+    readOffset = firstBlock / 8;
+    destSize = (firstBlock + numBlocks - 1) / 8 - readOffset + 1;
+    if (readOffset >= mapSize) {
+        readSize = 0;
+    } else {
+        readSize = size_min(destSize, mapSize - readOffset);
+    }
+    memset(dest + readSize, 0, destSize - readSize);
+    if (readSize == 0) {
+        return 0;
+    }
+    fbid = fbid_new(&fa->fid, SRFS_HOLE_MAP_BLOCK_INDEX);
+    pbrr = pbrr_new(fbid, dest, readOffset, readSize, stat_mtime_micros(&fa->stat));
+    totalRead = -1;
+    for (i = 0; totalRead != (int)readSize && i < _PBR_MAX_SKFS_BLOCK_READ_RETRIES; i++) {
+        totalRead = fbr_read(pbr->fbr, &pbrr, 1, NULL, 0, TRUE, FALSE);
+        if (totalRead != (int)readSize) {
+            srfsLog(LOG_WARNING, "pbr_read_hole_map retry %d %d %u", i, totalRead, readSize);
+            usleep(_PBR_SKFS_READ_ERROR_SLEEP_MICROS);
+        }
+    }
+    pbrr_delete(&pbrr);
+    fbid_delete(&fbid);
+    return totalRead == (int)readSize ? 0 : -1;
+}
+
+static int pbr_is_hole(unsigned char *holeMap, uint64_t holeMapFirstBlock, uint64_t block) {
+    uint64_t    bit;
+    
+    if (holeMap == NULL || block >= SRFS_HOLE_MAP_MAX_BLOCKS) {
+        return FALSE;
+    }
+    bit = block - (holeMapFirstBlock & ~(uint64_t)7);
+    return (holeMap[bit >> 3] >> (bit & 7)) & 1;
+}
+
+// Zero-copy fast path. If every block covering the read is cached in a
+// pooled BlockBuffer, stores a reference to each in bbs and returns the
+// number of blocks; the caller must release them. Returns 0, holding no
+// references, if the read must be served by pbr_read_given_attr instead.
+int pbr_read_block_buffers(PartialBlockReader *pbr, FileAttr *fa, size_t readSize, off_t readOffset,
+                           BlockBuffer **bbs, int maxBlocks, size_t *bytesRead) {
+	uint64_t	firstBlock;
+	uint64_t	lastBlock;
+	off_t		readEnd;
+	int			numBlocks;
+	int			i;
+
+	// Sparse files would need holes synthesized; leave them to the copying path
+	if (readSize == 0 || readOffset >= fa->stat.st_size || fa_has_holes(fa)) {
+		return 0;
+	}
+	readEnd = off_min(readOffset + readSize, fa->stat.st_size);
+	firstBlock = offsetToBlock(readOffset);
+	lastBlock = offsetToBlock(readEnd - 1);
+	numBlocks = lastBlock - firstBlock + 1;
+	if (numBlocks > maxBlocks) {
+		return 0;
+	}
+	for (i = 0; i < numBlocks; i++) {
+		FileBlockID	*fbid;
+		CacheReadResult	result;
+		off_t		blockEnd;
+
+		fbid = fbid_new(&fa->fid, firstBlock + i);
+		result = fbc_read_block_buffer(pbr->fbr->fileBlockCache, fbid, &bbs[i], stat_mtime_micros(&fa->stat));
+		fbid_delete(&fbid);
+		if (result == CRR_FOUND) {
+			// A short block must still cover the portion of the read it serves
+			blockEnd = off_min(readEnd - (off_t)(firstBlock + i) * SRFS_BLOCK_SIZE, SRFS_BLOCK_SIZE);
+			if ((off_t)bbs[i]->size < blockEnd) {
+				bb_release(&bbs[i]);
+				result = CRR_NOT_FOUND;
+			}
+		}
+		if (result != CRR_FOUND) {
+			while (--i >= 0) {
+				bb_release(&bbs[i]);
+			}
+			return 0;
+		}
+	}
+	for (i = 0; i < numBlocks; i++) {
+		rs_cache_inc(pbr->fbr->rs);
+	}
+	*bytesRead = readEnd - readOffset;
+	return numBlocks;
+}
+
 int pbr_read_given_attr(PartialBlockReader *pbr, const char *path, char *dest, size_t readSize, off_t readOffset, FileAttr *fa, int presumeBlocksInDHT, int maxBlocksReadAhead, int useNFSReadAhead) {    
 	int			numBlocks;
 	uint64_t	firstBlock;
@@ -192,11 +296,29 @@ int pbr_read_given_attr(PartialBlockReader *pbr, const char *path, char *dest, s
 		FileBlockID	*fbids[numBlocks];
 		FileBlockID	*fbidsReadAhead[numBlocksReadAhead];
 		PartialBlockReadRequest *pbrrsReadAhead[numBlocksReadAhead];
+        unsigned char   *holeMap;
+        off_t   holeBytes;
+        off_t   dhtReadSize;
+        int     numDHTBlocks;
+        int     numDHTBlocksReadAhead;
+
+        // Hole blocks of sparse files are not stored; they are zero-filled here
+        holeMap = NULL;
+        if (fa_has_holes(fa)) {
+            uint64_t    mapBlocks;
+            
+            mapBlocks = readAheadFirstBlock + numBlocksReadAhead - firstBlock;
+            holeMap = (unsigned char *)mem_alloc(mapBlocks / 8 + 2, 1);
+            if (pbr_read_hole_map(pbr, fa, firstBlock, mapBlocks, holeMap) != 0) {
+                srfsLog(LOG_WARNING, "pbr_read_given_attr unable to read hole map %s", path);
+                mem_free((void **)&holeMap);
+                return -1;
+            }
+        }
 
-		for (i = 0; i < numBlocks; i++) {
-			fbids[i] = fbid_new(&fa->fid, firstBlock + i);
-		}
 		totalSize = 0;
+        holeBytes = 0;
+        numDHTBlocks = 0;
 		for (i = 0; i < numBlocks; i++) {
 			size_t	blockReadOffset;
 			size_t	blockReadSize;
@@ -220,24 +342,40 @@ int pbr_read_given_attr(PartialBlockReader *pbr, const char *path, char *dest, s
 				blockReadEnd = SRFS_BLOCK_SIZE;
 			}
 			blockReadSize = blockReadEnd - blockReadOffset;
-			pbrrs[i] = pbrr_new(fbids[i], dest + totalSize, blockReadOffset, blockReadSize, 
-                                stat_mtime_micros(&fa->stat));
+            if (pbr_is_hole(holeMap, firstBlock, firstBlock + i)) {
+                memset(dest + totalSize, 0, blockReadSize);
+                holeBytes += blockReadSize;
+            } else {
+                fbids[numDHTBlocks] = fbid_new(&fa->fid, firstBlock + i);
+                pbrrs[numDHTBlocks] = pbrr_new(fbids[numDHTBlocks], dest + totalSize, blockReadOffset, blockReadSize, 
+                                    stat_mtime_micros(&fa->stat));
+                numDHTBlocks++;
+            }
 			totalSize += blockReadSize;
 		}
 		if (dest != NULL && totalSize != actualReadSize) {
 			srfsLog(LOG_WARNING, "totalSize %d actualReadSize %d", totalSize, actualReadSize);
 			fatalError("totalSize != actualReadSize", __FILE__, __LINE__);
 		}
+        dhtReadSize = actualReadSize - holeBytes;
 
+        numDHTBlocksReadAhead = 0;
 		for (i = 0; i < numBlocksReadAhead; i++) {
-			fbidsReadAhead[i] = fbid_new(&fa->fid, readAheadFirstBlock + i);
-			pbrrsReadAhead[i] = pbrr_new(fbidsReadAhead[i], NULL, 0, 0, 
-                                    stat_mtime_micros(&fa->stat));
+            if (!pbr_is_hole(holeMap, firstBlock, readAheadFirstBlock + i)) {
+                fbidsReadAhead[numDHTBlocksReadAhead] = fbid_new(&fa->fid, readAheadFirstBlock + i);
+                pbrrsReadAhead[numDHTBlocksReadAhead] = pbrr_new(fbidsReadAhead[numDHTBlocksReadAhead], NULL, 0, 0, 
+                                        stat_mtime_micros(&fa->stat));
+                numDHTBlocksReadAhead++;
+            }
 		}
 
-		totalRead = fbr_read(pbr->fbr, pbrrs, numBlocks, pbrrsReadAhead, numBlocksReadAhead, presumeBlocksInDHT, useNFSReadAhead);
-		if (dest != NULL && totalRead != actualReadSize) {
-			srfsLog(LOG_WARNING, "totalRead %d actualReadSize %d", totalRead, actualReadSize);
+        if (numDHTBlocks == 0 && numDHTBlocksReadAhead == 0) {
+            totalRead = 0;
+        } else {
+            totalRead = fbr_read(pbr->fbr, pbrrs, numDHTBlocks, pbrrsReadAhead, numDHTBlocksReadAhead, presumeBlocksInDHT, useNFSReadAhead);
+        }
+		if (dest != NULL && totalRead != dhtReadSize) {
+			srfsLog(LOG_WARNING, "totalRead %d dhtReadSize %d", totalRead, dhtReadSize);
 			if (totalRead != -1) {
 				//fatalError("totalRead != actualReadSize", __FILE__, __LINE__);
 				srfsLog(LOG_WARNING, "totalRead != actualReadSize");
@@ -252,28 +390,34 @@ int pbr_read_given_attr(PartialBlockReader *pbr, const char *path, char *dest, s
                 } else {
                     int ii;
                     
-                    for (ii = 0; totalRead != actualReadSize && ii < _PBR_MAX_SKFS_BLOCK_READ_RETRIES; ii++) {
-                        totalRead = fbr_read(pbr->fbr, pbrrs, numBlocks, pbrrsReadAhead, numBlocksReadAhead, presumeBlocksInDHT, useNFSReadAhead);
-                        srfsLog(LOG_WARNING, "skfs block read retry %d %d", totalRead, actualReadSize);
-                        if (totalRead != actualReadSize) {
+                    for (ii = 0; totalRead != dhtReadSize && ii < _PBR_MAX_SKFS_BLOCK_READ_RETRIES; ii++) {
+                        totalRead = fbr_read(pbr->fbr, pbrrs, numDHTBlocks, pbrrsReadAhead, numDHTBlocksReadAhead, presumeBlocksInDHT, useNFSReadAhead);
+                        srfsLog(LOG_WARNING, "skfs block read retry %d %d", totalRead, dhtReadSize);
+                        if (totalRead != dhtReadSize) {
                             usleep(_PBR_SKFS_READ_ERROR_SLEEP_MICROS);
                         }
                     }
-                    if (totalRead != actualReadSize) {
+                    if (totalRead != dhtReadSize) {
                         srfsLog(LOG_WARNING, "writable path. pbr_read returning error");
                         totalRead = -1;
                     }
                 }
 			}
 		}
+        if (holeMap != NULL) {
+            if (totalRead >= 0) {
+                totalRead += holeBytes;
+            }
+            mem_free((void **)&holeMap);
+        }
 
 		srfsLog(LOG_FINE, "freeing file read resources");
-		for (i = 0; i < numBlocks; i++) {
+		for (i = 0; i < numDHTBlocks; i++) {
 			fbid_delete(&fbids[i]);
 			pbrr_delete(&pbrrs[i]);
 		}
 
-		for (i = 0; i < numBlocksReadAhead; i++) {
+		for (i = 0; i < numDHTBlocksReadAhead; i++) {
 			fbid_delete(&fbidsReadAhead[i]);
 			pbrr_delete(&pbrrsReadAhead[i]);
 		}
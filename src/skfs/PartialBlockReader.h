@@ -29,6 +29,9 @@ typedef struct PartialBlockReader {
 PartialBlockReader *pbr_new(AttrReader *ar, FileBlockReader *fbr, G2TaskOutputReader *g2tor);
 void pbr_delete(PartialBlockReader **pbr);
 int pbr_read(PartialBlockReader *pbr, const char *path, char *dest, size_t readSize, off_t readOffset, SKFSOpenFile *sof);
+int pbr_read_hole_map(PartialBlockReader *pbr, FileAttr *fa, uint64_t firstBlock, uint64_t numBlocks, unsigned char *dest);
+int pbr_read_block_buffers(PartialBlockReader *pbr, FileAttr *fa, size_t readSize, off_t readOffset,
+                           BlockBuffer **bbs, int maxBlocks, size_t *bytesRead);
 int pbr_read_given_attr(PartialBlockReader *pbr, const char *path, char *dest, size_t readSize, off_t readOffset, FileAttr *fa, int presumeBlocksInDHT, int maxBlocksReadAhead = 131072, int useNFSReadAhead = FALSE);
 
 #endif
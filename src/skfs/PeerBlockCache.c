@@ -0,0 +1,746 @@
+// PeerBlockCache.c
+
+/////////////
+// includes
+
+#include "FileBlockReader.h"
+#include "PartialBlockReadRequest.h"
+#include "PeerBlockCache.h"
+#include "Util.h"
+
+#include <arpa/inet.h>
+#include <ctype.h>
+#include <errno.h>
+#include <ifaddrs.h>
+#include <netinet/tcp.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/types.h>
+
+
+////////////////////
+// private defines
+
+#define _PBC_MAGIC	0x534b5042
+#define _PBC_MT_GET	1
+#define _PBC_RESULT_NOT_FOUND	0
+#define _PBC_RESULT_FOUND	1
+#define _PBC_LISTEN_BACKLOG	64
+#define _PBC_MAX_LINE_LENGTH	128
+
+
+/////////////////
+// private types
+
+/*
+ protocol: each connection carries a stream of requests, answered in order
+
+ request:  magic, type, minModificationTimeMicros, FileBlockID
+ response: magic, result, length, followed by length bytes of block data
+
+ Peers run the same build, so FileBlockID is sent as is, as BlockReader
+ does with FileAttr.
+*/
+
+typedef struct PBCRequest {
+	uint32_t	magic;
+	uint32_t	type;
+	uint64_t	minModificationTimeMicros;
+	FileBlockID	fbid;
+} PBCRequest;
+
+typedef struct PBCResponse {
+	uint32_t	magic;
+	uint32_t	result;
+	uint64_t	length;
+} PBCResponse;
+
+typedef struct PBCServerConnection {
+	PeerBlockCache	*pbc;
+	int		fd;
+} PBCServerConnection;
+
+// The requests of one pbc_fetch() bound for one peer
+typedef struct PBCPeerBatch {
+	int		peer;
+	PBCRequest	*requests;
+	int		numRequests;
+	int		numReceived;
+	PBCConnection	*connection; // NULL if none could be had before the deadline
+	int		reused; // the connection was open before this batch
+	int		retried; // reconnected after a stale connection
+	int		ok;
+	int		peerFailed; // failure attributable to the peer; marks it down
+} PBCPeerBatch;
+
+
+///////////////////////
+// private prototypes
+
+static uint64_t pbc_hash(const void *data, size_t length);
+static int pbc_read_peers(PeerBlockCache *pbc, char *peerAddressFile);
+static void pbc_build_ring(PeerBlockCache *pbc);
+static int pbc_owner(PeerBlockCache *pbc, FileBlockID *fbid);
+static int pbc_send_fully(int fd, const void *buf, size_t length, int flags);
+static int pbc_recv_fully(int fd, void *buf, size_t length);
+static void pbc_set_timeouts(int fd, uint64_t timeoutMillis);
+static PBCConnection *pbc_acquire_connection(PBCPeer *peer, uint64_t deadlineMillis);
+static int pbc_connect_and_send(PeerBlockCache *pbc, PBCPeerBatch *batch, uint64_t deadlineMillis);
+static void pbc_send_batch(PeerBlockCache *pbc, PBCPeerBatch *batch, uint64_t deadlineMillis);
+static void pbc_recv_batch(PeerBlockCache *pbc, PBCPeerBatch *batch, int *owners, int numBlocks,
+                           uint64_t deadlineMillis, void **blocks, size_t *blockSizes);
+static void pbc_finish_batch(PeerBlockCache *pbc, PBCPeerBatch *batch);
+static int pbc_is_peer_address(PeerBlockCache *pbc, struct sockaddr_in *addr);
+static void *pbc_accept_run(void *_pbc);
+static void *pbc_serve_run(void *_connection);
+static void pbc_warm(PeerBlockCache *pbc, FileBlockID *fbid, uint64_t minModificationTimeMicros);
+
+
+///////////////////
+// implementation
+
+PeerBlockCache *pbc_new(FileBlockReader *fbr, int port, char *peerAddressFile) {
+	PeerBlockCache	*pbc;
+	struct sockaddr_in	addr;
+	int		one;
+
+	pbc = (PeerBlockCache *)mem_alloc(1, sizeof(PeerBlockCache));
+	pbc->fbr = fbr;
+	pbc->port = port;
+	if (!pbc_read_peers(pbc, peerAddressFile)) {
+		mem_free((void **)&pbc);
+		return NULL;
+	}
+	pbc_build_ring(pbc);
+
+	pbc->listenFD = socket(AF_INET, SOCK_STREAM, 0);
+	if (pbc->listenFD < 0) {
+		srfsLog(LOG_WARNING, "errno %d %x", errno, errno);
+		fatalError("PeerBlockCache failed to create socket", __FILE__, __LINE__);
+	}
+	one = 1;
+	setsockopt(pbc->listenFD, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+	if (pbc->localPeer >= 0) {
+		// Only the address that peers were told about
+		addr = pbc->peers[pbc->localPeer].addr;
+	} else {
+		srfsLog(LOG_WARNING, "pbc no local entry in %s; listening on all addresses", peerAddressFile);
+		memset(&addr, 0, sizeof(struct sockaddr_in));
+		addr.sin_family = AF_INET;
+		addr.sin_addr.s_addr = htonl(INADDR_ANY);
+		addr.sin_port = htons(port);
+	}
+	if (bind(pbc->listenFD, (struct sockaddr *)&addr, sizeof(addr)) < 0
+			|| listen(pbc->listenFD, _PBC_LISTEN_BACKLOG) < 0) {
+		srfsLog(LOG_WARNING, "errno %d %x", errno, errno);
+		fatalError("PeerBlockCache failed to listen on port", __FILE__, __LINE__);
+	}
+	srfsLog(LOG_WARNING, "PeerBlockCache listening on %s:%d peers %d", inet_ntoa(addr.sin_addr), port, pbc->numPeers);
+	pbc->running = TRUE;
+	pthread_create(&pbc->acceptThread, NULL, pbc_accept_run, pbc);
+	return pbc;
+}
+
+void pbc_stop(PeerBlockCache *pbc) {
+	pbc->running = FALSE;
+	shutdown(pbc->listenFD, SHUT_RDWR);
+}
+
+// FNV-1a, finished with a 64-bit mix so that nearby keys spread over the ring
+static uint64_t pbc_hash(const void *data, size_t length) {
+	uint64_t	h;
+
+	h = fnv1a_64(data, length);
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	h *= 0xc4ceb9fe1a85ec53ULL;
+	h ^= h >> 33;
+	return h;
+}
+
+static int pbc_is_local_address(in_addr_t s_addr, struct ifaddrs *ifap) {
+	for (; ifap != NULL; ifap = ifap->ifa_next) {
+		if (ifap->ifa_addr != NULL && ifap->ifa_addr->sa_family == AF_INET
+				&& ((struct sockaddr_in *)ifap->ifa_addr)->sin_addr.s_addr == s_addr) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+// Each line of the address file holds an IPv4 address, optionally followed by
+// :port. Every host must use the same list so that all agree on block owners.
+// The entry matching a local address and our port is this host.
+static int pbc_read_peers(PeerBlockCache *pbc, char *peerAddressFile) {
+	FILE	*f;
+	char	line[_PBC_MAX_LINE_LENGTH];
+	struct ifaddrs	*ifap;
+	int		numLocal;
+
+	f = fopen(peerAddressFile, "r");
+	if (f == NULL) {
+		srfsLog(LOG_WARNING, "pbc unable to open %s", peerAddressFile);
+		return FALSE;
+	}
+	ifap = NULL;
+	if (getifaddrs(&ifap) < 0) {
+		ifap = NULL;
+		srfsLog(LOG_WARNING, "getifaddrs failed");
+	}
+	pbc->peers = (PBCPeer *)mem_alloc(PBC_MAX_PEERS, sizeof(PBCPeer));
+	pbc->localPeer = -1;
+	numLocal = 0;
+	while (fgets(line, sizeof(line), f) != NULL && pbc->numPeers < PBC_MAX_PEERS) {
+		PBCPeer	*peer;
+		char	*ip;
+		char	*port;
+		int		i;
+
+		ip = line;
+		while (isspace(*ip)) {
+			ip++;
+		}
+		ip[strcspn(ip, " \t\r\n")] = '\0';
+		if (*ip == '\0' || *ip == '#') {
+			continue;
+		}
+		port = strchr(ip, ':');
+		if (port != NULL) {
+			*port++ = '\0';
+		}
+		peer = &pbc->peers[pbc->numPeers];
+		peer->addr.sin_family = AF_INET;
+		peer->addr.sin_port = htons(port != NULL ? atoi(port) : PBC_DEFAULT_PORT);
+		if (inet_pton(AF_INET, ip, &peer->addr.sin_addr) != 1) {
+			srfsLog(LOG_WARNING, "pbc ignoring bad address %s", ip);
+			continue;
+		}
+		peer->isLocal = ntohs(peer->addr.sin_port) == pbc->port
+						&& pbc_is_local_address(peer->addr.sin_addr.s_addr, ifap);
+		if (peer->isLocal) {
+			if (pbc->localPeer < 0) {
+				pbc->localPeer = pbc->numPeers;
+			}
+			numLocal++;
+		}
+		for (i = 0; i < PBC_CONNECTIONS_PER_PEER; i++) {
+			pthread_mutex_init(&peer->connections[i].lock, NULL);
+			peer->connections[i].fd = -1;
+		}
+		srfsLog(LOG_WARNING, "pbc peer %d %s:%d%s", pbc->numPeers, ip, ntohs(peer->addr.sin_port),
+				peer->isLocal ? " (local)" : "");
+		pbc->numPeers++;
+	}
+	fclose(f);
+	if (ifap != NULL) {
+		freeifaddrs(ifap);
+	}
+	if (numLocal != 1) {
+		// Blocks we own would be requested from ourselves, or owners would disagree
+		srfsLog(LOG_WARNING, "pbc expected exactly one local entry in %s, found %d", peerAddressFile, numLocal);
+	}
+	if (pbc->numPeers == 0) {
+		mem_free((void **)&pbc->peers);
+		return FALSE;
+	}
+	return TRUE;
+}
+
+static int pbc_ring_entry_compare(const void *a, const void *b) {
+	uint64_t	ha;
+	uint64_t	hb;
+
+	ha = ((PBCRingEntry *)a)->hash;
+	hb = ((PBCRingEntry *)b)->hash;
+	return ha < hb ? -1 : (ha > hb ? 1 : 0);
+}
+
+static void pbc_build_ring(PeerBlockCache *pbc) {
+	int	i;
+	int	v;
+
+	pbc->ringSize = pbc->numPeers * PBC_VIRTUAL_NODES;
+	pbc->ring = (PBCRingEntry *)mem_alloc(pbc->ringSize, sizeof(PBCRingEntry));
+	for (i = 0; i < pbc->numPeers; i++) {
+		for (v = 0; v < PBC_VIRTUAL_NODES; v++) {
+			char	name[_PBC_MAX_LINE_LENGTH];
+			char	ip[INET_ADDRSTRLEN];
+			int		length;
+
+			inet_ntop(AF_INET, &pbc->peers[i].addr.sin_addr, ip, sizeof(ip));
+			length = snprintf(name, sizeof(name), "%s:%d#%d", ip, ntohs(pbc->peers[i].addr.sin_port), v);
+			pbc->ring[i * PBC_VIRTUAL_NODES + v].hash = pbc_hash(name, length);
+			pbc->ring[i * PBC_VIRTUAL_NODES + v].peer = i;
+		}
+	}
+	qsort(pbc->ring, pbc->ringSize, sizeof(PBCRingEntry), pbc_ring_entry_compare);
+}
+
+// The key string is the kvs key, so it is the same on every host
+static int pbc_owner(PeerBlockCache *pbc, FileBlockID *fbid) {
+	char	key[SRFS_FBID_KEY_SIZE];
+	uint64_t	h;
+	int		lo;
+	int		hi;
+
+	fbid_to_string(fbid, key);
+	h = pbc_hash(key, strlen(key));
+	// first entry at or after h, wrapping around
+	lo = 0;
+	hi = pbc->ringSize;
+	while (lo < hi) {
+		int	mid;
+
+		mid = (lo + hi) / 2;
+		if (pbc->ring[mid].hash < h) {
+			lo = mid + 1;
+		} else {
+			hi = mid;
+		}
+	}
+	return pbc->ring[lo % pbc->ringSize].peer;
+}
+
+static int pbc_send_fully(int fd, const void *buf, size_t length, int flags) {
+	size_t	sent;
+
+	sent = 0;
+	while (sent < length) {
+		ssize_t	n;
+
+		n = send(fd, (const char *)buf + sent, length - sent, flags | MSG_NOSIGNAL);
+		if (n < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return FALSE;
+		}
+		sent += n;
+	}
+	return TRUE;
+}
+
+static int pbc_recv_fully(int fd, void *buf, size_t length) {
+	size_t	received;
+
+	received = 0;
+	while (received < length) {
+		ssize_t	n;
+
+		n = recv(fd, (char *)buf + received, length - received, 0);
+		if (n < 0 && errno == EINTR) {
+			continue;
+		}
+		if (n == 0) {
+			errno = ECONNRESET; // closed by the peer
+		}
+		if (n <= 0) {
+			return FALSE;
+		}
+		received += n;
+	}
+	return TRUE;
+}
+
+static void pbc_set_timeouts(int fd, uint64_t timeoutMillis) {
+	struct timeval	tv;
+	int		one;
+
+	tv.tv_sec = timeoutMillis / 1000;
+	tv.tv_usec = (timeoutMillis % 1000) * 1000;
+	setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+	setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+	one = 1;
+	setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+}
+
+// Returns a locked connection, preferring an idle one, or NULL if all are
+// still busy at deadlineMillis
+static PBCConnection *pbc_acquire_connection(PBCPeer *peer, uint64_t deadlineMillis) {
+	struct timespec	ts;
+	int	start;
+	int	i;
+
+	start = (int)((uint64_t)pthread_self() % PBC_CONNECTIONS_PER_PEER);
+	for (i = 0; i < PBC_CONNECTIONS_PER_PEER; i++) {
+		PBCConnection	*connection;
+
+		connection = &peer->connections[(start + i) % PBC_CONNECTIONS_PER_PEER];
+		if (pthread_mutex_trylock(&connection->lock) == 0) {
+			return connection;
+		}
+	}
+	// curTimeMillis() is wall-clock time, as timedlock expects
+	ts.tv_sec = deadlineMillis / 1000;
+	ts.tv_nsec = (deadlineMillis % 1000) * 1000000;
+	if (pthread_mutex_timedlock(&peer->connections[start].lock, &ts) != 0) {
+		return NULL;
+	}
+	return &peer->connections[start];
+}
+
+// Connects batch->connection if needed and sends the batch's requests.
+// Returns FALSE, with the connection closed, on failure.
+static int pbc_connect_and_send(PeerBlockCache *pbc, PBCPeerBatch *batch, uint64_t deadlineMillis) {
+	PBCConnection	*connection;
+	PBCPeer	*peer;
+	uint64_t	curTime;
+
+	connection = batch->connection;
+	peer = &pbc->peers[batch->peer];
+	curTime = curTimeMillis();
+	if (curTime >= deadlineMillis) {
+		errno = ETIMEDOUT;
+		return FALSE;
+	}
+	if (connection->fd < 0) {
+		connection->fd = socket(AF_INET, SOCK_STREAM, 0);
+		if (connection->fd < 0) {
+			return FALSE;
+		}
+		// SO_SNDTIMEO also bounds connect()
+		pbc_set_timeouts(connection->fd, deadlineMillis - curTime);
+		if (connect(connection->fd, (struct sockaddr *)&peer->addr, sizeof(peer->addr)) != 0) {
+			close(connection->fd);
+			connection->fd = -1;
+			return FALSE;
+		}
+	} else {
+		pbc_set_timeouts(connection->fd, deadlineMillis - curTime);
+	}
+	if (!pbc_send_fully(connection->fd, batch->requests, batch->numRequests * sizeof(PBCRequest), 0)) {
+		close(connection->fd);
+		connection->fd = -1;
+		return FALSE;
+	}
+	return TRUE;
+}
+
+// Acquires a connection to batch->peer and sends it the batch's requests,
+// without waiting for responses. If no connection frees up before the
+// deadline the peer is skipped for this batch. A pooled connection that
+// fails (e.g. the peer restarted) is replaced once before the peer is
+// considered failed.
+static void pbc_send_batch(PeerBlockCache *pbc, PBCPeerBatch *batch, uint64_t deadlineMillis) {
+	batch->numReceived = 0;
+	batch->retried = FALSE;
+	batch->peerFailed = FALSE;
+	batch->connection = pbc_acquire_connection(&pbc->peers[batch->peer], deadlineMillis);
+	if (batch->connection == NULL) {
+		batch->ok = FALSE;
+		return;
+	}
+	batch->reused = batch->connection->fd >= 0;
+	batch->ok = pbc_connect_and_send(pbc, batch, deadlineMillis);
+	if (!batch->ok && batch->reused) {
+		batch->retried = TRUE;
+		batch->ok = pbc_connect_and_send(pbc, batch, deadlineMillis);
+	}
+	batch->peerFailed = !batch->ok && errno != ETIMEDOUT;
+}
+
+// Reads the responses to a batch, in request order, until all have arrived
+// or deadlineMillis passes. If a pooled connection turns out to have been
+// closed by the peer before any response, the batch is resent once on a
+// new connection.
+static void pbc_recv_batch(PeerBlockCache *pbc, PBCPeerBatch *batch, int *owners, int numBlocks,
+                           uint64_t deadlineMillis, void **blocks, size_t *blockSizes) {
+	int		b;
+
+	for (b = 0; batch->ok && b < numBlocks; b++) {
+		PBCResponse	response;
+		uint64_t	curTime;
+		int		fd;
+
+		if (owners[b] != batch->peer) {
+			continue;
+		}
+		curTime = curTimeMillis();
+		if (curTime >= deadlineMillis) {
+			// the peer had no time left to answer; not its fault
+			errno = ETIMEDOUT;
+			batch->ok = FALSE;
+			break;
+		}
+		fd = batch->connection->fd;
+		pbc_set_timeouts(fd, deadlineMillis - curTime);
+		if (!pbc_recv_fully(fd, &response, sizeof(PBCResponse))) {
+			if (errno == ECONNRESET && batch->numReceived == 0 && batch->reused && !batch->retried) {
+				srfsLog(LOG_INFO, "pbc peer %d stale connection; reconnecting", batch->peer);
+				close(batch->connection->fd);
+				batch->connection->fd = -1;
+				batch->retried = TRUE;
+				batch->ok = pbc_connect_and_send(pbc, batch, deadlineMillis);
+				batch->peerFailed = !batch->ok && errno != ETIMEDOUT;
+				b--; // read this response again
+				continue;
+			}
+			batch->ok = FALSE;
+			batch->peerFailed = TRUE;
+			break;
+		}
+		if (response.magic != _PBC_MAGIC || response.length > SRFS_BLOCK_SIZE) {
+			errno = EPROTO;
+			batch->ok = FALSE;
+			batch->peerFailed = TRUE;
+			break;
+		}
+		if (response.result == _PBC_RESULT_FOUND) {
+			blocks[b] = mem_alloc(response.length > 0 ? response.length : 1, 1);
+			if (!pbc_recv_fully(fd, blocks[b], response.length)) {
+				mem_free(&blocks[b]);
+				batch->ok = FALSE;
+				batch->peerFailed = TRUE;
+				break;
+			}
+			blockSizes[b] = response.length;
+			__atomic_fetch_add(&pbc->fetchHits, 1, __ATOMIC_RELAXED);
+		} else {
+			__atomic_fetch_add(&pbc->fetchMisses, 1, __ATOMIC_RELAXED);
+		}
+		batch->numReceived++;
+	}
+}
+
+// A failure closes the connection, as unread responses may remain; only a
+// failure of the peer itself marks it down. A peer whose connections were
+// all busy is simply skipped. Blocks not received are left to the caller.
+static void pbc_finish_batch(PeerBlockCache *pbc, PBCPeerBatch *batch) {
+	PBCConnection	*connection;
+
+	connection = batch->connection;
+	if (connection == NULL) {
+		__atomic_fetch_add(&pbc->fetchSkipped, batch->numRequests, __ATOMIC_RELAXED);
+		return;
+	}
+	if (!batch->ok) {
+		srfsLog(LOG_WARNING, "pbc peer %d failed errno %d%s", batch->peer, errno, batch->peerFailed ? "" : " (deadline)");
+		__atomic_fetch_add(&pbc->fetchErrors, batch->numRequests - batch->numReceived, __ATOMIC_RELAXED);
+		if (connection->fd >= 0) {
+			close(connection->fd);
+			connection->fd = -1;
+		}
+		if (batch->peerFailed) {
+			__atomic_store_n(&pbc->peers[batch->peer].downUntilMillis, curTimeMillis() + PBC_PEER_RETRY_MILLIS, __ATOMIC_RELAXED);
+		}
+	} else {
+		// restore the per-operation timeouts for the next user
+		pbc_set_timeouts(connection->fd, PBC_IO_TIMEOUT_MILLIS);
+	}
+	pthread_mutex_unlock(&connection->lock);
+}
+
+// Fetches blocks from their owning peers. Requests go out to all owners
+// before any response is read, and all responses, including any wait for
+// a connection, fall under a single deadline. blocks[i] is set to an
+// allocated copy of each block found, and to NULL otherwise. Returns the
+// number found.
+int pbc_fetch(PeerBlockCache *pbc, FileBlockID **fbids, uint64_t *minModificationTimesMicros, int numBlocks,
+              void **blocks, size_t *blockSizes) {
+	int		owners[numBlocks];
+	PBCPeerBatch	batches[numBlocks];
+	PBCRequest	requests[numBlocks];
+	int		numBatches;
+	uint64_t	curTime;
+	uint64_t	deadline;
+	int		numFound;
+	int		numRequests;
+	int		i;
+
+	curTime = curTimeMillis();
+	deadline = curTime + PBC_IO_TIMEOUT_MILLIS;
+	numBatches = 0;
+	for (i = 0; i < numBlocks; i++) {
+		int	owner;
+
+		blocks[i] = NULL;
+		blockSizes[i] = 0;
+		owner = pbc_owner(pbc, fbids[i]);
+		if (pbc->peers[owner].isLocal) {
+			owners[i] = -1;
+		} else if (__atomic_load_n(&pbc->peers[owner].downUntilMillis, __ATOMIC_RELAXED) > curTime) {
+			owners[i] = -1;
+			__atomic_fetch_add(&pbc->fetchSkipped, 1, __ATOMIC_RELAXED);
+		} else {
+			int	j;
+
+			owners[i] = owner;
+			// batches are kept in peer order; connections are locked in that order
+			for (j = 0; j < numBatches && batches[j].peer < owner; j++) {
+			}
+			if (j == numBatches || batches[j].peer != owner) {
+				memmove(&batches[j + 1], &batches[j], (numBatches - j) * sizeof(PBCPeerBatch));
+				batches[j].peer = owner;
+				batches[j].numRequests = 0;
+				numBatches++;
+			}
+			batches[j].numRequests++;
+		}
+	}
+	// give each batch a contiguous run of requests, in block order
+	numRequests = 0;
+	for (i = 0; i < numBatches; i++) {
+		batches[i].requests = &requests[numRequests];
+		numRequests += batches[i].numRequests;
+		batches[i].numRequests = 0;
+	}
+	for (i = 0; i < numBlocks; i++) {
+		if (owners[i] >= 0) {
+			PBCPeerBatch	*batch;
+			PBCRequest	*request;
+			int	j;
+
+			for (j = 0; batches[j].peer != owners[i]; j++) {
+			}
+			batch = &batches[j];
+			request = &batch->requests[batch->numRequests++];
+			memset(request, 0, sizeof(PBCRequest));
+			request->magic = _PBC_MAGIC;
+			request->type = _PBC_MT_GET;
+			request->minModificationTimeMicros = minModificationTimesMicros[i];
+			request->fbid = *fbids[i];
+		}
+	}
+	for (i = 0; i < numBatches; i++) {
+		pbc_send_batch(pbc, &batches[i], deadline);
+	}
+	for (i = 0; i < numBatches; i++) {
+		if (batches[i].connection != NULL) {
+			pbc_recv_batch(pbc, &batches[i], owners, numBlocks, deadline, blocks, blockSizes);
+		}
+		pbc_finish_batch(pbc, &batches[i]);
+	}
+	numFound = 0;
+	for (i = 0; i < numBlocks; i++) {
+		if (blocks[i] != NULL) {
+			numFound++;
+		}
+	}
+	return numFound;
+}
+
+// Connections come from peers' ephemeral ports, so only the address is checked
+static int pbc_is_peer_address(PeerBlockCache *pbc, struct sockaddr_in *addr) {
+	int	i;
+
+	for (i = 0; i < pbc->numPeers; i++) {
+		if (pbc->peers[i].addr.sin_addr.s_addr == addr->sin_addr.s_addr) {
+			return TRUE;
+		}
+	}
+	return FALSE;
+}
+
+static void *pbc_accept_run(void *_pbc) {
+	PeerBlockCache	*pbc;
+
+	pbc = (PeerBlockCache *)_pbc;
+	while (pbc->running) {
+		PBCServerConnection	*connection;
+		pthread_t	thread;
+		pthread_attr_t	attr;
+		struct sockaddr_in	addr;
+		socklen_t	addrLength;
+		int		fd;
+
+		addrLength = sizeof(addr);
+		fd = accept(pbc->listenFD, (struct sockaddr *)&addr, &addrLength);
+		if (fd < 0) {
+			if (pbc->running) {
+				srfsLog(LOG_WARNING, "pbc accept errno %d", errno);
+				usleep(1000);
+			}
+			continue;
+		}
+		if (addr.sin_family != AF_INET || !pbc_is_peer_address(pbc, &addr)) {
+			srfsLog(LOG_WARNING, "pbc rejecting connection from %s", inet_ntoa(addr.sin_addr));
+			__atomic_fetch_add(&pbc->rejectedConnections, 1, __ATOMIC_RELAXED);
+			close(fd);
+			continue;
+		}
+		pbc_set_timeouts(fd, 0);
+		connection = (PBCServerConnection *)mem_alloc(1, sizeof(PBCServerConnection));
+		connection->pbc = pbc;
+		connection->fd = fd;
+		// One thread per connection; peers hold at most PBC_CONNECTIONS_PER_PEER each
+		pthread_attr_init(&attr);
+		pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+		if (pthread_create(&thread, &attr, pbc_serve_run, connection) != 0) {
+			close(fd);
+			mem_free((void **)&connection);
+		}
+		pthread_attr_destroy(&attr);
+	}
+	return NULL;
+}
+
+static void *pbc_serve_run(void *_connection) {
+	PBCServerConnection	*connection;
+	PeerBlockCache	*pbc;
+	unsigned char	*buf;
+	PBCRequest	request;
+
+	connection = (PBCServerConnection *)_connection;
+	pbc = connection->pbc;
+	buf = (unsigned char *)mem_alloc(SRFS_BLOCK_SIZE, 1);
+	while (pbc->running && pbc_recv_fully(connection->fd, &request, sizeof(PBCRequest))) {
+		PBCResponse	response;
+		FileBlockID	*fbid;
+		CacheReadResult	result;
+		int		numRead;
+
+		if (request.magic != _PBC_MAGIC || request.type != _PBC_MT_GET) {
+			srfsLog(LOG_WARNING, "pbc bad request %x %d", request.magic, request.type);
+			break;
+		}
+		// Recompute the local hash rather than trusting the sender's
+		fbid = fbid_new(&request.fbid.fid, request.fbid.block);
+		numRead = 0;
+		result = fbc_read_no_op_creation(pbc->fbr->fileBlockCache, fbid, buf, 0, SRFS_BLOCK_SIZE, &numRead,
+										 request.minModificationTimeMicros);
+		response.magic = _PBC_MAGIC;
+		if (result == CRR_FOUND) {
+			response.result = _PBC_RESULT_FOUND;
+			response.length = numRead;
+			__atomic_fetch_add(&pbc->servedHits, 1, __ATOMIC_RELAXED);
+		} else {
+			response.result = _PBC_RESULT_NOT_FOUND;
+			response.length = 0;
+			__atomic_fetch_add(&pbc->servedMisses, 1, __ATOMIC_RELAXED);
+			if (result == CRR_NOT_FOUND) {
+				pbc_warm(pbc, fbid, request.minModificationTimeMicros);
+			}
+		}
+		fbid_delete(&fbid);
+		if (!pbc_send_fully(connection->fd, &response, sizeof(PBCResponse), response.length > 0 ? MSG_MORE : 0)
+				|| !pbc_send_fully(connection->fd, buf, response.length, 0)) {
+			break;
+		}
+	}
+	close(connection->fd);
+	mem_free((void **)&buf);
+	mem_free((void **)&connection);
+	return NULL;
+}
+
+// Starts a kvs read-ahead of a block we own but do not hold, so that the
+// next peer to ask finds it
+static void pbc_warm(PeerBlockCache *pbc, FileBlockID *fbid, uint64_t minModificationTimeMicros) {
+	PartialBlockReadRequest	*pbrr;
+
+	pbrr = pbrr_new(fbid, NULL, 0, 0, minModificationTimeMicros);
+	fbr_read(pbc->fbr, NULL, 0, &pbrr, 1, TRUE, FALSE);
+	pbrr_delete(&pbrr);
+}
+
+void pbc_display_stats(PeerBlockCache *pbc) {
+	srfsLog(LOG_WARNING, "pbc fetchHits %lu fetchMisses %lu fetchErrors %lu fetchSkipped %lu servedHits %lu servedMisses %lu rejectedConnections %lu",
+		__atomic_load_n(&pbc->fetchHits, __ATOMIC_RELAXED), __atomic_load_n(&pbc->fetchMisses, __ATOMIC_RELAXED),
+		__atomic_load_n(&pbc->fetchErrors, __ATOMIC_RELAXED), __atomic_load_n(&pbc->fetchSkipped, __ATOMIC_RELAXED),
+		__atomic_load_n(&pbc->servedHits, __ATOMIC_RELAXED), __atomic_load_n(&pbc->servedMisses, __ATOMIC_RELAXED),
+		__atomic_load_n(&pbc->rejectedConnections, __ATOMIC_RELAXED));
+}
@@ -0,0 +1,91 @@
+// PeerBlockCache.h
+
+#ifndef _PEER_BLOCK_CACHE_H_
+#define _PEER_BLOCK_CACHE_H_
+
+/*
+ Cooperative block cache. Each block has an owner among the peers listed in
+ the BlockReader address file, chosen by consistent hashing of its key.
+ A host that misses locally asks the owner for the block over TCP before
+ going to the kvs or NFS. Owners answer from their FileBlockCache only; on
+ a miss they start a read-ahead of the block so that later requests hit.
+ Hosts listen on their own entry's address and only serve listed peers.
+*/
+
+/////////////
+// includes
+
+#include "FileBlockID.h"
+#include "SRFSConstants.h"
+
+#include <netinet/in.h> // struct sockaddr_in
+#include <pthread.h>
+#include <stdint.h>
+#include <unistd.h>
+
+
+///////////////////
+// public defines
+
+#define PBC_DEFAULT_PORT 33778
+#define PBC_MAX_PEERS	1024
+#define PBC_VIRTUAL_NODES	64
+#define PBC_CONNECTIONS_PER_PEER	4
+#define PBC_IO_TIMEOUT_MILLIS	200
+#define PBC_PEER_RETRY_MILLIS	5000
+
+
+//////////
+// types
+
+struct FileBlockReader;
+
+typedef struct PBCConnection {
+	pthread_mutex_t	lock;
+	int		fd; // -1 when not connected
+} PBCConnection;
+
+typedef struct PBCPeer {
+	struct sockaddr_in	addr;
+	int		isLocal;
+	uint64_t	downUntilMillis; // accessed atomically
+	PBCConnection	connections[PBC_CONNECTIONS_PER_PEER];
+} PBCPeer;
+
+typedef struct PBCRingEntry {
+	uint64_t	hash;
+	int		peer;
+} PBCRingEntry;
+
+typedef struct PeerBlockCache {
+	struct FileBlockReader	*fbr;
+	uint16_t	port;
+	int		listenFD;
+	int		running;
+	pthread_t	acceptThread;
+	int		numPeers;
+	PBCPeer	*peers;
+	int		localPeer; // -1 if no entry matched this host
+	int		ringSize;
+	PBCRingEntry	*ring;
+	// stats, updated atomically
+	uint64_t	fetchHits;
+	uint64_t	fetchMisses;
+	uint64_t	fetchErrors;
+	uint64_t	fetchSkipped; // owner down
+	uint64_t	servedHits;
+	uint64_t	servedMisses;
+	uint64_t	rejectedConnections; // not from a listed peer
+} PeerBlockCache;
+
+
+//////////////////////
+// public prototypes
+
+PeerBlockCache *pbc_new(struct FileBlockReader *fbr, int port, char *peerAddressFile);
+void pbc_stop(PeerBlockCache *pbc);
+int pbc_fetch(PeerBlockCache *pbc, FileBlockID **fbids, uint64_t *minModificationTimesMicros, int numBlocks,
+              void **blocks, size_t *blockSizes);
+void pbc_display_stats(PeerBlockCache *pbc);
+
+#endif
@@ -89,16 +89,21 @@ void qp_delete(QueueProcessor **qp) {
 }
 
 /**
- * Add an item to the work queue.
+ * Add an item to the work queue. Items below ABQ_PRIORITY_DEMAND may be
+ * shed when the queue is under pressure; callers must handle rejection.
  */
-int qp_add(QueueProcessor *qp, void *item) {
+int qp_add(QueueProcessor *qp, void *item, ABQPriority priority) {
 	if (qp->running || !item) {
 		//srfsLog(LOG_FINE, "qp_add %llx %llx %llx", qp, qp->abq, item);
-		return abq_put(qp->abq, item);
+		return abq_put(qp->abq, item, priority);
 	}
 	return FALSE;
 }
 
+void qp_display_stats(QueueProcessor *qp, const char *name) {
+	abq_display_stats(qp->abq, name);
+}
+
 static void *qp_run(void *_qp) {
 	QueueProcessor	*qp;
 	void	*data;
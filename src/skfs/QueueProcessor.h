@@ -36,6 +36,7 @@ typedef struct QueueProcessor {
 QueueProcessor *qp_new_batch_processor(void (*processBatch)(void **, int, int), char *file, int line, int queueSize, ABQFullMode qFullMode, int numThreads, int batchLimit);
 QueueProcessor *qp_new(void (*processElement)(void *, int), char *file, int line, int queueSize, ABQFullMode qFullMode = ABQ_FULL_BLOCK, int numThreads = 1, int batchLimit = 1);
 void qp_delete(QueueProcessor **qp);
-int qp_add(QueueProcessor *qp, void *item);
+int qp_add(QueueProcessor *qp, void *item, ABQPriority priority = ABQ_PRIORITY_DEMAND);
+void qp_display_stats(QueueProcessor *qp, const char *name);
 
 #endif
@@ -18,13 +18,12 @@ ReaderStats *rs_new() {
 	rs->opWait = 0;
 	rs->dht = 0;
 	rs->nfs = 0;
-	pthread_spin_init(&rs->lock, 0);
+	rs->dirData = 0;
 	return rs;
 }
 
 void rs_delete(ReaderStats **rs) {
 	if (rs != NULL && *rs != NULL) {
-		pthread_spin_destroy(&(*rs)->lock);
 		mem_free((void **)rs);
 	} else {
 		fatalError("bad ptr in rs_delete");
@@ -32,34 +31,40 @@ void rs_delete(ReaderStats **rs) {
 }
 
 void rs_cache_inc(ReaderStats *rs) {
-	pthread_spin_lock(&rs->lock);
-	rs->cache++;
-	pthread_spin_unlock(&rs->lock);
+	__atomic_fetch_add(&rs->cache, 1, __ATOMIC_RELAXED);
 }
 
 void rs_opWait_inc(ReaderStats *rs) {
-	pthread_spin_lock(&rs->lock);
-	rs->opWait++;
-	pthread_spin_unlock(&rs->lock);
+	__atomic_fetch_add(&rs->opWait, 1, __ATOMIC_RELAXED);
 }
 
 void rs_dht_inc(ReaderStats *rs) {
-	pthread_spin_lock(&rs->lock);
-	rs->dht++;
-	pthread_spin_unlock(&rs->lock);
+	__atomic_fetch_add(&rs->dht, 1, __ATOMIC_RELAXED);
 }
 
 void rs_nfs_inc(ReaderStats *rs) {
-	pthread_spin_lock(&rs->lock);
-	rs->nfs++;
-	pthread_spin_unlock(&rs->lock);
+	__atomic_fetch_add(&rs->nfs, 1, __ATOMIC_RELAXED);
+}
+
+void rs_dirData_inc(ReaderStats *rs) {
+	__atomic_fetch_add(&rs->dirData, 1, __ATOMIC_RELAXED);
+}
+
+void rs_get_stats(ReaderStats *rs, ReaderStats *stats) {
+	stats->cache = __atomic_load_n(&rs->cache, __ATOMIC_RELAXED);
+	stats->opWait = __atomic_load_n(&rs->opWait, __ATOMIC_RELAXED);
+	stats->dht = __atomic_load_n(&rs->dht, __ATOMIC_RELAXED);
+	stats->nfs = __atomic_load_n(&rs->nfs, __ATOMIC_RELAXED);
+	stats->dirData = __atomic_load_n(&rs->dirData, __ATOMIC_RELAXED);
 }
 
 void rs_display(ReaderStats *rs) {
-	pthread_spin_lock(&rs->lock);
-	srfsLog(LOG_WARNING, "cache: \t%lu", rs->cache);
-	srfsLog(LOG_WARNING, "opWait:\t%lu", rs->opWait);
-	srfsLog(LOG_WARNING, "dht:   \t%lu", rs->dht);
-	srfsLog(LOG_WARNING, "nfs:   \t%lu", rs->nfs);
-	pthread_spin_unlock(&rs->lock);
+	ReaderStats	stats;
+
+	rs_get_stats(rs, &stats);
+	srfsLog(LOG_WARNING, "cache: \t%lu", stats.cache);
+	srfsLog(LOG_WARNING, "opWait:\t%lu", stats.opWait);
+	srfsLog(LOG_WARNING, "dht:   \t%lu", stats.dht);
+	srfsLog(LOG_WARNING, "nfs:   \t%lu", stats.nfs);
+	srfsLog(LOG_WARNING, "dirData:\t%lu", stats.dirData);
 }
@@ -6,19 +6,19 @@
 /////////////
 // includes
 
-#include <pthread.h>
 #include <stdint.h>
 
 
 //////////
 // types
 
+// Counters are updated and read atomically; no lock is required
 typedef struct ReaderStats {
 	uint64_t	cache;
 	uint64_t	opWait;
 	uint64_t	dht;
 	uint64_t	nfs;
-	pthread_spinlock_t	lock;
+	uint64_t	dirData;
 } ReaderStats;
 
 
@@ -31,6 +31,8 @@ void rs_cache_inc(ReaderStats *rs);
 void rs_opWait_inc(ReaderStats *rs);
 void rs_dht_inc(ReaderStats *rs);
 void rs_nfs_inc(ReaderStats *rs);
+void rs_dirData_inc(ReaderStats *rs);
+void rs_get_stats(ReaderStats *rs, ReaderStats *stats);
 void rs_display(ReaderStats *rs);
 
 #endif
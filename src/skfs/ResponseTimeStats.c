@@ -15,6 +15,12 @@
 #define MAX_REASONABLE_RT_MILLIS	(24 * 60 * 60 * 1000)
 
 
+///////////////////////
+// private prototypes
+
+static uint64_t _rts_get_rt_percentile_millis(ResponseTimeStats *rts, double percentile);
+
+
 ///////////////////
 // implementation
 
@@ -57,6 +63,46 @@ uint64_t rts_get_rt_dev_millis(ResponseTimeStats *rts) {
 	return result;
 }
 
+// Quantiles are reported using the bucket upper bound so that they err
+// on the side of waiting longer.
+// lock must be held
+static uint64_t _rts_get_rt_percentile_millis(ResponseTimeStats *rts, double percentile) {
+	uint64_t	target;
+	uint64_t	cumulative;
+	int	i;
+
+	if (rts->histogramSamples == 0) {
+		// nothing observed yet; fall back to the initial estimate
+		return (uint64_t)rts->rtAverageMillis;
+	}
+	if (percentile < 0.0) {
+		percentile = 0.0;
+	} else if (percentile > 100.0) {
+		percentile = 100.0;
+	}
+	target = (uint64_t)ceil((double)rts->histogramSamples * percentile / 100.0);
+	if (target == 0) {
+		target = 1;
+	}
+	cumulative = 0;
+	for (i = 0; i < RTS_HIST_BUCKETS; i++) {
+		cumulative += rts->histogram[i];
+		if (cumulative >= target) {
+			return log_bucket_upper_bound(i);
+		}
+	}
+	return log_bucket_upper_bound(RTS_HIST_BUCKETS - 1);
+}
+
+uint64_t rts_get_rt_percentile_millis(ResponseTimeStats *rts, double percentile) {
+	uint64_t	result;
+
+	pthread_rwlock_rdlock(&rts->rwLock);
+	result = _rts_get_rt_percentile_millis(rts, percentile);
+	pthread_rwlock_unlock(&rts->rwLock);
+	return result;
+}
+
 void rts_add_sample(ResponseTimeStats *rts, uint64_t responseTimeMillis, int numSamples) {
 	double	rt;
 	double	error;
@@ -73,6 +119,18 @@ void rts_add_sample(ResponseTimeStats *rts, uint64_t responseTimeMillis, int num
 		error = rt - rts->rtAverageMillis;
 		//rts->rtDevMillis = rts->rtDevMillis * oneMinusBeta + beta * fabs(error);
 		rts->rtDevMillis = rts->rtDevMillis + beta * (fabs(error) - rts->rtDevMillis);
+		// a batch contributes numSamples observations of its per-op time
+		rts->histogram[log_bucket_index(responseTimeMillis / numSamples, RTS_HIST_BUCKETS)] += numSamples;
+		rts->histogramSamples += numSamples;
+		if (rts->histogramSamples >= RTS_HIST_DECAY_SAMPLES) {
+			int	i;
+
+			rts->histogramSamples = 0;
+			for (i = 0; i < RTS_HIST_BUCKETS; i++) {
+				rts->histogram[i] /= 2;
+				rts->histogramSamples += rts->histogram[i];
+			}
+		}
 		pthread_rwlock_unlock(&rts->rwLock);
 	} else {
 		srfsLog(LOG_FINE, "rts_add_sample ignoring unreasonable %lu %d", responseTimeMillis, numSamples);
@@ -81,7 +139,9 @@ void rts_add_sample(ResponseTimeStats *rts, uint64_t responseTimeMillis, int num
 
 void rts_display(ResponseTimeStats *rts) {
 	pthread_rwlock_rdlock(&rts->rwLock);
-	srfsLog(LOG_WARNING, "%lu %lu", (uint64_t)rts->rtAverageMillis, (uint64_t)rts->rtDevMillis);
+	srfsLog(LOG_WARNING, "%lu %lu\tp50 %lu p95 %lu p99 %lu", (uint64_t)rts->rtAverageMillis, (uint64_t)rts->rtDevMillis,
+		_rts_get_rt_percentile_millis(rts, 50.0), _rts_get_rt_percentile_millis(rts, 95.0),
+		_rts_get_rt_percentile_millis(rts, 99.0));
 	pthread_rwlock_unlock(&rts->rwLock);
 }
 
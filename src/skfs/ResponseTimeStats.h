@@ -6,11 +6,25 @@
 /////////////
 // includes
 
+#include "Util.h"
+
 #include <math.h>
 #include <pthread.h>
 #include <stdint.h>
 
 
+////////////
+// defines
+
+// Log buckets (see LOG_BUCKET_COUNT) over milliseconds, sized to cover
+// MAX_REASONABLE_RT_MILLIS
+#define RTS_HIST_MAX_EXPONENT	26
+#define RTS_HIST_BUCKETS	LOG_BUCKET_COUNT(RTS_HIST_MAX_EXPONENT)
+// Counts are halved once this many samples accumulate so that the
+// quantiles follow shifts in latency rather than all-time history
+#define RTS_HIST_DECAY_SAMPLES	8192
+
+
 //////////
 // types
 
@@ -19,6 +33,8 @@ typedef struct ResponseTimeStats {
 	double	rtDevMillis;
 	double	alpha;
 	double	oneMinusAlpha;
+	uint64_t	histogram[RTS_HIST_BUCKETS];
+	uint64_t	histogramSamples;
 	pthread_rwlock_t	rwLock;
 } ResponseTimeStats;
 
@@ -30,6 +46,7 @@ ResponseTimeStats *rts_new(double alpha, uint64_t initialResponseTimeMillis);
 void rts_delete(ResponseTimeStats **rts);
 uint64_t rts_get_rt_average_millis(ResponseTimeStats *rts);
 uint64_t rts_get_rt_dev_millis(ResponseTimeStats *rts);
+uint64_t rts_get_rt_percentile_millis(ResponseTimeStats *rts, double percentile);
 void rts_add_sample(ResponseTimeStats *rts, uint64_t responseTimeMillis, int numSamples = 1);
 void rts_display(ResponseTimeStats *rts);
 
@@ -23,6 +23,9 @@
 //#define SRFS_BLOCK_SIZE 131072
 //#define SRFS_BLOCK_SIZE 524288
 #define SRFS_BLOCK_SIZE 262144
+// Sparse file hole bitmaps are stored as a pseudo-block of the file (see fa_has_holes)
+#define SRFS_HOLE_MAP_BLOCK_INDEX	(UINT64_MAX - 1)
+#define SRFS_HOLE_MAP_MAX_BLOCKS	((uint64_t)SRFS_BLOCK_SIZE * 8)
 //#define SRFS_BLOCK_SIZE 2097152
 // below is for testing only
 //#define SRFS_BLOCK_SIZE 32
@@ -55,7 +58,6 @@
 #define SRFS_DHT_OP_MIN_TIMEOUT_MS 20 
 //#define SRFS_DHT_OP_MIN_TIMEOUT_MS 100
 #define SRFS_DHT_OP_MAX_TIMEOUT_MS (30 * 1000)
-#define SRFS_DHT_OP_DEV_WEIGHT 2.0
 #define SRFS_DHT_OP_DHT_WEIGHT 0.7
 
 #define AR_NFS_THREADS	8
@@ -78,6 +80,23 @@
 #define ODW_RETRY_MAX_BATCH_SIZE	1024
 #define ODW_DEF_MIN_WRITE_INTERVAL_MILLIS   2
 #define DEF_SYNC_DIR_UPDATES 1
+#define DEF_REWRITE_BUFFER_KB   (16 * 1024)
+#define DEF_WRITE_BUFFER_POOL_MB    1024
+#define DEF_WRITE_BEHIND_MB 256
+#define WB_DRAINER_THREADS	8
+#define WB_QUEUE_SIZE	4096
+#define DEF_DEDUP 0
+#define BD_KNOWN_HASH_SLOTS	(64 * 1024)
+#define DEF_STATFS_REFRESH_SECS 30
+#define DEF_NEGATIVE_CACHE_MILLIS 0
+#define AC_NEGATIVE_CACHE_SIZE	(64 * 1024)
+#define DEF_DIR_DATA_FRESHNESS_MILLIS 0
+#define DEF_HEDGE_PERCENTILE 95.0
+#define DEF_TRACE_SAMPLE_RATE 1000
+#define DEF_ZERO_COPY_READS 0
+#define BBP_MIN_EXTRA_SLOTS 64
+#define DEF_PEER_BLOCK_CACHE 0
+#define DEF_F2P_EXPECTED_ENTRIES	(512 * 1024)
 
 
 #define DDR_DHT_THREADS	4
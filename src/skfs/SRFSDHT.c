@@ -38,6 +38,7 @@ static void sd_check_dht_health(SRFSDHT *sd);
 
 SKClient  * pClient = NULL;
 SKSession * pGlobalSession = NULL;
+SKSessionOptions * sessOption = NULL;
 SKChecksumType::SKChecksumType defaultChecksum = SKChecksumType::NONE;
 SKCompression::SKCompression defaultCompression = SKCompression::NONE;
 volatile bool exitSignalReceived = FALSE;
@@ -47,7 +48,7 @@ volatile bool exitSignalReceived = FALSE;
 
 SRFSDHT *sd_new(char *host, char *gcname, char *zk, SKCompression::SKCompression compression,
 				uint64_t minOpTimeout, uint64_t	maxOpTimeout, 
-				double devWeight, double dhtWeight) {
+				double hedgePercentile, double dhtWeight) {
 	SRFSDHT *sd;
 
 	sd = (SRFSDHT *)mem_alloc(1, sizeof(SRFSDHT));
@@ -61,7 +62,10 @@ SRFSDHT *sd_new(char *host, char *gcname, char *zk, SKCompression::SKCompression
 	}
 	sd->minOpTimeout = minOpTimeout;
 	sd->maxOpTimeout = maxOpTimeout;
-	sd->devWeight = devWeight;
+	if (hedgePercentile <= 0.0 || hedgePercentile > 100.0) {
+		fatalError("hedgePercentile <= 0.0 || hedgePercentile > 100.0", __FILE__, __LINE__);
+	}
+	sd->hedgePercentile = hedgePercentile;
 	if (dhtWeight < 0.0 || dhtWeight > 1.0) {
 		fatalError("dhtWeight < 0.0 || dhtWeight > 1.0", __FILE__, __LINE__);
 	}
@@ -108,17 +112,22 @@ int sd_is_enabled(SRFSDHT *sd) {
 	return sd->status == SD_Enabled;
 }
 
+// Time to wait on the kvs before hedging with a native fs read. Waiting
+// until the kvs's hedgePercentile response time (or the native fs's, if
+// that is sooner) bounds the extra native load to roughly
+// (100 - hedgePercentile)% of reads, and unlike a mean/deviation estimate
+// tracks the tail of multi-modal response times.
 uint64_t sd_get_dht_timeout(SRFSDHT *sd, ResponseTimeStats *rtsDHT, ResponseTimeStats *rtsNFS, int numOps) {
-	double		dhtTimeout;
-	double		nfsTimeout;
+	uint64_t	dhtTimeout;
+	uint64_t	nfsTimeout;
 	uint64_t	timeout;
 
-	dhtTimeout = (double)rts_get_rt_average_millis(rtsDHT) + (double)rts_get_rt_dev_millis(rtsDHT) * sd->devWeight;
-	nfsTimeout = (double)rts_get_rt_average_millis(rtsNFS) + (double)rts_get_rt_dev_millis(rtsNFS) * sd->devWeight;
+	dhtTimeout = rts_get_rt_percentile_millis(rtsDHT, sd->hedgePercentile);
+	nfsTimeout = rts_get_rt_percentile_millis(rtsNFS, sd->hedgePercentile);
 	if (dhtTimeout < nfsTimeout) {
-		timeout = (uint64_t)dhtTimeout;
+		timeout = dhtTimeout;
 	} else {
-		timeout = (uint64_t)nfsTimeout;
+		timeout = nfsTimeout;
 	}
 	//timeout = (uint64_t)(dhtTimeout * sd->dhtWeight + nfsTimeout * sd->nfsWeight);
 	if (timeout < sd->minOpTimeout) {
@@ -126,7 +135,7 @@ uint64_t sd_get_dht_timeout(SRFSDHT *sd, ResponseTimeStats *rtsDHT, ResponseTime
 	} else if (timeout > sd->maxOpTimeout) {
 		timeout = sd->maxOpTimeout;
 	}
-	srfsLog(LOG_FINE, "dhtTimeout %5.0f\tnfsTimeout %5.0f\ttimeout%5u", dhtTimeout, nfsTimeout, timeout);
+	srfsLog(LOG_FINE, "dhtTimeout %5lu\tnfsTimeout %5lu\ttimeout%5u", dhtTimeout, nfsTimeout, timeout);
 	return timeout * numOps;
 }
 
@@ -246,6 +255,25 @@ SKSession *sd_new_session(SRFSDHT *sd) {
 	}
 }
 
+// Returns the default perspective options for ns with the default get options
+// modified to return null values for missing keys. Missing keys are then reported
+// per-key instead of causing an SKRetrievalException for the whole batch.
+SKNamespacePerspectiveOptions *sd_new_null_value_nsp_options(SKNamespace *ns) {
+	SKNamespacePerspectiveOptions	*_nspOptions;
+	SKNamespacePerspectiveOptions	*nspOptions;
+	SKGetOptions	*_getOptions;
+	SKGetOptions	*getOptions;
+
+	_nspOptions = ns->getDefaultNSPOptions();
+	_getOptions = _nspOptions->getDefaultGetOptions();
+	getOptions = _getOptions->nonExistenceResponse(SKNonExistenceResponse::NULL_VALUE);
+	nspOptions = _nspOptions->defaultGetOptions(getOptions);
+	delete getOptions;
+	delete _getOptions;
+	delete _nspOptions;
+	return nspOptions;
+}
+
 uint64_t sd_parse_timeout(const char *s, uint64_t _default) {
     uint64_t    t;
     
@@ -83,7 +83,7 @@ typedef struct SRFSDHT {
 	char		*zk;
 	uint64_t	minOpTimeout;
 	uint64_t	maxOpTimeout;
-	double		devWeight;
+	double		hedgePercentile;
 	double		dhtWeight;
 	double		nfsWeight;
 	pthread_mutex_t	mutexInstance;
@@ -103,11 +103,12 @@ typedef struct SRFSDHT {
 
 SRFSDHT *sd_new(char *host, char *gcname, char *zk, SKCompression::SKCompression compression,
 				uint64_t minOpTimeout, uint64_t	maxOpTimeout, 
-				double devWeight, double dhtWeight);
+				double hedgePercentile, double dhtWeight);
 void sd_delete(SRFSDHT **sd);
 void sd_op_failed(SRFSDHT *sd, SKOperationState::SKOperationState errorCode, char *file = NULL, int line = 0);
 int sd_is_enabled(SRFSDHT *sd);
 SKSession *sd_new_session(SRFSDHT *sd);
+SKNamespacePerspectiveOptions *sd_new_null_value_nsp_options(SKNamespace *ns);
 uint64_t sd_get_dht_timeout(SRFSDHT *sd, ResponseTimeStats *rtsDHT, ResponseTimeStats *rtsNFS, int numOps);
 uint64_t sd_parse_timeout(const char *s, uint64_t _default);
 
@@ -0,0 +1,132 @@
+// Trace.c
+
+/////////////
+// includes
+
+#include "Trace.h"
+#include "Util.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+
+///////////////////////
+// private prototypes
+
+static void tr_escape(char *dest, size_t destSize, const char *src);
+static void tr_write(const char *buf, size_t length);
+
+
+/////////////////
+// private data
+
+static int	trFD = -1;
+static int	trSampleRate;
+static uint64_t	trRequestCount;
+static uint64_t	trNextTraceID = 1;
+static __thread uint64_t	trCurrentTraceID;
+
+
+///////////////////
+// implementation
+
+void tr_init(const char *traceFile, int sampleRate) {
+	if (traceFile == NULL || sampleRate <= 0) {
+		return;
+	}
+	trFD = open(traceFile, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND, 0644);
+	if (trFD < 0) {
+		srfsLog(LOG_ERROR, "tr_init unable to open %s %d", traceFile, errno);
+		return;
+	}
+	tr_write("[\n", 2);
+	trSampleRate = sampleRate;
+	srfsLog(LOG_WARNING, "tracing 1 in %d reads to %s", sampleRate, traceFile);
+}
+
+void tr_close() {
+	int	fd;
+
+	fd = trFD;
+	trSampleRate = 0;
+	trFD = -1;
+	if (fd >= 0) {
+		close(fd);
+	}
+}
+
+// Decides whether the calling thread's current request is sampled.
+// Returns the trace ID, or 0 if the request is not traced.
+uint64_t tr_begin() {
+	if (trSampleRate > 0
+			&& __atomic_fetch_add(&trRequestCount, 1, __ATOMIC_RELAXED) % trSampleRate == 0) {
+		trCurrentTraceID = __atomic_fetch_add(&trNextTraceID, 1, __ATOMIC_RELAXED);
+	} else {
+		trCurrentTraceID = 0;
+	}
+	return trCurrentTraceID;
+}
+
+void tr_end() {
+	trCurrentTraceID = 0;
+}
+
+uint64_t tr_current() {
+	return trCurrentTraceID;
+}
+
+static void tr_escape(char *dest, size_t destSize, const char *src) {
+	size_t	i;
+
+	i = 0;
+	for (; *src != '\0' && i + 7 < destSize; src++) {
+		unsigned char	c;
+
+		c = (unsigned char)*src;
+		if (c == '"' || c == '\\') {
+			dest[i++] = '\\';
+			dest[i++] = c;
+		} else if (c < 0x20) {
+			i += sprintf(dest + i, "\\u%04x", c);
+		} else {
+			dest[i++] = c;
+		}
+	}
+	dest[i] = '\0';
+}
+
+// Events are written with a single write() to an O_APPEND descriptor, so
+// concurrent writers do not interleave within an event.
+static void tr_write(const char *buf, size_t length) {
+	int	fd;
+
+	fd = trFD;
+	if (fd >= 0 && write(fd, buf, length) < 0) {
+		srfsLog(LOG_INFO, "tr_write failed %d", errno);
+	}
+}
+
+void tr_span(uint64_t traceID, const char *name, uint64_t startMicros, uint64_t endMicros, const char *detail) {
+	char	event[TR_MAX_EVENT_LENGTH];
+	char	escapedDetail[TR_MAX_DETAIL_LENGTH];
+	int	length;
+
+	if (traceID == 0 || trFD < 0) {
+		return;
+	}
+	tr_escape(escapedDetail, sizeof(escapedDetail), detail != NULL ? detail : "");
+	length = snprintf(event, sizeof(event),
+		"{\"name\":\"%s\",\"cat\":\"skfs\",\"ph\":\"X\",\"ts\":%lu,\"dur\":%lu,\"pid\":%d,\"tid\":%u,"
+		"\"args\":{\"trace\":\"%lx\",\"detail\":\"%s\"}},\n",
+		name, startMicros, endMicros >= startMicros ? endMicros - startMicros : 0,
+		getpid(), (unsigned int)pthread_self() & 0xffff, traceID, escapedDetail);
+	if (length > 0 && (size_t)length < sizeof(event)) {
+		tr_write(event, length);
+	}
+}
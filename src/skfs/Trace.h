@@ -0,0 +1,36 @@
+// Trace.h
+
+#ifndef _TRACE_H_
+#define _TRACE_H_
+
+/////////////
+// includes
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+////////////
+// defines
+
+#define TR_MAX_EVENT_LENGTH	2048
+#define TR_MAX_DETAIL_LENGTH	512
+
+
+///////////////
+// prototypes
+
+// A sampled read is assigned a nonzero trace ID, which is carried by its
+// PartialBlockReadRequests and by the ActiveOps they create. Each stage
+// that handles a traced request emits a span. Spans are written as
+// Chrome trace-event "complete" events to a JSON array that is left
+// open, as the trace-event format permits, so the file can be loaded
+// into chrome://tracing or Perfetto at any time.
+void tr_init(const char *traceFile, int sampleRate);
+void tr_close();
+uint64_t tr_begin();
+void tr_end();
+uint64_t tr_current();
+void tr_span(uint64_t traceID, const char *name, uint64_t startMicros, uint64_t endMicros, const char *detail = NULL);
+
+#endif
@@ -25,7 +25,7 @@
 #include <ucontext.h>
 
 #include "skconstants.h"
-#include "QueueProcessor.h"
+#include "BinaryLog.h"
 #include "SRFSDHT.h"
 #include "SRFSConstants.h"
 #include "Util.h"
@@ -34,16 +34,12 @@
 ////////////////////
 // private defines
 
-#define LOG_MAX_ENTRY_LENGTH 16384
 #define LOG_MAX_FORMAT_LENGTH 16384
 //#define LogFile stderr
 #define _BT_LIST_SIZE	16384
 #define	_PATH_CHAR '/'
 #define _PATH_CUR_DIR "."
 #define _PATH_PARENT_DIR ".."
-#define LOG_QUEUE_SIZE	16
-#define LOG_MAX_BATCH_SIZE	16
-#define LOG_THREADS 1
 
 
 #define _FLUSH_LOG
@@ -60,14 +56,12 @@ static LogLevel	currentLogLevel = LOG_WARNING;
 static int _fatalErrorWarnOnly;
 static uint64_t	fatalErrorCount;
 static FILE	*LogFile = stderr;
-static QueueProcessor	*logQP;
 
 
 ///////////////////////
 // private prototypes
 
 static void cv_wait_abs_given_time(pthread_mutex_t *mutex, pthread_cond_t *cv, uint64_t deadline, uint64_t currentTime);
-static void log_process_batch(void **logEntries, int numLogEntries, int curThreadIndex);
 
 
 ///////////////
@@ -128,27 +122,35 @@ static inline void modifyformat( char *newfmt, char const* format, char const* e
 }
 
 void srfsLogFlush() {
+#ifdef ASYNC_LOGGING
+	bl_flush();
+#endif
 	fflush(LogFile);
 }
 
 void srfsLogSetFile(char *fileName) {
+	FILE	*oldLogFile;
+	FILE	*newLogFile;
 	int logFileNameLen = strlen(fileName);
+
+	newLogFile = NULL;
 	if ( logFileNameLen > 0 && logFileNameLen < SRFS_MAX_PATH_LENGTH ) 
 	{
-		if( LogFile && LogFile != stderr) {
-			fclose(LogFile);
-			LogFile = NULL;
-		}
-
-	    LogFile = fopen(fileName, "w");
-		if ( LogFile ) {
-			srfsLog(LOG_WARNING, "Opened log file %s", fileName);
-			return ;
-		}
+	    newLogFile = fopen(fileName, "w");
+	}
+	oldLogFile = LogFile;
+	// bl_set_fd() drains records bound for the old file before swapping,
+	// so the old file may be closed afterwards
+	LogFile = newLogFile != NULL ? newLogFile : stderr;
+	bl_set_fd(fileno(LogFile));
+	if (oldLogFile && oldLogFile != stderr && oldLogFile != LogFile) {
+		fclose(oldLogFile);
+	}
+	if (newLogFile != NULL) {
+		srfsLog(LOG_WARNING, "Opened log file %s", fileName);
+	} else {
+		srfsLog(LOG_WARNING, "Failed to open log file %s. Using stderr", fileName);
 	}
-
-	LogFile = stderr;
-	srfsLog(LOG_WARNING, "Failed to open log file %s. Using stderr", fileName);
 }
 
 void srfsRedirectStdio() {
@@ -165,35 +167,31 @@ void srfsRedirectStdio() {
 
 void srfsLogInitAsync() {
 #ifdef ASYNC_LOGGING
-	logQP = qp_new_batch_processor(log_process_batch, __FILE__, __LINE__, 
-								LOG_QUEUE_SIZE, ABQ_FULL_BLOCK, LOG_THREADS, LOG_MAX_BATCH_SIZE);
-	srfsLog(LOG_WARNING, "logQP %llx %llx", logQP, logQP->abq);
+	bl_start(fileno(LogFile));
 #endif
 }
 
+// format must be a string literal; formatting is deferred to the log
+// writer thread (see BinaryLog.h). Entries are dropped, not delayed, when
+// the calling thread's ring is full.
 void srfsLogAsync(LogLevel level, char const * format, ...) {
 	if (level <= currentLogLevel) {
-		char newfmt[LOG_MAX_FORMAT_LENGTH];
 		va_list ap;
 		
 		va_start(ap, format);
-		// this is for a single MT-safe call to vfprintf with everything
-		modifyformat(newfmt, format, "");
 #ifdef ASYNC_LOGGING
+		bl_log(format, ap);
+#else
 		{
-            char tmpbuf[LOG_MAX_ENTRY_LENGTH];
-			char *buf;
+			char newfmt[LOG_MAX_FORMAT_LENGTH];
 			
-			vsprintf(tmpbuf, newfmt, ap);
-            buf = strdup(tmpbuf);
-			//srfsLog(LOG_FINE, "srfsLogAsync qp_add %llx", buf);
-			qp_add(logQP, buf);
-		}
-#else
-		vfprintf(LogFile, newfmt, ap);
+			// this is for a single MT-safe call to vfprintf with everything
+			modifyformat(newfmt, format, "");
+			vfprintf(LogFile, newfmt, ap);
 #ifdef _FLUSH_LOG
-		fflush(LogFile);
+			fflush(LogFile);
 #endif
+		}
 #endif
 		va_end(ap);
 	}
@@ -215,20 +213,6 @@ void srfsLog(LogLevel level, char const * format, ...) {
 	}
 }
 
-static void log_process_batch(void **logEntries, int numLogEntries, int curThreadIndex) {
-	int	i;
-	
-	//srfsLog(LOG_FINE, "log_process_batch %llx %d", logQP, numLogEntries);
-	for (i = 0; i < numLogEntries; i++) {
-		char	*buf;
-		
-		buf = (char *)(logEntries[i]);
-		fprintf(LogFile, "%s", buf);
-		free(buf);
-	}
-	//srfsLog(LOG_FINE, "out log_process_batch %d", numLogEntries);
-}
-
 void setSRFSLogLevel(LogLevel level) {
 	currentLogLevel = level;
     LoggingLevel llvl = level==LOG_ERROR ? LVL_OFF : level==LOG_FINE ? LVL_ALL : LVL_INFO ;
@@ -885,6 +869,21 @@ unsigned int mem_hash(void *m, int size) {
     return hash;
 }
 
+// 64-bit FNV-1a
+uint64_t fnv1a_64(const void *data, size_t length) {
+	const unsigned char	*p;
+	uint64_t	hash;
+	size_t	i;
+
+	p = (const unsigned char *)data;
+	hash = 0xcbf29ce484222325ULL;
+	for (i = 0; i < length; i++) {
+		hash ^= p[i];
+		hash *= 0x100000001b3ULL;
+	}
+	return hash;
+}
+
 size_t size_max(size_t a, size_t b) {
 	return a >= b ? a : b;
 }
@@ -917,6 +916,32 @@ uint64_t uint64_min(off_t a, off_t b) {
 	return a <= b ? a : b;
 }
 
+// Values beyond the last bucket are counted in it
+int log_bucket_index(uint64_t value, int numBuckets) {
+	int	exponent;
+	int	subBucket;
+
+	if (value < LOG_BUCKET_LINEAR_LIMIT) {
+		return (int)value;
+	}
+	exponent = 63 - __builtin_clzll(value);
+	subBucket = (int)((value >> (exponent - LOG_BUCKET_SUB_BUCKET_BITS)) & (LOG_BUCKET_SUB_BUCKETS - 1));
+	return int_min(LOG_BUCKET_LINEAR_LIMIT + (exponent - 5) * LOG_BUCKET_SUB_BUCKETS + subBucket, numBuckets - 1);
+}
+
+// Largest value that maps to the given bucket
+uint64_t log_bucket_upper_bound(int index) {
+	int	exponent;
+	int	subBucket;
+
+	if (index < LOG_BUCKET_LINEAR_LIMIT) {
+		return (uint64_t)index;
+	}
+	exponent = (index - LOG_BUCKET_LINEAR_LIMIT) / LOG_BUCKET_SUB_BUCKETS + 5;
+	subBucket = (index - LOG_BUCKET_LINEAR_LIMIT) % LOG_BUCKET_SUB_BUCKETS;
+	return ((uint64_t)(LOG_BUCKET_SUB_BUCKETS + subBucket + 1) << (exponent - LOG_BUCKET_SUB_BUCKET_BITS)) - 1;
+}
+
 int get_num_cpus() {
 	return sysconf(_SC_NPROCESSORS_ONLN);
 }
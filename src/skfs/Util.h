@@ -29,6 +29,15 @@
 #define ptr_to_offset(B,P) ((uint64_t)(P) - (uint64_t)(B))
 #define MEM_DBG_IGNORE_ALLOCATION NULL
 
+// Log-linear histogram buckets: values below LOG_BUCKET_LINEAR_LIMIT have
+// their own bucket; above that each power of two is split into
+// LOG_BUCKET_SUB_BUCKETS (~6% resolution).
+#define LOG_BUCKET_LINEAR_LIMIT	32
+#define LOG_BUCKET_SUB_BUCKET_BITS	4
+#define LOG_BUCKET_SUB_BUCKETS	(1 << LOG_BUCKET_SUB_BUCKET_BITS)
+// Buckets needed to cover values below 2^(MAX_EXPONENT + 1)
+#define LOG_BUCKET_COUNT(MAX_EXPONENT)	(LOG_BUCKET_LINEAR_LIMIT + ((MAX_EXPONENT) - 4) * LOG_BUCKET_SUB_BUCKETS)
+
 
 //////////
 // types
@@ -112,6 +121,7 @@ size_t trim_in_place(char *s, size_t length);
 
 
 unsigned int mem_hash(void *m, int size);
+uint64_t fnv1a_64(const void *data, size_t length);
 
 void stat_display(struct stat *s, FILE *f = stdout);
 uint64_t stat_mtime_micros(struct stat *s);
@@ -126,6 +136,9 @@ off_t off_min(off_t a, off_t b);
 uint64_t uint64_max(off_t a, off_t b);
 uint64_t uint64_min(off_t a, off_t b);
 
+int log_bucket_index(uint64_t value, int numBuckets);
+uint64_t log_bucket_upper_bound(int index);
+
 int get_num_cpus(void);
 int get_pid();
 uint64_t getValueCreatorAsUint64(SKValueCreator *vc);
@@ -10,10 +10,12 @@
 #include <time.h>
 
 #include "AttrReader.h"
+#include "BlockDedup.h"
 #include "FileBlockWriter.h"
 #include "SKFSOpenFile.h"
 #include "WritableFile.h"
 #include "WritableFileBlock.h"
+#include "WriteBehind.h"
 #include "Util.h"
 
 
@@ -51,6 +53,9 @@ typedef struct WF_BlockWrite {
 // private data
 
 static int wf_syncDirUpdates;
+static size_t wf_rewriteBufferLimit = DEF_REWRITE_BUFFER_KB * 1024;
+static WriteBehind *wf_writeBehind;
+static int wf_dedup;
 
 ///////////////////////
 // private prototypes
@@ -62,6 +67,8 @@ static SKOperationState::SKOperationState wf_write_block_sync(WritableFile *wf,
 static void wf_new_block(WritableFile *wf);
 static uint64_t wf_blocks_outstanding(WritableFile *wf);
 static void wf_limit_outstanding_blocks(WritableFile *wf, FileBlockWriter *fbw, uint64_t limit);
+static void wf_reap_completed_blocks(WritableFile *wf, FileBlockWriter *fbw);
+static void wf_wait_for_block_pool(WritableFile *wf, FileBlockWriter *fbw);
 static int wf_all_blocks_written_successfully(WritableFile *wf, FileBlockWriter *fbw);
 static int wf_blocks_written_successfully(WritableFile *wf, size_t numBlocks, FileBlockWriter *fbw);
 static uint64_t wf_cur_block_index(WritableFile *wf);
@@ -71,6 +78,15 @@ static int _wf_has_references(WritableFile *wf);
 static int wf_close(WritableFile *wf, AttrWriter *aw, FileBlockWriter *fbw, AttrCache *ac);
 static int _wf_flush(WritableFile *wf, AttrWriter *aw, FileBlockWriter *fbw, AttrCache *ac);
 static off_t wf_bytes_successfully_written(WritableFile *wf, FileBlockWriter *fbw);
+static WritableFileBlock *wf_get_dirty_block(WritableFile *wf, uint64_t blockIndex, PartialBlockReader *pbr);
+static int wf_flush_dirty_blocks(WritableFile *wf, FileBlockWriter *fbw);
+static void wf_discard_dirty_blocks(WritableFile *wf, uint64_t firstBlockIndex);
+static size_t wf_unconfirmed_bytes(WritableFile *wf);
+static int wf_is_hole(WritableFile *wf, uint64_t blockIndex);
+static void wf_set_hole(WritableFile *wf, uint64_t blockIndex);
+static void wf_clear_hole(WritableFile *wf, uint64_t blockIndex);
+static int wf_load_hole_map(WritableFile *wf, PartialBlockReader *pbr);
+static int wf_write_hole_map(WritableFile *wf, FileBlockWriter *fbw);
 
 ///////////////////
 // implementation
@@ -80,6 +96,26 @@ void wf_set_sync_dir_updates(int syncDirUpdates) {
     wf_syncDirUpdates = syncDirUpdates;
 }
 
+void wf_set_rewrite_buffer_limit(size_t rewriteBufferLimit) {
+    srfsLog(LOG_INFO, "wf_set_rewrite_buffer_limit %u", rewriteBufferLimit);
+    wf_rewriteBufferLimit = rewriteBufferLimit;
+}
+
+// Files created while dedup is set store their blocks deduplicated for
+// their whole life (see FID_SKFS_DEDUP and BlockDedup.h)
+void wf_set_dedup(int dedup) {
+    srfsLog(LOG_INFO, "wf_set_dedup %d", dedup);
+    if (dedup && !bd_hash_self_test()) {
+        fatalError("bd_hash_self_test failed", __FILE__, __LINE__);
+    }
+    wf_dedup = dedup;
+}
+
+void wf_set_write_behind(WriteBehind *writeBehind) {
+    srfsLog(LOG_INFO, "wf_set_write_behind %llx", writeBehind);
+    wf_writeBehind = writeBehind;
+}
+
 static WF_BlockWrite *wfbw_new(WritableFileBlock *wfb, FBW_ActiveDirectPut *adp) {
 	WF_BlockWrite	*bw;
 
@@ -163,6 +199,10 @@ WritableFile *wf_new(const char *path, mode_t mode, HashTableAndLock *htl,
 	wf->magic = WF_MAGIC;
     wf->path = str_dup(path);
     wf->htl = htl;
+	// Initialized up front so that wf_delete() can release a partially constructed wf
+	pthread_mutexattr_init(&mutexAttr);
+	pthread_mutexattr_settype(&mutexAttr, PTHREAD_MUTEX_RECURSIVE);	
+    pthread_mutex_init(&wf->lock, &mutexAttr); 
     
     if (clock_gettime(CLOCK_REALTIME, &tp)) {
         fatalError("clock_gettime failed", __FILE__, __LINE__);
@@ -171,7 +211,11 @@ WritableFile *wf_new(const char *path, mode_t mode, HashTableAndLock *htl,
     curTimeNanos = tp.tv_nsec;
     
     if (fa == NULL) {            
-        fid_generate_and_init_skfs(&wf->fa.fid);
+        if (wf_dedup) {
+            fid_generate_and_init_skfs_flags(&wf->fa.fid, FID_SKFS_DEDUP);
+        } else {
+            fid_generate_and_init_skfs(&wf->fa.fid);
+        }
         wf->fa.stat.st_mode = mode;
         wf->fa.stat.st_nlink = 1;
         wf->fa.stat.st_ino = fid_get_inode(&wf->fa.fid);
@@ -190,7 +234,12 @@ WritableFile *wf_new(const char *path, mode_t mode, HashTableAndLock *htl,
         wf->numBlocks = wf->fa.stat.st_size / SRFS_BLOCK_SIZE + 1;
         
         if (wf_init_cur_block(wf, pbr) != 0) {
-            return NULL; // FIXME - FREE RESOURCES...
+            wf_delete(&wf);
+            return NULL;
+        }
+        if (fa_has_holes(&wf->fa) && wf_load_hole_map(wf, pbr) != 0) {
+            wf_delete(&wf);
+            return NULL;
         }
         wf->blockList = abl_new(WF_INITIAL_BLOCK_SIZE, WF_MAX_BLOCK_SIZE, WF_BLOCK_INCREMENT, TRUE);
         wf_init_blockList(wf, wf->numBlocks - 1);
@@ -200,10 +249,6 @@ WritableFile *wf_new(const char *path, mode_t mode, HashTableAndLock *htl,
     wf->fa.stat.st_atime = curEpochTimeSeconds;
     wf->fa.stat.st_mtim.tv_nsec = curTimeNanos;
     wf->fa.stat.st_atim.tv_nsec = curTimeNanos;
-    
-	pthread_mutexattr_init(&mutexAttr);
-	pthread_mutexattr_settype(&mutexAttr, PTHREAD_MUTEX_RECURSIVE);	
-    pthread_mutex_init(&wf->lock, &mutexAttr); 
 
     minModificationTimeMicros = stat_mtime_micros(&wf->fa.stat);
     
@@ -261,13 +306,23 @@ void wf_delete(WritableFile **wf) {
 	if (wf != NULL && *wf != NULL) {
         srfsLog(LOG_FINE, "wf_delete %llx %llx", wf, *wf);
 		(*wf)->magic = 0;
-		abl_delete(&(*wf)->blockList);
+        if ((*wf)->blockList != NULL) {
+            abl_delete(&(*wf)->blockList);
+        }
         mem_free((void **)&(*wf)->path);
         if ((*wf)->pendingRename != NULL) {
             mem_free((void **)&(*wf)->pendingRename);
         }
         if ((*wf)->curBlock != NULL) {
             wfb_delete(&(*wf)->curBlock);
+        }
+        if ((*wf)->dirtyBlocks != NULL) {
+            wf_discard_dirty_blocks(*wf, 0);
+            delete (*wf)->dirtyBlocks;
+            (*wf)->dirtyBlocks = NULL;
+        }
+        if ((*wf)->holeMap != NULL) {
+            mem_free((void **)&(*wf)->holeMap);
         }
 		pthread_mutex_destroy(&(*wf)->lock);
 		mem_free((void **)wf);
@@ -321,9 +376,16 @@ static void wf_skip_ahead(WritableFile *wf, off_t writeOffset, FileBlockWriter *
         // Zero out the remainder of the current block, and write it
         wf->fa.stat.st_size += wfb_zero_out_remainder(wf->curBlock);
 		wf_write_block(wf, wf->curBlock, wf_cur_block_index(wf), fbw);
-        // Write zero blocks (reader will interpret these as full blocks of zeros)
         for (zbIndex = wf->numBlocks; zbIndex < newBlockIndex; zbIndex++) {
-			wf_write_block(wf, wfb_new(), zbIndex, fbw);
+            if (newBlockIndex < SRFS_HOLE_MAP_MAX_BLOCKS) {
+                // Leave a hole. Nothing is stored for this block.
+                wf_set_hole(wf, zbIndex);
+                abl_add(wf->blockList, NULL);
+            } else {
+                // Too large for a hole map; write a zero block
+                // (reader will interpret these as full blocks of zeros)
+                wf_write_block(wf, wfb_new(), zbIndex, fbw);
+            }
             wf->numBlocks++;
             wf->fa.stat.st_size += SRFS_BLOCK_SIZE;
         }
@@ -344,59 +406,161 @@ static void wf_skip_ahead(WritableFile *wf, off_t writeOffset, FileBlockWriter *
     wf->fa.stat.st_size += bytesToWrite;
 }
 
+// lock must be held
+// Past blocks are modified in memory only. They are written out by wf_flush_dirty_blocks()
+// at flush time, or sooner if wf_rewriteBufferLimit is exceeded.
 static size_t wf_rewrite_past_blocks(WritableFile *wf, const char *src, size_t pastWriteSize, off_t writeOffset, 
             uint64_t firstBlockIndex, uint64_t lastPastBlockIndex,
             FileBlockWriter *fbw, PartialBlockReader *pbr, FileBlockCache *fbc) {
-    uint64_t    numBlocks;
-    size_t      rewriteBufSize;
-    char *      rewriteBuf;
-    int         readResult;
-    off_t       firstBlockOffset;
+    uint64_t    blockIndex;
+    size_t      blockOffset;
+    size_t      srcOffset;
     
     srfsLog(LOG_FINE, "wf_rewrite_past_blocks %llx %s %u %u %u %u", wf, src, pastWriteSize, writeOffset, firstBlockIndex, lastPastBlockIndex);
-    // Read in blocks
-    numBlocks = lastPastBlockIndex - firstBlockIndex + 1;
-    rewriteBufSize = numBlocks * SRFS_BLOCK_SIZE;
-    rewriteBuf = (char *)mem_alloc(rewriteBufSize, 1);
-    readResult = pbr_read_given_attr(pbr, wf->path, rewriteBuf, rewriteBufSize, firstBlockIndex * SRFS_BLOCK_SIZE, &wf->fa, TRUE, 0);
-    
-    // Rewrite
-    firstBlockOffset = writeOffset % SRFS_BLOCK_SIZE;
-    memcpy(rewriteBuf + firstBlockOffset, src, pastWriteSize);
-    srfsLog(LOG_FINE, "firstBlockOffset %u", firstBlockOffset);
+    wf->dirtyBlockCache = fbc;
+    blockOffset = writeOffset % SRFS_BLOCK_SIZE;
+    srcOffset = 0;
+    for (blockIndex = firstBlockIndex; blockIndex <= lastPastBlockIndex; blockIndex++) {
+        WritableFileBlock   *wfb;
+        size_t  bytesToWrite;
+        
+        wfb = wf_get_dirty_block(wf, blockIndex, pbr);
+        bytesToWrite = size_min(pastWriteSize - srcOffset, SRFS_BLOCK_SIZE - blockOffset);
+        srfsLog(LOG_FINE, "past wfb_rewrite %llx %llx %u %u %u", wf, wfb, blockIndex, blockOffset, bytesToWrite);
+        srcOffset += wfb_rewrite(wfb, src + srcOffset, blockOffset, bytesToWrite);
+        blockOffset = 0;
+    }
+    if (srcOffset != pastWriteSize) {
+        fatalError("srcOffset != pastWriteSize", __FILE__, __LINE__);
+    }
+    if (wf->dirtyBytes > wf_rewriteBufferLimit) {
+        srfsLog(LOG_FINE, "wf_rewrite_past_blocks %s dirtyBytes %u > limit. Flushing.", wf->path, wf->dirtyBytes);
+        wf_flush_dirty_blocks(wf, fbw); // failed blocks are retained and reported by flush
+    }
+    return pastWriteSize;
+}
+
+// lock must be held
+// Returns the in-memory copy of a past block, creating it from the current block
+// contents on first use.
+static WritableFileBlock *wf_get_dirty_block(WritableFile *wf, uint64_t blockIndex, PartialBlockReader *pbr) {
+    std::map<uint64_t, WritableFileBlock *>::iterator    it;
+    WritableFileBlock   *wfb;
+    WF_BlockWrite       *bw;
     
-    // Write back modified blocks
-    uint64_t    i;
+    if (wf->dirtyBlocks == NULL) {
+        wf->dirtyBlocks = new std::map<uint64_t, WritableFileBlock *>();
+    } else {
+        it = wf->dirtyBlocks->find(blockIndex);
+        if (it != wf->dirtyBlocks->end()) {
+            return it->second;
+        }
+    }
+    wfb = wfb_new();
+    if (blockIndex < abl_size(wf->blockList)) {
+        bw = (WF_BlockWrite *)abl_get(wf->blockList, blockIndex);
+    } else {
+        bw = NULL;
+    }
+    if (bw != NULL && bw->wfb != NULL) {
+        // This block's write has not yet been reaped; its data is still in memory
+        wfb_write(wfb, (const char *)bw->wfb->block, bw->wfb->size);
+    } else if (wf_is_hole(wf, blockIndex)) {
+        // Filling a hole. The block will be stored when the dirty blocks are flushed.
+        wfb_write(wfb, (const char *)zeroBlock, SRFS_BLOCK_SIZE);
+        wf_clear_hole(wf, blockIndex);
+    } else {
+        int readResult;
+        
+        // The block is already in the key-value store. Read it once.
+        readResult = pbr_read_given_attr(pbr, wf->path, (char *)wfb->block, SRFS_BLOCK_SIZE, 
+                                         blockIndex * SRFS_BLOCK_SIZE, &wf->fa, TRUE, 0);
+        if (readResult != SRFS_BLOCK_SIZE) {
+            srfsLog(LOG_ERROR, "wf_get_dirty_block short read %s %u %d", wf->path, blockIndex, readResult);
+            if (readResult < 0) {
+                readResult = 0;
+            }
+        }
+        wfb->size = readResult;
+    }
+    // Dirty blocks are always whole blocks. Zero whatever the source did not fill
+    // so that neither a short read nor a recycled wfb leaves stale bytes behind.
+    if (wfb->size < SRFS_BLOCK_SIZE) {
+        memset(wfb->block + wfb->size, 0, SRFS_BLOCK_SIZE - wfb->size);
+        wfb->size = SRFS_BLOCK_SIZE;
+    }
+    (*wf->dirtyBlocks)[blockIndex] = wfb;
+    wf->dirtyBytes += SRFS_BLOCK_SIZE;
+    return wfb;
+}
+
+// lock must be held
+// Writes out all dirty blocks. Blocks that cannot be written are retained.
+// Returns TRUE iff all dirty blocks were written successfully.
+static int wf_flush_dirty_blocks(WritableFile *wf, FileBlockWriter *fbw) {
+    std::map<uint64_t, WritableFileBlock *>::iterator    it;
     uint64_t    blockWriteTimeMillis;
+    int         blocksOK;
     
+    if (wf->dirtyBlocks == NULL || wf->dirtyBlocks->empty()) {
+        return TRUE;
+    }
+    srfsLog(LOG_FINE, "wf_flush_dirty_blocks %s %u", wf->path, wf->dirtyBlocks->size());
+    // Outstanding writes of these blocks must complete before we overwrite them
+	wf_limit_outstanding_blocks(wf, fbw, 0);
+    blocksOK = TRUE;
     blockWriteTimeMillis = curTimeMillis();
-    for (i = 0; i < numBlocks; i++) {
-        size_t  bytesWritten;
+    it = wf->dirtyBlocks->begin();
+    while (it != wf->dirtyBlocks->end()) {
+        uint64_t            blockIndex;
         WritableFileBlock   *wfb;
-        CacheStoreResult    blockCacheStoreResult;
-        FileBlockID	*fbid;
-        void    *cacheBlock;
+        SKOperationState::SKOperationState	bwResult;
         
-        wfb = wfb_new();
-        bytesWritten = wfb_write(wfb, rewriteBuf + SRFS_BLOCK_SIZE * i, SRFS_BLOCK_SIZE);
-        if (bytesWritten != SRFS_BLOCK_SIZE) {
-            fatalError("bytesWritten != SRFS_BLOCK_SIZE", __FILE__, __LINE__);
-        }
-        srfsLog(LOG_FINE, "past wf_write_block %llx %llx %u", wf, wfb, (firstBlockIndex + i));
-        cacheBlock = mem_dup(wfb->block, wfb->size);
-        wf_write_block_sync(wf, wfb, firstBlockIndex + i, fbw);
-        fbid = fbid_new(&wf->fa.fid, (firstBlockIndex + i));
-        blockCacheStoreResult = fbc_store_raw_data(fbc, fbid, cacheBlock, wfb->size, TRUE,
-                                        blockWriteTimeMillis * 1000);
-        if (blockCacheStoreResult != CACHE_STORE_SUCCESS) {
-            srfsLog(LOG_ERROR, "wf_rewrite_past_blocks blockCacheStoreResult != CACHE_STORE_SUCCESS %s", wf->path);
-            mem_free((void **)&cacheBlock);
+        blockIndex = it->first;
+        wfb = it->second;
+        bwResult = wf_write_block_sync(wf, wfb, blockIndex, fbw, WF_FAILED_BLOCK_RETRIES);
+        if (bwResult == SKOperationState::SUCCEEDED) {
+            if (wf->dirtyBlockCache != NULL) {
+                CacheStoreResult    blockCacheStoreResult;
+                FileBlockID	*fbid;
+                void    *cacheBlock;
+                
+                cacheBlock = mem_dup(wfb->block, wfb->size);
+                fbid = fbid_new(&wf->fa.fid, blockIndex);
+                blockCacheStoreResult = fbc_store_raw_data(wf->dirtyBlockCache, fbid, cacheBlock, wfb->size, TRUE,
+                                                blockWriteTimeMillis * 1000);
+                if (blockCacheStoreResult != CACHE_STORE_SUCCESS) {
+                    srfsLog(LOG_ERROR, "wf_flush_dirty_blocks blockCacheStoreResult != CACHE_STORE_SUCCESS %s", wf->path);
+                    mem_free((void **)&cacheBlock);
+                }
+                fbid_delete(&fbid);
+            }
+            wfb_delete(&wfb);
+            wf->dirtyBlocks->erase(it++);
+            wf->dirtyBytes -= SRFS_BLOCK_SIZE;
+        } else {
+            srfsLog(LOG_ERROR, "wf_flush_dirty_blocks failed %s %u %d", wf->path, blockIndex, bwResult);
+            blocksOK = FALSE;
+            ++it;
         }
-        fbid_delete(&fbid);
-        wfb_delete(&wfb);
     }
-    mem_free((void **)&rewriteBuf);
-    return pastWriteSize;
+    return blocksOK;
+}
+
+// lock must be held
+// Drops all dirty blocks with index >= firstBlockIndex without writing them.
+static void wf_discard_dirty_blocks(WritableFile *wf, uint64_t firstBlockIndex) {
+    std::map<uint64_t, WritableFileBlock *>::iterator    it;
+    
+    if (wf->dirtyBlocks == NULL) {
+        return;
+    }
+    it = wf->dirtyBlocks->lower_bound(firstBlockIndex);
+    while (it != wf->dirtyBlocks->end()) {
+        wfb_delete(&it->second);
+        wf->dirtyBlocks->erase(it++);
+        wf->dirtyBytes -= SRFS_BLOCK_SIZE;
+    }
 }
 
 // lock must be held
@@ -413,8 +577,9 @@ static size_t wf_rewrite(WritableFile *wf, const char *src, size_t writeSize, of
     size_t      curBlockSrcOffset;
     
     srfsLog(LOG_FINE, "wf_rewrite %llx %s %u %u", wf, src, writeSize, writeOffset);
-    // first flush all new blocks
-	wf_limit_outstanding_blocks(wf, fbw, 0);
+    // No need to wait for outstanding blocks here. Past blocks are rewritten
+    // in memory (see wf_get_dirty_block) and only written after the outstanding
+    // writes complete (see wf_flush_dirty_blocks).
     
     if (writeOffset + (off_t)writeSize >= wf->fa.stat.st_size) {
         rewriteSize = wf->fa.stat.st_size - writeOffset;
@@ -511,6 +676,8 @@ int wf_write(WritableFile *wf, const char *src, size_t writeSize, off_t writeOff
         if (wfb_is_full(wf->curBlock)) {
             wf_limit_outstanding_blocks(wf, fbw, WF_MAX_BLOCKS_OUTSTANDING);
             wf_write_block(wf, wf->curBlock, wf_cur_block_index(wf), fbw);
+            wf_reap_completed_blocks(wf, fbw);
+            wf_wait_for_block_pool(wf, fbw);
             wf_new_block(wf);
         }
     } while (totalBytesWritten < writeSize);		
@@ -545,7 +712,13 @@ static int _wf_truncate(WritableFile *wf, off_t size, FileBlockWriter *fbw, Part
         // Adjust list size (to remove the old write)
         abl_truncate(wf->blockList, newNumBlocks - 1);
     
-        if (newCurBlockLength > 0) {
+        if (newCurBlockLength > 0 && wf->dirtyBlocks != NULL 
+                && wf->dirtyBlocks->find(newCurBlockIndex) != wf->dirtyBlocks->end()) {
+            // The new current block has been rewritten in memory; use that copy
+            wfb_write(wf->curBlock, (const char *)(*wf->dirtyBlocks)[newCurBlockIndex]->block, newCurBlockLength);
+        } else if (newCurBlockLength > 0 && wf_is_hole(wf, newCurBlockIndex)) {
+            wfb_write(wf->curBlock, (const char *)zeroBlock, newCurBlockLength);
+        } else if (newCurBlockLength > 0) {
             int     readResult;
             char    *blockBuf;
 
@@ -562,9 +735,19 @@ static int _wf_truncate(WritableFile *wf, off_t size, FileBlockWriter *fbw, Part
             wfb_write(wf->curBlock, blockBuf, newCurBlockLength);
             mem_free((void **)&blockBuf);
         }
+        // Dirty blocks at or beyond the new current block are no longer past blocks
+        wf_discard_dirty_blocks(wf, newCurBlockIndex);
+        // Nor are holes
+        if (wf->numHoles > 0) {
+            uint64_t    blockIndex;
+            
+            for (blockIndex = newCurBlockIndex; blockIndex < wf->numBlocks; blockIndex++) {
+                wf_clear_hole(wf, blockIndex);
+            }
+        }
         wf->numBlocks = newNumBlocks;
         wf->leastIncompleteBlockIndex = wf->numBlocks - 1;
-        wf->fa.stat.st_blocks = statBlockConversion(wf->numBlocks); 
+        wf->fa.stat.st_blocks = statBlockConversion(wf->numBlocks - wf->numHoles); 
                                                 // FUTURE - we don't normally update this on the fly
                                                 // maybe change that everywhere        
     } else { // Modify the current block size only
@@ -617,6 +800,14 @@ static int _wf_flush(WritableFile *wf, AttrWriter *aw, FileBlockWriter *fbw, Att
 	srfsLog(LOG_FINE, "wf_flush. ensure blocks written successfully");
     blocksOK = wf_blocks_written_successfully(wf, abl_size(wf->blockList), fbw);
     // FUTURE - consider retrying failed blocks
+    // Rewritten blocks must follow the original writes of those blocks
+    if (!wf_flush_dirty_blocks(wf, fbw)) {
+        blocksOK = FALSE;
+    }
+    // The hole map must be stored before the attribute that refers to it
+    if (!wf_write_hole_map(wf, fbw)) {
+        blocksOK = FALSE;
+    }
 	if (!wfb_is_empty(wf->curBlock)) { // attempt this write even if others failed
         SKOperationState::SKOperationState	bwResult;
         
@@ -677,10 +868,11 @@ static int wf_update_attr(WritableFile *wf, AttrWriter *aw, AttrCache *ac, int c
     wf->fa.stat.st_atime = curTimeSeconds;
     wf->fa.stat.st_mtim.tv_nsec = curTimeNanos;
     wf->fa.stat.st_atim.tv_nsec = curTimeNanos;
+	// Holes are excluded; this is how readers detect them (see fa_has_holes)
 	if (!wfb_is_empty(wf->curBlock)) {
-        wf->fa.stat.st_blocks = statBlockConversion(wf->numBlocks);
+        wf->fa.stat.st_blocks = statBlockConversion(wf->numBlocks - wf->numHoles);
     } else {
-        wf->fa.stat.st_blocks = statBlockConversion(wf->numBlocks - 1);
+        wf->fa.stat.st_blocks = statBlockConversion(wf->numBlocks - 1 - wf->numHoles);
     }
     
     if (cacheOnly) {
@@ -811,7 +1003,9 @@ static void wf_limit_outstanding_blocks(WritableFile *wf, FileBlockWriter *fbw,
 	
 		bw = (WF_BlockWrite *)abl_get(wf->blockList, wf->leastIncompleteBlockIndex);
 		if (bw == NULL) {
-			fatalError("Unexpected bw == NULL", __FILE__, __LINE__);
+            // Hole (possibly since filled by a dirty block); nothing was written
+            wf->leastIncompleteBlockIndex++;
+            continue;
         }
 		if (bw->result != SKOperationState::INCOMPLETE) {
 			fatalError("Unexpected complete operation", __FILE__, __LINE__);
@@ -825,6 +1019,176 @@ static void wf_limit_outstanding_blocks(WritableFile *wf, FileBlockWriter *fbw,
 	}
 }
 
+// lock must be held
+// Reaps blocks whose writes have completed without waiting on any others, so that
+// their buffers are returned to the pool as early as possible
+static void wf_reap_completed_blocks(WritableFile *wf, FileBlockWriter *fbw) {
+	while (wf_blocks_outstanding(wf) > 0) {
+		SKOperationState::SKOperationState	result;
+		WF_BlockWrite	*bw;
+	
+		bw = (WF_BlockWrite *)abl_get(wf->blockList, wf->leastIncompleteBlockIndex);
+		if (bw == NULL) {
+            // Hole; nothing was written
+            wf->leastIncompleteBlockIndex++;
+            continue;
+        }
+		if (bw->adp == NULL || !fbw_is_direct_put_complete(fbw, bw->adp)) {
+			break;
+		}
+		result = fbw_wait_for_direct_put(fbw, &bw->adp);
+		wfbw_set_complete(bw, result);
+		wf->leastIncompleteBlockIndex++;
+	}
+}
+
+// lock must be held
+// Backpressure for the shared WritableFileBlock pool
+static void wf_wait_for_block_pool(WritableFile *wf, FileBlockWriter *fbw) {
+	if (wfb_pool_over_budget()) {
+		// Release this file's buffers before waiting on other files to release theirs
+		wf_limit_outstanding_blocks(wf, fbw, 0);
+		if (!wfb_pool_wait_for_space(WFB_POOL_WAIT_MILLIS)) {
+			// The budget is soft; proceed rather than risk stalling indefinitely
+			srfsLog(LOG_FINE, "wf_wait_for_block_pool timed out %s", wf->path);
+		}
+	}
+}
+
+// Completes a close handed off by wf_check_for_close() to write-behind
+int wf_drain(WritableFile *wf, AttrWriter *aw, FileBlockWriter *fbw, AttrCache *ac) {
+    int rc_f;
+    int rc_c;
+    
+    pthread_mutex_lock(&wf->lock);
+    rc_f = _wf_flush(wf, aw, fbw, ac);
+    pthread_mutex_unlock(&wf->lock);
+    rc_c = wf_close(wf, aw, fbw, ac);
+    return rc_f != 0 ? rc_f : rc_c;
+}
+
+// Bytes of block data not yet known to be in the key-value store
+// lock must be held
+static size_t wf_unconfirmed_bytes(WritableFile *wf) {
+    size_t  i;
+    size_t  numBlocks;
+    
+    numBlocks = 0;
+    for (i = 0; i < abl_size(wf->blockList); i++) {
+		WF_BlockWrite	*bw;
+		
+		bw = (WF_BlockWrite *)abl_get(wf->blockList, i);
+        if (bw != NULL && bw->wfb != NULL) {
+            numBlocks++;
+        }
+    }
+    if (wf->dirtyBlocks != NULL) {
+        numBlocks += wf->dirtyBlocks->size();
+    }
+	if (!wfb_is_empty(wf->curBlock)) {
+        numBlocks++;
+    }
+    return numBlocks * SRFS_BLOCK_SIZE;
+}
+
+// Appends every block not yet known to be in the key-value store to a
+// write-behind journal, in the order in which they must be replayed.
+// Returns 0 on success.
+int wf_journal_blocks(WritableFile *wf, int fd) {
+    size_t  i;
+    int     rc;
+    
+    rc = 0;
+    pthread_mutex_lock(&wf->lock);
+    for (i = 0; rc == 0 && i < abl_size(wf->blockList); i++) {
+		WF_BlockWrite	*bw;
+		
+		bw = (WF_BlockWrite *)abl_get(wf->blockList, i);
+        if (bw != NULL && bw->wfb != NULL) {
+            rc = wb_journal_append_block(fd, i, bw->wfb->block, bw->wfb->size);
+        }
+    }
+    if (rc == 0 && wf->dirtyBlocks != NULL) {
+        std::map<uint64_t, WritableFileBlock *>::iterator    it;
+        
+        for (it = wf->dirtyBlocks->begin(); rc == 0 && it != wf->dirtyBlocks->end(); ++it) {
+            rc = wb_journal_append_block(fd, it->first, it->second->block, it->second->size);
+        }
+    }
+	if (rc == 0 && !wfb_is_empty(wf->curBlock)) {
+        rc = wb_journal_append_block(fd, wf_cur_block_index(wf), wf->curBlock->block, wf->curBlock->size);
+    }
+    if (rc == 0 && wf->numHoles > 0) {
+        rc = wb_journal_append_block(fd, SRFS_HOLE_MAP_BLOCK_INDEX, wf->holeMap, fa_hole_map_size(&wf->fa));
+    }
+    pthread_mutex_unlock(&wf->lock);
+    return rc;
+}
+
+/////////////////
+// sparse files
+
+// lock must be held
+static int wf_is_hole(WritableFile *wf, uint64_t blockIndex) {
+    if (wf->holeMap == NULL || blockIndex >= SRFS_HOLE_MAP_MAX_BLOCKS) {
+        return FALSE;
+    }
+    return (wf->holeMap[blockIndex >> 3] >> (blockIndex & 7)) & 1;
+}
+
+// lock must be held
+static void wf_set_hole(WritableFile *wf, uint64_t blockIndex) {
+    if (wf->holeMap == NULL) {
+        wf->holeMap = (unsigned char *)mem_alloc(SRFS_HOLE_MAP_MAX_BLOCKS / 8, 1);
+    }
+    if (!wf_is_hole(wf, blockIndex)) {
+        wf->holeMap[blockIndex >> 3] |= 1 << (blockIndex & 7);
+        wf->numHoles++;
+    }
+}
+
+// lock must be held
+static void wf_clear_hole(WritableFile *wf, uint64_t blockIndex) {
+    if (wf_is_hole(wf, blockIndex)) {
+        wf->holeMap[blockIndex >> 3] &= ~(1 << (blockIndex & 7));
+        wf->numHoles--;
+    }
+}
+
+// Loads the hole map of an existing sparse file that is being reopened for writing
+static int wf_load_hole_map(WritableFile *wf, PartialBlockReader *pbr) {
+    size_t  mapSize;
+    size_t  i;
+    
+    wf->holeMap = (unsigned char *)mem_alloc(SRFS_HOLE_MAP_MAX_BLOCKS / 8, 1);
+    mapSize = fa_hole_map_size(&wf->fa);
+    if (pbr_read_hole_map(pbr, &wf->fa, 0, mapSize * 8, wf->holeMap) != 0) {
+        srfsLog(LOG_ERROR, "wf_load_hole_map failed %s", wf->path);
+        return -EIO;
+    }
+    wf->numHoles = 0;
+    for (i = 0; i < mapSize; i++) {
+        wf->numHoles += __builtin_popcount(wf->holeMap[i]);
+    }
+    return 0;
+}
+
+// lock must be held
+// Returns TRUE iff the hole map was stored (or none is needed)
+static int wf_write_hole_map(WritableFile *wf, FileBlockWriter *fbw) {
+    WritableFileBlock   *wfb;
+    SKOperationState::SKOperationState	result;
+    
+    if (wf->numHoles == 0) {
+        return TRUE;
+    }
+    wfb = wfb_new();
+    wfb_write(wfb, (const char *)wf->holeMap, fa_hole_map_size(&wf->fa));
+    result = wf_write_block_sync(wf, wfb, SRFS_HOLE_MAP_BLOCK_INDEX, fbw, WF_FAILED_BLOCK_RETRIES);
+    wfb_delete(&wfb);
+    return result == SKOperationState::SUCCEEDED;
+}
+
 // Verifies that all blocks that have been written to SK have succeeded.
 // Does not consider blocks that have not yet been written to SK.
 static int wf_all_blocks_written_successfully(WritableFile *wf, FileBlockWriter *fbw) {
@@ -1028,6 +1392,7 @@ static int wf_check_for_close(WritableFile *wf, AttrWriter *aw, FileBlockWriter
         int rc_f;
         int rc_c;
         WritableFile *_wf;
+        char *wbPath;
         
         wf_sanity_check(wf);
         _wf = (WritableFile *)hashtable_remove(wf->htl->ht, (void *)wf->path); 
@@ -1036,6 +1401,22 @@ static int wf_check_for_close(WritableFile *wf, AttrWriter *aw, FileBlockWriter
                                 wf->htl->ht, wf->path, _wf, wf);
             fatalError("_wf != wf", __FILE__, __LINE__);
         }
+        wbPath = NULL;
+        if (wf_writeBehind != NULL) {
+            size_t  bytes;
+            
+            bytes = wf_unconfirmed_bytes(wf);
+            if (wb_reserve(wf_writeBehind, wf->path, bytes)) {
+                // Write-behind. The path is now pending, so a reopen will wait
+                // for the drainer; we may drop the table lock before any i/o.
+                wf_update_attr(wf, aw, ac, TRUE); // make the final size visible locally
+                pthread_rwlock_unlock(&wf->htl->rwLock);
+                pthread_mutex_unlock(&wf->lock);
+                return wb_submit(wf_writeBehind, wf, bytes);
+            }
+            // flush() has already returned; the next flush/fsync reports any error
+            wbPath = str_dup(wf->path);
+        }
         // We would like to drop the table lock here to avoid holding it during remote i/o
         // We cannot, however, as this can introduce inconsistency.
         // (Mitigating this with many table partitions to minimize extraneous locking)
@@ -1051,6 +1432,12 @@ static int wf_check_for_close(WritableFile *wf, AttrWriter *aw, FileBlockWriter
         } else {
             rc = rc_c;
         }
+        if (wbPath != NULL) {
+            if (rc != 0) {
+                wb_record_error(wf_writeBehind, wbPath, rc);
+            }
+            mem_free((void **)&wbPath);
+        }
     } else {
         pthread_mutex_unlock(&wf->lock);
         pthread_rwlock_unlock(&wf->htl->rwLock);
@@ -22,6 +22,8 @@
 #include <stdlib.h>
 #include <unistd.h>
 
+#include <map>
+
 
 ////////////
 // defines
@@ -34,6 +36,8 @@
 //////////
 // types
 
+struct WriteBehind;
+
 typedef enum {WFR_Invalid = 0, WFR_Created, WFR_Destroyed} WFRefStatus;
 
 typedef struct WritableFileReferentState {
@@ -59,6 +63,13 @@ typedef struct WritableFile {
 	uint64_t	leastIncompleteBlockIndex;
     WritableFileReferentState   referentState;
     uint8_t kvAttrStale;
+    // rewritten past blocks held in memory until flush (or until the rewrite buffer limit is exceeded)
+    std::map<uint64_t, WritableFileBlock *>  *dirtyBlocks;
+    size_t  dirtyBytes;
+    FileBlockCache  *dirtyBlockCache;
+    // sparse files: bitmap of blocks that are holes (never stored), see wf_skip_ahead
+    unsigned char   *holeMap;
+    uint64_t    numHoles;
 } WritableFile;
 
 
@@ -84,5 +95,10 @@ int wf_delete_ref(WritableFile *wf, int ref, AttrWriter *aw, FileBlockWriter *fb
 void wf_debug(WritableFile *wf);
 void wf_sanity_check(WritableFile *wf);
 void wf_set_sync_dir_updates(int syncDirUpdates);
+void wf_set_rewrite_buffer_limit(size_t rewriteBufferLimit);
+void wf_set_write_behind(struct WriteBehind *writeBehind);
+void wf_set_dedup(int dedup);
+int wf_journal_blocks(WritableFile *wf, int fd);
+int wf_drain(WritableFile *wf, AttrWriter *aw, FileBlockWriter *fbw, AttrCache *ac);
 
 #endif
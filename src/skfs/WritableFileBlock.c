@@ -3,32 +3,186 @@
 /////////////
 // includes
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 #include "WritableFileBlock.h"
 #include "Util.h"
 
 
+/////////////////
+// private data
+
+// All WritableFileBlocks are drawn from a single pool shared by all WritableFiles.
+// Freed blocks are recycled as long as the pool is within its budget and the
+// free list is within its own, smaller, limit. wfb_pool_trim() additionally
+// returns blocks that sat unused on the free list for a whole trim interval.
+// The budget is soft: wfb_new() never blocks. Writers apply backpressure
+// using wfb_pool_over_budget() and wfb_pool_wait_for_space().
+static pthread_mutex_t	wfbPoolLock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	wfbPoolCV = PTHREAD_COND_INITIALIZER;
+static WritableFileBlock	*wfbFreeList;
+static uint64_t	wfbPoolBudget = (uint64_t)DEF_WRITE_BUFFER_POOL_MB * 1024 * 1024;
+static uint64_t	wfbFreeLimit = (uint64_t)DEF_WRITE_BUFFER_POOL_MB * 1024 * 1024 / WFB_FREE_LIST_BUDGET_DIVISOR;
+static uint64_t	wfbInUse;
+static uint64_t	wfbFree;
+static uint64_t	wfbFreeLowWater; // minimum of wfbFree since the last trim
+static uint64_t	wfbAllocated;
+static uint64_t	wfbRecycled;
+static uint64_t	wfbWaits;
+static uint64_t	wfbWaitTimeouts;
+static uint64_t	wfbTrimmed;
+
+
 ///////////////////
 // implementation
 
 WritableFileBlock *wfb_new() {
 	WritableFileBlock    *wfb;
 
-	wfb = (WritableFileBlock *)mem_alloc(1, sizeof(WritableFileBlock));
+	pthread_mutex_lock(&wfbPoolLock);
+	wfb = wfbFreeList;
+	if (wfb != NULL) {
+		wfbFreeList = wfb->next;
+		wfbFree--;
+		if (wfbFree < wfbFreeLowWater) {
+			wfbFreeLowWater = wfbFree;
+		}
+		wfbRecycled++;
+	} else {
+		wfbAllocated++;
+	}
+	wfbInUse++;
+	pthread_mutex_unlock(&wfbPoolLock);
+	if (wfb == NULL) {
+		wfb = (WritableFileBlock *)mem_alloc(1, sizeof(WritableFileBlock));
+	} else {
+		// Block contents are only meaningful up to size, so no need to clear them
+		wfb->size = 0;
+		wfb->next = NULL;
+	}
     srfsLog(LOG_FINE, "wfb_new %llx\n", wfb);
 	return wfb;
 }
 
 void wfb_delete(WritableFileBlock **wfb) {
 	if (wfb != NULL && *wfb != NULL) {
-		mem_free((void **)wfb);
+		int	recycle;
+		
+		pthread_mutex_lock(&wfbPoolLock);
+		wfbInUse--;
+		recycle = (wfbInUse + wfbFree + 1) * sizeof(WritableFileBlock) <= wfbPoolBudget
+					&& (wfbFree + 1) * sizeof(WritableFileBlock) <= wfbFreeLimit;
+		if (recycle) {
+			(*wfb)->next = wfbFreeList;
+			wfbFreeList = *wfb;
+			wfbFree++;
+		}
+		pthread_cond_broadcast(&wfbPoolCV);
+		pthread_mutex_unlock(&wfbPoolLock);
+		if (recycle) {
+			*wfb = NULL;
+		} else {
+			mem_free((void **)wfb);
+		}
 	} else {
 		fatalError("bad ptr in wfb_delete");
 	}
 }
 
+void wfb_pool_set_budget(uint64_t budgetBytes) {
+    srfsLog(LOG_INFO, "wfb_pool_set_budget %lu", budgetBytes);
+	pthread_mutex_lock(&wfbPoolLock);
+	wfbPoolBudget = budgetBytes;
+	wfbFreeLimit = budgetBytes / WFB_FREE_LIST_BUDGET_DIVISOR;
+	pthread_mutex_unlock(&wfbPoolLock);
+}
+
+// Frees the blocks that have not been needed since the previous call, i.e. the
+// low-water mark of the free list over the interval. Called periodically.
+void wfb_pool_trim() {
+	WritableFileBlock	*trimList;
+	uint64_t	numToTrim;
+	uint64_t	i;
+	
+	trimList = NULL;
+	pthread_mutex_lock(&wfbPoolLock);
+	numToTrim = wfbFreeLowWater;
+	for (i = 0; i < numToTrim && wfbFreeList != NULL; i++) {
+		WritableFileBlock	*wfb;
+		
+		wfb = wfbFreeList;
+		wfbFreeList = wfb->next;
+		wfb->next = trimList;
+		trimList = wfb;
+		wfbFree--;
+	}
+	wfbTrimmed += i;
+	wfbFreeLowWater = wfbFree;
+	pthread_mutex_unlock(&wfbPoolLock);
+	while (trimList != NULL) {
+		WritableFileBlock	*next;
+		
+		next = trimList->next;
+		mem_free((void **)&trimList);
+		trimList = next;
+	}
+}
+
+int wfb_pool_over_budget() {
+	int	overBudget;
+	
+	pthread_mutex_lock(&wfbPoolLock);
+	overBudget = wfbInUse * sizeof(WritableFileBlock) >= wfbPoolBudget;
+	pthread_mutex_unlock(&wfbPoolLock);
+	return overBudget;
+}
+
+// Wait until the blocks in use fall below the pool budget.
+// Returns TRUE if they did, FALSE if the timeout expired first.
+int wfb_pool_wait_for_space(uint64_t timeoutMillis) {
+	struct timespec	deadline;
+	int	rc;
+	int	hasSpace;
+	
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeoutMillis / 1000;
+	deadline.tv_nsec += (timeoutMillis % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+	rc = 0;
+	pthread_mutex_lock(&wfbPoolLock);
+	wfbWaits++;
+	while (wfbInUse * sizeof(WritableFileBlock) >= wfbPoolBudget && rc != ETIMEDOUT) {
+		rc = pthread_cond_timedwait(&wfbPoolCV, &wfbPoolLock, &deadline);
+	}
+	hasSpace = wfbInUse * sizeof(WritableFileBlock) < wfbPoolBudget;
+	if (!hasSpace) {
+		wfbWaitTimeouts++;
+	}
+	pthread_mutex_unlock(&wfbPoolLock);
+	return hasSpace;
+}
+
+void wfb_pool_display_stats() {
+	pthread_mutex_lock(&wfbPoolLock);
+	srfsLog(LOG_WARNING, "WritableFileBlock pool");
+	srfsLog(LOG_WARNING, "budgetMB: \t%lu", wfbPoolBudget / (1024 * 1024));
+	srfsLog(LOG_WARNING, "inUse: \t%lu\t%luMB", wfbInUse, (wfbInUse * sizeof(WritableFileBlock)) / (1024 * 1024));
+	srfsLog(LOG_WARNING, "free: \t%lu\t%luMB", wfbFree, (wfbFree * sizeof(WritableFileBlock)) / (1024 * 1024));
+	srfsLog(LOG_WARNING, "freeLimitMB: \t%lu", wfbFreeLimit / (1024 * 1024));
+	srfsLog(LOG_WARNING, "trimmed: \t%lu", wfbTrimmed);
+	srfsLog(LOG_WARNING, "allocated: \t%lu", wfbAllocated);
+	srfsLog(LOG_WARNING, "recycled: \t%lu", wfbRecycled);
+	srfsLog(LOG_WARNING, "waits: \t%lu", wfbWaits);
+	srfsLog(LOG_WARNING, "waitTimeouts: \t%lu", wfbWaitTimeouts);
+	pthread_mutex_unlock(&wfbPoolLock);
+}
+
 size_t wfb_write(WritableFileBlock *wfb, const char *src, size_t length) {
 	size_t  bytesToWrite;
 	
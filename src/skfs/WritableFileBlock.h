@@ -16,6 +16,9 @@
 ////////////
 // defines
 
+#define WFB_POOL_WAIT_MILLIS	100
+// Blocks kept on the free list are limited to this fraction of the pool budget
+#define WFB_FREE_LIST_BUDGET_DIVISOR	4
 
 
 //////////
@@ -24,6 +27,7 @@
 typedef struct WritableFileBlock {
     unsigned char	block[SRFS_BLOCK_SIZE];
 	size_t	size;
+	struct WritableFileBlock	*next; // pool free list only
 } WritableFileBlock;
 
 
@@ -38,5 +42,10 @@ void wfb_truncate(WritableFileBlock *wfb, size_t length);
 int wfb_is_full(WritableFileBlock *wfb);
 int wfb_is_empty(WritableFileBlock *wfb);
 size_t wfb_zero_out_remainder(WritableFileBlock *wfb);
+void wfb_pool_set_budget(uint64_t budgetBytes);
+int wfb_pool_over_budget();
+void wfb_pool_trim();
+int wfb_pool_wait_for_space(uint64_t timeoutMillis);
+void wfb_pool_display_stats();
 
 #endif
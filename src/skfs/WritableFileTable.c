@@ -209,8 +209,13 @@ int wft_delete_file(WritableFileTable *wft, const char *name, int deleteBlocks)
     } else {
         if (!getAttrResult) {
             if (deleteBlocks) {
-                srfsLog(LOG_FINE, "wft_delete_file %s invalidating %d blocks\n", name, fa->stat.st_blocks);
-                fbw_invalidate_file_blocks(wft->fbw, &fa->fid, fa->stat.st_blocks);
+                int numBlocks;
+                
+                // st_blocks excludes holes, so derive the block count from the size.
+                // As in wf_new(), this includes the (possibly empty) block at st_size.
+                numBlocks = fa->stat.st_size / SRFS_BLOCK_SIZE + 1;
+                srfsLog(LOG_FINE, "wft_delete_file %s invalidating %d blocks\n", name, numBlocks);
+                fbw_invalidate_file_blocks(wft->fbw, &fa->fid, numBlocks, fa_has_holes(fa));
             }
             result = 0;
         } else {
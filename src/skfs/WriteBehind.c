@@ -0,0 +1,545 @@
+// WriteBehind.c
+
+/////////////
+// includes
+
+#include "FileBlockID.h"
+#include "Util.h"
+#include "WritableFileBlock.h"
+#include "WriteBehind.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+
+////////////////////
+// private defines
+
+#define WB_JOURNAL_MAGIC	0x534b5742
+#define WB_JOURNAL_VERSION	1
+#define WB_JOURNAL_TRAILER	0xffffffffffffffffULL
+#define WB_RECOVERY_MAX_ATTEMPTS	3
+
+
+/////////////////
+// private types
+
+// Journal layout: a WB_JournalHeader, the path, a WB_JournalRecord plus
+// data for each unconfirmed block, and a trailer record. A journal without
+// a trailer belongs to a release() that never returned; it is discarded.
+
+typedef struct WB_JournalHeader {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	pathLength;
+	uint32_t	reserved;
+	FileAttr	fa;
+} WB_JournalHeader;
+
+typedef struct WB_JournalRecord {
+	uint64_t	blockIndex;
+	uint32_t	size;
+	uint32_t	reserved;
+} WB_JournalRecord;
+
+typedef struct WB_Entry {
+	WriteBehind		*wb;
+	WritableFile	*wf;
+	char			*path;
+	char			journalFile[SRFS_MAX_PATH_LENGTH];
+	size_t			bytes;
+} WB_Entry;
+
+
+///////////////////////
+// private prototypes
+
+static void wb_process_entry(void *_entry, int curThreadIndex);
+static void wb_complete(WriteBehind *wb, WB_Entry *entry, int rc);
+static void _wb_record_error(WriteBehind *wb, const char *path, int rc);
+static void wb_recover(WriteBehind *wb);
+static int wb_recover_journal(WriteBehind *wb, const char *journalFile);
+static int wb_journal_is_newer(WriteBehind *wb, char *path, FileAttr *journalFA);
+static int wb_write_fully(int fd, const void *buf, size_t size);
+static int wb_read_fully(int fd, void *buf, size_t size);
+
+
+///////////////////
+// implementation
+
+WriteBehind *wb_new(const char *journalDir, uint64_t maxBytes, AttrWriter *aw, FileBlockWriter *fbw, AttrReader *ar) {
+	WriteBehind	*wb;
+
+	wb = (WriteBehind *)mem_alloc(1, sizeof(WriteBehind));
+	wb->journalDir = str_dup(journalDir);
+	wb->maxBytes = maxBytes;
+	wb->aw = aw;
+	wb->fbw = fbw;
+	wb->ar = ar;
+	wb->ac = ar_get_attrCache(ar);
+	wb->pendingPaths = new std::map<std::string, int>();
+	wb->pathErrors = new std::map<std::string, int>();
+	pthread_mutex_init(&wb->lock, NULL);
+	pthread_cond_init(&wb->cv, NULL);
+	if (mkdir(journalDir, 0700) != 0 && errno != EEXIST) {
+		srfsLog(LOG_ERROR, "wb_new unable to create %s %d", journalDir, errno);
+		fatalError("wb_new unable to create journal dir", __FILE__, __LINE__);
+	}
+	wb->journalDirFD = open(journalDir, O_RDONLY | O_DIRECTORY);
+	if (wb->journalDirFD < 0) {
+		srfsLog(LOG_ERROR, "wb_new unable to open %s %d", journalDir, errno);
+		fatalError("wb_new unable to open journal dir", __FILE__, __LINE__);
+	}
+	// Replay anything left over from a previous run before accepting new work
+	wb_recover(wb);
+	// Journal IDs must increase across restarts so that recovery replays in order
+	wb->nextJournalID = curTimeMicros();
+	wb->qp = qp_new(wb_process_entry, __FILE__, __LINE__, WB_QUEUE_SIZE, ABQ_FULL_BLOCK, WB_DRAINER_THREADS);
+	srfsLog(LOG_WARNING, "wb_new %s maxBytes %lu", journalDir, maxBytes);
+	return wb;
+}
+
+void wb_delete(WriteBehind **wb) {
+	if (wb != NULL && *wb != NULL) {
+		wb_wait_for_all(*wb);
+		(*wb)->qp->running = FALSE;
+		for (int i = 0; i < (*wb)->qp->numThreads; i++) {
+			int added = qp_add((*wb)->qp, NULL);
+			if (!added) srfsLog(LOG_ERROR, "wb_delete failed to add NULL to qp\n");
+		}
+		qp_delete(&(*wb)->qp);
+		close((*wb)->journalDirFD);
+		delete (*wb)->pendingPaths;
+		delete (*wb)->pathErrors;
+		pthread_mutex_destroy(&(*wb)->lock);
+		pthread_cond_destroy(&(*wb)->cv);
+		mem_free((void **)&(*wb)->journalDir);
+		mem_free((void **)wb);
+	} else {
+		fatalError("bad ptr in wb_delete");
+	}
+}
+
+// Called with the WritableFileTable lock held, so that the path is
+// marked pending before any other thread can reopen it.
+// Returns TRUE iff the caller may hand the file to wb_submit().
+int wb_reserve(WriteBehind *wb, const char *path, size_t bytes) {
+	int	accepted;
+
+	pthread_mutex_lock(&wb->lock);
+	if (wb->bytesPending + bytes > wb->maxBytes) {
+		accepted = FALSE;
+		wb->rejected++;
+	} else {
+		accepted = TRUE;
+		wb->bytesPending += bytes;
+		(*wb->pendingPaths)[path]++;
+		wb->submitted++;
+	}
+	pthread_mutex_unlock(&wb->lock);
+	return accepted;
+}
+
+// Journals the file and queues it for the drainer. If the journal cannot be
+// written, the file is flushed synchronously instead. Takes ownership of wf.
+int wb_submit(WriteBehind *wb, WritableFile *wf, size_t bytes) {
+	WB_Entry	*entry;
+	WB_JournalHeader	header;
+	WB_JournalRecord	trailer;
+	uint64_t	journalID;
+	int			fd;
+	int			journalOK;
+
+	entry = (WB_Entry *)mem_alloc(1, sizeof(WB_Entry));
+	entry->wb = wb;
+	entry->wf = wf;
+	entry->path = str_dup(wf->path);
+	entry->bytes = bytes;
+	pthread_mutex_lock(&wb->lock);
+	journalID = wb->nextJournalID++;
+	pthread_mutex_unlock(&wb->lock);
+	snprintf(entry->journalFile, SRFS_MAX_PATH_LENGTH, "%s/%020lu%s", wb->journalDir, journalID, WB_JOURNAL_SUFFIX);
+
+	journalOK = FALSE;
+	fd = open(entry->journalFile, O_WRONLY | O_CREAT | O_TRUNC, 0600);
+	if (fd < 0) {
+		srfsLog(LOG_ERROR, "wb_submit unable to create %s %d", entry->journalFile, errno);
+	} else {
+		memset(&header, 0, sizeof(WB_JournalHeader));
+		header.magic = WB_JOURNAL_MAGIC;
+		header.version = WB_JOURNAL_VERSION;
+		header.pathLength = strlen(entry->path);
+		memcpy(&header.fa, &wf->fa, sizeof(FileAttr));
+		memset(&trailer, 0, sizeof(WB_JournalRecord));
+		trailer.blockIndex = WB_JOURNAL_TRAILER;
+		journalOK = !wb_write_fully(fd, &header, sizeof(WB_JournalHeader))
+					&& !wb_write_fully(fd, entry->path, header.pathLength)
+					&& !wf_journal_blocks(wf, fd)
+					&& !wb_write_fully(fd, &trailer, sizeof(WB_JournalRecord))
+					&& !fsync(fd)
+					&& !fsync(wb->journalDirFD);
+		close(fd);
+		if (!journalOK) {
+			srfsLog(LOG_ERROR, "wb_submit unable to write %s %d", entry->journalFile, errno);
+			unlink(entry->journalFile);
+		}
+	}
+	if (journalOK) {
+		qp_add(wb->qp, entry);
+		return 0;
+	} else {
+		int	rc;
+
+		entry->journalFile[0] = '\0';
+		rc = wf_drain(wf, wb->aw, wb->fbw, wb->ac);
+		wb_complete(wb, entry, rc);
+		return rc;
+	}
+}
+
+static void wb_process_entry(void *_entry, int curThreadIndex) {
+	WB_Entry	*entry;
+	int			rc;
+
+	entry = (WB_Entry *)_entry;
+	if (entry == NULL) {
+		return;
+	}
+	srfsLog(LOG_FINE, "wb_process_entry %s %s", entry->path, entry->journalFile);
+	rc = wf_drain(entry->wf, entry->wb->aw, entry->wb->fbw, entry->wb->ac);
+	wb_complete(entry->wb, entry, rc);
+}
+
+static void wb_complete(WriteBehind *wb, WB_Entry *entry, int rc) {
+	std::map<std::string, int>::iterator	it;
+
+	if (entry->journalFile[0] != '\0') {
+		if (rc == 0) {
+			unlink(entry->journalFile);
+		} else {
+			char	failedFile[SRFS_MAX_PATH_LENGTH];
+
+			// Keep the data, but don't replay it automatically over later writes
+			snprintf(failedFile, SRFS_MAX_PATH_LENGTH, "%s%s", entry->journalFile, WB_FAILED_JOURNAL_SUFFIX);
+			rename(entry->journalFile, failedFile);
+			srfsLog(LOG_ERROR, "wb drain failed %s %d. Journal retained as %s", entry->path, rc, failedFile);
+		}
+	}
+	pthread_mutex_lock(&wb->lock);
+	wb->bytesPending -= entry->bytes;
+	if (rc == 0) {
+		wb->drained++;
+	} else {
+		wb->failed++;
+		_wb_record_error(wb, entry->path, rc);
+	}
+	it = wb->pendingPaths->find(entry->path);
+	if (it != wb->pendingPaths->end()) {
+		if (--it->second == 0) {
+			wb->pendingPaths->erase(it);
+		}
+	} else {
+		srfsLog(LOG_ERROR, "wb_complete path not pending %s", entry->path);
+	}
+	pthread_cond_broadcast(&wb->cv);
+	pthread_mutex_unlock(&wb->lock);
+	mem_free((void **)&entry->path);
+	mem_free((void **)&entry);
+}
+
+void wb_wait_for_path(WriteBehind *wb, const char *path) {
+	pthread_mutex_lock(&wb->lock);
+	if (!wb->pendingPaths->empty()) {
+		std::string	_path(path);
+
+		while (wb->pendingPaths->find(_path) != wb->pendingPaths->end()) {
+			srfsLog(LOG_FINE, "wb_wait_for_path %s", path);
+			pthread_cond_wait(&wb->cv, &wb->lock);
+		}
+	}
+	pthread_mutex_unlock(&wb->lock);
+}
+
+// lock must be held
+static void _wb_record_error(WriteBehind *wb, const char *path, int rc) {
+	(*wb->pathErrors)[path] = rc;
+}
+
+// Records the failure of a close of path that was not handed to write-behind
+void wb_record_error(WriteBehind *wb, const char *path, int rc) {
+	pthread_mutex_lock(&wb->lock);
+	_wb_record_error(wb, path, rc);
+	pthread_mutex_unlock(&wb->lock);
+}
+
+// Returns, and clears, the error of any failed write-behind of path since the last call
+int wb_take_error(WriteBehind *wb, const char *path) {
+	int	rc;
+
+	rc = 0;
+	pthread_mutex_lock(&wb->lock);
+	if (!wb->pathErrors->empty()) {
+		std::map<std::string, int>::iterator	it;
+
+		it = wb->pathErrors->find(path);
+		if (it != wb->pathErrors->end()) {
+			rc = it->second;
+			wb->pathErrors->erase(it);
+		}
+	}
+	pthread_mutex_unlock(&wb->lock);
+	return rc;
+}
+
+void wb_wait_for_all(WriteBehind *wb) {
+	pthread_mutex_lock(&wb->lock);
+	while (!wb->pendingPaths->empty()) {
+		pthread_cond_wait(&wb->cv, &wb->lock);
+	}
+	pthread_mutex_unlock(&wb->lock);
+}
+
+int wb_journal_append_block(int fd, uint64_t blockIndex, const void *data, size_t size) {
+	WB_JournalRecord	record;
+
+	memset(&record, 0, sizeof(WB_JournalRecord));
+	record.blockIndex = blockIndex;
+	record.size = (uint32_t)size;
+	if (wb_write_fully(fd, &record, sizeof(WB_JournalRecord))) {
+		return -1;
+	}
+	return wb_write_fully(fd, data, size);
+}
+
+void wb_display_stats(WriteBehind *wb) {
+	pthread_mutex_lock(&wb->lock);
+	srfsLog(LOG_WARNING, "WriteBehind");
+	srfsLog(LOG_WARNING, "pendingFiles: \t%lu", wb->pendingPaths->size());
+	srfsLog(LOG_WARNING, "pendingMB: \t%lu / %lu", wb->bytesPending / (1024 * 1024), wb->maxBytes / (1024 * 1024));
+	srfsLog(LOG_WARNING, "submitted: \t%lu", wb->submitted);
+	srfsLog(LOG_WARNING, "drained: \t%lu", wb->drained);
+	srfsLog(LOG_WARNING, "failed: \t%lu", wb->failed);
+	srfsLog(LOG_WARNING, "rejected: \t%lu", wb->rejected);
+	srfsLog(LOG_WARNING, "recovered: \t%lu", wb->recovered);
+	srfsLog(LOG_WARNING, "superseded: \t%lu", wb->superseded);
+	srfsLog(LOG_WARNING, "pathErrors: \t%lu", wb->pathErrors->size());
+	pthread_mutex_unlock(&wb->lock);
+}
+
+
+//////////////
+// recovery
+
+static void wb_recover(WriteBehind *wb) {
+	DIR	*dir;
+	struct dirent	*de;
+	size_t	suffixLength;
+	std::vector<std::string>	journalNames;
+
+	dir = opendir(wb->journalDir);
+	if (dir == NULL) {
+		srfsLog(LOG_ERROR, "wb_recover unable to open %s %d", wb->journalDir, errno);
+		return;
+	}
+	suffixLength = strlen(WB_JOURNAL_SUFFIX);
+	while ((de = readdir(dir)) != NULL) {
+		size_t	nameLength;
+
+		nameLength = strlen(de->d_name);
+		if (nameLength > suffixLength && !strcmp(de->d_name + nameLength - suffixLength, WB_JOURNAL_SUFFIX)) {
+			journalNames.push_back(de->d_name);
+		}
+	}
+	closedir(dir);
+	// Names are zero-padded journal IDs; replay oldest first so later closes of a path win
+	std::sort(journalNames.begin(), journalNames.end());
+	for (size_t i = 0; i < journalNames.size(); i++) {
+		char	journalFile[SRFS_MAX_PATH_LENGTH];
+
+		snprintf(journalFile, SRFS_MAX_PATH_LENGTH, "%s/%s", wb->journalDir, journalNames[i].c_str());
+		if (wb_recover_journal(wb, journalFile) == 0) {
+			unlink(journalFile);
+		} else {
+			char	failedFile[SRFS_MAX_PATH_LENGTH];
+
+			snprintf(failedFile, SRFS_MAX_PATH_LENGTH, "%s%s", journalFile, WB_FAILED_JOURNAL_SUFFIX);
+			rename(journalFile, failedFile);
+		}
+	}
+}
+
+// Returns 1 if the journaled attribute is newer than the kvs attribute for path,
+// 0 if the kvs holds this or a later version, or -1 if that cannot be determined.
+static int wb_journal_is_newer(WriteBehind *wb, char *path, FileAttr *journalFA) {
+	FileAttr	kvsFA;
+	int			rc;
+
+	memset(&kvsFA, 0, sizeof(FileAttr));
+	rc = ar_get_attr(wb->ar, path, &kvsFA);
+	if (rc == ENOENT) {
+		// The attribute of this close never reached the kvs
+		return 1;
+	} else if (rc != 0) {
+		srfsLog(LOG_ERROR, "wb_journal_is_newer unable to read attr %s %d", path, rc);
+		return -1;
+	}
+	if (stat_mtime_micros(&kvsFA.stat) < stat_mtime_micros(&journalFA->stat)) {
+		return 1;
+	}
+	// Either this close completed before the crash (same file, same mtime)
+	// or the path has since been rewritten or replaced
+	srfsLog(LOG_WARNING, "wb_journal_is_newer kvs attr %s is not older than journal. fid match %d",
+			path, fid_compare(&kvsFA.fid, &journalFA->fid) == 0);
+	return 0;
+}
+
+// Returns 0 if the journal was replayed or can safely be discarded
+static int wb_recover_journal(WriteBehind *wb, const char *journalFile) {
+	WB_JournalHeader	header;
+	WB_JournalRecord	record;
+	char	path[SRFS_MAX_PATH_LENGTH];
+	off_t	recordsOffset;
+	int		complete;
+	int		rc;
+	int		fd;
+
+	fd = open(journalFile, O_RDONLY);
+	if (fd < 0) {
+		srfsLog(LOG_ERROR, "wb_recover_journal unable to open %s %d", journalFile, errno);
+		return -1;
+	}
+	if (wb_read_fully(fd, &header, sizeof(WB_JournalHeader))
+			|| header.magic != WB_JOURNAL_MAGIC || header.version != WB_JOURNAL_VERSION
+			|| header.pathLength >= SRFS_MAX_PATH_LENGTH
+			|| wb_read_fully(fd, path, header.pathLength)) {
+		srfsLog(LOG_WARNING, "wb_recover_journal discarding unreadable journal %s", journalFile);
+		close(fd);
+		return 0;
+	}
+	path[header.pathLength] = '\0';
+	recordsOffset = lseek(fd, 0, SEEK_CUR);
+
+	// First pass: the journal is only valid if its trailer was written
+	complete = FALSE;
+	while (!wb_read_fully(fd, &record, sizeof(WB_JournalRecord))) {
+		if (record.blockIndex == WB_JOURNAL_TRAILER) {
+			complete = TRUE;
+			break;
+		}
+		if (record.size > SRFS_BLOCK_SIZE || lseek(fd, record.size, SEEK_CUR) < 0) {
+			break;
+		}
+	}
+	if (!complete) {
+		srfsLog(LOG_WARNING, "wb_recover_journal discarding incomplete journal %s %s", journalFile, path);
+		close(fd);
+		return 0;
+	}
+
+	// Never replay over a newer version of the file
+	rc = wb_journal_is_newer(wb, path, &header.fa);
+	if (rc <= 0) {
+		if (rc == 0) {
+			srfsLog(LOG_WARNING, "wb_recover_journal discarding superseded journal %s %s", journalFile, path);
+			wb->superseded++;
+		}
+		close(fd);
+		return rc;
+	}
+
+	// Second pass: write the blocks, then the attribute
+	srfsLog(LOG_WARNING, "wb_recover_journal replaying %s %s", journalFile, path);
+	rc = 0;
+	lseek(fd, recordsOffset, SEEK_SET);
+	while (rc == 0 && !wb_read_fully(fd, &record, sizeof(WB_JournalRecord))
+			&& record.blockIndex != WB_JOURNAL_TRAILER) {
+		WritableFileBlock	*wfb;
+		FileBlockID	*fbid;
+		SKOperationState::SKOperationState	result;
+		int	attempt;
+
+		wfb = wfb_new();
+		if (wb_read_fully(fd, wfb->block, record.size)) {
+			rc = -1;
+		} else {
+			wfb->size = record.size;
+			fbid = fbid_new(&header.fa.fid, record.blockIndex);
+			attempt = 0;
+			do {
+				FBW_ActiveDirectPut	*adp;
+
+				adp = fbw_put_direct(wb->fbw, fbid, wfb);
+				result = fbw_wait_for_direct_put(wb->fbw, &adp);
+			} while (result != SKOperationState::SUCCEEDED && ++attempt < WB_RECOVERY_MAX_ATTEMPTS);
+			fbid_delete(&fbid);
+			if (result != SKOperationState::SUCCEEDED) {
+				srfsLog(LOG_ERROR, "wb_recover_journal block write failed %s %lu", path, record.blockIndex);
+				rc = -1;
+			}
+		}
+		wfb_delete(&wfb);
+	}
+	if (rc == 0) {
+		if (aw_write_attr_direct(wb->aw, path, &header.fa, wb->ac, WB_RECOVERY_MAX_ATTEMPTS) != SKOperationState::SUCCEEDED) {
+			srfsLog(LOG_ERROR, "wb_recover_journal attr write failed %s", path);
+			rc = -1;
+		} else {
+			wb->recovered++;
+		}
+	}
+	close(fd);
+	return rc;
+}
+
+
+////////////
+// file i/o
+
+static int wb_write_fully(int fd, const void *buf, size_t size) {
+	size_t	written;
+
+	written = 0;
+	while (written < size) {
+		ssize_t	rc;
+
+		rc = write(fd, (const char *)buf + written, size - written);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		}
+		written += rc;
+	}
+	return 0;
+}
+
+static int wb_read_fully(int fd, void *buf, size_t size) {
+	size_t	totalRead;
+
+	totalRead = 0;
+	while (totalRead < size) {
+		ssize_t	rc;
+
+		rc = read(fd, (char *)buf + totalRead, size - totalRead);
+		if (rc < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+			return -1;
+		} else if (rc == 0) {
+			return -1;
+		}
+		totalRead += rc;
+	}
+	return 0;
+}
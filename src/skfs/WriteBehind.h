@@ -0,0 +1,83 @@
+// WriteBehind.h
+
+#ifndef _WRITE_BEHIND_H_
+#define _WRITE_BEHIND_H_
+
+/////////////
+// includes
+
+#include "AttrCache.h"
+#include "AttrReader.h"
+#include "AttrWriter.h"
+#include "FileAttr.h"
+#include "FileBlockWriter.h"
+#include "QueueProcessor.h"
+#include "SRFSConstants.h"
+#include "WritableFile.h"
+
+#include <pthread.h>
+#include <stdint.h>
+
+#include <map>
+#include <string>
+
+
+////////////
+// defines
+
+#define WB_JOURNAL_SUFFIX	".wbj"
+#define WB_FAILED_JOURNAL_SUFFIX	".failed"
+
+
+//////////
+// types
+
+// Write-behind lets the last release() of a WritableFile return once its
+// unconfirmed blocks and attribute have been journaled locally. A pool of
+// drainer threads then completes the flush. Paths with a close in
+// progress are tracked so that reopening them waits for the drainer.
+// A failed drain, or a failed synchronous close when write-behind is
+// full, is remembered per path and reported (once) by the next flush() or
+// fsync() of that path, since release() cannot return errors. Unlinking
+// the path forgets it.
+// Journals left over from a crash are replayed by wb_new() unless the
+// kvs already holds a newer attribute for the path.
+typedef struct WriteBehind {
+	char	*journalDir;
+	int		journalDirFD;
+	uint64_t	maxBytes;
+	uint64_t	bytesPending;
+	uint64_t	nextJournalID;
+	std::map<std::string, int>	*pendingPaths;
+	std::map<std::string, int>	*pathErrors;
+	pthread_mutex_t	lock;
+	pthread_cond_t	cv;
+	QueueProcessor	*qp;
+	AttrWriter		*aw;
+	AttrReader		*ar;
+	FileBlockWriter	*fbw;
+	AttrCache		*ac;
+	uint64_t	submitted;
+	uint64_t	drained;
+	uint64_t	failed;
+	uint64_t	rejected;
+	uint64_t	recovered;
+	uint64_t	superseded;
+} WriteBehind;
+
+
+///////////////
+// prototypes
+
+WriteBehind *wb_new(const char *journalDir, uint64_t maxBytes, AttrWriter *aw, FileBlockWriter *fbw, AttrReader *ar);
+void wb_delete(WriteBehind **wb);
+int wb_reserve(WriteBehind *wb, const char *path, size_t bytes);
+int wb_submit(WriteBehind *wb, WritableFile *wf, size_t bytes);
+void wb_wait_for_path(WriteBehind *wb, const char *path);
+void wb_wait_for_all(WriteBehind *wb);
+void wb_record_error(WriteBehind *wb, const char *path, int rc);
+int wb_take_error(WriteBehind *wb, const char *path);
+int wb_journal_append_block(int fd, uint64_t blockIndex, const void *data, size_t size);
+void wb_display_stats(WriteBehind *wb);
+
+#endif
@@ -0,0 +1,169 @@
+// F2PBenchmark.c
+
+/////////////
+// includes
+
+#include "FileIDToPathMap.h"
+#include "SRFSConstants.h"
+#include "Util.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+////////////////////
+// private defines
+
+#define _F2P_BENCHMARK_PATH_SIZE	64
+
+
+//////////////////
+// private types
+
+typedef struct F2PBenchmarkThread {
+	FileIDToPathMap	*f2p;
+	FileID	**fids;
+	int	numFileIDs;
+	int	writePercent;
+	uint64_t	deadlineMillis;
+	unsigned int	seed;
+	uint64_t	reads;
+	uint64_t	writes;
+	uint64_t	misses;
+} F2PBenchmarkThread;
+
+
+///////////////////////
+// private prototypes
+
+static void *f2p_benchmark_thread(void *_bt);
+static void f2p_benchmark(int numThreads, int numFileIDs, int writePercent, int durationMillis, uint64_t expectedEntries);
+
+
+///////////////////
+// implementation
+
+static void *f2p_benchmark_thread(void *_bt) {
+	F2PBenchmarkThread	*bt;
+	char	path[_F2P_BENCHMARK_PATH_SIZE];
+
+	bt = (F2PBenchmarkThread *)_bt;
+	while (curTimeMillis() < bt->deadlineMillis) {
+		int	i;
+
+		// check the clock only every so often so that it doesn't dominate
+		for (i = 0; i < 1024; i++) {
+			FileID	*fid;
+
+			fid = bt->fids[rand_r(&bt->seed) % bt->numFileIDs];
+			if ((int)(rand_r(&bt->seed) % 100) < bt->writePercent) {
+				FileID	*fidCopy;
+
+				fidCopy = (FileID *)malloc(sizeof(FileID));
+				memcpy(fidCopy, fid, sizeof(FileID));
+				sprintf(path, "/bench/%lu", fid->skfs.sequence);
+				f2p_put(bt->f2p, fidCopy, path);
+				bt->writes++;
+			} else {
+				if (f2p_get(bt->f2p, fid) == NULL) {
+					bt->misses++;
+				}
+				bt->reads++;
+			}
+		}
+	}
+	return NULL;
+}
+
+// Measures f2p throughput with numThreads threads hammering a map of
+// numFileIDs entries, writePercent of operations being puts. Half of the
+// fids are inserted up front so that gets see both hits and misses.
+static void f2p_benchmark(int numThreads, int numFileIDs, int writePercent, int durationMillis, uint64_t expectedEntries) {
+	FileIDToPathMap	*f2p;
+	FileID	**fids;
+	F2PBenchmarkThread	*bts;
+	pthread_t	*threads;
+	uint64_t	startMillis;
+	uint64_t	elapsedMillis;
+	uint64_t	reads;
+	uint64_t	writes;
+	uint64_t	misses;
+	char	path[_F2P_BENCHMARK_PATH_SIZE];
+	int	i;
+
+	f2p = f2p_new(expectedEntries);
+	fids = (FileID **)mem_alloc(numFileIDs, sizeof(FileID *));
+	for (i = 0; i < numFileIDs; i++) {
+		fids[i] = fid_new_skfs(0, i);
+		if (i % 2 == 0) {
+			FileID	*fidCopy;
+
+			fidCopy = (FileID *)malloc(sizeof(FileID));
+			memcpy(fidCopy, fids[i], sizeof(FileID));
+			sprintf(path, "/bench/%d", i);
+			f2p_put(f2p, fidCopy, path);
+		}
+	}
+	bts = (F2PBenchmarkThread *)mem_alloc(numThreads, sizeof(F2PBenchmarkThread));
+	threads = (pthread_t *)mem_alloc(numThreads, sizeof(pthread_t));
+	startMillis = curTimeMillis();
+	for (i = 0; i < numThreads; i++) {
+		bts[i].f2p = f2p;
+		bts[i].fids = fids;
+		bts[i].numFileIDs = numFileIDs;
+		bts[i].writePercent = writePercent;
+		bts[i].deadlineMillis = startMillis + durationMillis;
+		bts[i].seed = (unsigned int)(startMillis + i);
+		pthread_create(&threads[i], NULL, f2p_benchmark_thread, &bts[i]);
+	}
+	reads = 0;
+	writes = 0;
+	misses = 0;
+	for (i = 0; i < numThreads; i++) {
+		pthread_join(threads[i], NULL);
+		reads += bts[i].reads;
+		writes += bts[i].writes;
+		misses += bts[i].misses;
+	}
+	elapsedMillis = curTimeMillis() - startMillis;
+	if (elapsedMillis == 0) {
+		elapsedMillis = 1;
+	}
+	printf("f2p_benchmark threads %d fids %d writePercent %d millis %lu reads %lu writes %lu misses %lu ops/sec %lu\n",
+		numThreads, numFileIDs, writePercent, elapsedMillis, reads, writes, misses,
+		(reads + writes) * 1000 / elapsedMillis);
+	f2p_display_stats(f2p);
+	mem_free((void **)&threads);
+	mem_free((void **)&bts);
+	for (i = 0; i < numFileIDs; i++) {
+		fid_delete(&fids[i]);
+	}
+	mem_free((void **)&fids);
+	f2p_delete(&f2p);
+}
+
+int main(int argc, char *argv[]) {
+	int	numThreads;
+	int	numFileIDs;
+	int	writePercent;
+	int	durationMillis;
+	uint64_t	expectedEntries;
+
+	if (argc < 5 || argc > 6) {
+		fprintf(stderr, "usage: %s <threads> <fileIDs> <writePercent> <durationMillis> [expectedEntries]\n", argv[0]);
+		return 1;
+	}
+	numThreads = atoi(argv[1]);
+	numFileIDs = atoi(argv[2]);
+	writePercent = atoi(argv[3]);
+	durationMillis = atoi(argv[4]);
+	expectedEntries = argc == 6 ? strtoull(argv[5], NULL, 10) : DEF_F2P_EXPECTED_ENTRIES;
+	if (numThreads <= 0 || numFileIDs <= 0 || writePercent < 0 || writePercent > 100 || durationMillis <= 0) {
+		fprintf(stderr, "threads, fileIDs and durationMillis must be positive; writePercent must be in [0, 100]\n");
+		return 1;
+	}
+	f2p_benchmark(numThreads, numFileIDs, writePercent, durationMillis, expectedEntries);
+	return 0;
+}
@@ -38,23 +38,29 @@
 
 #include "AttrReader.h"
 #include "AttrWriter.h"
+#include "BinaryLog.h"
 #include "BlockReader.h"
 #include "FileBlockReader.h"
 #include "FileBlockWriter.h"
 #include "FileIDToPathMap.h"
+#include "LatencyHistogram.h"
+#include "MetricsServer.h"
 //#include "NSKeySplit.h"
 #include "OpenDirTable.h"
 #include "PartialBlockReader.h"
 #include "PathGroup.h"
+#include "PeerBlockCache.h"
 #include "ReconciliationSet.h"
 #include "ResponseTimeStats.h"
 #include "skfs.h"
 #include "SKFSOpenFile.h"
 #include "SRFSConstants.h"
 #include "SRFSDHT.h"
+#include "Trace.h"
 #include "Util.h"
 #include "WritableFile.h"
 #include "WritableFileTable.h"
+#include "WriteBehind.h"
 
 #include <signal.h>
 #include <sys/inotify.h>
@@ -99,6 +105,23 @@
 #define SO_RECONCILIATION_SLEEP 'L'
 #define SO_ODW_MIN_WRITE_INTERVAL_MILLIS 'I'
 #define SO_SYNC_DIR_UPDATES 'U'
+#define SO_REWRITE_BUFFER_KB 'W'
+#define SO_WRITE_BUFFER_POOL_MB 'M'
+#define SO_WRITE_BEHIND_JOURNAL_DIR 'j'
+#define SO_WRITE_BEHIND_MB 'b'
+#define SO_DEDUP 'D'
+#define SO_STATFS_REFRESH_SECS 'K'
+#define SO_NEGATIVE_CACHE_MILLIS 'H'
+#define SO_NEGATIVE_CACHE_TIMEOUTS 'Y'
+#define SO_DIR_DATA_FRESHNESS_MILLIS 'Z'
+#define SO_HEDGE_PERCENTILE 'p'
+#define SO_METRICS_SOCKET 'O'
+#define SO_TRACE_FILE 't'
+#define SO_TRACE_SAMPLE_RATE 'r'
+#define SO_ZERO_COPY_READS 'k'
+#define SO_PEER_BLOCK_CACHE 'Q'
+#define SO_PEER_CACHE_PORT 'u'
+#define SO_F2P_EXPECTED_ENTRIES 'i'
 
 #define LO_VERBOSE "verbose"
 #define LO_HOST "host"
@@ -135,6 +158,23 @@
 #define LO_RECONCILIATION_SLEEP "reconciliationSleep"
 #define LO_ODW_MIN_WRITE_INTERVAL_MILLIS "odwMinWriteIntervalMillis"
 #define LO_SYNC_DIR_UPDATES "syncDirUpdates"
+#define LO_REWRITE_BUFFER_KB "rewriteBufferKB"
+#define LO_WRITE_BUFFER_POOL_MB "writeBufferPoolMB"
+#define LO_WRITE_BEHIND_JOURNAL_DIR "writeBehindJournalDir"
+#define LO_WRITE_BEHIND_MB "writeBehindMB"
+#define LO_DEDUP "dedup"
+#define LO_STATFS_REFRESH_SECS "statfsRefreshSecs"
+#define LO_NEGATIVE_CACHE_MILLIS "negativeCacheMillis"
+#define LO_NEGATIVE_CACHE_TIMEOUTS "negativeCacheTimeouts"
+#define LO_DIR_DATA_FRESHNESS_MILLIS "dirDataFreshnessMillis"
+#define LO_HEDGE_PERCENTILE "hedgePercentile"
+#define LO_METRICS_SOCKET "metricsSocket"
+#define LO_TRACE_FILE "traceFile"
+#define LO_TRACE_SAMPLE_RATE "traceSampleRate"
+#define LO_ZERO_COPY_READS "zeroCopyReads"
+#define LO_PEER_BLOCK_CACHE "peerBlockCache"
+#define LO_PEER_CACHE_PORT "peerCachePort"
+#define LO_F2P_EXPECTED_ENTRIES "f2pExpectedEntries"
 
 
 #define OPEN_MODE_FLAG_MASK 0x3
@@ -147,13 +187,23 @@
 #define _SKFS_TIMEOUT_NEVER 0x0fffffff
 #define _FBC_NAME "FileBlockCache"
 #define _MAX_REASONABLE_DISK_STAT_LENGTH 32
-
+// displayArguments: printf of a NULL %s is undefined
+#define _ARG_STR(X) ((X) != NULL ? (X) : "(null)")
+
+#define _SKFS_JVM_OPTIONS_LENGTH 128
+// Default jvm heap: a base plus headroom for values in transit to/from the
+// native block cache, proportional to the size of that cache
+#define _SKFS_JVM_HEAP_BASE_MB 512
+#define _SKFS_JVM_HEAP_CACHE_DIVISOR 8
+#define _SKFS_JVM_HEAP_MAX_MB (16 * 1024)
 #define _rn_retry_limit 20
 #define _rn_retry_interval_ms 10
 
 #define _NUM_NATIVE_FILE_MODES 3
 #define _DEFAULT_NATIVE_FILE_MODE nf_readRelay_localPreread
 #define _PREREAD_SIZE 1
+// Reads spanning more blocks than this are copied even with zeroCopyReads
+#define _SKFS_MAX_ZERO_COPY_BLOCKS 32
 
 
 ///////////////////////
@@ -161,6 +211,8 @@
 
 static error_t parse_opt(int key, char *arg, struct argp_state *state);
 static void *stats_thread(void *);
+static void render_metrics(MetricsBuffer *mb);
+static void *statfs_thread(void *);
 static void * nativefile_watcher_thread(void * unused);
 static void initPaths();
 static void initReaders();
@@ -221,6 +273,23 @@ static struct argp_option options[] = {
        {LO_RECONCILIATION_SLEEP, SO_RECONCILIATION_SLEEP, LO_RECONCILIATION_SLEEP, 0, "reconciliationSleep", 0 },
        {LO_ODW_MIN_WRITE_INTERVAL_MILLIS, SO_ODW_MIN_WRITE_INTERVAL_MILLIS, LO_ODW_MIN_WRITE_INTERVAL_MILLIS, 0, "odwMinWriteIntervalMillis", 0 },
        {LO_SYNC_DIR_UPDATES, SO_SYNC_DIR_UPDATES, LO_SYNC_DIR_UPDATES, 0, "syncDirUpdates", 0 },
+       {LO_REWRITE_BUFFER_KB, SO_REWRITE_BUFFER_KB, LO_REWRITE_BUFFER_KB, 0, "per-file rewrite buffer KB", 0 },
+       {LO_WRITE_BUFFER_POOL_MB, SO_WRITE_BUFFER_POOL_MB, LO_WRITE_BUFFER_POOL_MB, 0, "shared write buffer pool MB", 0 },
+       {LO_WRITE_BEHIND_JOURNAL_DIR, SO_WRITE_BEHIND_JOURNAL_DIR, LO_WRITE_BEHIND_JOURNAL_DIR, 0, "enables write-behind; local journal dir", 0 },
+       {LO_WRITE_BEHIND_MB, SO_WRITE_BEHIND_MB, LO_WRITE_BEHIND_MB, 0, "write-behind memory limit MB", 0 },
+       {LO_DEDUP, SO_DEDUP, LO_DEDUP, 0, "content-addressed block deduplication of newly created files", 0 },
+       {LO_STATFS_REFRESH_SECS, SO_STATFS_REFRESH_SECS, LO_STATFS_REFRESH_SECS, 0, "statfs cache refresh interval", 0 },
+       {LO_NEGATIVE_CACHE_MILLIS, SO_NEGATIVE_CACHE_MILLIS, LO_NEGATIVE_CACHE_MILLIS, 0, "ENOENT cache timeout; 0 disables", 0 },
+       {LO_NEGATIVE_CACHE_TIMEOUTS, SO_NEGATIVE_CACHE_TIMEOUTS, LO_NEGATIVE_CACHE_TIMEOUTS, 0, "per path group ENOENT cache timeouts: paths=millis[+paths=millis...]", 0 },
+       {LO_DIR_DATA_FRESHNESS_MILLIS, SO_DIR_DATA_FRESHNESS_MILLIS, LO_DIR_DATA_FRESHNESS_MILLIS, 0, "max parent DirData age for local ENOENT; 0 disables", 0 },
+       {LO_HEDGE_PERCENTILE, SO_HEDGE_PERCENTILE, LO_HEDGE_PERCENTILE, 0, "kvs response time percentile at which native fs reads are hedged", 0 },
+       {LO_METRICS_SOCKET, SO_METRICS_SOCKET, LO_METRICS_SOCKET, 0, "unix socket serving Prometheus-format metrics", 0 },
+       {LO_TRACE_FILE, SO_TRACE_FILE, LO_TRACE_FILE, 0, "file receiving Chrome trace-event JSON for sampled reads", 0 },
+       {LO_TRACE_SAMPLE_RATE, SO_TRACE_SAMPLE_RATE, LO_TRACE_SAMPLE_RATE, 0, "trace 1 in this many reads", 0 },
+       {LO_ZERO_COPY_READS, SO_ZERO_COPY_READS, LO_ZERO_COPY_READS, 0, "serve cached blocks to FUSE without copying", 0 },
+       {LO_PEER_BLOCK_CACHE, SO_PEER_BLOCK_CACHE, LO_PEER_BLOCK_CACHE, 0, "fetch blocks from peers listed in brRemoteAddressFile", 0 },
+       {LO_PEER_CACHE_PORT, SO_PEER_CACHE_PORT, LO_PEER_CACHE_PORT, 0, "peerCachePort", 0 },
+       {LO_F2P_EXPECTED_ENTRIES, SO_F2P_EXPECTED_ENTRIES, LO_F2P_EXPECTED_ENTRIES, 0, "expected number of file ids; sizes the fid to path map", 0 },
        { 0, 0, 0, 0, 0, 0 }
 };
 static char *nativeFileModes[] = {"nf_blockReadOnly", "nf_readRelay_localPreread", "nf_readRelay_distributedPreread"};
@@ -255,10 +324,17 @@ static ResponseTimeStats	*rtsODT;
 static PathGroup volatile	*fsNativeOnlyPaths;
 static char			*fsNativeOnlyFile;
 static BlockReader  *br;
+static WriteBehind  *wb;
+static BlockBufferPool	*bbp;
+static PeerBlockCache	*pbc;
+static uint64_t	zeroCopyReads;
+static uint64_t	copiedReads;
 
 static int			statsIntervalSeconds = 20;
 static int			statsDetailIntervalSeconds = 300;
 static pthread_t	statsThread;
+static pthread_t	statfsThread;
+static MetricsServer	*metricsServer;
 static pthread_t	nativeFileWatcherThread;
 
 static char	logFileName[SRFS_MAX_PATH_LENGTH];
@@ -270,8 +346,6 @@ static char	fuseAttrOption[SKFS_FUSE_OPTION_STRING_LENGTH];
 static char	fuseACAttrOption[SKFS_FUSE_OPTION_STRING_LENGTH];
 static char	fuseNegativeOption[SKFS_FUSE_OPTION_STRING_LENGTH];
 
-SKSessionOptions	*sessOption;
-
 static int  destroyCalled;
 static pthread_spinlock_t	destroyLockInstance;
 static pthread_spinlock_t	*destroyLock = &destroyLockInstance;
@@ -279,6 +353,13 @@ static pthread_spinlock_t	*destroyLock = &destroyLockInstance;
 static SKSession    *pUtilSession;
 static SKSyncNSPerspective *systemNSP;
 
+// statfs() is served from these; see statfs_thread()
+static pthread_mutex_t	statfsLock = PTHREAD_MUTEX_INITIALIZER;
+static uint64_t	statfsTotalBytes;
+static uint64_t	statfsFreeBytes;
+static uint64_t	statfsLastUpdateMillis;
+static uint64_t	statfsRefreshFailures;
+
 
 ///////////////////
 // implementation
@@ -468,6 +549,57 @@ static error_t parse_opt(int key, char *arg, struct argp_state *state) {
 				case SO_SYNC_DIR_UPDATES:
 						arguments->syncDirUpdates = parseBoolean(arg);
 						break;
+				case SO_REWRITE_BUFFER_KB:
+						arguments->rewriteBufferKB = atoi(arg);
+						break;
+				case SO_WRITE_BUFFER_POOL_MB:
+						arguments->writeBufferPoolMB = atoi(arg);
+						break;
+				case SO_WRITE_BEHIND_JOURNAL_DIR:
+						arguments->writeBehindJournalDir = arg;
+						break;
+				case SO_WRITE_BEHIND_MB:
+						arguments->writeBehindMB = atoi(arg);
+						break;
+				case SO_DEDUP:
+						arguments->dedup = parseBoolean(arg);
+						break;
+				case SO_STATFS_REFRESH_SECS:
+						arguments->statfsRefreshSecs = atoi(arg);
+						break;
+				case SO_NEGATIVE_CACHE_MILLIS:
+						arguments->negativeCacheMillis = atoi(arg);
+						break;
+				case SO_NEGATIVE_CACHE_TIMEOUTS:
+						arguments->negativeCacheTimeouts = arg;
+						break;
+				case SO_DIR_DATA_FRESHNESS_MILLIS:
+						arguments->dirDataFreshnessMillis = atoi(arg);
+						break;
+				case SO_HEDGE_PERCENTILE:
+						arguments->hedgePercentile = atof(arg);
+						break;
+				case SO_METRICS_SOCKET:
+						arguments->metricsSocket = arg;
+						break;
+				case SO_TRACE_FILE:
+						arguments->traceFile = arg;
+						break;
+				case SO_TRACE_SAMPLE_RATE:
+						arguments->traceSampleRate = atoi(arg);
+						break;
+				case SO_ZERO_COPY_READS:
+						arguments->zeroCopyReads = parseBoolean(arg);
+						break;
+				case SO_PEER_BLOCK_CACHE:
+						arguments->peerBlockCache = parseBoolean(arg);
+						break;
+				case SO_PEER_CACHE_PORT:
+						arguments->peerCachePort = atoi(arg);
+						break;
+				case SO_F2P_EXPECTED_ENTRIES:
+						arguments->f2pExpectedEntries = atoi(arg);
+						break;
                 default:
 			//printf("Adding %d %s\n", state->arg_num, state->argv[state->arg_num]); fflush(stdout);
 			//fuse_opt_add_arg(&fuseArgs, state->argv[state->arg_num]);
@@ -514,21 +646,38 @@ void initDefaults(CmdArgs *arguments) {
     arguments->reconciliationSleep = NULL;
     arguments->odwMinWriteIntervalMillis = ODW_DEF_MIN_WRITE_INTERVAL_MILLIS;
     arguments->syncDirUpdates = DEF_SYNC_DIR_UPDATES;
+    arguments->rewriteBufferKB = DEF_REWRITE_BUFFER_KB;
+    arguments->writeBufferPoolMB = DEF_WRITE_BUFFER_POOL_MB;
+    arguments->writeBehindJournalDir = NULL;
+    arguments->writeBehindMB = DEF_WRITE_BEHIND_MB;
+    arguments->dedup = DEF_DEDUP;
+    arguments->statfsRefreshSecs = DEF_STATFS_REFRESH_SECS;
+    arguments->negativeCacheMillis = DEF_NEGATIVE_CACHE_MILLIS;
+    arguments->negativeCacheTimeouts = NULL;
+    arguments->dirDataFreshnessMillis = DEF_DIR_DATA_FRESHNESS_MILLIS;
+    arguments->hedgePercentile = DEF_HEDGE_PERCENTILE;
+    arguments->metricsSocket = NULL;
+    arguments->traceFile = NULL;
+    arguments->traceSampleRate = DEF_TRACE_SAMPLE_RATE;
+    arguments->zeroCopyReads = DEF_ZERO_COPY_READS;
+    arguments->peerBlockCache = DEF_PEER_BLOCK_CACHE;
+    arguments->peerCachePort = -1;
+    arguments->f2pExpectedEntries = DEF_F2P_EXPECTED_ENTRIES;
 }
 
 static void displayArguments(CmdArgs *arguments) {
     printf("verbose %d\n", (int)arguments->verbose);
-    printf("host %s\n", arguments->host);
-    printf("gcname %s\n", arguments->gcname);
-    printf("zkLoc %s\n", arguments->zkLoc);
-    printf("nfsMapping %s\n", arguments->nfsMapping);
-    printf("permanentSuffixes %s\n", arguments->permanentSuffixes);
-    printf("noErrorCachePaths %s\n", arguments->noErrorCachePaths);
+    printf("host %s\n", _ARG_STR(arguments->host));
+    printf("gcname %s\n", _ARG_STR(arguments->gcname));
+    printf("zkLoc %s\n", _ARG_STR(arguments->zkLoc));
+    printf("nfsMapping %s\n", _ARG_STR(arguments->nfsMapping));
+    printf("permanentSuffixes %s\n", _ARG_STR(arguments->permanentSuffixes));
+    printf("noErrorCachePaths %s\n", _ARG_STR(arguments->noErrorCachePaths));
     printf("compression %d\n", arguments->compression);
     printf("checksum %d\n", arguments->checksum);
     printf("transientCacheSizeKB %d\n", arguments->transientCacheSizeKB);
     printf("cacheConcurrency %d\n", arguments->cacheConcurrency);
-    printf("jvmOptions %s\n", arguments->jvmOptions);
+    printf("jvmOptions %s\n", _ARG_STR(arguments->jvmOptions));
 	printf("enableBigWrites %d\n", arguments->enableBigWrites);
 	printf("entryTimeoutSecs %d\n", arguments->entryTimeoutSecs);
 	printf("attrTimeoutSecs %d\n", arguments->attrTimeoutSecs);
@@ -536,11 +685,28 @@ static void displayArguments(CmdArgs *arguments) {
 	printf("dhtOpMinTimeoutMS %ld\n", arguments->dhtOpMinTimeoutMS);
 	printf("dhtOpMaxTimeoutMS %ld\n", arguments->dhtOpMaxTimeoutMS);
 	printf("nativeFileMode %s\n", nativeFileModes[arguments->nativeFileMode]);
-	printf("brRemoteAddressFile %s\n", arguments->brRemoteAddressFile);
+	printf("brRemoteAddressFile %s\n", _ARG_STR(arguments->brRemoteAddressFile));
 	printf("brPort %d\n", arguments->brPort);
 	printf("reconciliationSleep %d\n", arguments->reconciliationSleep);
 	printf("odwMinWriteIntervalMillis %d\n", arguments->odwMinWriteIntervalMillis);
 	printf("syncDirUpdates %d\n", arguments->syncDirUpdates);
+	printf("rewriteBufferKB %d\n", arguments->rewriteBufferKB);
+	printf("writeBufferPoolMB %d\n", arguments->writeBufferPoolMB);
+	printf("writeBehindJournalDir %s\n", _ARG_STR(arguments->writeBehindJournalDir));
+	printf("writeBehindMB %d\n", arguments->writeBehindMB);
+	printf("dedup %d\n", arguments->dedup);
+	printf("statfsRefreshSecs %d\n", arguments->statfsRefreshSecs);
+	printf("negativeCacheMillis %d\n", arguments->negativeCacheMillis);
+	printf("negativeCacheTimeouts %s\n", _ARG_STR(arguments->negativeCacheTimeouts));
+	printf("dirDataFreshnessMillis %d\n", arguments->dirDataFreshnessMillis);
+	printf("hedgePercentile %f\n", arguments->hedgePercentile);
+	printf("metricsSocket %s\n", _ARG_STR(arguments->metricsSocket));
+	printf("traceFile %s\n", _ARG_STR(arguments->traceFile));
+	printf("traceSampleRate %d\n", arguments->traceSampleRate);
+	printf("zeroCopyReads %d\n", arguments->zeroCopyReads);
+	printf("peerBlockCache %d\n", arguments->peerBlockCache);
+	printf("peerCachePort %d\n", arguments->peerCachePort);
+	printf("f2pExpectedEntries %d\n", arguments->f2pExpectedEntries);
 }
 
 // FUSE interface
@@ -716,6 +882,9 @@ static int skfs_truncate(const char *path, off_t size) {
     int rc;
     
 	srfsLogAsync(LOG_OPS, "_t %s %lu", path, size);
+    if (wb != NULL) {
+        wb_wait_for_path(wb, path);
+    }
     wf_ref = wft_get(wft, path);
 	if (wf_ref != NULL) { // file is currently open; we're good
         openedForTruncation = FALSE;
@@ -957,6 +1126,10 @@ static int skfs_rmdir(const char *path) {
 
 static int skfs_rename(const char *oldpath, const char *newpath) {
 	srfsLogAsync(LOG_OPS, "_rn %s %s", oldpath, newpath);
+    if (wb != NULL) {
+        wb_wait_for_path(wb, oldpath);
+        wb_wait_for_path(wb, newpath);
+    }
 	if (!is_writable_path(oldpath) || !is_writable_path(newpath)) {
 		return -EIO;
     } else {    
@@ -1239,6 +1412,9 @@ static int skfs_open(const char *path, struct fuse_file_info *fi) {
         ((fi->flags & O_TRUNC) ? "t" : "")
         );
     
+    if (wb != NULL && is_writable_path(path)) {
+        wb_wait_for_path(wb, path);
+    }
     sof = sof_new();
     fi->fh = (uint64_t)sof;
     
@@ -1444,6 +1620,9 @@ static int skfs_mknod(const char *path, mode_t mode, dev_t rdev) {
     WritableFileReference    *wf_ref;
 	
     srfsLogAsync(LOG_OPS, "_mn %s %x %x", path, mode, rdev);
+    if (wb != NULL) {
+        wb_wait_for_path(wb, path);
+    }
 	wf_ref = wft_create_new_file(wft, path, mode);
 	if (wf_ref != NULL) {
         OpenDir *parentDir;
@@ -1474,6 +1653,11 @@ static int _skfs_unlink(const char *path, int deleteBlocks) {
 
 static int skfs_unlink(const char *path) {
 	srfsLogAsync(LOG_OPS, "_ul %s", path);
+    if (wb != NULL) {
+        wb_wait_for_path(wb, path);
+        // nobody is left to report a failed close of the removed file to
+        wb_take_error(wb, path);
+    }
     // FUTURE - below is best-effort. enforce
     if (wft_contains(wft, path)) {
         srfsLog(LOG_ERROR, "Can't unlink writable file");
@@ -1567,56 +1751,113 @@ static int skfs_read(const char *path, char *dest, size_t readSize, off_t readOf
 }
 
 #if FUSE_VERSION >= 29
+// Block buffers handed to FUSE by this thread's last read_buf. libfuse sends
+// the reply before its worker thread takes another request, so the
+// references are dropped when this thread next enters a FUSE op, or when
+// it exits.
+static __thread BlockBuffer	*pendingBlockBuffers[_SKFS_MAX_ZERO_COPY_BLOCKS];
+static __thread int	numPendingBlockBuffers;
+static pthread_key_t	pendingBlockBuffersKey;
+static pthread_once_t	pendingBlockBuffersKeyOnce = PTHREAD_ONCE_INIT;
+
+static void release_pending_block_buffers() {
+    while (numPendingBlockBuffers > 0) {
+        numPendingBlockBuffers--;
+        bb_release(&pendingBlockBuffers[numPendingBlockBuffers]);
+    }
+}
+
+// pthread_key destructor; runs on the exiting thread
+static void release_pending_block_buffers_at_exit(void *unused) {
+    release_pending_block_buffers();
+}
+
+static void create_pending_block_buffers_key() {
+    if (pthread_key_create(&pendingBlockBuffersKey, release_pending_block_buffers_at_exit) != 0) {
+        fatalError("pthread_key_create failed", __FILE__, __LINE__);
+    }
+}
+
+// Returns the cached blocks covering the read as (fd, offset) buffers that
+// libfuse can splice to /dev/fuse, or NULL if the read must be copied.
+static struct fuse_bufvec *skfs_read_block_buffers(const char *path, size_t readSize, off_t readOffset,
+                                                   SKFSOpenFile *sof) {
+    struct fuse_bufvec  *src;
+    size_t  bytesRead;
+    size_t  blockOffset;
+    size_t  remaining;
+    off_t   nextBlockOffset;
+    int     numBlocks;
+    int     i;
+
+    if (!sof_is_valid(sof) || sof->attr == NULL
+            || sof->type == OFT_WritableFile_Write
+            || (sof->type == OFT_NativeRelay && args->nativeFileMode != nf_blockReadOnly)) {
+        return NULL;
+    }
+    numBlocks = pbr_read_block_buffers(pbr, sof->attr, readSize, readOffset, pendingBlockBuffers, 
+                                       _SKFS_MAX_ZERO_COPY_BLOCKS, &bytesRead);
+    if (numBlocks == 0) {
+        return NULL;
+    }
+    numPendingBlockBuffers = numBlocks;
+    pthread_once(&pendingBlockBuffersKeyOnce, create_pending_block_buffers_key);
+    if (pthread_getspecific(pendingBlockBuffersKey) == NULL) {
+        // any non-NULL value; the destructor only runs for non-NULL values
+        pthread_setspecific(pendingBlockBuffersKey, pendingBlockBuffers);
+    }
+    // fuse_bufvec ends in a one-element buf array
+    src = (struct fuse_bufvec *)mem_alloc_no_dbg(1, sizeof(struct fuse_bufvec) + (numBlocks - 1) * sizeof(struct fuse_buf));
+    src->count = numBlocks;
+    blockOffset = readOffset % SRFS_BLOCK_SIZE;
+    remaining = bytesRead;
+    for (i = 0; i < numBlocks; i++) {
+        src->buf[i].size = size_min(SRFS_BLOCK_SIZE - blockOffset, remaining);
+        src->buf[i].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
+        src->buf[i].fd = bb_fd(pendingBlockBuffers[i]);
+        src->buf[i].pos = bb_fd_offset(pendingBlockBuffers[i]) + blockOffset;
+        remaining -= src->buf[i].size;
+        blockOffset = 0;
+    }
+
+    // Issue the read-ahead that pbr_read would have issued
+    nextBlockOffset = (off_t)(offsetToBlock(readOffset + bytesRead - 1) + 1) * SRFS_BLOCK_SIZE;
+    if (bytesRead >= PBR_READAHEAD_THRESHOLD && nextBlockOffset < sof->attr->stat.st_size) {
+        pbr_read_given_attr(pbr, path, NULL, SRFS_BLOCK_SIZE, nextBlockOffset, sof->attr, TRUE, 
+                            PBR_MAX_READAHEAD_BLOCKS - 1);
+    }
+    return src;
+}
+
 static int skfs_read_buf(const char *path, struct fuse_bufvec **bufp,
                          size_t readSize, off_t readOffset, struct fuse_file_info *fi) {
-    size_t	size;
-    char	*buf;
-    int	rVal;
-    size_t	totalRead;
+    struct fuse_bufvec *src;
+    char    *dest;
+    int     result;
 
 	srfsLogAsync(LOG_OPS, "_R %x %s %d %ld", get_caller_pid(), path, readSize, readOffset);
-    {
-        struct fuse_bufvec *src;
-        char    *dest;
-        int     result;
-        
-        src = (struct fuse_bufvec *)mem_alloc_no_dbg(1, sizeof(struct fuse_bufvec));
-        *src = FUSE_BUFVEC_INIT(readSize);
-        src->buf[0].flags = (enum fuse_buf_flags)(FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK);
-        src->buf[0].fd = fi->fh;
-        src->buf[0].pos = readOffset;
+    release_pending_block_buffers();
+    src = skfs_read_block_buffers(path, readSize, readOffset, (SKFSOpenFile*)fi->fh);
+    if (src != NULL) {
+        __atomic_fetch_add(&zeroCopyReads, 1, __ATOMIC_RELAXED);
         *bufp = src;
         return 0;
     }
-                         
-#if 0
-    struct fuse_bufvec *src;
-    char    *dest;
-    int     result;
-    
-	srfsLogAsync(LOG_OPS, "_R %x %s %d %ld", get_caller_pid(), path, readSize, readOffset);
-    // This is a proof-of-concept implementation
-    // A real implementation will probably want to allow
-    // native files to be passed back via fd/offset
-    src = (struct fuse_bufvec *)mem_alloc_no_dbg(1, sizeof(struct fuse_bufvec));
-    dest = (char *)mem_alloc_no_dbg(readSize, 1);
+
+    // libfuse frees both the bufvec and its memory buffer after replying
+    __atomic_fetch_add(&copiedReads, 1, __ATOMIC_RELAXED);
+    dest = (char *)mem_alloc_no_dbg(int_max(readSize, 1), 1);
     result = skfs_read(path, dest, readSize, readOffset, fi);
     if (result < 0) {
+        mem_free((void **)&dest);
         return result;
     } else {
-        *src = FUSE_BUFVEC_INIT(readSize);
-        /*
-        src->buf[0].flags = FUSE_BUF_IS_FD | FUSE_BUF_FD_SEEK;
-        src->buf[0].fd = fi->fh;
-        src->buf[0].pos = offset;
-        */
-        //src->buf[0].flags = 0;
+        src = (struct fuse_bufvec *)mem_alloc_no_dbg(1, sizeof(struct fuse_bufvec));
+        *src = FUSE_BUFVEC_INIT((size_t)result);
         src->buf[0].mem = dest;
         *bufp = src;
-        //srfsLog(LOG_WARNING, "_R returning 0");
         return 0;
     }
-#endif    
 }
 #endif
 
@@ -1704,11 +1945,40 @@ int skfs_flush(const char *path, struct fuse_file_info *fi) {
 		return 0;
 	} else {
 		srfsLogAsync(LOG_OPS, "_f %s", path);
+        if (wb != NULL) {
+            // With write-behind, the final release flushes asynchronously; fsync() is the durability point.
+            // Report the failure of any earlier write-behind of this path, as release() cannot.
+            return -wb_take_error(wb, path);
+        }
 		return -wf_flush(wf, aw, fbwSKFS, ar->attrCache);
 	}
     return 0;
 }
 
+static int skfs_fsync(const char *path, int datasync, struct fuse_file_info *fi) {
+    WritableFile *wf;
+	
+	srfsLogAsync(LOG_OPS, "_fs %s %d", path, datasync);
+	wf = wf_fuse_fi_fh_to_wf(fi);
+	if (wf == NULL) {
+        // Not open for writing. Any data is durable once a pending write-behind completes.
+        if (wb != NULL && is_writable_path(path)) {
+            wb_wait_for_path(wb, path);
+            return -wb_take_error(wb, path);
+        }
+		return 0;
+	} else {
+        int rc;
+        
+        // datasync is treated as a full sync since blocks are unreachable without the attribute
+		rc = wf_flush(wf, aw, fbwSKFS, ar->attrCache);
+        if (rc == 0 && wb != NULL) {
+            rc = wb_take_error(wb, path);
+        }
+		return -rc;
+	}
+}
+
 static void init_util_sk() {
     SKNamespace	*systemNS;
     SKNamespacePerspectiveOptions *nspOptions;
@@ -1724,7 +1994,12 @@ static uint64_t _get_sk_system_uint64(const char *stat) {
     SKVal       *pval;
     uint64_t    bytes;
 
-    pval = systemNSP->get(stat);
+    try {
+        pval = systemNSP->get(stat);
+    } catch (std::exception &e) {
+        srfsLog(LOG_WARNING, "_get_sk_system_uint64 %s exception %s", stat, e.what());
+        pval = NULL;
+    }
     if (pval != NULL) {
         if (pval->m_pVal != NULL && pval->m_len > 0 && pval->m_len < _MAX_REASONABLE_DISK_STAT_LENGTH){
             bytes = strtoull((const char *)pval->m_pVal, NULL, 10);
@@ -1738,14 +2013,55 @@ static uint64_t _get_sk_system_uint64(const char *stat) {
     return bytes;
 }
 
+// Fetches the disk stats from the DHT. Previous values are retained on failure
+// so that statfs() continues to be served while the DHT is degraded.
+static void refresh_statfs() {
+    uint64_t    totalBytes;
+    uint64_t    freeBytes;
+
+    totalBytes = _get_sk_system_uint64("totalDiskBytes");
+    freeBytes = _get_sk_system_uint64("freeDiskBytes");
+    pthread_mutex_lock(&statfsLock);
+    if (totalBytes != 0 && freeBytes != 0) {
+        statfsTotalBytes = totalBytes;
+        statfsFreeBytes = freeBytes;
+        statfsLastUpdateMillis = curTimeMillis();
+    } else {
+        statfsRefreshFailures++;
+        if (statfsLastUpdateMillis != 0) {
+            srfsLog(LOG_WARNING, "refresh_statfs failed. Serving values from %lu ms ago", 
+                    curTimeMillis() - statfsLastUpdateMillis);
+        }
+    }
+    pthread_mutex_unlock(&statfsLock);
+}
+
+static void *statfs_thread(void *) {
+	while (!exitSignalReceived) {
+		sleep(args->statfsRefreshSecs);
+		refresh_statfs();
+	}
+	return NULL;
+}
+
 static int skfs_statfs(const char *path, struct statvfs *s) {
     uint64_t    totalBytes;
     uint64_t    freeBytes;
 
 	srfsLogAsync(LOG_OPS, "_s %s", path);
     
-    totalBytes = _get_sk_system_uint64("totalDiskBytes");
-    freeBytes = _get_sk_system_uint64("freeDiskBytes");
+    pthread_mutex_lock(&statfsLock);
+    totalBytes = statfsTotalBytes;
+    freeBytes = statfsFreeBytes;
+    pthread_mutex_unlock(&statfsLock);
+    if (totalBytes == 0 || args->statfsRefreshSecs <= 0) {
+        // No successful refresh yet, or no refresh thread; query the kvs now
+        refresh_statfs();
+        pthread_mutex_lock(&statfsLock);
+        totalBytes = statfsTotalBytes;
+        freeBytes = statfsFreeBytes;
+        pthread_mutex_unlock(&statfsLock);
+    }
     if (totalBytes != 0 && freeBytes != 0) {
         memset(s, 0, sizeof(struct statvfs));
         
@@ -1755,9 +2071,11 @@ static int skfs_statfs(const char *path, struct statvfs *s) {
         s->f_bfree = freeBytes / SRFS_BLOCK_SIZE;
         s->f_bavail = freeBytes / SRFS_BLOCK_SIZE;
         
-        s->f_files = 0;
-        s->f_ffree = 0;
-        s->f_favail = 0;
+        // There is no inode table. Every non-empty file occupies at least one
+        // block, so blocks bound the number of files.
+        s->f_files = s->f_blocks;
+        s->f_ffree = s->f_bfree;
+        s->f_favail = s->f_bavail;
         
         s->f_fsid = 0;
         s->f_flag = 0;
@@ -1929,6 +2247,19 @@ static void *skfs_init(struct fuse_conn_info *conn) {
 	wft = wft_new("WritableFileTable", aw, ar->attrCache, ar, fbwSKFS);
 	initPaths();
 	pthread_create(&statsThread, NULL, stats_thread, NULL);
+	if (args->statfsRefreshSecs > 0) {
+		pthread_create(&statfsThread, NULL, statfs_thread, NULL);
+	}
+	if (args->metricsSocket != NULL) {
+		metricsServer = ms_new(args->metricsSocket, render_metrics);
+	}
+	tr_init(args->traceFile, args->traceSampleRate);
+#if FUSE_VERSION >= 29
+	// read_buf returns cached blocks as fd buffers; let libfuse splice them
+	if (args->zeroCopyReads && (conn->capable & FUSE_CAP_SPLICE_WRITE)) {
+		conn->want |= FUSE_CAP_SPLICE_WRITE;
+	}
+#endif
 	if(fsNativeOnlyFile) {
 		//if nativeOnlyFile name is supplied, then create this thread 
 		pthread_create(&nativeFileWatcherThread, NULL, nativefile_watcher_thread, NULL);
@@ -1955,6 +2286,17 @@ static void skfs_destroy(void* private_data) {
 
     if (doDestroy) {
         srfsLog(LOG_WARNING, "skfs_destroy()");
+        if (wb != NULL) {
+            srfsLog(LOG_WARNING, "skfs_destroy() waiting for write-behind");
+            wb_wait_for_all(wb);
+        }
+        if (metricsServer != NULL) {
+            ms_delete(&metricsServer);
+        }
+        if (pbc != NULL) {
+            pbc_stop(pbc);
+        }
+        tr_close();
         //srfsRedirectStdio(); //TODO: think about this
         /*
         srfsLog(LOG_WARNING, "skfs_destroy() waiting for threads");
@@ -2035,12 +2377,214 @@ static void *stats_thread(void *) {
 		srfsLog(LOG_WARNING, "\n\t** stats **");
 		ar_display_stats(ar, detailFlag);
 		fbr_display_stats(fbr, detailFlag);
+		if (detailFlag) {
+			f2p_display_stats(f2p);
+		}
+		wfb_pool_trim();
+		wfb_pool_display_stats();
+		ao_display_stats();
+		if (bbp != NULL) {
+			bbp_display_stats(bbp);
+			srfsLog(LOG_WARNING, "read_buf zeroCopyReads %lu copiedReads %lu",
+				__atomic_load_n(&zeroCopyReads, __ATOMIC_RELAXED), __atomic_load_n(&copiedReads, __ATOMIC_RELAXED));
+		}
+		if (pbc != NULL) {
+			pbc_display_stats(pbc);
+		}
+		if (br != NULL) {
+			br_display_stats(br);
+		}
+		lh_display_stats();
+		if (args->dedup) {
+			bd_display_stats();
+		}
+		pthread_mutex_lock(&statfsLock);
+		srfsLog(LOG_WARNING, "statfs lastUpdateMillis %lu refreshFailures %lu", 
+				statfsLastUpdateMillis, statfsRefreshFailures);
+		pthread_mutex_unlock(&statfsLock);
+		if (wb != NULL) {
+			wb_display_stats(wb);
+		}
 		detailPhase = (detailPhase + 1) % detailPeriod;
 	}
 	return NULL;
 }
 
 
+// metrics
+
+static void render_reader_stats(MetricsBuffer *mb, const char *reader, ReaderStats *rs) {
+	ReaderStats	stats;
+	char	labels[128];
+
+	rs_get_stats(rs, &stats);
+	sprintf(labels, "reader=\"%s\",source=\"cache\"", reader);
+	mb_sample(mb, "skfs_reader_results_total", labels, stats.cache);
+	sprintf(labels, "reader=\"%s\",source=\"opWait\"", reader);
+	mb_sample(mb, "skfs_reader_results_total", labels, stats.opWait);
+	sprintf(labels, "reader=\"%s\",source=\"dht\"", reader);
+	mb_sample(mb, "skfs_reader_results_total", labels, stats.dht);
+	sprintf(labels, "reader=\"%s\",source=\"nfs\"", reader);
+	mb_sample(mb, "skfs_reader_results_total", labels, stats.nfs);
+	sprintf(labels, "reader=\"%s\",source=\"dirData\"", reader);
+	mb_sample(mb, "skfs_reader_results_total", labels, stats.dirData);
+}
+
+static void render_cache_stats(MetricsBuffer *mb) {
+	const char	*names[3] = {"attr", "block", "dir"};
+	CacheStats	stats[3];
+	char	labels[128];
+	int	i;
+	int	j;
+
+	ac_get_cache_stats(ar->attrCache, &stats[0]);
+	fbc_get_cache_stats(fbr->fileBlockCache, &stats[1]);
+	odc_get_cache_stats(odt->odc, &stats[2]);
+	mb_family(mb, "skfs_cache_reads_total", "counter", "Cache reads by result");
+	for (i = 0; i < 3; i++) {
+		for (j = CRR_NOT_FOUND; j < CRR_CODE_TRAILER; j++) {
+			sprintf(labels, "cache=\"%s\",result=\"%s\"", names[i], crr_strings[j]);
+			mb_sample(mb, "skfs_cache_reads_total", labels, stats[i].readResults[j]);
+		}
+	}
+	mb_family(mb, "skfs_cache_speculative_reads_total", "counter", "Speculative (read-ahead) cache reads by result");
+	for (i = 0; i < 3; i++) {
+		for (j = CRR_NOT_FOUND; j < CRR_CODE_TRAILER; j++) {
+			sprintf(labels, "cache=\"%s\",result=\"%s\"", names[i], crr_strings[j]);
+			mb_sample(mb, "skfs_cache_speculative_reads_total", labels, stats[i].specReadResults[j]);
+		}
+	}
+	mb_family(mb, "skfs_cache_writes_total", "counter", "Cache writes");
+	for (i = 0; i < 3; i++) {
+		sprintf(labels, "cache=\"%s\"", names[i]);
+		mb_sample(mb, "skfs_cache_writes_total", labels, stats[i].writes);
+	}
+	mb_family(mb, "skfs_cache_evictions_total", "counter", "Cache evictions");
+	for (i = 0; i < 3; i++) {
+		sprintf(labels, "cache=\"%s\"", names[i]);
+		mb_sample(mb, "skfs_cache_evictions_total", labels, stats[i].evictions);
+	}
+	mb_family(mb, "skfs_cache_failed_evictions_total", "counter", "Cache evictions that failed");
+	for (i = 0; i < 3; i++) {
+		sprintf(labels, "cache=\"%s\"", names[i]);
+		mb_sample(mb, "skfs_cache_failed_evictions_total", labels, stats[i].failed_evictions);
+	}
+	mb_family(mb, "skfs_cache_removals_total", "counter", "Cache removals");
+	for (i = 0; i < 3; i++) {
+		sprintf(labels, "cache=\"%s\"", names[i]);
+		mb_sample(mb, "skfs_cache_removals_total", labels, stats[i].removals);
+	}
+}
+
+static void render_response_time(MetricsBuffer *mb, const char *reader, const char *stage, ResponseTimeStats *rts) {
+	const double	quantiles[3] = {50.0, 95.0, 99.0};
+	char	labels[128];
+	int	i;
+
+	for (i = 0; i < 3; i++) {
+		sprintf(labels, "reader=\"%s\",stage=\"%s\",quantile=\"%g\"", reader, stage, quantiles[i] / 100.0);
+		mb_sample(mb, "skfs_stage_response_millis", labels, rts_get_rt_percentile_millis(rts, quantiles[i]));
+	}
+}
+
+static void render_latency_histograms(MetricsBuffer *mb) {
+	const double	quantiles[3] = {50.0, 99.0, 99.9};
+	LHHistogram	*histograms;
+	char	labels[128];
+	int	i;
+	int	j;
+
+	histograms = (LHHistogram *)mem_alloc(LH_NUM_METRICS, sizeof(LHHistogram));
+	lh_merge(histograms);
+	mb_family(mb, "skfs_latency_micros", "summary", "Latency of FUSE operations and read stages");
+	for (i = 0; i < LH_NUM_METRICS; i++) {
+		const char	*name;
+
+		name = lh_metric_name((LHMetric)i);
+		for (j = 0; j < 3; j++) {
+			sprintf(labels, "op=\"%s\",quantile=\"%g\"", name, quantiles[j] / 100.0);
+			mb_sample(mb, "skfs_latency_micros", labels, lh_percentile(&histograms[i], quantiles[j]));
+		}
+		sprintf(labels, "op=\"%s\"", name);
+		mb_sample(mb, "skfs_latency_micros_sum", labels, histograms[i].sumMicros);
+		mb_sample(mb, "skfs_latency_micros_count", labels, histograms[i].total);
+	}
+	mb_family(mb, "skfs_latency_max_micros", "gauge", "Maximum latency observed");
+	for (i = 0; i < LH_NUM_METRICS; i++) {
+		sprintf(labels, "op=\"%s\"", lh_metric_name((LHMetric)i));
+		mb_sample(mb, "skfs_latency_max_micros", labels, histograms[i].maxMicros);
+	}
+	mem_free((void **)&histograms);
+}
+
+// Renders all metrics in the Prometheus text format. Counters are read
+// without locks, so samples need not form a consistent snapshot.
+static void render_metrics(MetricsBuffer *mb) {
+	ACNegativeStats	negativeStats;
+	uint64_t	logRecords;
+	uint64_t	logDropped;
+
+	mb_family(mb, "skfs_reader_results_total", "counter", "Reads satisfied by source");
+	render_reader_stats(mb, "attr", ar->rs);
+	render_reader_stats(mb, "block", fbr->rs);
+	render_cache_stats(mb);
+
+	ac_get_negative_stats(ar->attrCache, &negativeStats);
+	mb_family(mb, "skfs_negative_cache_total", "counter", "ENOENT cache events");
+	mb_sample(mb, "skfs_negative_cache_total", "event=\"hit\"", negativeStats.hits);
+	mb_sample(mb, "skfs_negative_cache_total", "event=\"miss\"", negativeStats.misses);
+	mb_sample(mb, "skfs_negative_cache_total", "event=\"store\"", negativeStats.stores);
+	mb_sample(mb, "skfs_negative_cache_total", "event=\"expiration\"", negativeStats.expirations);
+	mb_sample(mb, "skfs_negative_cache_total", "event=\"invalidation\"", negativeStats.invalidations);
+
+	mb_family(mb, "skfs_hedges_total", "counter", "Native reads hedging an outstanding kvs read");
+	mb_sample(mb, "skfs_hedges_total", "result=\"issued\"", __atomic_load_n(&fbr->hedgesIssued, __ATOMIC_RELAXED));
+	mb_sample(mb, "skfs_hedges_total", "result=\"won\"", __atomic_load_n(&fbr->hedgeWins, __ATOMIC_RELAXED));
+	mb_sample(mb, "skfs_hedges_total", "result=\"lost\"", __atomic_load_n(&fbr->hedgeLosses, __ATOMIC_RELAXED));
+
+	mb_family(mb, "skfs_stage_response_millis", "gauge", "Decaying response time quantiles per reader stage");
+	render_response_time(mb, "attr", "dht", ar->rtsDHT);
+	render_response_time(mb, "attr", "nfs", ar->rtsNFS);
+	render_response_time(mb, "block", "dht", fbr->rtsDHT);
+	render_response_time(mb, "block", "nfs", fbr->rtsNFS);
+	render_response_time(mb, "dir", "dht", odt->ddr->rtsDirData);
+
+	render_latency_histograms(mb);
+
+	bl_get_stats(&logRecords, &logDropped);
+	mb_family(mb, "skfs_async_log_records_total", "counter", "Asynchronous log records by outcome");
+	mb_sample(mb, "skfs_async_log_records_total", "result=\"queued\"", logRecords);
+	mb_sample(mb, "skfs_async_log_records_total", "result=\"dropped\"", logDropped);
+
+	if (bbp != NULL) {
+		mb_family(mb, "skfs_read_buf_total", "counter", "read_buf replies by how block data was returned");
+		mb_sample(mb, "skfs_read_buf_total", "path=\"zero_copy\"", __atomic_load_n(&zeroCopyReads, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_read_buf_total", "path=\"copied\"", __atomic_load_n(&copiedReads, __ATOMIC_RELAXED));
+		mb_family(mb, "skfs_block_buffers_in_use", "gauge", "Pooled block buffer slots in use");
+		mb_sample(mb, "skfs_block_buffers_in_use", NULL, __atomic_load_n(&bbp->slotsInUse, __ATOMIC_RELAXED));
+	}
+
+	if (pbc != NULL) {
+		mb_family(mb, "skfs_peer_cache_total", "counter", "Peer block cache requests by outcome");
+		mb_sample(mb, "skfs_peer_cache_total", "event=\"fetch_hit\"", __atomic_load_n(&pbc->fetchHits, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_peer_cache_total", "event=\"fetch_miss\"", __atomic_load_n(&pbc->fetchMisses, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_peer_cache_total", "event=\"fetch_error\"", __atomic_load_n(&pbc->fetchErrors, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_peer_cache_total", "event=\"fetch_skipped\"", __atomic_load_n(&pbc->fetchSkipped, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_peer_cache_total", "event=\"served_hit\"", __atomic_load_n(&pbc->servedHits, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_peer_cache_total", "event=\"served_miss\"", __atomic_load_n(&pbc->servedMisses, __ATOMIC_RELAXED));
+	}
+
+	if (br != NULL) {
+		mb_family(mb, "skfs_block_reader_total", "counter", "Distributed read-ahead requests and datagrams by outcome");
+		mb_sample(mb, "skfs_block_reader_total", "event=\"read_queued\"", __atomic_load_n(&br->readsQueued, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_block_reader_total", "event=\"datagram_sent\"", __atomic_load_n(&br->datagramsSent, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_block_reader_total", "event=\"retransmit\"", __atomic_load_n(&br->retransmits, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_block_reader_total", "event=\"datagram_lost\"", __atomic_load_n(&br->datagramsLost, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_block_reader_total", "event=\"read_served\"", __atomic_load_n(&br->readsServed, __ATOMIC_RELAXED));
+		mb_sample(mb, "skfs_block_reader_total", "event=\"read_coalesced\"", __atomic_load_n(&br->readsCoalesced, __ATOMIC_RELAXED));
+	}
+}
+
 static void * nativefile_watcher_thread(void * unused) {
   //passed params are unused currently 
 
@@ -2127,23 +2671,124 @@ static void * nativefile_watcher_thread(void * unused) {
   return NULL;
 }
 
+// Latency-recording wrappers for the hot FUSE entry points
+
+static int skfs_getattr_timed(const char *path, struct stat *stbuf) {
+	uint64_t	t1;
+	int	result;
+
+	t1 = curTimeMicros();
+	result = skfs_getattr(path, stbuf);
+	lh_record(LH_GETATTR, curTimeMicros() - t1);
+	return result;
+}
+
+static int skfs_read_timed(const char *path, char *dest, size_t readSize, off_t readOffset,
+                    struct fuse_file_info *fi) {
+	uint64_t	t1;
+	uint64_t	t2;
+	uint64_t	traceID;
+	int	result;
+
+	traceID = tr_begin();
+	t1 = curTimeMicros();
+	result = skfs_read(path, dest, readSize, readOffset, fi);
+	t2 = curTimeMicros();
+	lh_record(LH_READ, t2 - t1);
+	if (traceID != 0) {
+		char	detail[TR_MAX_DETAIL_LENGTH];
+
+		snprintf(detail, sizeof(detail), "%s %lu %ld %d", path, readSize, readOffset, result);
+		tr_span(traceID, "read", t1, t2, detail);
+		tr_end();
+	}
+	return result;
+}
+
+#if FUSE_VERSION >= 29
+static int skfs_read_buf_timed(const char *path, struct fuse_bufvec **bufp,
+                         size_t readSize, off_t readOffset, struct fuse_file_info *fi) {
+	uint64_t	t1;
+	uint64_t	t2;
+	uint64_t	traceID;
+	int	result;
+
+	traceID = tr_begin();
+	t1 = curTimeMicros();
+	result = skfs_read_buf(path, bufp, readSize, readOffset, fi);
+	t2 = curTimeMicros();
+	lh_record(LH_READ, t2 - t1);
+	if (traceID != 0) {
+		char	detail[TR_MAX_DETAIL_LENGTH];
+
+		snprintf(detail, sizeof(detail), "%s %lu %ld %d", path, readSize, readOffset, result);
+		tr_span(traceID, "read_buf", t1, t2, detail);
+		tr_end();
+	}
+	return result;
+}
+#endif
+
+static int skfs_write_timed(const char *path, const char *src, size_t writeSize, off_t writeOffset, 
+                    struct fuse_file_info *fi) {
+	uint64_t	t1;
+	int	result;
+
+	t1 = curTimeMicros();
+	result = skfs_write(path, src, writeSize, writeOffset, fi);
+	lh_record(LH_WRITE, curTimeMicros() - t1);
+	return result;
+}
+
+static int skfs_readdir_timed(const char *path, void *buf, fuse_fill_dir_t filler,
+                       off_t offset, struct fuse_file_info *fi) {
+	uint64_t	t1;
+	int	result;
+
+	t1 = curTimeMicros();
+	result = skfs_readdir(path, buf, filler, offset, fi);
+	lh_record(LH_READDIR, curTimeMicros() - t1);
+	return result;
+}
+
+static int skfs_open_timed(const char *path, struct fuse_file_info *fi) {
+	uint64_t	t1;
+	int	result;
+
+	t1 = curTimeMicros();
+	result = skfs_open(path, fi);
+	lh_record(LH_OPEN, curTimeMicros() - t1);
+	return result;
+}
+
+static int skfs_release_timed(const char *path, struct fuse_file_info *fi) {
+	uint64_t	t1;
+	int	result;
+
+	t1 = curTimeMicros();
+	result = skfs_release(path, fi);
+	lh_record(LH_RELEASE, curTimeMicros() - t1);
+	return result;
+}
+
 void initFuse() {
-    skfs_oper.getattr = skfs_getattr;
-    skfs_oper.read = skfs_read;
+    skfs_oper.getattr = skfs_getattr_timed;
+    skfs_oper.read = skfs_read_timed;
 #if FUSE_VERSION >= 29
 //    skfs_oper.read_buf = skfs_read_buf;
 #endif
     skfs_oper.readlink = skfs_readlink;
-    skfs_oper.readdir = skfs_readdir;
+    skfs_oper.readdir = skfs_readdir_timed;
     skfs_oper.flush = skfs_flush;
+    skfs_oper.fsync = skfs_fsync;
 	skfs_oper.init = skfs_init;
     skfs_oper.access = skfs_access;
 	skfs_oper.destroy = skfs_destroy;
 	
-    skfs_oper.open = skfs_open;
-    skfs_oper.release = skfs_release;
+    skfs_oper.open = skfs_open_timed;
+    skfs_oper.release = skfs_release_timed;
     skfs_oper.mknod = skfs_mknod;
-    skfs_oper.write = skfs_write;
+    skfs_oper.write = skfs_write_timed;
 	skfs_oper.chmod = skfs_chmod;
 	skfs_oper.chown = skfs_chown;
 	skfs_oper.truncate = skfs_truncate;
@@ -2178,7 +2823,29 @@ void initDHT() {
         //	lvl = LVL_INFO;
         }
 
-        pClient = SKClient::getClient(lvl, args->jvmOptions);
+        const char  *jvmOptions;
+        char        defaultJvmOptions[_SKFS_JVM_OPTIONS_LENGTH];
+        
+        jvmOptions = args->jvmOptions;
+        if (jvmOptions == NULL && getenv("SK_JVM_ARGS") == NULL) {
+            uint64_t    cacheMB;
+            uint64_t    heapMB;
+            
+            // Use the production profile with the heap derived from the cache size
+            if (args->transientCacheSizeKB != 0) {
+                cacheMB = (uint64_t)args->transientCacheSizeKB / 1024;
+            } else {
+                cacheMB = (uint64_t)FBR_TRANSIENT_CACHE_SIZE * (uint64_t)SRFS_BLOCK_SIZE / (1024 * 1024);
+            }
+            heapMB = _SKFS_JVM_HEAP_BASE_MB + cacheMB / _SKFS_JVM_HEAP_CACHE_DIVISOR;
+            if (heapMB > _SKFS_JVM_HEAP_MAX_MB) {
+                heapMB = _SKFS_JVM_HEAP_MAX_MB;
+            }
+            snprintf(defaultJvmOptions, _SKFS_JVM_OPTIONS_LENGTH, "profile=production,-Xmx%luM", heapMB);
+            jvmOptions = defaultJvmOptions;
+        }
+        srfsLog(LOG_INFO, "jvmOptions %s", jvmOptions != NULL ? jvmOptions : "SK_JVM_ARGS");
+        pClient = SKClient::getClient(lvl, jvmOptions);
         if (!pClient) {
             srfsLog(LOG_WARNING, "dht client init failed. Will continue with NFS-only");
         }
@@ -2248,6 +2915,8 @@ PathGroup *initTaskOutputPaths(int* taskOutputPort ) {
 void initPaths() {
 	ar_parse_native_aliases(ar, (char *)args->nfsMapping);
 	ar_parse_no_error_cache_paths(ar, (char *)args->noErrorCachePaths);
+	ar_set_negative_cache(ar, args->negativeCacheMillis > 0 || args->negativeCacheTimeouts != NULL ? AC_NEGATIVE_CACHE_SIZE : 0, 
+						  args->negativeCacheMillis, (char *)args->negativeCacheTimeouts);
 	ar_parse_no_link_cache_paths(ar, (char *)args->noLinkCachePaths);
 	fsNativeOnlyFile = (char *)args->fsNativeOnlyFile;
 	ar_parse_snapshot_only_paths(ar, (char *)args->snapshotOnlyPaths);
@@ -2261,7 +2930,8 @@ void initPaths() {
 void destroyPaths() {
 }
 
-FileBlockCache *createFileBlockCache(int numSubCaches, int transientCacheSize, FileIDToPathMap *f2p) {
+FileBlockCache *createFileBlockCache(int numSubCaches, int transientCacheSize, FileIDToPathMap *f2p, 
+                                     BlockBufferPool *bbp) {
     int evictionBatch;
     
 	if (transientCacheSize == 0) {
@@ -2269,7 +2939,7 @@ FileBlockCache *createFileBlockCache(int numSubCaches, int transientCacheSize, F
 	}
     evictionBatch = int_max(int_min(FBR_TRANSIENT_CACHE_EVICTION_BATCH, transientCacheSize / numSubCaches), 1);
     
-	return fbc_new(_FBC_NAME, transientCacheSize, evictionBatch, f2p, numSubCaches);
+	return fbc_new(_FBC_NAME, transientCacheSize, evictionBatch, f2p, numSubCaches, bbp);
 }
 
 void initReaders() {
@@ -2278,14 +2948,22 @@ void initReaders() {
 
 	sd = sd_new((char *)args->host, (char *)args->gcname, NULL, args->compression, 
 				args->dhtOpMinTimeoutMS, args->dhtOpMaxTimeoutMS, 
-				SRFS_DHT_OP_DEV_WEIGHT, SRFS_DHT_OP_DHT_WEIGHT);
+				args->hedgePercentile, SRFS_DHT_OP_DHT_WEIGHT);
 
-	f2p = f2p_new();
+	f2p = f2p_new(args->f2pExpectedEntries > 0 ? (uint64_t)args->f2pExpectedEntries : DEF_F2P_EXPECTED_ENTRIES);
 	aw = aw_new(sd);
 	awSKFS = aw_new(sd);    
     
 	transientCacheSizeBlocks = (uint64_t)args->transientCacheSizeKB * (uint64_t)1024 / (uint64_t)SRFS_BLOCK_SIZE;
-    fbc = createFileBlockCache(args->cacheConcurrency, transientCacheSizeBlocks, f2p);
+    if (args->zeroCopyReads) {
+        uint64_t    poolSlots;
+
+        // Room for every cached block, plus blocks held by in-flight replies and ops
+        poolSlots = transientCacheSizeBlocks != 0 ? transientCacheSizeBlocks : FBR_TRANSIENT_CACHE_SIZE;
+        poolSlots += poolSlots / 8 + BBP_MIN_EXTRA_SLOTS;
+        bbp = bbp_new(poolSlots);
+    }
+    fbc = createFileBlockCache(args->cacheConcurrency, transientCacheSizeBlocks, f2p, bbp);
 	fbwCompress = fbw_new(sd, TRUE, fbc, args->fbwReliableQueue);
 	fbwRaw = fbw_new(sd, FALSE, fbc, args->fbwReliableQueue);
 	fbwSKFS = fbw_new(sd, TRUE, fbc, args->fbwReliableQueue);
@@ -2303,6 +2981,17 @@ void initReaders() {
 	ar_set_g2tor(ar, NULL);
 	fbr = fbr_new(f2p, fbwCompress, fbwRaw, sd, rtsFBR_DHT, rtsFBR_NFS, fbc);
 	pbr = pbr_new(ar, fbr, NULL);
+    if (args->peerBlockCache) {
+        if (args->brRemoteAddressFile != NULL) {
+            pbc = pbc_new(fbr, args->peerCachePort >= 0 ? args->peerCachePort : PBC_DEFAULT_PORT,
+                          args->brRemoteAddressFile);
+            if (pbc != NULL) {
+                fbr_set_peer_block_cache(fbr, pbc);
+            }
+        } else {
+            srfsLog(LOG_WARNING, "peerBlockCache requires brRemoteAddressFile; ignoring");
+        }
+    }
 
     if (args->nativeFileMode == nf_readRelay_distributedPreread) {
         int _port;
@@ -2328,6 +3017,7 @@ void initReaders() {
 void initDirs() {
 	rcst_init();
 	odt = odt_new(ODT_NAME, sd, aw, ar, rtsODT, args->reconciliationSleep, args->odwMinWriteIntervalMillis);
+	ar_set_open_dir_table(ar, odt, args->dirDataFreshnessMillis);
 	if (odt_mkdir_base(odt)) {
 		fatalError("odt_mkdir_base skfs failed", __FILE__, __LINE__);
 	}
@@ -2342,6 +3032,14 @@ void initDirs() {
         fatalError("Couldn't create dir", __FILE__, __LINE__);
     }
     wf_set_sync_dir_updates(args->syncDirUpdates);
+    wf_set_rewrite_buffer_limit((size_t)args->rewriteBufferKB * 1024);
+    wfb_pool_set_budget((uint64_t)args->writeBufferPoolMB * 1024 * 1024);
+    wf_set_dedup(args->dedup);
+    if (args->writeBehindJournalDir != NULL) {
+        wb = wb_new(args->writeBehindJournalDir, (uint64_t)args->writeBehindMB * 1024 * 1024, 
+                    aw, fbwSKFS, ar);
+        wf_set_write_behind(wb);
+    }
 }
 
 void destroyReaders(){
@@ -2449,6 +3147,11 @@ int main(int argc, char *argv[]) {
     //argp_parse(&argp, argc, argv, 0, 0, &_args);
 	parseArgs(argc, argv, &_args);
     displayArguments(&_args);
+#if FUSE_VERSION >= 29
+    if (_args.zeroCopyReads) {
+        skfs_oper.read_buf = skfs_read_buf_timed;
+    }
+#endif
     //checkArguments(&_args);
 
 	initLogging();
@@ -48,6 +48,23 @@ typedef struct CmdArgs {
         char *reconciliationSleep;
         uint64_t    odwMinWriteIntervalMillis;
         int syncDirUpdates;
+        int rewriteBufferKB;
+        int writeBufferPoolMB;
+        char *writeBehindJournalDir;
+        int writeBehindMB;
+        int dedup;
+        int statfsRefreshSecs;
+        int negativeCacheMillis;
+        const char *negativeCacheTimeouts;
+        int dirDataFreshnessMillis;
+        double hedgePercentile;
+        char *metricsSocket;
+        char *traceFile;
+        int traceSampleRate;
+        int zeroCopyReads;
+        int peerBlockCache;
+        int peerCachePort;
+        int f2pExpectedEntries;
 } CmdArgs;
 
 extern CmdArgs *args;